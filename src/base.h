@@ -23,6 +23,10 @@
 #include <math.h>
 #include <domlib.h>
 
+#ifndef NO_OMP
+#include <omp.h>
+#endif
+
 
 #include "clairvoyance.h"
 
@@ -44,11 +48,16 @@
 #define FILETYPE_CLUTO_STRING "cluto"
 #define FILETYPE_CSR_STRING "csr"
 #define FILETYPE_CSR_HEADER_STRING "csr_header"
+#define FILETYPE_BCSR_STRING "bcsr"
 #define FILETYPE_RAW_STRING "raw"
 #define FILETYPE_DENSE_STRING "dense"
 #define FILETYPE_DIMACS_STRING "dimacs"
 #define FILETYPE_COO_STRING "coo"
 #define FILETYPE_POINT_STRING "point"
+#define FILETYPE_MTX_STRING "mtx"
+#define FILETYPE_NPY_STRING "npy"
+#define FILETYPE_GAP_STRING "gap"
+#define FILETYPE_LIGRA_STRING "ligra"
 #define FILETYPE_BMP_STRING "bmp"
 #define FILETYPE_JPEG_STRING "jpeg"
 #define FILETYPE_PNG_STRING "png"
@@ -77,11 +86,16 @@ typedef enum filetype_t {
   FILETYPE_CLUTO,
   FILETYPE_CSR,
   FILETYPE_CSR_HEADER,
+  FILETYPE_BCSR,
   FILETYPE_RAW,
   FILETYPE_DENSE,
   FILETYPE_DIMACS,
   FILETYPE_COO,
   FILETYPE_POINT,
+  FILETYPE_MTX,
+  FILETYPE_NPY,
+  FILETYPE_GAP,
+  FILETYPE_LIGRA,
   FILETYPE_BMP,
   FILETYPE_JPEG,
   FILETYPE_PNG,
@@ -147,11 +161,16 @@ static const char * const FILETYPE_NAMES[] = {
   [FILETYPE_CLUTO] = FILETYPE_CLUTO_STRING,
   [FILETYPE_CSR] = FILETYPE_CSR_STRING,
   [FILETYPE_CSR_HEADER] = FILETYPE_CSR_HEADER_STRING,
+  [FILETYPE_BCSR] = FILETYPE_BCSR_STRING,
   [FILETYPE_RAW] = FILETYPE_RAW_STRING,
   [FILETYPE_DENSE] = FILETYPE_DENSE_STRING,
   [FILETYPE_DIMACS] = FILETYPE_DIMACS_STRING,
   [FILETYPE_COO] = FILETYPE_COO_STRING,
   [FILETYPE_POINT] = FILETYPE_POINT_STRING,
+  [FILETYPE_MTX] = FILETYPE_MTX_STRING,
+  [FILETYPE_NPY] = FILETYPE_NPY_STRING,
+  [FILETYPE_GAP] = FILETYPE_GAP_STRING,
+  [FILETYPE_LIGRA] = FILETYPE_LIGRA_STRING,
   [FILETYPE_BMP] = FILETYPE_BMP_STRING,
   [FILETYPE_JPEG] = FILETYPE_JPEG_STRING,
   [FILETYPE_PNG] = FILETYPE_PNG_STRING,
@@ -170,6 +189,13 @@ static const char * const COLOR_NAMES[] = {
 };
 
 
+static const char * const FUNCTION_NAMES[] = {
+  [FUNCTION_DENSITY] = FUNCTION_DENSITY_STRING,
+  [FUNCTION_MAX] = FUNCTION_MAX_STRING,
+  [FUNCTION_AVERAGE] = FUNCTION_AVERAGE_STRING
+};
+
+
 
 
 /******************************************************************************
@@ -177,6 +203,37 @@ static const char * const COLOR_NAMES[] = {
 ******************************************************************************/
 
 
+/**
+ * @brief Get the number of threads parallel regions will be run with.
+ *
+ * @return The number of threads (1 when built without OpenMP).
+ */
+static inline int max_threads(void)
+{
+  #ifndef NO_OMP
+  return omp_get_max_threads();
+  #else
+  return 1;
+  #endif
+}
+
+
+/**
+ * @brief Get the number of the calling thread within a parallel region.
+ *
+ * @return The thread number (0 outside of a parallel region or when built
+ * without OpenMP).
+ */
+static inline int thread_id(void)
+{
+  #ifndef NO_OMP
+  return omp_get_thread_num();
+  #else
+  return 0;
+  #endif
+}
+
+
 static inline filetype_t translate_filetype(const char * const name)
 {
   size_t i;
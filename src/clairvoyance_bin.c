@@ -21,6 +21,40 @@
 #include "iojpeg.h"
 #include "iobmp.h"
 #include "iopng.h"
+#include "iobcsr.h"
+#include "decompress.h"
+#include "ionpy.h"
+#include "iograph.h"
+#include "dist.h"
+
+
+
+
+/******************************************************************************
+* DOMLIB IMPORTS **************************************************************
+******************************************************************************/
+
+
+#define DLMEM_PREFIX image_ptr
+#define DLMEM_TYPE_T image_t *
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX char_ptr
+#define DLMEM_TYPE_T char *
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
 
 
 
@@ -35,6 +69,17 @@ typedef enum clairvoyance_option_t {
   OPTION_FUNCTION,
   OPTION_SIZE,
   OPTION_INPUTTYPE,
+  OPTION_DIMS,
+  OPTION_INDEX,
+  OPTION_PREVIEW,
+  OPTION_BUDGET,
+  OPTION_ZOOM,
+  OPTION_ROWS,
+  OPTION_COLS,
+  OPTION_ROW_OFFSET,
+  OPTION_COL_OFFSET,
+  OPTION_STATE,
+  OPTION_MEMORY,
   OPTION_HELP
 } clairvoyance_option_t;
 
@@ -67,7 +112,23 @@ static const cmd_opt_pair_t INPUT_CHOICES[] = {
   {FILETYPE_CSR_STRING,"CSR without a header matrix format",FILETYPE_CSR},
   {FILETYPE_CSR_HEADER_STRING,"CSR with a header matrix format",
     FILETYPE_CSR_HEADER},
+  {FILETYPE_BCSR_STRING,"Binary CSR matrix format (see convert)",
+    FILETYPE_BCSR},
   {FILETYPE_POINT_STRING,"Point (ijv) matrix format",FILETYPE_POINT},
+  {FILETYPE_MTX_STRING,"Matrix Market format",FILETYPE_MTX},
+  {FILETYPE_DIMACS_STRING,"DIMACS graph format (arc or edge lines)",
+    FILETYPE_DIMACS},
+  {FILETYPE_DENSE_STRING,"Dense text matrix format (a line of values per "
+    "row)",FILETYPE_DENSE},
+  {FILETYPE_RAW_STRING,"Raw row-major floats or doubles (requires --dims)",
+    FILETYPE_RAW},
+  {FILETYPE_NPY_STRING,"NumPy coordinate arrays (a directory holding "
+    "row.npy, col.npy, and data.npy, or the three files separated by "
+    "commas)",FILETYPE_NPY},
+  {FILETYPE_GAP_STRING,"GAP serialized graph (.sg, or .wsg with weights)",
+    FILETYPE_GAP},
+  {FILETYPE_LIGRA_STRING,"Ligra binary graph (the .config, .adj, and .idx "
+    "files sharing a base name)",FILETYPE_LIGRA},
   {FILETYPE_AUTO_STRING,"Determine the file format from the filename.",
     FILETYPE_AUTO}
 };
@@ -85,22 +146,96 @@ static const cmd_opt_pair_t FUNCTION_CHOICES[] = {
 
 static const cmd_opt_t OPTS[] = {
   {OPTION_HELP,'h',"help","Display this help page.",CMD_OPT_FLAG,NULL,0},
-  {OPTION_COLOR,'c',"color","The coloring of zeros and non-zeros to use.",
-    CMD_OPT_CHOICE,COLOR_CHOICES,sizeof(COLOR_CHOICES)/sizeof(cmd_opt_pair_t)},
+  {OPTION_COLOR,'c',"color","The coloring of zeros and non-zeros to use, or "
+    "a comma separated list of colorings to write an image of each.",
+    CMD_OPT_STRING,NULL,0},
   {OPTION_INPUTTYPE,'i',"inputtype","The format of the input (default will "
     "guess it from the filename).",CMD_OPT_CHOICE,INPUT_CHOICES,
     sizeof(INPUT_CHOICES)/sizeof(cmd_opt_pair_t)},
-  {OPTION_FUNCTION,'f',"function","The function to use for pixel values.",
-    CMD_OPT_CHOICE,FUNCTION_CHOICES,
-    sizeof(FUNCTION_CHOICES)/sizeof(cmd_opt_pair_t)},
+  {OPTION_FUNCTION,'f',"function","The function to use for pixel values, or "
+    "a comma separated list of functions to write an image of each (all "
+    "found in a single pass over the input).",CMD_OPT_STRING,NULL,0},
   {OPTION_SIZE,'s',"size","The size of the image to be rendered.",
-    CMD_OPT_STRING,NULL,0}
+    CMD_OPT_STRING,NULL,0},
+  {OPTION_DIMS,'d',"dims","The dimensions of the matrix (<rows>x<cols>), "
+    "for formats which do not give them.",CMD_OPT_STRING,NULL,0},
+  {OPTION_INDEX,'x',"index","Use the sidecar index of the input "
+    "(<inputfile>.cvidx) if it is up to date, or write one.",CMD_OPT_FLAG,
+    NULL,0},
+  {OPTION_PREVIEW,'p',"preview","Render a sample of the input read within "
+    "the time budget, rather than all of it.",CMD_OPT_FLAG,NULL,0},
+  {OPTION_BUDGET,'t',"time-budget","The time to spend reading a preview "
+    "(ie. 5s, 500ms, or 2m), which implies --preview.",CMD_OPT_STRING,NULL,0},
+  {OPTION_ZOOM,'z',"zoom","The deepest zoom level of a pyramid of tiles, "
+    "whose finest level is at most 256*2^zoom pixels on a side (see tiles).",
+    CMD_OPT_INT,NULL,0},
+  {OPTION_ROWS,'R',"rows","The rows to draw (<first>:<end>, zero based and "
+    "excluding <end>, which can be left off to run to the last row), at the "
+    "full size of the image.",CMD_OPT_STRING,NULL,0},
+  {OPTION_COLS,'C',"cols","The columns to draw (<first>:<end>, as with "
+    "--rows).",CMD_OPT_STRING,NULL,0},
+  {OPTION_ROW_OFFSET,'I',"row-offset","The row of the matrix that the first "
+    "row of a shard is, for shards whose rows are numbered from zero (see "
+    "shard).",CMD_OPT_INT,NULL,0},
+  {OPTION_COL_OFFSET,'J',"col-offset","The column of the matrix that the "
+    "first column of a shard is, as with --row-offset.",CMD_OPT_INT,NULL,0},
+  {OPTION_STATE,'S',"state","The file to save what was drawn to, so that "
+    "the next time only what has since been appended to the (uncompressed "
+    "point) input is read. A line still being written at the end of the "
+    "input is left for next time.",CMD_OPT_STRING,NULL,0},
+  {OPTION_MEMORY,'M',"memory","Draw out of core, holding no more than about "
+    "this much memory (ie. 512M or 8G), for canvases too large to draw in "
+    "memory. The non-zeros and bins are kept in a scratch file next to the "
+    "(png) output.",CMD_OPT_STRING,NULL,0}
 };
 
 
 static const size_t NOPTS = sizeof(OPTS)/sizeof(cmd_opt_t);
 
 
+/* used as array sizes, so these can not be static consts */
+#define NCOLOR_CHOICES (sizeof(COLOR_CHOICES)/sizeof(cmd_opt_pair_t))
+#define NFUNCTION_CHOICES (sizeof(FUNCTION_CHOICES)/sizeof(cmd_opt_pair_t))
+
+
+/* the separator between the entries of a list of functions or colorings */
+static const char LIST_SEPARATOR = ',';
+
+
+/* the separator between the first and end of a range of rows/columns */
+static const char RANGE_SEPARATOR = ':';
+
+
+/* the first argument that selects conversion instead of rendering */
+static const char * const CONVERT_MODE = "convert";
+
+
+/* the first argument that selects drawing a pyramid of tiles */
+static const char * const TILES_MODE = "tiles";
+
+
+/* the first argument that selects writing the accumulators of a shard */
+static const char * const SHARD_MODE = "shard";
+
+
+/* the first argument that selects drawing from the accumulators of shards */
+static const char * const MERGE_MODE = "merge";
+
+
+/* the deepest zoom level of a pyramid unless told otherwise (a 4096 by 4096
+ * finest level) */
+static const size_t DEFAULT_TILES_ZOOM = 4;
+
+
+/* the deepest zoom level allowed, past which the finest level could not be
+ * held in memory anyway */
+static const size_t MAX_TILES_ZOOM = 16;
+
+
+/* the number of seconds a preview spends reading unless told otherwise */
+static const double DEFAULT_PREVIEW_BUDGET = 5.0;
+
+
 
 
 /******************************************************************************
@@ -127,6 +262,261 @@ static inline int __endswith(
 }
 
 
+/* match the extension of an input file, ignoring any compression extension */
+static inline int __input_endswith(
+    char const * const str, 
+    char const * const ext)
+{
+  size_t lstr, lext;
+  if (!str || !ext) {
+    return 0;
+  } else {
+    lstr = strlen(str) - strlen(COMPRESSION_EXTENSIONS[decompress_type(str)]);
+    lext = strlen(ext);
+    if (lext > lstr) {
+      return 0;
+    } else {
+      return strncmp(str+lstr-lext,ext,lext) == 0;
+    }
+  }
+}
+
+
+/**
+ * @brief Parse a length of time, in seconds unless followed by a unit of 'ms',
+ * 's', 'm', or 'h'.
+ *
+ * @param str The string to parse.
+ * @param r_secs The number of seconds.
+ *
+ * @return 1 on success, 0 if the string is not a positive length of time.
+ */
+static int __parse_seconds(
+    char const * const str,
+    double * const r_secs)
+{
+  double val;
+  char * end;
+
+  val = strtod(str,&end);
+  if (end == str || val <= 0) {
+    return 0;
+  }
+  if (*end == '\0' || strcmp(end,"s") == 0) {
+    *r_secs = val;
+  } else if (strcmp(end,"ms") == 0) {
+    *r_secs = val / 1000.0;
+  } else if (strcmp(end,"m") == 0) {
+    *r_secs = val * 60.0;
+  } else if (strcmp(end,"h") == 0) {
+    *r_secs = val * 3600.0;
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Parse a number of bytes, unless followed by a unit of 'K', 'M', 'G',
+ * or 'T' (powers of 1024).
+ *
+ * @param str The string to parse.
+ * @param r_bytes The number of bytes.
+ *
+ * @return 1 on success, 0 if the string is not a positive number of bytes.
+ */
+static int __parse_bytes(
+    char const * const str,
+    size_t * const r_bytes)
+{
+  double val;
+  char * end;
+
+  val = strtod(str,&end);
+  if (end == str || val <= 0) {
+    return 0;
+  }
+  if (*end == '\0') {
+    /* just bytes */
+  } else if (strcmp(end,"K") == 0) {
+    val *= 1024.0;
+  } else if (strcmp(end,"M") == 0) {
+    val *= 1024.0*1024.0;
+  } else if (strcmp(end,"G") == 0) {
+    val *= 1024.0*1024.0*1024.0;
+  } else if (strcmp(end,"T") == 0) {
+    val *= 1024.0*1024.0*1024.0*1024.0;
+  } else {
+    return 0;
+  }
+  if (val < 1) {
+    return 0;
+  }
+
+  *r_bytes = (size_t)val;
+
+  return 1;
+}
+
+
+/**
+ * @brief Parse a range of rows/columns, either '<first>:<end>', or
+ * '<first>:' to run to the last one.
+ *
+ * @param str The string to parse.
+ * @param r_start The first row/column.
+ * @param r_end One past the last row/column (WINDOW_END if not given).
+ *
+ * @return 1 on success, 0 if the string is not a non-empty range.
+ */
+static int __parse_range(
+    char const * const str,
+    size_t * const r_start,
+    size_t * const r_end)
+{
+  unsigned long long start, end;
+  char * sptr;
+
+  if (*str < '0' || *str > '9') {
+    return 0;
+  }
+  start = strtoull(str,&sptr,10);
+  if (*sptr != RANGE_SEPARATOR) {
+    return 0;
+  }
+  ++sptr;
+
+  if (*sptr == '\0') {
+    end = WINDOW_END;
+  } else {
+    if (*sptr < '0' || *sptr > '9') {
+      return 0;
+    }
+    end = strtoull(sptr,&sptr,10);
+    if (*sptr != '\0' || end <= start) {
+      return 0;
+    }
+  }
+
+  *r_start = (size_t)start;
+  *r_end = (size_t)end;
+
+  return 1;
+}
+
+
+/**
+ * @brief Parse a comma separated list of choices, ignoring repeats.
+ *
+ * @param str The list.
+ * @param choices The choices.
+ * @param nchoices The number of choices.
+ * @param vals The values of the chosen choices (at least nchoices long).
+ * @param r_nvals The number of values.
+ *
+ * @return 1 on success, 0 if an entry is not one of the choices.
+ */
+static int __parse_choices(
+    char const * const str,
+    cmd_opt_pair_t const * const choices,
+    size_t const nchoices,
+    int * const vals,
+    size_t * const r_nvals)
+{
+  size_t c, v, len, nvals;
+  char const * sptr, * eptr;
+
+  nvals = 0;
+  sptr = str;
+  while (1) {
+    eptr = strchr(sptr,LIST_SEPARATOR);
+    len = eptr ? (size_t)(eptr - sptr) : strlen(sptr);
+    for (c=0;c<nchoices;++c) {
+      if (strlen(choices[c].str) == len && \
+          strncmp(choices[c].str,sptr,len) == 0) {
+        break;
+      }
+    }
+    if (c == nchoices) {
+      return 0;
+    }
+    for (v=0;v<nvals;++v) {
+      if (vals[v] == choices[c].val) {
+        break;
+      }
+    }
+    if (v == nvals) {
+      vals[nvals++] = choices[c].val;
+    }
+    if (eptr == NULL) {
+      break;
+    }
+    sptr = eptr+1;
+  }
+
+  *r_nvals = nvals;
+
+  return 1;
+}
+
+
+/**
+ * @brief Build the name of one of several output images, by inserting the
+ * function and/or coloring before the extension of the output file.
+ *
+ * @param outfile The name of the output file.
+ * @param func The function of the image (NULL if there is only one).
+ * @param color The coloring of the image (NULL if there is only one).
+ *
+ * @return The name of the image (to be freed by the caller).
+ */
+static char * __output_name(
+    char const * const outfile,
+    char const * const func,
+    char const * const color)
+{
+  size_t len;
+  char * name;
+  char const * ext;
+
+  ext = strrchr(outfile,'.');
+  len = (size_t)(ext - outfile);
+
+  name = char_alloc(strlen(outfile) + (func ? strlen(func)+1 : 0) + \
+      (color ? strlen(color)+1 : 0) + 1);
+  memcpy(name,outfile,len);
+  name[len] = '\0';
+  if (func) {
+    strcat(name,"_");
+    strcat(name,func);
+  }
+  if (color) {
+    strcat(name,"_");
+    strcat(name,color);
+  }
+  strcat(name,ext);
+
+  return name;
+}
+
+
+static void __print_choices(
+    FILE * const out,
+    char const * const title,
+    cmd_opt_pair_t const * const choices,
+    size_t const nchoices)
+{
+  size_t i;
+
+  fprintf(out,"%s:\n",title);
+  for (i=0;i<nchoices;++i) {
+    fprintf(out,"  %s : %s\n",choices[i].str,choices[i].desc);
+  }
+}
+
+
 static void __usage(
     FILE * const out, 
     char const * const name)
@@ -135,9 +525,31 @@ static void __usage(
       CLAIRVOYANCE_VER_MINOR,CLAIRVOYANCE_VER_SUBMINOR);
   fprintf(out,"USAGE:\n");
   fprintf(out,"%s [options] <inputfile> <outputfile>\n",name);
+  fprintf(out,"(an <inputfile> of '%s' reads from standard input, which is "
+      "first copied to a\ntemporary file when neither it nor --dims gives "
+      "the dimensions of the matrix)\n",DECOMPRESS_STDIN);
+  fprintf(out,"%s [options] <row.npy>%c<col.npy>[%c<data.npy>] "
+      "<outputfile>\n",name,NPY_SEPARATOR,NPY_SEPARATOR);
+  fprintf(out,"%s %s [options] <inputfile> <outputfile.bcsr>\n",name,
+      CONVERT_MODE);
+  fprintf(out,"%s %s [options] <inputfile> <outputdirectory>\n",name,
+      TILES_MODE);
+  fprintf(out,"(writes <outputdirectory>/<z>/<x>/<y>.png tiles for an XYZ "
+      "map viewer)\n");
+  fprintf(out,"%s %s [options] <inputfile> <outputfile.cvstate>\n",name,
+      SHARD_MODE);
+  fprintf(out,"%s %s [options] <shard.cvstate>... <outputfile>\n",name,
+      MERGE_MODE);
+  fprintf(out,"(a shard holds some of the non-zeros of a matrix, at their "
+      "row and column in it\nor numbered from --row-offset and --col-offset; "
+      "the merged image is only exact\nwhen every shard is given --dims)\n");
   fprintf(out,"\n");
   fprintf(out,"Options:\n");
   fprint_cmd_opts(out,OPTS,NOPTS);
+  fprintf(out,"\n");
+  __print_choices(out,"Functions (-f)",FUNCTION_CHOICES,NFUNCTION_CHOICES);
+  fprintf(out,"\n");
+  __print_choices(out,"Colorings (-c)",COLOR_CHOICES,NCOLOR_CHOICES);
 }
 
 
@@ -152,29 +564,77 @@ int main(
     int argc, 
     char ** argv) 
 {
-  int err;
-  size_t nargs;
-  image_t * img;
-  const char * infile, * outfile;
+  int err, convert, tiles, shard, merge, useindex, windowed, sized;
+  size_t nargs, nargv, nxargs, nshards;
+  double budget, fraction;
+  int choices[NCOLOR_CHOICES+NFUNCTION_CHOICES];
+  image_t ** imgs;
+  char ** names;
+  char ** shards;
+  const char * infile, * outfile, * statefile;
   filetype_t otype;
   filetype_t itype;
-  colortype_t ctype;
-  functiontype_t ftype;
+  colortype_t ctypes[NCOLOR_CHOICES];
+  functiontype_t ftypes[NFUNCTION_CHOICES];
   cmd_arg_t * args;
-  size_t i, xarg, width, height;
+  window_t window;
+  size_t i, j, xarg, width, height, nrows, ncols, nctypes, nftypes, nimgs, \
+      zoom, ntiles, maxmem, x, y, roffset, coffset;
 
   args = NULL;
   height = width = 512;
-  ctype = COLOR_HEATMAP;
+  nrows = ncols = 0;
+  useindex = 0;
+  windowed = 0;
+  sized = 0;
+  window.rstart = window.cstart = 0;
+  window.rend = window.cend = WINDOW_END;
+  roffset = coffset = 0;
+  budget = 0;
+  maxmem = 0;
+  ctypes[0] = COLOR_HEATMAP;
+  nctypes = 1;
   itype = FILETYPE_AUTO;
   otype = FILETYPE_AUTO;
-  ftype = FUNCTION_DENSITY;
+  ftypes[0] = FUNCTION_DENSITY;
+  nftypes = 1;
   outfile = NULL;
   infile = NULL;
-  img = NULL;
+  statefile = NULL;
+  imgs = NULL;
+  names = NULL;
+  shards = NULL;
+  nshards = 0;
+  nimgs = 0;
+  zoom = DEFAULT_TILES_ZOOM;
   err = CLAIRVOYANCE_SUCCESS;
 
-  err = cmd_parse_args(argc-1,argv+1,OPTS,NOPTS,&args,&nargs);
+  if (!dist_init(&argc,&argv)) {
+    eprintf("Failed to start up the processes\n");
+    return 1;
+  }
+
+  /* rendering is the default mode */
+  convert = 0;
+  tiles = 0;
+  shard = 0;
+  merge = 0;
+  nargv = argc-1;
+  if (nargv > 0 && strcmp(argv[1],CONVERT_MODE) == 0) {
+    convert = 1;
+    --nargv;
+  } else if (nargv > 0 && strcmp(argv[1],TILES_MODE) == 0) {
+    tiles = 1;
+    --nargv;
+  } else if (nargv > 0 && strcmp(argv[1],SHARD_MODE) == 0) {
+    shard = 1;
+    --nargv;
+  } else if (nargv > 0 && strcmp(argv[1],MERGE_MODE) == 0) {
+    merge = 1;
+    --nargv;
+  }
+
+  err = cmd_parse_args(nargv,argv+argc-nargv,OPTS,NOPTS,&args,&nargs);
   if (err != DL_CMDLINE_SUCCESS) {
     __usage(stderr,argv[0]);
     err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
@@ -188,13 +648,35 @@ int main(
     } else {
       switch(args[i].id) {
         case OPTION_COLOR:
-          ctype = (colortype_t)args[i].val.o;
+          if (!__parse_choices(args[i].val.s,COLOR_CHOICES,NCOLOR_CHOICES, \
+                choices,&nctypes)) {
+            eprintf("Invalid coloring '%s', should be one or more of the "
+                "colorings below separated by '%c'\n",args[i].val.s, \
+                LIST_SEPARATOR);
+            __usage(stderr,argv[0]);
+            err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+            goto END;
+          }
+          for (j=0;j<nctypes;++j) {
+            ctypes[j] = (colortype_t)choices[j];
+          }
           break;
         case OPTION_INPUTTYPE:
           itype = (filetype_t)args[i].val.o;
           break;
         case OPTION_FUNCTION:
-          ftype = (functiontype_t)args[i].val.o;
+          if (!__parse_choices(args[i].val.s,FUNCTION_CHOICES, \
+                NFUNCTION_CHOICES,choices,&nftypes)) {
+            eprintf("Invalid function '%s', should be one or more of the "
+                "functions below separated by '%c'\n",args[i].val.s, \
+                LIST_SEPARATOR);
+            __usage(stderr,argv[0]);
+            err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+            goto END;
+          }
+          for (j=0;j<nftypes;++j) {
+            ftypes[j] = (functiontype_t)choices[j];
+          }
           break;
         case OPTION_SIZE:
           if (sscanf(args[i].val.s,"%zux%zu",&width,&height) != 2) {
@@ -203,9 +685,87 @@ int main(
             err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
             goto END;
           }
+          sized = 1;
+          break;
+        case OPTION_DIMS:
+          if (sscanf(args[i].val.s,"%zux%zu",&nrows,&ncols) != 2) {
+            eprintf("Invalid dimensions format '%s', should be in the format "
+                "<rows>x<cols> (ie. 1000x2000)\n",args[i].val.s);
+            err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+            goto END;
+          }
+          break;
+        case OPTION_INDEX:
+          useindex = 1;
+          break;
+        case OPTION_PREVIEW:
+          if (budget == 0) {
+            budget = DEFAULT_PREVIEW_BUDGET;
+          }
+          break;
+        case OPTION_BUDGET:
+          if (!__parse_seconds(args[i].val.s,&budget)) {
+            eprintf("Invalid time budget '%s', should be a length of time "
+                "(ie. 5s)\n",args[i].val.s);
+            err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+            goto END;
+          }
+          break;
+        case OPTION_ZOOM:
+          if (args[i].val.i < 0 || (size_t)args[i].val.i > MAX_TILES_ZOOM) {
+            eprintf("Invalid zoom level '%zd', should be from 0 to %zu\n", \
+                args[i].val.i,MAX_TILES_ZOOM);
+            err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+            goto END;
+          }
+          zoom = (size_t)args[i].val.i;
+          break;
+        case OPTION_ROWS:
+          if (!__parse_range(args[i].val.s,&window.rstart,&window.rend)) {
+            eprintf("Invalid rows '%s', should be in the format "
+                "<first>:<end> or <first>: (ie. 1000:2000)\n",args[i].val.s);
+            err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+            goto END;
+          }
+          windowed = 1;
+          break;
+        case OPTION_COLS:
+          if (!__parse_range(args[i].val.s,&window.cstart,&window.cend)) {
+            eprintf("Invalid columns '%s', should be in the format "
+                "<first>:<end> or <first>: (ie. 1000:2000)\n",args[i].val.s);
+            err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+            goto END;
+          }
+          windowed = 1;
+          break;
+        case OPTION_ROW_OFFSET:
+        case OPTION_COL_OFFSET:
+          if (args[i].val.i < 0) {
+            eprintf("Invalid offset '%zd', should be a row/column of the "
+                "matrix\n",args[i].val.i);
+            err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+            goto END;
+          }
+          if (args[i].id == OPTION_ROW_OFFSET) {
+            roffset = (size_t)args[i].val.i;
+          } else {
+            coffset = (size_t)args[i].val.i;
+          }
+          break;
+        case OPTION_STATE:
+          statefile = args[i].val.s;
+          break;
+        case OPTION_MEMORY:
+          if (!__parse_bytes(args[i].val.s,&maxmem)) {
+            eprintf("Invalid memory cap '%s', should be a number of bytes "
+                "(ie. 512M)\n",args[i].val.s);
+            err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+            goto END;
+          }
           break;
         case OPTION_HELP:
           __usage(stdout,argv[0]);
+          dist_finalize();
           return 0;
           break;
         default:
@@ -213,25 +773,64 @@ int main(
       }
     }
   }
+  nxargs = 0;
+  for (i=0;i<nargs;++i) {
+    if (args[i].type == CMD_OPT_XARG) {
+      ++nxargs;
+    }
+  }
+  if (merge) {
+    shards = char_ptr_alloc(nxargs);
+  }
   xarg = 0;
-  for (i=0;i<(size_t)(argc-1);++i) {
+  for (i=0;i<nargv;++i) {
     if (args[i].type == CMD_OPT_XARG) {
-      switch (xarg) {
+      if (merge && nshards+1 < nxargs) {
+        /* every argument but the last names a shard */
+        shards[nshards++] = args[i].val.s;
+        continue;
+      }
+      switch (merge ? 1 : xarg) {
         case 0:
           infile = args[i].val.s;
           if (itype == FILETYPE_AUTO) {
-            if (__endswith(infile,".metis") || __endswith(infile,".chaco") ||
-                __endswith(infile,".graph")) {
+            if (strcmp(infile,DECOMPRESS_STDIN) == 0) {
+              eprintf("The format of standard input must be given with -i\n");
+              err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+              goto END;
+            } else if (__input_endswith(infile,".metis") || __input_endswith(infile,".chaco") ||
+                __input_endswith(infile,".graph")) {
               itype = FILETYPE_METIS;
-            } else if (__endswith(infile,".cluto") || 
-                __endswith(infile,".clu")) {
+            } else if (__input_endswith(infile,".cluto") || 
+                __input_endswith(infile,".clu")) {
               itype = FILETYPE_CLUTO;
-            } else if (__endswith(infile,".csr")) {
+            } else if (__input_endswith(infile,".csr")) {
               itype = FILETYPE_CSR;
-            } else if (__endswith(infile,".ij")) {
+            } else if (__input_endswith(infile,".bcsr")) {
+              itype = FILETYPE_BCSR;
+            } else if (__input_endswith(infile,".ij")) {
               itype = FILETYPE_POINT;
+            } else if (__input_endswith(infile,".mtx")) {
+              itype = FILETYPE_MTX;
+            } else if (__input_endswith(infile,".dimacs") || 
+                __input_endswith(infile,".gr") || 
+                __input_endswith(infile,".col")) {
+              itype = FILETYPE_DIMACS;
+            } else if (__input_endswith(infile,".dense")) {
+              itype = FILETYPE_DENSE;
+            } else if (__input_endswith(infile,".raw")) {
+              itype = FILETYPE_RAW;
+            } else if (__input_endswith(infile,".sg") || \
+                __input_endswith(infile,".wsg")) {
+              itype = FILETYPE_GAP;
+            } else if (__input_endswith(infile,LIGRA_CONFIG_EXTENSION) || \
+                __input_endswith(infile,LIGRA_ADJ_EXTENSION) || \
+                __input_endswith(infile,LIGRA_IDX_EXTENSION)) {
+              itype = FILETYPE_LIGRA;
+            } else if (npy_detect(infile)) {
+              itype = FILETYPE_NPY;
             } else {
-              eprintf("Unknown input filetype: '%s'\n",outfile);
+              eprintf("Unknown input filetype: '%s'\n",infile);
               err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
               goto END;
             }
@@ -239,6 +838,18 @@ int main(
           break;
         case 1:
           outfile = args[i].val.s;
+          if (convert) {
+            /* always written as binary csr */
+            otype = FILETYPE_BCSR;
+            break;
+          } else if (tiles) {
+            /* a directory of png tiles */
+            otype = FILETYPE_PNG;
+            break;
+          } else if (shard) {
+            /* accumulators, not an image */
+            break;
+          }
           if (strlen(outfile) < 5) {
             eprintf("Invalid output file extension '%s'\n",argv[3]); 
             err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
@@ -265,39 +876,202 @@ int main(
       ++xarg;
     }
   }
-  if (xarg != 2) {
+  if (merge ? (nshards == 0 || xarg != 1) : xarg != 2) {
     eprintf("Did not supply both input and output files!\n");
     __usage(stderr,argv[0]);
     err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
     goto END;
   }
 
-  img = draw_matrix_file(infile,itype,ctype,ftype,width,height);
+  if (statefile && (budget > 0 || useindex)) {
+    eprintf("A drawing picked up from its state is always of all of the "
+        "input read so far (without --preview or --index)\n");
+    err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    goto END;
+  }
 
-  switch (otype) {
-    case FILETYPE_BMP:
-      bmp_write(outfile,img);
-      break;
-    case FILETYPE_PNG:
-      png_write(outfile,img);
-      break;
-    case FILETYPE_JPEG:
-      jpeg_write(outfile,img);
-      break;
-    default:
-      eprintf("Unimplemented filetype '%s'\n",argv[3]);
+  if (merge && (useindex || budget > 0 || windowed || statefile)) {
+    eprintf("Shards are merged as they were accumulated (without --index, "
+        "--preview, --rows, --cols, or --state)\n");
+    err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    goto END;
+  }
+
+  if (dist_size() > 1 && (convert || shard || merge || useindex || \
+        budget > 0 || statefile || strcmp(infile,DECOMPRESS_STDIN) == 0)) {
+    eprintf("Only a full draw of a file into images or tiles is split "
+        "between processes (without --index, --preview, or --state)\n");
+    err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    goto END;
+  }
+
+  if (maxmem > 0 && (convert || tiles || shard || merge || useindex || \
+        budget > 0 || statefile || dist_size() > 1)) {
+    eprintf("Only a full draw of a file into an image is done out of core "
+        "(without --index, --preview, --state, or more than one process)\n");
+    err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    goto END;
+  }
+
+  if (!shard && (roffset > 0 || coffset > 0)) {
+    eprintf("Only the rows and columns of a shard are read from offsets\n");
+    err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    goto END;
+  }
+
+  if (shard) {
+    if (budget > 0 || statefile) {
+      eprintf("A shard is always accumulated in full (without --preview or "
+          "--state)\n");
+      err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    } else if (!draw_matrix_shard(infile,itype,ftypes,nftypes,width,height, \
+          nrows,ncols,windowed ? &window : NULL,roffset,coffset,useindex, \
+          outfile)) {
+      err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    } else {
+      printf("Wrote the accumulators of '%s' in %s format to '%s'.\n", \
+          infile,FILETYPE_NAMES[itype],outfile);
+    }
+    goto END;
+  }
+
+  if (convert) {
+    if (windowed || statefile) {
+      eprintf("A matrix is always converted in full (without --rows, "
+          "--cols, or --state)\n");
+      err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    } else if (bcsr_convert(infile,itype,nrows,ncols,outfile) != \
+        BCSR_SUCCESS) {
+      err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    } else {
+      printf("Converted '%s' from %s format to '%s' in %s format.\n",infile,
+          FILETYPE_NAMES[itype],outfile,FILETYPE_NAMES[otype]);
+    }
+    goto END;
+  }
+
+  if (tiles) {
+    if (nftypes > 1 || nctypes > 1) {
+      eprintf("A pyramid of tiles is drawn with a single function and "
+          "coloring\n");
+      err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    } else if (!draw_matrix_tiles(infile,itype,ctypes[0],ftypes[0],zoom, \
+          nrows,ncols,windowed ? &window : NULL,useindex,statefile,budget, \
+          outfile,&fraction,&ntiles)) {
+      err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    } else if (dist_rank() == 0) {
+      printf("Wrote %zu tiles to '%s' from '%s' in %s format.\n",ntiles, \
+          outfile,infile,FILETYPE_NAMES[itype]);
+      if (budget > 0) {
+        printf("Previewed %.2f%% of '%s' within %g seconds.\n", \
+            100.0*fraction,infile,budget);
+      }
+    }
+    goto END;
+  }
+
+  if (maxmem > 0) {
+    if (nftypes > 1 || nctypes > 1 || otype != FILETYPE_PNG) {
+      eprintf("A canvas is drawn out of core with a single function and "
+          "coloring, to a png\n");
+      err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    } else if (!draw_matrix_ooc(infile,itype,ctypes[0],ftypes[0],width, \
+          height,nrows,ncols,windowed ? &window : NULL,maxmem,outfile,&x, \
+          &y)) {
+      err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    } else {
+      printf("Wrote %zux%zu image '%s' from '%s' in %s format.\n",x,y, \
+          outfile,infile,FILETYPE_NAMES[itype]);
+    }
+    goto END;
+  }
+
+  nimgs = nftypes*nctypes;
+  imgs = image_ptr_calloc(nimgs);
+  if (merge) {
+    /* unless told otherwise, draw at the size the shards were accumulated
+     * for */
+    if (!draw_merge_images(shards,nshards,ftypes,nftypes,ctypes,nctypes, \
+          sized ? width : 0,sized ? height : 0,nrows,ncols,imgs)) {
       err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
       goto END;
+    }
+  } else if (!draw_matrix_images(infile,itype,ftypes,nftypes,ctypes,nctypes, \
+        width,height,nrows,ncols,windowed ? &window : NULL,useindex, \
+        statefile,budget,&fraction,imgs)) {
+    err = CLAIRVOYANCE_ERROR_INVALIDINPUT;
+    goto END;
+  }
+
+  /* the other processes only helped read the file */
+  if (dist_rank() > 0) {
+    goto END;
+  }
+
+  /* a single image goes to the output file as named, and several get the
+   * function and/or coloring they were drawn with added to it */
+  names = char_ptr_calloc(nimgs);
+  for (i=0;i<nimgs;++i) {
+    names[i] = __output_name(outfile, \
+        nftypes > 1 ? FUNCTION_NAMES[ftypes[i/nctypes]] : NULL, \
+        nctypes > 1 ? COLOR_NAMES[ctypes[i%nctypes]] : NULL);
+  }
+
+  #pragma omp parallel for schedule(dynamic,1)
+  for (i=0;i<nimgs;++i) {
+    switch (otype) {
+      case FILETYPE_BMP:
+        bmp_write(names[i],imgs[i]);
+        break;
+      case FILETYPE_PNG:
+        png_write(names[i],imgs[i]);
+        break;
+      case FILETYPE_JPEG:
+        jpeg_write(names[i],imgs[i]);
+        break;
+      default:
+        dl_error("Unimplemented filetype '%s'\n",FILETYPE_NAMES[otype]);
+    }
+  }
+
+  for (i=0;i<nimgs;++i) {
+    if (merge) {
+      printf("Wrote %zux%zu image '%s' from %zu shards.\n",imgs[i]->width, \
+          imgs[i]->height,names[i],nshards);
+    } else {
+      printf("Wrote %zux%zu image '%s' from '%s' in %s format.\n", \
+          imgs[i]->width,imgs[i]->height,names[i],infile, \
+          FILETYPE_NAMES[itype]);
+    }
+  }
+  if (budget > 0) {
+    printf("Previewed %.2f%% of '%s' within %g seconds.\n",100.0*fraction,
+        infile,budget);
   }
-        
-  printf("Wrote %zux%zu image '%s' from '%s' in %s format.\n",img->width,
-      img->height,outfile,infile,FILETYPE_NAMES[itype]);
 
   END:
   
-  if (img) {
-    image_free(img);
+  if (imgs) {
+    for (i=0;i<nimgs;++i) {
+      if (imgs[i]) {
+        image_free(imgs[i]);
+      }
+    }
+    dl_free(imgs);
+  }
+  if (names) {
+    for (i=0;i<nimgs;++i) {
+      if (names[i]) {
+        dl_free(names[i]);
+      }
+    }
+    dl_free(names);
   }
+  if (shards) {
+    dl_free(shards);
+  }
+
+  dist_finalize();
 
   if (err != CLAIRVOYANCE_SUCCESS) {
     return 1;
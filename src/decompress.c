@@ -0,0 +1,594 @@
+/**
+ * @file decompress.c
+ * @brief Functions for decompressing input on a separate thread
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-12
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_DECOMPRESS_C
+#define CLAIRVOYANCE_DECOMPRESS_C
+
+
+
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <unistd.h>
+#include "decompress.h"
+
+#ifndef NO_GZ_SUPPORT
+#include <zlib.h>
+#endif
+#ifndef NO_ZSTD_SUPPORT
+#include <zstd.h>
+#endif
+#ifndef NO_XZ_SUPPORT
+#include <lzma.h>
+#endif
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* the number of buffers in the ring, so the decompressor can run this far
+ * ahead of the reader */
+static const size_t DECOMPRESS_NBUFFERS = 4;
+
+
+/* the size of each buffer */
+static const size_t DECOMPRESS_BUFFER_SIZE = 1 << 20;
+
+
+#if !defined(NO_GZ_SUPPORT) || !defined(NO_ZSTD_SUPPORT) || \
+    !defined(NO_XZ_SUPPORT)
+/* the size of the buffer of compressed input */
+static const size_t DECOMPRESS_INPUT_SIZE = 1 << 17;
+#endif
+
+
+
+
+/******************************************************************************
+* DOMLIB IMPORTS **************************************************************
+******************************************************************************/
+
+
+#define DLMEM_PREFIX decompress
+#define DLMEM_TYPE_T decompress_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX char_ptr
+#define DLMEM_TYPE_T char *
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Open the input for reading with stdio.
+ *
+ * @param dec The decompressor.
+ * @param name The name of the file (DECOMPRESS_STDIN for standard input).
+ *
+ * @return 1 on success, 0 otherwise.
+ */
+static int __open_input(
+    decompress_t * const dec,
+    char const * const name)
+{
+  if (strcmp(name,DECOMPRESS_STDIN) == 0) {
+    dec->fin = stdin;
+  } else if ((dec->fin = fopen(name,"rb")) == NULL) {
+    eprintf("Failed to open '%s' for reading\n",name);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Read the next part of an uncompressed input into a buffer.
+ *
+ * @param dec The decompressor.
+ * @param buf The buffer.
+ * @param size The size of the buffer.
+ *
+ * @return The number of bytes read (less than size only at the end of the
+ * input), or -1 on error.
+ */
+static ssize_t __fill_none(
+    decompress_t * const dec,
+    char * const buf,
+    size_t const size)
+{
+  size_t len;
+
+  len = fread(buf,1,size,dec->fin);
+  if (len < size && ferror(dec->fin)) {
+    return -1;
+  }
+
+  return (ssize_t)len;
+}
+
+
+#if !defined(NO_ZSTD_SUPPORT) || !defined(NO_XZ_SUPPORT)
+/**
+ * @brief Refill the buffer of compressed input once it has been consumed.
+ *
+ * @param dec The decompressor.
+ *
+ * @return 0 on success, -1 if the file could not be read.
+ */
+static int __refill(
+    decompress_t * const dec)
+{
+  if (dec->inpos == dec->inlen && !dec->eof) {
+    dec->inlen = fread(dec->inbuf,1,dec->insize,dec->fin);
+    dec->inpos = 0;
+    if (dec->inlen < dec->insize) {
+      if (ferror(dec->fin)) {
+        return -1;
+      }
+      dec->eof = 1;
+    }
+  }
+
+  return 0;
+}
+#endif
+
+
+#ifndef NO_GZ_SUPPORT
+static ssize_t __fill_gz(
+    decompress_t * const dec,
+    char * const buf,
+    size_t const size)
+{
+  int n, err;
+  size_t len = 0;
+
+  while (len < size) {
+    n = gzread((gzFile)dec->state,buf+len,(unsigned int)(size-len));
+    if (n < 0) {
+      return -1;
+    } else if (n == 0) {
+      /* a truncated stream ends without error from gzread() */
+      gzerror((gzFile)dec->state,&err);
+      if (err != Z_OK) {
+        return -1;
+      }
+      break;
+    }
+    len += (size_t)n;
+  }
+
+  return (ssize_t)len;
+}
+#endif
+
+
+#ifndef NO_ZSTD_SUPPORT
+static ssize_t __fill_zstd(
+    decompress_t * const dec,
+    char * const buf,
+    size_t const size)
+{
+  size_t ret, prev;
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer out;
+
+  out.dst = buf;
+  out.size = size;
+  out.pos = 0;
+
+  while (out.pos < out.size) {
+    if (__refill(dec) != 0) {
+      return -1;
+    }
+    prev = out.pos;
+    in.src = dec->inbuf;
+    in.size = dec->inlen;
+    in.pos = dec->inpos;
+    ret = ZSTD_decompressStream((ZSTD_DStream*)dec->state,&out,&in);
+    if (ZSTD_isError(ret)) {
+      eprintf("Failed to decompress zstd input: %s\n",ZSTD_getErrorName(ret));
+      return -1;
+    }
+    dec->inpos = in.pos;
+    if (dec->eof && dec->inpos == dec->inlen && out.pos == prev) {
+      /* the input is exhausted and nothing more was flushed */
+      if (ret != 0) {
+        eprintf("Truncated zstd input\n");
+        return -1;
+      }
+      break;
+    }
+  }
+
+  return (ssize_t)out.pos;
+}
+#endif
+
+
+#ifndef NO_XZ_SUPPORT
+static ssize_t __fill_xz(
+    decompress_t * const dec,
+    char * const buf,
+    size_t const size)
+{
+  lzma_ret ret;
+  lzma_stream * const strm = (lzma_stream*)dec->state;
+
+  strm->next_out = (uint8_t*)buf;
+  strm->avail_out = size;
+
+  while (strm->avail_out > 0) {
+    if (__refill(dec) != 0) {
+      return -1;
+    }
+    strm->next_in = (uint8_t const *)dec->inbuf + dec->inpos;
+    strm->avail_in = dec->inlen - dec->inpos;
+    ret = lzma_code(strm,dec->eof ? LZMA_FINISH : LZMA_RUN);
+    dec->inpos = dec->inlen - strm->avail_in;
+    if (ret == LZMA_STREAM_END) {
+      break;
+    } else if (ret != LZMA_OK) {
+      eprintf("Failed to decompress xz input (error %d)\n",(int)ret);
+      return -1;
+    }
+  }
+
+  return (ssize_t)(size - strm->avail_out);
+}
+#endif
+
+
+/**
+ * @brief Decompress the next part of the input into a buffer.
+ *
+ * @param dec The decompressor.
+ * @param buf The buffer.
+ * @param size The size of the buffer.
+ *
+ * @return The number of bytes decompressed (less than size only at the end of
+ * the input), or -1 on error.
+ */
+static ssize_t __fill(
+    decompress_t * const dec,
+    char * const buf,
+    size_t const size)
+{
+  switch (dec->type) {
+    case COMPRESSION_NONE:
+      return __fill_none(dec,buf,size);
+    #ifndef NO_GZ_SUPPORT
+    case COMPRESSION_GZIP:
+      return __fill_gz(dec,buf,size);
+    #endif
+    #ifndef NO_ZSTD_SUPPORT
+    case COMPRESSION_ZSTD:
+      return __fill_zstd(dec,buf,size);
+    #endif
+    #ifndef NO_XZ_SUPPORT
+    case COMPRESSION_XZ:
+      return __fill_xz(dec,buf,size);
+    #endif
+    default:
+      return -1;
+  }
+}
+
+
+/**
+ * @brief The decompression thread, which fills buffers as the reader frees
+ * them, until the input is exhausted or the reader stops it.
+ *
+ * @param ptr The decompressor.
+ *
+ * @return NULL.
+ */
+static void * __run(
+    void * const ptr)
+{
+  size_t slot;
+  ssize_t len;
+  decompress_t * const dec = (decompress_t*)ptr;
+
+  for (;;) {
+    pthread_mutex_lock(&dec->lock);
+    while (dec->head - dec->tail == DECOMPRESS_NBUFFERS && !dec->stop) {
+      pthread_cond_wait(&dec->emptied,&dec->lock);
+    }
+    if (dec->stop) {
+      pthread_mutex_unlock(&dec->lock);
+      break;
+    }
+    slot = dec->head % DECOMPRESS_NBUFFERS;
+    pthread_mutex_unlock(&dec->lock);
+
+    /* the slot is ours until head is advanced */
+    len = __fill(dec,dec->buffers[slot],DECOMPRESS_BUFFER_SIZE);
+
+    pthread_mutex_lock(&dec->lock);
+    if (len > 0) {
+      dec->lengths[slot] = (size_t)len;
+      ++dec->head;
+    }
+    if (len < (ssize_t)DECOMPRESS_BUFFER_SIZE) {
+      dec->error = len < 0;
+      dec->done = 1;
+    }
+    pthread_cond_signal(&dec->filled);
+    pthread_mutex_unlock(&dec->lock);
+
+    if (len < (ssize_t)DECOMPRESS_BUFFER_SIZE) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+
+/**
+ * @brief Set up the codec for the input.
+ *
+ * @param dec The decompressor.
+ * @param name The name of the file.
+ *
+ * @return 1 on success, 0 otherwise.
+ */
+static int __init_codec(
+    decompress_t * const dec,
+    char const * const name)
+{
+  switch (dec->type) {
+    case COMPRESSION_NONE:
+      return __open_input(dec,name);
+    #ifndef NO_GZ_SUPPORT
+    case COMPRESSION_GZIP:
+      if (strcmp(name,DECOMPRESS_STDIN) == 0) {
+        dec->state = gzdopen(dup(STDIN_FILENO),"rb");
+      } else {
+        dec->state = gzopen(name,"rb");
+      }
+      if (dec->state == NULL) {
+        eprintf("Failed to open '%s' for reading\n",name);
+        return 0;
+      }
+      gzbuffer((gzFile)dec->state,(unsigned int)DECOMPRESS_INPUT_SIZE);
+      return 1;
+    #endif
+    #ifndef NO_ZSTD_SUPPORT
+    case COMPRESSION_ZSTD:
+      if (!__open_input(dec,name)) {
+        return 0;
+      }
+      dec->insize = ZSTD_DStreamInSize();
+      dec->inbuf = char_alloc(dec->insize);
+      dec->state = ZSTD_createDStream();
+      ZSTD_initDStream((ZSTD_DStream*)dec->state);
+      return 1;
+    #endif
+    #ifndef NO_XZ_SUPPORT
+    case COMPRESSION_XZ:
+      {
+        lzma_stream const init = LZMA_STREAM_INIT;
+        lzma_stream * strm;
+        if (!__open_input(dec,name)) {
+          return 0;
+        }
+        dec->insize = DECOMPRESS_INPUT_SIZE;
+        dec->inbuf = char_alloc(dec->insize);
+        strm = malloc(sizeof(lzma_stream));
+        *strm = init;
+        dec->state = strm;
+        if (lzma_stream_decoder(strm,UINT64_MAX,LZMA_CONCATENATED) != \
+            LZMA_OK) {
+          eprintf("Failed to initialize xz decoder\n");
+          return 0;
+        }
+        return 1;
+      }
+    #endif
+    default:
+      eprintf("Support for '%s' files was not built in\n", \
+          COMPRESSION_EXTENSIONS[dec->type]);
+      return 0;
+  }
+}
+
+
+/**
+ * @brief Tear down the codec.
+ *
+ * @param dec The decompressor.
+ */
+static void __free_codec(
+    decompress_t * const dec)
+{
+  if (dec->state) {
+    switch (dec->type) {
+      #ifndef NO_GZ_SUPPORT
+      case COMPRESSION_GZIP:
+        gzclose((gzFile)dec->state);
+        break;
+      #endif
+      #ifndef NO_ZSTD_SUPPORT
+      case COMPRESSION_ZSTD:
+        ZSTD_freeDStream((ZSTD_DStream*)dec->state);
+        break;
+      #endif
+      #ifndef NO_XZ_SUPPORT
+      case COMPRESSION_XZ:
+        lzma_end((lzma_stream*)dec->state);
+        dl_free(dec->state);
+        break;
+      #endif
+      default:
+        break;
+    }
+  }
+  if (dec->fin && dec->fin != stdin) {
+    fclose(dec->fin);
+  }
+  if (dec->inbuf) {
+    dl_free(dec->inbuf);
+  }
+}
+
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+compression_t decompress_type(
+    char const * const name)
+{
+  size_t i, len, elen;
+
+  len = strlen(name);
+  for (i=COMPRESSION_NONE+1;
+      i<sizeof(COMPRESSION_EXTENSIONS)/sizeof(char*);++i) {
+    elen = strlen(COMPRESSION_EXTENSIONS[i]);
+    if (len > elen && \
+        strcmp(name+len-elen,COMPRESSION_EXTENSIONS[i]) == 0) {
+      return (compression_t)i;
+    }
+  }
+
+  return COMPRESSION_NONE;
+}
+
+
+decompress_t * decompress_open(
+    char const * const name,
+    compression_t const type)
+{
+  size_t i;
+  decompress_t * dec;
+
+  dec = decompress_calloc(1);
+  dec->type = type;
+
+  if (!__init_codec(dec,name)) {
+    __free_codec(dec);
+    dl_free(dec);
+    return NULL;
+  }
+
+  dec->buffers = char_ptr_alloc(DECOMPRESS_NBUFFERS);
+  for (i=0;i<DECOMPRESS_NBUFFERS;++i) {
+    dec->buffers[i] = char_alloc(DECOMPRESS_BUFFER_SIZE);
+  }
+  dec->lengths = size_calloc(DECOMPRESS_NBUFFERS);
+
+  pthread_mutex_init(&dec->lock,NULL);
+  pthread_cond_init(&dec->filled,NULL);
+  pthread_cond_init(&dec->emptied,NULL);
+
+  if (pthread_create(&dec->thread,NULL,__run,dec) != 0) {
+    dl_error("Failed to start decompression thread\n");
+  }
+
+  return dec;
+}
+
+
+ssize_t decompress_next(
+    decompress_t * const dec,
+    char const ** const r_buf)
+{
+  ssize_t len;
+
+  pthread_mutex_lock(&dec->lock);
+
+  /* hand back the buffer we were holding */
+  if (dec->held) {
+    dec->held = 0;
+    ++dec->tail;
+    pthread_cond_signal(&dec->emptied);
+  }
+
+  while (dec->head == dec->tail && !dec->done) {
+    pthread_cond_wait(&dec->filled,&dec->lock);
+  }
+
+  if (dec->head > dec->tail) {
+    *r_buf = dec->buffers[dec->tail % DECOMPRESS_NBUFFERS];
+    len = (ssize_t)dec->lengths[dec->tail % DECOMPRESS_NBUFFERS];
+    dec->held = 1;
+  } else {
+    len = dec->error ? -1 : 0;
+  }
+
+  pthread_mutex_unlock(&dec->lock);
+
+  return len;
+}
+
+
+void decompress_close(
+    decompress_t * dec)
+{
+  size_t i;
+
+  pthread_mutex_lock(&dec->lock);
+  dec->stop = 1;
+  pthread_cond_signal(&dec->emptied);
+  pthread_mutex_unlock(&dec->lock);
+
+  pthread_join(dec->thread,NULL);
+
+  pthread_cond_destroy(&dec->filled);
+  pthread_cond_destroy(&dec->emptied);
+  pthread_mutex_destroy(&dec->lock);
+
+  __free_codec(dec);
+
+  for (i=0;i<DECOMPRESS_NBUFFERS;++i) {
+    dl_free(dec->buffers[i]);
+  }
+  dl_free(dec->buffers);
+  dl_free(dec->lengths);
+  dl_free(dec);
+}
+
+
+
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * @file decompress.h
+ * @brief Types and function prototypes for decompressing input on a separate
+ * thread
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-12
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_DECOMPRESS_H
+#define CLAIRVOYANCE_DECOMPRESS_H
+
+
+
+
+#include <pthread.h>
+#include "base.h"
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+typedef enum compression_t {
+  COMPRESSION_NONE,
+  COMPRESSION_GZIP,
+  COMPRESSION_ZSTD,
+  COMPRESSION_XZ
+} compression_t;
+
+
+/**
+ * @brief A decompressor running on its own thread, which fills a ring of
+ * fixed size buffers that are handed to the reader in order. Uncompressed
+ * streams (COMPRESSION_NONE) are read into the ring as is.
+ */
+typedef struct decompress_t {
+  compression_t type;
+  /* the compressed input and the state of the codec */
+  FILE * fin;
+  void * state;
+  char * inbuf;
+  size_t insize;
+  size_t inpos;
+  size_t inlen;
+  int eof;
+  /* the ring of buffers -- buffers [tail,head) are full, and the reader holds
+   * the tail buffer if held is set */
+  char ** buffers;
+  size_t * lengths;
+  size_t head;
+  size_t tail;
+  int held;
+  int done;
+  int error;
+  int stop;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t filled;
+  pthread_cond_t emptied;
+} decompress_t;
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* the name that selects standard input instead of a file */
+static const char DECOMPRESS_STDIN[] = "-";
+
+
+static const char * const COMPRESSION_EXTENSIONS[] = {
+  [COMPRESSION_NONE] = "",
+  [COMPRESSION_GZIP] = ".gz",
+  [COMPRESSION_ZSTD] = ".zst",
+  [COMPRESSION_XZ] = ".xz"
+};
+
+
+
+
+/******************************************************************************
+* FUNCTION PROTOTYPES *********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Determine the compression of a file from its extension.
+ *
+ * @param name The name of the file.
+ *
+ * @return The compression (COMPRESSION_NONE if it is not compressed).
+ */
+compression_t decompress_type(
+    char const * name);
+
+
+/**
+ * @brief Open a compressed file and start decompressing it.
+ *
+ * @param name The name of the file (DECOMPRESS_STDIN for standard input).
+ * @param type The compression of the file.
+ *
+ * @return The decompressor, or NULL if the file could not be opened (or this
+ * compression is not supported by the build).
+ */
+decompress_t * decompress_open(
+    char const * name,
+    compression_t type);
+
+
+/**
+ * @brief Get the next buffer of decompressed data, waiting for it if needed.
+ * The previous buffer is handed back to the decompressor.
+ *
+ * @param dec The decompressor.
+ * @param r_buf The buffer.
+ *
+ * @return The length of the buffer, 0 at the end of the data, or -1 if the
+ * input could not be decompressed.
+ */
+ssize_t decompress_next(
+    decompress_t * dec,
+    char const ** r_buf);
+
+
+/**
+ * @brief Stop the decompressor and free its associated memory.
+ *
+ * @param dec The decompressor.
+ */
+void decompress_close(
+    decompress_t * dec);
+
+
+
+
+#endif
@@ -0,0 +1,323 @@
+/**
+ * @file dist.c
+ * @brief Functions for reading a matrix with several processes, which each
+ * parse a part of the file into their own grid, reduced into that of the
+ * first process
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-23
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_DIST_C
+#define CLAIRVOYANCE_DIST_C
+
+
+
+
+#include "dist.h"
+
+#ifdef MPI_SUPPORT
+#include <mpi.h>
+#endif
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+#ifdef MPI_SUPPORT
+/* the most bins sent in one message, as MPI counts are ints */
+static const size_t DIST_BLOCK_BINS = 1 << 24;
+#endif
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Read a matrix into a grid with the calling process alone.
+ *
+ * @param handle The handle to read from.
+ * @param grid The grid to add the non-zeros to.
+ *
+ * @return 1 on success, 0 if a row/point is malformed.
+ */
+static int __read_local(
+    spmat_handle_t * const handle,
+    grid_t * const grid)
+{
+  if (handle->use_rows) {
+    return read_rows(handle,grid);
+  } else {
+    return read_points(handle,grid);
+  }
+}
+
+
+#ifdef MPI_SUPPORT
+
+
+/**
+ * @brief Combine the grid of every process into that of the first. The
+ * grids are first brought to the same bins (the coarsest among them, wide
+ * enough for the sum of their counts), as grid_reduce() does for the grids
+ * of threads. They are then combined up a fixed binomial tree, each process
+ * adding the bins of the one step after it to its own, so that the sums are
+ * always added in the same order (which MPI_Reduce() does not promise), and
+ * the image does not change from run to run.
+ *
+ * @param grid The grid of the calling process.
+ */
+static void __reduce_grid(
+    grid_t * const grid)
+{
+  int rank, size, step;
+  size_t k, n, len, cellsize;
+  uint64_t mine[4], all[4];
+  char * cells, * buf;
+
+  MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+  MPI_Comm_size(MPI_COMM_WORLD,&size);
+
+  /* find the coarsest bins, and the extents of the matrix */
+  mine[0] = (uint64_t)grid->rshift;
+  mine[1] = (uint64_t)grid->cshift;
+  mine[2] = (uint64_t)grid->nrows;
+  mine[3] = (uint64_t)grid->ncols;
+  MPI_Allreduce(mine,all,4,MPI_UINT64_T,MPI_MAX,MPI_COMM_WORLD);
+  grid_align(grid,(size_t)all[0],(size_t)all[1],0,0);
+  grid->nrows = (size_t)all[2];
+  grid->ncols = (size_t)all[3];
+
+  /* and allocate as many of them in every grid */
+  mine[0] = (uint64_t)grid->nbrows;
+  mine[1] = (uint64_t)grid->nbcols;
+  MPI_Allreduce(mine,all,2,MPI_UINT64_T,MPI_MAX,MPI_COMM_WORLD);
+  grid_align(grid,grid->rshift,grid->cshift,(size_t)all[0],(size_t)all[1]);
+
+  /* wide enough for the sum of their counts */
+  mine[0] = (uint64_t)grid->cell;
+  mine[1] = grid_max_count(grid);
+  MPI_Allreduce(mine,all,1,MPI_UINT64_T,MPI_MAX,MPI_COMM_WORLD);
+  MPI_Allreduce(mine+1,all+1,1,MPI_UINT64_T,MPI_SUM,MPI_COMM_WORLD);
+  if (all[0] != (uint64_t)grid->cell || all[1] > (uint64_t)UINT32_MAX) {
+    grid_widen(grid);
+  }
+
+  n = grid->nbrows*grid->nbcols;
+  cellsize = grid_cell_size(grid);
+  cells = (char*)grid->cells;
+  buf = NULL;
+
+  for (step=1;step<size;step*=2) {
+    if (rank % (2*step) != 0) {
+      /* hand our bins to the process step before us, and we are done */
+      for (k=0;k<n;k+=DIST_BLOCK_BINS) {
+        len = dl_min(n-k,DIST_BLOCK_BINS);
+        MPI_Send(cells+(k*cellsize),(int)(len*cellsize),MPI_BYTE, \
+            rank-step,0,MPI_COMM_WORLD);
+      }
+      break;
+    } else if (rank+step < size) {
+      if (buf == NULL) {
+        buf = char_alloc(dl_max(dl_min(n,DIST_BLOCK_BINS),1)*cellsize);
+      }
+      for (k=0;k<n;k+=DIST_BLOCK_BINS) {
+        len = dl_min(n-k,DIST_BLOCK_BINS);
+        MPI_Recv(buf,(int)(len*cellsize),MPI_BYTE,rank+step,0, \
+            MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+        grid_combine_bins(grid->cell,cells+(k*cellsize),buf,len);
+      }
+    }
+  }
+
+  if (buf) {
+    dl_free(buf);
+  }
+}
+
+
+#endif
+
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+int dist_init(
+    int * const argc,
+    char *** const argv)
+{
+  #ifdef MPI_SUPPORT
+  int provided;
+
+  /* only the main thread makes MPI calls */
+  if (MPI_Init_thread(argc,argv,MPI_THREAD_FUNNELED,&provided) != \
+      MPI_SUCCESS) {
+    return 0;
+  }
+  #endif
+
+  return 1;
+}
+
+
+void dist_finalize(void)
+{
+  #ifdef MPI_SUPPORT
+  int init;
+
+  MPI_Initialized(&init);
+  if (init) {
+    MPI_Finalize();
+  }
+  #endif
+}
+
+
+int dist_rank(void)
+{
+  int rank = 0;
+
+  #ifdef MPI_SUPPORT
+  int init;
+
+  MPI_Initialized(&init);
+  if (init) {
+    MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+  }
+  #endif
+
+  return rank;
+}
+
+
+int dist_size(void)
+{
+  int size = 1;
+
+  #ifdef MPI_SUPPORT
+  int init;
+
+  MPI_Initialized(&init);
+  if (init) {
+    MPI_Comm_size(MPI_COMM_WORLD,&size);
+  }
+  #endif
+
+  return size;
+}
+
+
+int dist_find_dims(
+    spmat_handle_t * const handle,
+    filetype_t const type,
+    char const * const name)
+{
+  #ifdef MPI_SUPPORT
+  int ok, rank, size;
+  size_t nrows, ncols, mappos, mapsize;
+  uint64_t mine[2], all[2];
+
+  if (handle->nrows > 0 && handle->ncols > 0) {
+    return 1;
+  }
+
+  MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+  MPI_Comm_size(MPI_COMM_WORLD,&size);
+
+  mappos = handle->mappos;
+  mapsize = handle->mapsize;
+
+  nrows = ncols = 0;
+  if (split_matrix(handle,(size_t)rank,(size_t)size)) {
+    /* each process scans the part of the file it will read, whose rows
+     * follow those of the parts before it */
+    ok = scan_dims(handle,&nrows,&ncols);
+    handle->mappos = mappos;
+    handle->mapsize = mapsize;
+    MPI_Allreduce(MPI_IN_PLACE,&ok,1,MPI_INT,MPI_LAND,MPI_COMM_WORLD);
+    mine[0] = (uint64_t)nrows;
+    MPI_Allreduce(mine,all,1,MPI_UINT64_T, \
+        handle->use_rows ? MPI_SUM : MPI_MAX,MPI_COMM_WORLD);
+    mine[1] = (uint64_t)ncols;
+    MPI_Allreduce(mine+1,all+1,1,MPI_UINT64_T,MPI_MAX,MPI_COMM_WORLD);
+  } else {
+    /* the first process reads the file alone, so it finds them alone */
+    ok = rank == 0 ? find_dims(handle,type,name) : 1;
+    all[0] = (uint64_t)handle->nrows;
+    all[1] = (uint64_t)handle->ncols;
+    MPI_Bcast(&ok,1,MPI_INT,0,MPI_COMM_WORLD);
+    MPI_Bcast(all,2,MPI_UINT64_T,0,MPI_COMM_WORLD);
+  }
+  if (!ok) {
+    return 0;
+  }
+
+  if (handle->nrows == 0) {
+    handle->nrows = (size_t)all[0];
+  }
+  if (handle->ncols == 0) {
+    handle->ncols = (size_t)all[1];
+  }
+
+  return 1;
+  #else
+  return find_dims(handle,type,name);
+  #endif
+}
+
+
+int dist_read(
+    spmat_handle_t * const handle,
+    grid_t * const grid)
+{
+  #ifdef MPI_SUPPORT
+  int ok, rank, size;
+  uint64_t nrows, before;
+
+  MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+  MPI_Comm_size(MPI_COMM_WORLD,&size);
+
+  if (size > 1 && split_matrix(handle,(size_t)rank,(size_t)size)) {
+    /* the rows of each part follow those of the parts before it */
+    if (handle->use_rows) {
+      nrows = (uint64_t)count_rows(handle);
+      before = 0;
+      MPI_Exscan(&nrows,&before,1,MPI_UINT64_T,MPI_SUM,MPI_COMM_WORLD);
+      if (rank > 0) {
+        handle->drow += (size_t)before;
+      }
+    }
+    ok = __read_local(handle,grid);
+    __reduce_grid(grid);
+  } else {
+    ok = rank == 0 ? __read_local(handle,grid) : 1;
+  }
+
+  MPI_Allreduce(MPI_IN_PLACE,&ok,1,MPI_INT,MPI_LAND,MPI_COMM_WORLD);
+
+  return ok;
+  #else
+  return __read_local(handle,grid);
+  #endif
+}
+
+
+
+
+#endif
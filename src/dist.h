@@ -0,0 +1,107 @@
+/**
+ * @file dist.h
+ * @brief Function prototypes for reading a matrix with several processes
+ * (when built with MPI support)
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-23
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_DIST_H
+#define CLAIRVOYANCE_DIST_H
+
+
+
+
+#include "base.h"
+#include "grid.h"
+#include "io.h"
+
+
+
+
+/******************************************************************************
+* FUNCTION PROTOTYPES *********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Start up the processes (only the main thread of each makes MPI
+ * calls). This does nothing when built without MPI support.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ *
+ * @return 1 on success.
+ */
+int dist_init(
+    int * argc,
+    char *** argv);
+
+
+/**
+ * @brief Shut down the processes started with dist_init().
+ */
+void dist_finalize(void);
+
+
+/**
+ * @brief Get the number of the calling process.
+ *
+ * @return The number of the process (0 when not running under MPI).
+ */
+int dist_rank(void);
+
+
+/**
+ * @brief Get the number of processes.
+ *
+ * @return The number of processes (1 when not running under MPI).
+ */
+int dist_size(void);
+
+
+/**
+ * @brief Fill in the dimensions of a matrix that its file does not give, as
+ * find_dims() does, with each process scanning the part of the file it will
+ * read (or the first process all of it, when the file can not be split).
+ * Every process must open the same file, and call this before dist_read().
+ *
+ * @param handle The handle of the file (before anything is read from it).
+ * @param type The format of the file.
+ * @param name The name of the file.
+ *
+ * @return 1 on success, 0 if the file could not be scanned.
+ */
+int dist_find_dims(
+    spmat_handle_t * handle,
+    filetype_t type,
+    char const * name);
+
+
+/**
+ * @brief Read a matrix with every process, each accumulating a part of the
+ * file into its own grid, which are then combined into the grid of the
+ * first process. Every process must open the same file, with the same
+ * window, and call this with a grid for the same canvas. Files that can not
+ * be split on line boundaries (compressed, binary, and dense matrix market
+ * input) are read by the first process alone.
+ *
+ * @param handle The handle to read from (before anything is read from it).
+ * @param grid The grid to add the non-zeros to (only that of the first
+ * process holds the whole matrix afterwards).
+ *
+ * @return 1 if every process read its part, 0 if a row/point is malformed.
+ */
+int dist_read(
+    spmat_handle_t * handle,
+    grid_t * grid);
+
+
+
+
+#endif
@@ -17,6 +17,50 @@
 
 
 #include "draw.h"
+#include "tiles.h"
+#include "iostate.h"
+#include "dist.h"
+#include "ooc.h"
+
+
+
+
+/******************************************************************************
+* DOMLIB IMPORTS **************************************************************
+******************************************************************************/
+
+
+#define DLMEM_PREFIX real_ptr
+#define DLMEM_TYPE_T real_t *
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX grid_ptr
+#define DLMEM_TYPE_T grid_t *
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX state_header
+#define DLMEM_TYPE_T state_header_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
 
 
 
@@ -26,44 +70,62 @@
 ******************************************************************************/
 
 
-static inline int __normalize(
+/**
+ * @brief Map the square roots of pixel values onto a range of intensities,
+ * given the range of the square roots of every value of the canvas.
+ *
+ * @param val The pixel values.
+ * @param n The number of pixel values.
+ * @param range The range of the square roots (see draw_color_range()).
+ * @param nmin The lowest intensity.
+ * @param nmax The highest intensity.
+ *
+ * @return 1 on success.
+ */
+static inline int __scale(
     real_t * const val, 
     size_t const n, 
+    color_range_t const * const range,
     real_t const nmin, 
     real_t const nmax) 
 {
-  real_t max, min, scale, range;
+  real_t scale, span;
   size_t i;
   const real_t nrange = nmax -nmin;
+  const real_t min = range->min;
 
-  val[0] = min = max = sqrt(val[0]);
-
-  for (i=1;i<n;++i) {
-    val[i] = sqrt(val[i]);
-    if (val[i] > max) {
-      max = val[i];
-    }
-    if (val[i] < min) {
-      min = val[i];
-    }
-  }
-  range = max - min;
-  if (range == 0) {
+  span = range->max - min;
+  if (span == 0) {
     if (min == 0) {
       scale = 0;
     } else {
       scale = nmin / min;
     }
   } else {
-    scale = nrange / range;
+    scale = nrange / span;
   }
   for (i=0;i<n;++i) {
+    val[i] = sqrt(val[i]);
     val[i] = ((val[i]-min)*scale)+nmin;
   }
   return 1;
 }
 
 
+static inline int __normalize(
+    real_t * const val, 
+    size_t const n, 
+    real_t const nmin, 
+    real_t const nmax) 
+{
+  color_range_t range = {0,0,0};
+
+  draw_color_range(val,n,&range);
+
+  return __scale(val,n,&range,nmin,nmax);
+}
+
+
 static inline int __invert(
     real_t * const val, 
     size_t const n, 
@@ -112,96 +174,763 @@ static int __fix(
 }
 
 
+/**
+ * @brief Start the header of the saved accumulators of a grid.
+ *
+ * @param header The header.
+ * @param ftype The type of the file the grid was read from.
+ * @param window The region of the matrix read into the grid.
+ */
+static void __state_header(
+    state_header_t * const header,
+    filetype_t const ftype,
+    window_t const * const window)
+{
+  memset(header,0,sizeof(state_header_t));
+  header->filetype = (uint32_t)ftype;
+  header->offset = STATE_NO_OFFSET;
+  header->rstart = (uint64_t)window->rstart;
+  header->rend = (uint64_t)window->rend;
+  header->cstart = (uint64_t)window->cstart;
+  header->cend = (uint64_t)window->cend;
+}
+
+
+/**
+ * @brief Pick up a grid saved by __save_state() where it left off. It is only
+ * used if it was read from the same type of file, the same region of it, for
+ * at least the functions wanted, onto the same canvas, and if the file has
+ * only been appended to since. As its rows/columns were mapped straight to
+ * pixels, the new non-zeros of a file without a header must also fall inside
+ * of the dimensions it was saved with (which giving the dimensions ahead of
+ * time guarantees), or the file is read in full.
+ *
+ * @param handle The handle of the file, to read only its new part from.
+ * @param statefile The file the grid was saved to.
+ * @param ftype The type of the file.
+ * @param funcs The functions to accumulate (a mask of grid_func()s).
+ * @param nx The width of the canvas.
+ * @param ny The height of the canvas.
+ *
+ * @return The saved grid, or NULL if the file must be read from the start.
+ */
+static grid_t * __resume_state(
+    spmat_handle_t * const handle,
+    char const * const statefile,
+    filetype_t const ftype,
+    unsigned int const funcs,
+    size_t const nx,
+    size_t const ny)
+{
+  int err, known;
+  size_t wrows, wcols, nrows, ncols, mappos, mapsize;
+  state_header_t header;
+  grid_t * grid;
+  window_t const * const window = &handle->window;
+
+  err = state_read(statefile,&header,&grid);
+  if (err == STATE_ERROR_OPEN) {
+    /* nothing saved yet */
+    return NULL;
+  } else if (err != STATE_SUCCESS) {
+    wprintf("Failed to read state '%s', reading the input in full\n", \
+        statefile);
+    return NULL;
+  }
 
+  if (header.filetype != (uint32_t)ftype || (header.funcs & funcs) != funcs \
+      || header.nx != nx || header.ny != ny || \
+      header.rstart != window->rstart || header.rend != window->rend || \
+      header.cstart != window->cstart || header.cend != window->cend) {
+    wprintf("State '%s' was saved from a different drawing, reading the "
+        "input in full\n",statefile);
+    grid_free(grid);
+    return NULL;
+  }
 
-/******************************************************************************
-* PUBLIC FUNCTIONS ************************************************************
-******************************************************************************/
+  if (header.offset == STATE_NO_OFFSET) {
+    wprintf("State '%s' can not be picked up where it left off, reading the "
+        "input in full\n",statefile);
+    grid_free(grid);
+    return NULL;
+  }
 
+  mappos = handle->mappos;
+  mapsize = handle->mapsize;
+  if (!resume_matrix(handle,(size_t)header.offset,header.tail, \
+        header.ntail)) {
+    wprintf("The input has been changed other than by appending to it since "
+        "state '%s' was saved, reading it in full\n",statefile);
+    grid_free(grid);
+    return NULL;
+  }
 
-image_t * draw_matrix_file(
+  /* without a header, the dimensions are those the grid was saved with,
+   * unless the new part of the file goes past them */
+  known = handle->nrows > 0 && handle->ncols > 0;
+  if (!known && grid->prows > 0 && scan_dims(handle,&nrows,&ncols)) {
+    handle->nrows = dl_max(nrows,window->rstart+grid->nrows);
+    handle->ncols = dl_max(ncols,window->cstart+grid->ncols);
+  }
+
+  /* a grid whose rows/columns were mapped straight to pixels is only exact
+   * for that canvas and matrix */
+  window_dims(handle,&wrows,&wcols);
+  if (grid->prows == 0 || grid->nrows != wrows || grid->ncols != wcols || \
+      grid->prows != dl_max(dl_min(ny,wrows),1) || \
+      grid->pcols != dl_max(dl_min(nx,wcols),1)) {
+    wprintf("State '%s' was saved for a different size of matrix or canvas, "
+        "reading the input in full\n",statefile);
+    if (!known) {
+      handle->nrows = handle->ncols = 0;
+    }
+    handle->mappos = mappos;
+    handle->mapsize = mapsize;
+    grid_free(grid);
+    return NULL;
+  }
+
+  return grid;
+}
+
+
+/**
+ * @brief Save a grid along with how far into its file has been read, for
+ * __resume_state() to pick up.
+ *
+ * @param handle The handle of the file.
+ * @param grid The grid the file was read into.
+ * @param statefile The file to save the grid to.
+ * @param ftype The type of the file.
+ */
+static void __save_state(
+    spmat_handle_t const * const handle,
+    grid_t const * const grid,
+    char const * const statefile,
+    filetype_t const ftype)
+{
+  state_header_t header;
+
+  __state_header(&header,ftype,&handle->window);
+  header.offset = (uint64_t)handle->mappos;
+  header.ntail = (uint32_t)matrix_tail(handle,header.tail,STATE_TAIL_SIZE);
+
+  if (state_write(statefile,&header,grid) != STATE_SUCCESS) {
+    wprintf("Failed to write state '%s'\n",statefile);
+  }
+}
+
+
+/**
+ * @brief Open a matrix and accumulate its non-zeros into a grid.
+ *
+ * @param filein The file to read.
+ * @param ftype The type of the file.
+ * @param funcs The functions to accumulate (a mask of grid_func()s).
+ * @param nx The width of the canvas.
+ * @param ny The height of the canvas.
+ * @param nrows The number of rows in the matrix (0 if unknown).
+ * @param ncols The number of columns in the matrix (0 if unknown).
+ * @param window The region of the matrix to read (NULL for all of it).
+ * @param shard Whether the file is a shard of the matrix, which only holds
+ * some of its non-zeros, and so can not give its dimensions.
+ * @param roffset The row of the matrix that the first row of a shard is.
+ * @param coffset The column of the matrix that the first column of a shard
+ * is.
+ * @param useindex Whether to use (and build) the sidecar row index.
+ * @param statefile The file to save the grid to, and pick it up from (NULL
+ * to read the file in full).
+ * @param budget The time budget of a sampled preview (0 to read everything).
+ * @param r_fraction The fraction of the file that was read (may be NULL).
+ *
+ * @return The grid, or NULL if the file could not be opened or is malformed.
+ */
+static grid_t * __read_grid(
     char const * const filein, 
     filetype_t const ftype, 
-    colortype_t const ctype, 
-    functiontype_t const func, 
+    unsigned int const funcs,
     size_t const nx, 
-    size_t const ny)
+    size_t const ny,
+    size_t const nrows,
+    size_t const ncols,
+    window_t const * const window,
+    int const shard,
+    size_t const roffset,
+    size_t const coffset,
+    int const useindex,
+    char const * statefile,
+    double const budget,
+    double * const r_fraction)
 {
-  size_t i;
-  image_t * img = NULL;
-  real_t * out, * den = NULL, * max = NULL, * avg = NULL;
-  size_t x,y;
+  int ok;
+  size_t wrows, wcols;
+  double fraction;
+  grid_t * grid;
+
+  spmat_handle_t * handle = open_matrix(filein,ftype,nrows,ncols);
+
+  if (handle == NULL) {
+    return NULL;
+  }
+
+  if (roffset > 0 || coffset > 0) {
+    if (!offset_matrix(handle,roffset,coffset)) {
+      close_matrix(handle);
+      return NULL;
+    }
+    handle->nrows = nrows;
+    handle->ncols = ncols;
+  }
+
+  if (useindex) {
+    open_index(handle,ftype,filein);
+  }
+
+  if (window && !set_window(handle,window)) {
+    close_matrix(handle);
+    return NULL;
+  }
+
+  grid = NULL;
+  if (statefile) {
+    grid = __resume_state(handle,statefile,ftype,funcs,nx,ny);
+    if (grid == NULL && !resume_matrix(handle,0,NULL,0)) {
+      wprintf("State is only kept for uncompressed point files, not saving "
+          "'%s'\n",statefile);
+      statefile = NULL;
+    }
+  }
+
+  if (grid == NULL) {
+    /* find the dimensions the file does not give, so that each row/column
+     * goes straight to its pixel (a preview only samples the file, and a
+     * shard only holds part of the matrix, so their grids discover them as
+     * they go instead, splitting the bins that straddle pixels once they
+     * have) */
+    if (budget <= 0 && !shard && !(dist_size() > 1 ? \
+        dist_find_dims(handle,ftype,filein) : \
+        find_dims(handle,ftype,filein))) {
+      close_matrix(handle);
+      return NULL;
+    }
+    window_dims(handle,&wrows,&wcols);
+    if (wrows > 0 && wcols > 0) {
+      grid = grid_create_exact(nx,ny,wrows,wcols,funcs);
+    } else {
+      grid = grid_create(nx,ny,wrows,wcols,funcs);
+    }
+  }
+
+  fraction = 1.0;
+  if (budget > 0) {
+    ok = read_preview(handle,grid,budget,&fraction);
+  } else {
+    if (dist_size() > 1) {
+      /* each process reads a part of the file, and the first gets the sum */
+      ok = dist_read(handle,grid);
+    } else if (handle->use_rows) {
+      ok = read_rows(handle,grid);
+    } else {
+      ok = read_points(handle,grid);
+    }
+
+    /* only a full read says enough about the file to index it */
+    if (ok && useindex) {
+      save_index(handle,grid,ftype,filein);
+    }
+    if (ok && statefile) {
+      __save_state(handle,grid,statefile,ftype);
+    }
+  }
+  if (r_fraction) {
+    *r_fraction = fraction;
+  }
+
+  close_matrix(handle);
+
+  if (!ok) {
+    grid_free(grid);
+    return NULL;
+  }
+
+  return grid;
+}
+
+
+
+
+/**
+ * @brief Get the mask of grid_func()s of several functions.
+ *
+ * @param funcs The functions.
+ * @param nfuncs The number of functions.
+ *
+ * @return The mask.
+ */
+static unsigned int __func_mask(
+    functiontype_t const * const funcs,
+    size_t const nfuncs)
+{
+  size_t f;
+  unsigned int mask;
+
+  mask = 0;
+  for (f=0;f<nfuncs;++f) {
+    mask |= grid_func(funcs[f]);
+  }
+
+  return mask;
+}
+
+
+/**
+ * @brief Draw several functions of a grid, in several colorings, at the size
+ * of its canvas.
+ *
+ * @param grid The grid.
+ * @param funcs The functions to draw.
+ * @param nfuncs The number of functions.
+ * @param ctypes The colorings to draw each function in.
+ * @param nctypes The number of colorings.
+ * @param imgs The nfuncs*nctypes images, with the colorings of the first
+ * function first.
+ */
+static void __draw_grid(
+    grid_t const * const grid,
+    functiontype_t const * const funcs,
+    size_t const nfuncs,
+    colortype_t const * const ctypes,
+    size_t const nctypes,
+    image_t ** const imgs)
+{
+  size_t f, x, y;
+  real_t ** outs;
+
+  outs = real_ptr_alloc(nfuncs);
+  for (f=0;f<nfuncs;++f) {
+    outs[f] = grid_finalize(grid,funcs[f],&x,&y);
+  }
+
+  /* the colorings overwrite the pixel values, so each image gets its own
+   * copy */
+  #pragma omp parallel for schedule(dynamic,1)
+  for (f=0;f<nfuncs*nctypes;++f) {
+    real_t * const out = real_alloc(x*y);
+    memcpy(out,outs[f/nctypes],sizeof(real_t)*x*y);
+    draw_color_values(out,x*y,ctypes[f%nctypes]);
+    imgs[f] = draw_color_image(out,x,y,ctypes[f%nctypes],grid->nx,grid->ny);
+    dl_free(out);
+  }
+
+  for (f=0;f<nfuncs;++f) {
+    dl_free(outs[f]);
+  }
+  dl_free(outs);
+}
+
+
 
-  spmat_handle_t * handle = open_matrix(filein,ftype);
 
-  x = dl_min(nx,handle->ncols);
-  y = dl_min(ny,handle->nrows);
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
 
-  out = real_init_alloc(0.0,x*y);
 
-  switch (func) {
-    case FUNCTION_DENSITY:
-      den = out;
+void draw_color_range(
+    real_t const * const out,
+    size_t const n,
+    color_range_t * const range)
+{
+  size_t i;
+  real_t v;
+
+  for (i=0;i<n;++i) {
+    v = sqrt(out[i]);
+    if (range->n++ == 0) {
+      range->min = range->max = v;
+    } else {
+      if (v > range->max) {
+        range->max = v;
+      }
+      if (v < range->min) {
+        range->min = v;
+      }
+    }
+  }
+}
+
+
+void draw_color_part(
+    real_t * const out,
+    size_t const n,
+    colortype_t const ctype,
+    color_range_t const * const range)
+{
+  switch (ctype) {
+    case COLOR_BLACKWHITE:
+      __truncate(out,n,0,0,255.0); 
       break;
-    case FUNCTION_MAX:
-      max = out;
+    case COLOR_WHITEBLACK:
+      __truncate(out,n,0,0,255.0); 
+      __invert(out,n,255.0);
       break;
-    case FUNCTION_AVERAGE:
-      avg = out;
+    case COLOR_GRAYSCALE:
+      __scale(out,n,range,0,255.0);
+      break;
+    case COLOR_INVGRAYSCALE:
+      __scale(out,n,range,0,255.0);
+      __invert(out,n,255.0);
+      break;
+    case COLOR_HEATMAP:
+      __scale(out,n,range,0,1020.0);
+      break;
+    case COLOR_INVHEATMAP:
+      __scale(out,n,range,0,1020.0);
+      __invert(out,n,1020.0);
       break;
     default:
-      dl_error("Unsupported function type %d\n",func);
+      dl_error("Unsupported coloring type %d\n",ctype);
       break;
   }
-  if (handle->use_rows) {
-    for (i=0;i<handle->nrows;++i) {
-      read_row(handle,(i*y)/handle->nrows,den,max,avg,x);
-    }
-  } else {
-    read_points(handle,x,y,den,max,avg);
-  }
+}
 
-  close_matrix(handle);
 
+void draw_color_values(
+    real_t * const out,
+    size_t const n,
+    colortype_t const ctype)
+{
   switch (ctype) {
     case COLOR_BLACKWHITE:
-      __truncate(out,x*y,0,0,255.0); 
-      img = image_create_grayscale(out,x,y,nx,ny);
+      __truncate(out,n,0,0,255.0); 
       break;
     case COLOR_WHITEBLACK:
-      __truncate(out,x*y,0,0,255.0); 
-      __invert(out,x*y,255.0);
-      img = image_create_grayscale(out,x,y,nx,ny);
+      __truncate(out,n,0,0,255.0); 
+      __invert(out,n,255.0);
       break;
     case COLOR_GRAYSCALE:
-      __normalize(out,x*y,0,255.0);
-      img = image_create_grayscale(out,x,y,nx,ny);
+      __normalize(out,n,0,255.0);
       break;
     case COLOR_INVGRAYSCALE:
-      __normalize(out,x*y,0,255.0);
-      __invert(out,x*y,255.0);
-      img = image_create_grayscale(out,x,y,nx,ny);
+      __normalize(out,n,0,255.0);
+      __invert(out,n,255.0);
       break;
     case COLOR_HEATMAP:
-      __normalize(out,x*y,0,1020.0);
-      img = image_create_heatmap(out,x,y,nx,ny);
+      __normalize(out,n,0,1020.0);
       break;
     case COLOR_INVHEATMAP:
-      __normalize(out,x*y,0,1020.0);
-      __invert(out,x*y,1020.0);
-      img = image_create_heatmap(out,x,y,nx,ny);
+      __normalize(out,n,0,1020.0);
+      __invert(out,n,1020.0);
       break;
     default:
       dl_error("Unsupported coloring type %d\n",ctype);
       break;
   }
+}
+
+
+image_t * draw_color_image(
+    real_t const * const out,
+    size_t const x,
+    size_t const y,
+    colortype_t const ctype,
+    size_t const nx,
+    size_t const ny)
+{
+  switch (ctype) {
+    case COLOR_HEATMAP:
+    case COLOR_INVHEATMAP:
+      return image_create_heatmap(out,x,y,nx,ny);
+    default:
+      return image_create_grayscale(out,x,y,nx,ny);
+  }
+}
+
+
+int draw_matrix_images(
+    char const * const filein, 
+    filetype_t const ftype, 
+    functiontype_t const * const funcs,
+    size_t const nfuncs,
+    colortype_t const * const ctypes,
+    size_t const nctypes,
+    size_t const nx, 
+    size_t const ny,
+    size_t const nrows,
+    size_t const ncols,
+    window_t const * const window,
+    int const useindex,
+    char const * const statefile,
+    double const budget,
+    double * const r_fraction,
+    image_t ** const imgs)
+{
+  grid_t * grid;
+
+  /* every function is accumulated in the same pass over the input */
+  grid = __read_grid(filein,ftype,__func_mask(funcs,nfuncs),nx,ny,nrows, \
+      ncols,window,0,0,0,useindex,statefile,budget,r_fraction);
+  if (grid == NULL) {
+    return 0;
+  }
 
-  dl_free(out);
+  /* only the first process holds the whole matrix */
+  if (dist_rank() == 0) {
+    __draw_grid(grid,funcs,nfuncs,ctypes,nctypes,imgs);
+  }
+  grid_free(grid);
+
+  return 1;
+}
+
+
+image_t * draw_matrix_file(
+    char const * const filein, 
+    filetype_t const ftype, 
+    colortype_t const ctype, 
+    functiontype_t const func, 
+    size_t const nx, 
+    size_t const ny,
+    size_t const nrows,
+    size_t const ncols,
+    window_t const * const window,
+    int const useindex,
+    char const * const statefile,
+    double const budget,
+    double * const r_fraction)
+{
+  image_t * img = NULL;
+
+  if (!draw_matrix_images(filein,ftype,&func,1,&ctype,1,nx,ny,nrows,ncols, \
+        window,useindex,statefile,budget,r_fraction,&img)) {
+    return NULL;
+  }
 
   return img;
 }
 
 
+int draw_matrix_tiles(
+    char const * const filein, 
+    filetype_t const ftype, 
+    colortype_t const ctype, 
+    functiontype_t const func, 
+    size_t const maxzoom,
+    size_t const nrows,
+    size_t const ncols,
+    window_t const * const window,
+    int const useindex,
+    char const * const statefile,
+    double const budget,
+    char const * const outdir,
+    double * const r_fraction,
+    size_t * const r_ntiles)
+{
+  size_t ntiles;
+  grid_t * grid;
+  size_t const size = TILE_SIZE << maxzoom;
+
+  /* the finest level is read in, and the rest are reduced from it */
+  grid = __read_grid(filein,ftype,grid_func(func),size,size,nrows,ncols, \
+      window,0,0,0,useindex,statefile,budget,r_fraction);
+  if (grid == NULL) {
+    return 0;
+  }
+
+  /* only the first process holds the whole matrix */
+  if (dist_rank() > 0) {
+    grid_free(grid);
+    return 1;
+  }
+
+  ntiles = tiles_write(grid,func,ctype,outdir);
+  grid_free(grid);
+
+  if (ntiles == 0) {
+    return 0;
+  }
+  if (r_ntiles) {
+    *r_ntiles = ntiles;
+  }
+
+  return 1;
+}
+
+
+int draw_matrix_ooc(
+    char const * const filein, 
+    filetype_t const ftype, 
+    colortype_t const ctype, 
+    functiontype_t const func, 
+    size_t const nx, 
+    size_t const ny,
+    size_t const nrows,
+    size_t const ncols,
+    window_t const * const window,
+    size_t const maxmem,
+    char const * const fileout,
+    size_t * const r_x,
+    size_t * const r_y)
+{
+  int ok;
+  spmat_handle_t * handle = open_matrix(filein,ftype,nrows,ncols);
+
+  if (handle == NULL) {
+    return 0;
+  }
+
+  if (window && !set_window(handle,window)) {
+    close_matrix(handle);
+    return 0;
+  }
+
+  ok = ooc_draw(handle,func,ctype,nx,ny,maxmem,fileout,r_x,r_y);
+
+  close_matrix(handle);
+
+  return ok;
+}
+
+
+
+int draw_matrix_shard(
+    char const * const filein,
+    filetype_t const ftype,
+    functiontype_t const * const funcs,
+    size_t const nfuncs,
+    size_t const nx,
+    size_t const ny,
+    size_t const nrows,
+    size_t const ncols,
+    window_t const * const window,
+    size_t const roffset,
+    size_t const coffset,
+    int const useindex,
+    char const * const fileout)
+{
+  int err;
+  state_header_t header;
+  grid_t * grid;
+  window_t const all = {0,WINDOW_END,0,WINDOW_END};
+
+  if (useindex && (roffset > 0 || coffset > 0)) {
+    eprintf("The rows of a shard read from offsets are not indexed\n");
+    return 0;
+  }
+
+  grid = __read_grid(filein,ftype,__func_mask(funcs,nfuncs),nx,ny,nrows, \
+      ncols,window,1,roffset,coffset,useindex,NULL,0,NULL);
+  if (grid == NULL) {
+    return 0;
+  }
+
+  __state_header(&header,ftype,window ? window : &all);
+  header.roffset = (uint64_t)roffset;
+  header.coffset = (uint64_t)coffset;
+  err = state_write(fileout,&header,grid);
+  grid_free(grid);
+
+  if (err != STATE_SUCCESS) {
+    eprintf("Failed to write the accumulators of '%s' to '%s'\n",filein, \
+        fileout);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+int draw_merge_images(
+    char * const * const shards,
+    size_t const nshards,
+    functiontype_t const * const funcs,
+    size_t const nfuncs,
+    colortype_t const * const ctypes,
+    size_t const nctypes,
+    size_t const nx,
+    size_t const ny,
+    size_t const nrows,
+    size_t const ncols,
+    image_t ** const imgs)
+{
+  int ok;
+  size_t s;
+  grid_t * grid;
+  grid_t ** grids;
+  state_header_t * headers;
+  unsigned int const mask = __func_mask(funcs,nfuncs);
+
+  grids = grid_ptr_calloc(nshards);
+  headers = state_header_alloc(nshards);
+
+  ok = 1;
+  #pragma omp parallel for schedule(dynamic,1) reduction(&&:ok)
+  for (s=0;s<nshards;++s) {
+    if (state_read(shards[s],headers+s,grids+s) != STATE_SUCCESS) {
+      eprintf("Failed to read the accumulators of shard '%s'\n",shards[s]);
+      ok = 0;
+    }
+  }
+
+  /* bins can only be combined with those accumulated the same way */
+  for (s=0;ok && s<nshards;++s) {
+    if ((grids[s]->funcs & mask) != mask) {
+      eprintf("Shard '%s' does not accumulate every function to draw\n", \
+          shards[s]);
+      ok = 0;
+    } else if (grids[s]->funcs != grids[0]->funcs || \
+        grids[s]->nx != grids[0]->nx || grids[s]->ny != grids[0]->ny || \
+        grids[s]->prows != grids[0]->prows || \
+        grids[s]->pcols != grids[0]->pcols || (grids[s]->prows > 0 && \
+        (grids[s]->nrows != grids[0]->nrows || \
+        grids[s]->ncols != grids[0]->ncols)) || \
+        headers[s].rstart != headers[0].rstart || \
+        headers[s].rend != headers[0].rend || \
+        headers[s].cstart != headers[0].cstart || \
+        headers[s].cend != headers[0].cend) {
+      eprintf("Shard '%s' was not accumulated for the same functions, size, "
+          "dimensions, and region as '%s'\n",shards[s],shards[0]);
+      ok = 0;
+    }
+  }
+  if (ok && (nx > grids[0]->nx || ny > grids[0]->ny)) {
+    eprintf("Shards accumulated for a %zux%zu image can not be drawn at "
+        "%zux%zu\n",grids[0]->nx,grids[0]->ny,nx,ny);
+    ok = 0;
+  }
+  /* shards that knew the dimensions of the matrix mapped its rows/columns
+   * straight to pixels, and can not be stretched */
+  if (ok && grids[0]->prows > 0 && ((nrows > 0 && nrows != grids[0]->nrows) \
+      || (ncols > 0 && ncols != grids[0]->ncols))) {
+    eprintf("Shards accumulated for a %zux%zu matrix can not be drawn as "
+        "%zux%zu\n",grids[0]->nrows,grids[0]->ncols,nrows,ncols);
+    ok = 0;
+  }
+
+  if (ok) {
+    grid = grids[0];
+    grid_reduce(grid,grids+1,nshards-1);
+
+    /* the shards only know the extents of their own non-zeros */
+    grid_extend(grid,nrows,ncols);
+    if (nx > 0 && ny > 0 && (nx < grid->nx || ny < grid->ny)) {
+      grid_coarsen(grid,nx,ny);
+    }
+
+    __draw_grid(grid,funcs,nfuncs,ctypes,nctypes,imgs);
+  }
+
+  for (s=0;s<nshards;++s) {
+    if (grids[s]) {
+      grid_free(grids[s]);
+    }
+  }
+  dl_free(grids);
+  dl_free(headers);
+
+  return ok;
+}
+
 
 
 #endif
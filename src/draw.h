@@ -18,6 +18,25 @@
 
 #include "base.h"
 #include "image.h"
+#include "io.h"
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+/**
+ * @brief The range of the square roots of the pixel values of a canvas, which
+ * its colorings are scaled to.
+ */
+typedef struct color_range_t {
+  size_t n;
+  real_t min;
+  real_t max;
+} color_range_t;
 
 
 
@@ -27,13 +46,301 @@
 ******************************************************************************/
 
 
+/**
+ * @brief Map the pixel values of a drawn matrix to the intensities of a
+ * coloring (in place). The values are scaled together, so all of a canvas
+ * must be passed at once.
+ *
+ * @param out The pixel values.
+ * @param n The number of pixel values.
+ * @param ctype The coloring.
+ */
+void draw_color_values(
+    real_t * out,
+    size_t n,
+    colortype_t ctype);
+
+
+/**
+ * @brief Fold pixel values into the range of a canvas, for coloring a canvas
+ * a part at a time (see draw_color_part()).
+ *
+ * @param out The pixel values.
+ * @param n The number of pixel values.
+ * @param range The range so far (zeroed before the first part).
+ */
+void draw_color_range(
+    real_t const * out,
+    size_t n,
+    color_range_t * range);
+
+
+/**
+ * @brief Map a part of the pixel values of a canvas to the intensities of a
+ * coloring (in place), as draw_color_values() would map them with the rest of
+ * the canvas.
+ *
+ * @param out The pixel values.
+ * @param n The number of pixel values.
+ * @param ctype The coloring.
+ * @param range The range of the whole canvas (see draw_color_range()).
+ */
+void draw_color_part(
+    real_t * out,
+    size_t n,
+    colortype_t ctype,
+    color_range_t const * range);
+
+
+/**
+ * @brief Create an image from intensities given by draw_color_values().
+ *
+ * @param out The intensities.
+ * @param x The width of the intensities.
+ * @param y The height of the intensities.
+ * @param ctype The coloring.
+ * @param nx The width of the image.
+ * @param ny The height of the image.
+ *
+ * @return The image.
+ */
+image_t * draw_color_image(
+    real_t const * out,
+    size_t x,
+    size_t y,
+    colortype_t ctype,
+    size_t nx,
+    size_t ny);
+
+
+/**
+ * @brief Draw several functions of a matrix, in several colorings, from a
+ * single pass over its file.
+ *
+ * @param filein The file to read.
+ * @param ftype The type of the file.
+ * @param funcs The functions to draw.
+ * @param nfuncs The number of functions.
+ * @param ctypes The colorings to draw each function in.
+ * @param nctypes The number of colorings.
+ * @param nx The width of the images.
+ * @param ny The height of the images.
+ * @param nrows The number of rows in the matrix (0 if unknown).
+ * @param ncols The number of columns in the matrix (0 if unknown).
+ * @param window The region of the matrix to draw, at the full size of the
+ * canvas (NULL for all of it).
+ * @param useindex Whether to use (and build) the sidecar row index.
+ * @param statefile The file to save the grid to, and pick it up from on the
+ * next draw of an append-only point file (NULL to read the file in full).
+ * @param budget The time budget of a sampled preview (0 to read everything).
+ * @param r_fraction The fraction of the file that was read (may be NULL).
+ * @param imgs The nfuncs*nctypes images, with the colorings of the first
+ * function first (only drawn by the first process when running under MPI,
+ * see dist_read()).
+ *
+ * @return 1 on success, 0 if the file could not be opened.
+ */
+int draw_matrix_images(
+    char const * filein, 
+    filetype_t ftype, 
+    functiontype_t const * funcs,
+    size_t nfuncs,
+    colortype_t const * ctypes,
+    size_t nctypes,
+    size_t nx, 
+    size_t ny,
+    size_t nrows,
+    size_t ncols,
+    window_t const * window,
+    int useindex,
+    char const * statefile,
+    double budget,
+    double * r_fraction,
+    image_t ** imgs);
+
+
 image_t * draw_matrix_file(
     char const * filein, 
     filetype_t ftype, 
     colortype_t ctype, 
     functiontype_t func, 
     size_t nx, 
-    size_t ny);
+    size_t ny,
+    size_t nrows,
+    size_t ncols,
+    window_t const * window,
+    int useindex,
+    char const * statefile,
+    double budget,
+    double * r_fraction);
+
+
+
+
+/**
+ * @brief Draw a matrix as a pyramid of tiles (see tiles_write()), from a
+ * single pass over its file.
+ *
+ * @param filein The file to read.
+ * @param ftype The type of the file.
+ * @param ctype The coloring.
+ * @param func The function.
+ * @param maxzoom The deepest zoom level to draw (the finest level is at most
+ * TILE_SIZE*2^maxzoom pixels on a side).
+ * @param nrows The number of rows in the matrix (0 if unknown).
+ * @param ncols The number of columns in the matrix (0 if unknown).
+ * @param window The region of the matrix to draw, at the full size of the
+ * canvas (NULL for all of it).
+ * @param useindex Whether to use (and build) the sidecar row index.
+ * @param statefile The file to save the grid to, and pick it up from on the
+ * next draw of an append-only point file (NULL to read the file in full).
+ * @param budget The time budget of a sampled preview (0 to read everything).
+ * @param outdir The directory to write the tiles to.
+ * @param r_fraction The fraction of the file that was read (may be NULL).
+ * @param r_ntiles The number of tiles written (may be NULL, and only set
+ * by the first process when running under MPI, which alone writes them).
+ *
+ * @return 1 on success, 0 if the file could not be opened or the tiles
+ * could not be written.
+ */
+int draw_matrix_tiles(
+    char const * filein, 
+    filetype_t ftype, 
+    colortype_t ctype, 
+    functiontype_t func, 
+    size_t maxzoom,
+    size_t nrows,
+    size_t ncols,
+    window_t const * window,
+    int useindex,
+    char const * statefile,
+    double budget,
+    char const * outdir,
+    double * r_fraction,
+    size_t * r_ntiles);
+
+
+/**
+ * @brief Draw a matrix to a PNG out of core, holding no more than about maxmem
+ * bytes (see ooc_draw()), for canvases too large to draw in memory.
+ *
+ * @param filein The file to read.
+ * @param ftype The type of the file.
+ * @param ctype The coloring.
+ * @param func The function.
+ * @param nx The width of the canvas.
+ * @param ny The height of the canvas.
+ * @param nrows The number of rows in the matrix (0 if unknown).
+ * @param ncols The number of columns in the matrix (0 if unknown).
+ * @param window The region of the matrix to draw, at the full size of the
+ * canvas (NULL for all of it).
+ * @param maxmem The number of bytes to hold at most.
+ * @param fileout The PNG to write.
+ * @param r_x The width of the image written.
+ * @param r_y The height of the image written.
+ *
+ * @return 1 on success, 0 if the file could not be opened or the image could
+ * not be written.
+ */
+int draw_matrix_ooc(
+    char const * filein, 
+    filetype_t ftype, 
+    colortype_t ctype, 
+    functiontype_t func, 
+    size_t nx, 
+    size_t ny,
+    size_t nrows,
+    size_t ncols,
+    window_t const * window,
+    size_t maxmem,
+    char const * fileout,
+    size_t * r_x,
+    size_t * r_y);
+
+
+/**
+ * @brief Accumulate a shard of a matrix -- a file holding some of its
+ * non-zeros, at their row and column in the whole matrix, or numbered from
+ * offsets into it -- and write its grid to a file for merging with those of
+ * the other shards (see draw_merge_images()). Unless the dimensions of the
+ * matrix are given (or a header gives them, without offsets), the grid
+ * discovers them as it goes, as a shard can not know them, and the merged
+ * image is approximate: the bins that straddle pixels are split between
+ * them. Giving every shard the dimensions maps each row/column straight to
+ * its pixel, and the merged image is the same as a draw of the whole
+ * matrix.
+ *
+ * @param filein The file to read.
+ * @param ftype The type of the file.
+ * @param funcs The functions to accumulate.
+ * @param nfuncs The number of functions.
+ * @param nx The width of the canvas.
+ * @param ny The height of the canvas.
+ * @param nrows The number of rows in the matrix (0 if unknown).
+ * @param ncols The number of columns in the matrix (0 if unknown).
+ * @param window The region of the matrix to draw (NULL for all of it).
+ * @param roffset The row of the matrix that the first row of the file is
+ * (see offset_matrix()).
+ * @param coffset The column of the matrix that the first column of the file
+ * is.
+ * @param useindex Whether to use (and build) the sidecar row index (not with
+ * offsets).
+ * @param fileout The file to write the accumulators to.
+ *
+ * @return 1 on success, 0 if the file could not be read or the accumulators
+ * could not be written.
+ */
+int draw_matrix_shard(
+    char const * filein,
+    filetype_t ftype,
+    functiontype_t const * funcs,
+    size_t nfuncs,
+    size_t nx,
+    size_t ny,
+    size_t nrows,
+    size_t ncols,
+    window_t const * window,
+    size_t roffset,
+    size_t coffset,
+    int useindex,
+    char const * fileout);
+
+
+/**
+ * @brief Draw several functions of a matrix, in several colorings, from the
+ * accumulators of its shards (written by draw_matrix_shard(), or saved with
+ * --state). The shards are read and then reduced in parallel, and must have
+ * been accumulated for the same functions, canvas, and region.
+ *
+ * @param shards The files holding the accumulators of the shards.
+ * @param nshards The number of shards.
+ * @param funcs The functions to draw.
+ * @param nfuncs The number of functions.
+ * @param ctypes The colorings to draw each function in.
+ * @param nctypes The number of colorings.
+ * @param nx The width of the images (0 for that of the shards).
+ * @param ny The height of the images (0 for that of the shards).
+ * @param nrows The number of rows in the matrix (0 if only the non-zeros of
+ * the shards give it).
+ * @param ncols The number of columns in the matrix (0 if only the non-zeros
+ * of the shards give it).
+ * @param imgs The nfuncs*nctypes images, with the colorings of the first
+ * function first.
+ *
+ * @return 1 on success, 0 if the shards could not be read or merged.
+ */
+int draw_merge_images(
+    char * const * shards,
+    size_t nshards,
+    functiontype_t const * funcs,
+    size_t nfuncs,
+    colortype_t const * ctypes,
+    size_t nctypes,
+    size_t nx,
+    size_t ny,
+    size_t nrows,
+    size_t ncols,
+    image_t ** imgs);
 
 
 
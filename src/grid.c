@@ -0,0 +1,1458 @@
+/**
+ * @file grid.c
+ * @brief Functions for accumulating non-zeros into pixels
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-04
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_GRID_C
+#define CLAIRVOYANCE_GRID_C
+
+
+
+
+#include "grid.h"
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+/* the output pixel a bin starts in, and the fraction of it that lands there
+ * (the rest lands in the next pixel) */
+typedef struct span_t {
+  size_t pix;
+  real_t frac;
+} span_t;
+
+
+
+
+/******************************************************************************
+* DOMLIB IMPORTS **************************************************************
+******************************************************************************/
+
+
+#define DLMEM_PREFIX grid
+#define DLMEM_TYPE_T grid_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX span
+#define DLMEM_TYPE_T span_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX sweep
+#define DLMEM_TYPE_T grid_sweep_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Determine how the bins of a grid for a set of functions start out.
+ *
+ * @param funcs The functions (a mask of grid_func()s).
+ *
+ * @return The type of the bins.
+ */
+static gridcell_t __cell_for(
+    unsigned int const funcs)
+{
+  if (funcs == grid_func(FUNCTION_DENSITY)) {
+    return GRID_CELL_COUNT32;
+  } else if (funcs == grid_func(FUNCTION_MAX)) {
+    return GRID_CELL_MAX;
+  } else if (funcs == grid_func(FUNCTION_AVERAGE)) {
+    return GRID_CELL_AVERAGE;
+  } else {
+    return GRID_CELL_PIXEL32;
+  }
+}
+
+
+/**
+ * @brief Combine a record into another (either of which may be empty). The
+ * caller makes sure that the count can not overflow.
+ *
+ * @param dst The record to combine into.
+ * @param n The count of the record to combine from.
+ * @param s The sum of the record to combine from.
+ * @param hi The maximum of the record to combine from.
+ */
+#define __combine_pixel(dst,n,s,hi) \
+  do { \
+    if ((n) > 0) { \
+      (dst)->max = (dst)->max < (hi) ? (hi) : (dst)->max; \
+      (dst)->sum += (s); \
+      (dst)->count += (n); \
+    } \
+  } while (0)
+
+
+/**
+ * @brief Copy bin s of src into bin d of dst, where both hold bins of the
+ * given type (and may be the same).
+ *
+ * @param cell The type of the bins.
+ * @param dst The bins to copy to.
+ * @param d The bin to copy to.
+ * @param src The bins to copy from.
+ * @param s The bin to copy from.
+ */
+static inline void __copy(
+    gridcell_t const cell,
+    void * const dst,
+    size_t const d,
+    void const * const src,
+    size_t const s)
+{
+  switch (cell) {
+    case GRID_CELL_COUNT32:
+      ((uint32_t*)dst)[d] = ((uint32_t const *)src)[s];
+      break;
+    case GRID_CELL_COUNT64:
+      ((uint64_t*)dst)[d] = ((uint64_t const *)src)[s];
+      break;
+    case GRID_CELL_MAX:
+      ((float*)dst)[d] = ((float const *)src)[s];
+      break;
+    case GRID_CELL_AVERAGE:
+      ((grid_avg_t*)dst)[d] = ((grid_avg_t const *)src)[s];
+      break;
+    case GRID_CELL_PIXEL32:
+      ((grid_pixel32_t*)dst)[d] = ((grid_pixel32_t const *)src)[s];
+      break;
+    case GRID_CELL_PIXEL64:
+      ((grid_pixel64_t*)dst)[d] = ((grid_pixel64_t const *)src)[s];
+      break;
+  }
+}
+
+
+/**
+ * @brief Combine bin s of src into bin d of dst, where both hold bins of the
+ * given type. The caller makes sure that counts can not overflow.
+ *
+ * @param cell The type of the bins.
+ * @param dst The bins to combine into.
+ * @param d The bin to combine into.
+ * @param src The bins to combine from.
+ * @param s The bin to combine from.
+ */
+static inline void __combine(
+    gridcell_t const cell,
+    void * const dst,
+    size_t const d,
+    void const * const src,
+    size_t const s)
+{
+  switch (cell) {
+    case GRID_CELL_COUNT32:
+      ((uint32_t*)dst)[d] += ((uint32_t const *)src)[s];
+      break;
+    case GRID_CELL_COUNT64:
+      ((uint64_t*)dst)[d] += ((uint64_t const *)src)[s];
+      break;
+    case GRID_CELL_MAX:
+      if (((float*)dst)[d] < ((float const *)src)[s]) {
+        ((float*)dst)[d] = ((float const *)src)[s];
+      }
+      break;
+    case GRID_CELL_AVERAGE:
+      ((grid_avg_t*)dst)[d].count += ((grid_avg_t const *)src)[s].count;
+      ((grid_avg_t*)dst)[d].sum += ((grid_avg_t const *)src)[s].sum;
+      break;
+    case GRID_CELL_PIXEL32: {
+      grid_pixel32_t const * const p = ((grid_pixel32_t const *)src)+s;
+      __combine_pixel(((grid_pixel32_t*)dst)+d,p->count,p->sum,p->max);
+      break;
+    }
+    case GRID_CELL_PIXEL64: {
+      grid_pixel64_t const * const p = ((grid_pixel64_t const *)src)+s;
+      __combine_pixel(((grid_pixel64_t*)dst)+d,p->count,p->sum,p->max);
+      break;
+    }
+  }
+}
+
+
+/**
+ * @brief Find the largest 32 bit count in a grid.
+ *
+ * @param grid The grid.
+ *
+ * @return The largest count (0 if the counts are not 32 bits).
+ */
+static uint64_t __max_count(
+    grid_t const * const grid)
+{
+  size_t i;
+  uint32_t max;
+  size_t const n = grid->nbrows*grid->nbcols;
+
+  max = 0;
+  switch (grid->cell) {
+    case GRID_CELL_COUNT32:
+      for (i=0;i<n;++i) {
+        max = dl_max(max,((uint32_t const *)grid->cells)[i]);
+      }
+      break;
+    case GRID_CELL_PIXEL32:
+      for (i=0;i<n;++i) {
+        max = dl_max(max,((grid_pixel32_t const *)grid->cells)[i].count);
+      }
+      break;
+    default:
+      break;
+  }
+
+  return (uint64_t)max;
+}
+
+
+/**
+ * @brief Bring two grids to the same type of bins, wide enough to hold the
+ * sum of any of their counts.
+ *
+ * @param a The first grid.
+ * @param b The second grid (may be the same as the first).
+ */
+static void __match_cells(
+    grid_t * const a,
+    grid_t * const b)
+{
+  if (a->cell != b->cell || \
+      __max_count(a) + __max_count(b) > (uint64_t)UINT32_MAX) {
+    grid_widen(a);
+    grid_widen(b);
+  }
+}
+
+
+/**
+ * @brief Add a run of non-zeros to a bin at once.
+ *
+ * @param grid The grid.
+ * @param idx The bin.
+ * @param count The number of non-zeros.
+ * @param sum The sum of their values.
+ * @param max The largest of their values (or zero).
+ */
+static inline void __add_bulk(
+    grid_t * const grid,
+    size_t const idx,
+    uint64_t const count,
+    real_t const sum,
+    real_t const max)
+{
+  if (count == 0) {
+    return;
+  }
+
+  switch (grid->cell) {
+    case GRID_CELL_MAX:
+      if (((float*)grid->cells)[idx] < (float)max) {
+        ((float*)grid->cells)[idx] = (float)max;
+      }
+      return;
+    case GRID_CELL_COUNT32:
+      if ((uint64_t)((uint32_t*)grid->cells)[idx] + count <= \
+          (uint64_t)UINT32_MAX) {
+        ((uint32_t*)grid->cells)[idx] += (uint32_t)count;
+        return;
+      }
+      break;
+    case GRID_CELL_PIXEL32:
+      if ((uint64_t)((grid_pixel32_t*)grid->cells)[idx].count + count <= \
+          (uint64_t)UINT32_MAX) {
+        __combine_pixel(((grid_pixel32_t*)grid->cells)+idx,(uint32_t)count, \
+            sum,(float)max);
+        return;
+      }
+      break;
+    default:
+      break;
+  }
+
+  /* the count does not fit in 32 bits (or already has 64) */
+  grid_widen(grid);
+
+  switch (grid->cell) {
+    case GRID_CELL_COUNT64:
+      ((uint64_t*)grid->cells)[idx] += count;
+      break;
+    case GRID_CELL_AVERAGE:
+      ((grid_avg_t*)grid->cells)[idx].count += count;
+      ((grid_avg_t*)grid->cells)[idx].sum += sum;
+      break;
+    case GRID_CELL_PIXEL64:
+      __combine_pixel(((grid_pixel64_t*)grid->cells)+idx,count,sum, \
+          (float)max);
+      break;
+    default:
+      break;
+  }
+}
+
+
+/**
+ * @brief Get what has been accumulated in a bin for a function.
+ *
+ * @param grid The grid.
+ * @param func The function.
+ * @param scale The factor to scale counts by.
+ * @param idx The bin.
+ * @param r_count The number of non-zeros in the bin (only set for averages).
+ *
+ * @return The scaled count, maximum, or sum of the bin.
+ */
+static inline real_t __cell_value(
+    grid_t const * const grid,
+    functiontype_t const func,
+    real_t const scale,
+    size_t const idx,
+    real_t * const r_count)
+{
+  switch (grid->cell) {
+    case GRID_CELL_COUNT32:
+      return scale*((uint32_t const *)grid->cells)[idx];
+    case GRID_CELL_COUNT64:
+      return scale*((uint64_t const *)grid->cells)[idx];
+    case GRID_CELL_MAX:
+      return ((float const *)grid->cells)[idx];
+    case GRID_CELL_AVERAGE:
+      *r_count = (real_t)((grid_avg_t const *)grid->cells)[idx].count;
+      return ((grid_avg_t const *)grid->cells)[idx].sum;
+    case GRID_CELL_PIXEL32: {
+      grid_pixel32_t const * const cell = \
+          ((grid_pixel32_t const *)grid->cells)+idx;
+      switch (func) {
+        case FUNCTION_DENSITY:
+          return scale*cell->count;
+        case FUNCTION_MAX:
+          return cell->max;
+        default:
+          *r_count = cell->count;
+          return cell->sum;
+      }
+    }
+    default: {
+      grid_pixel64_t const * const cell = \
+          ((grid_pixel64_t const *)grid->cells)+idx;
+      switch (func) {
+        case FUNCTION_DENSITY:
+          return scale*(real_t)cell->count;
+        case FUNCTION_MAX:
+          return cell->max;
+        default:
+          *r_count = (real_t)cell->count;
+          return cell->sum;
+      }
+    }
+  }
+}
+
+
+/**
+ * @brief Determine the smallest block size (as a shift) that fits n matrix
+ * rows/columns in maxbins bins.
+ *
+ * @param n The number of rows/columns.
+ * @param maxbins The maximum number of bins.
+ *
+ * @return The shift.
+ */
+static size_t __shift_for(
+    size_t const n,
+    size_t const maxbins)
+{
+  size_t shift = 0;
+
+  while (n > 0 && ((n-1) >> shift) >= maxbins) {
+    ++shift;
+  }
+
+  return shift;
+}
+
+
+/**
+ * @brief Count the non-zero values in a run. The run is split between four
+ * independent accumulators so the loop can be vectorized.
+ *
+ * @param vals The values.
+ * @param n The number of values.
+ *
+ * @return The number of non-zeros.
+ */
+static inline size_t __run_count(
+    real_t const * const vals,
+    size_t const n)
+{
+  size_t k, c0, c1, c2, c3;
+
+  c0 = c1 = c2 = c3 = 0;
+  for (k=0;k+4<=n;k+=4) {
+    c0 += vals[k] != 0;
+    c1 += vals[k+1] != 0;
+    c2 += vals[k+2] != 0;
+    c3 += vals[k+3] != 0;
+  }
+  for (;k<n;++k) {
+    c0 += vals[k] != 0;
+  }
+
+  return c0+c1+c2+c3;
+}
+
+
+static inline real_t __run_sum(
+    real_t const * const vals,
+    size_t const n)
+{
+  size_t k;
+  real_t s0, s1, s2, s3;
+
+  s0 = s1 = s2 = s3 = 0;
+  for (k=0;k+4<=n;k+=4) {
+    s0 += vals[k];
+    s1 += vals[k+1];
+    s2 += vals[k+2];
+    s3 += vals[k+3];
+  }
+  for (;k<n;++k) {
+    s0 += vals[k];
+  }
+
+  return (s0+s1)+(s2+s3);
+}
+
+
+static inline real_t __run_max(
+    real_t const * const vals,
+    size_t const n)
+{
+  size_t k;
+  real_t m0, m1, m2, m3;
+
+  /* zeros never raise a bin above its initial value of zero */
+  m0 = m1 = m2 = m3 = 0;
+  for (k=0;k+4<=n;k+=4) {
+    m0 = vals[k] > m0 ? vals[k] : m0;
+    m1 = vals[k+1] > m1 ? vals[k+1] : m1;
+    m2 = vals[k+2] > m2 ? vals[k+2] : m2;
+    m3 = vals[k+3] > m3 ? vals[k+3] : m3;
+  }
+  for (;k<n;++k) {
+    m0 = vals[k] > m0 ? vals[k] : m0;
+  }
+  m0 = m1 > m0 ? m1 : m0;
+  m2 = m3 > m2 ? m3 : m2;
+
+  return m2 > m0 ? m2 : m0;
+}
+
+
+static void __resize(
+    grid_t * const grid,
+    size_t const nbrows,
+    size_t const nbcols)
+{
+  size_t r, mr, mc;
+  char * cells;
+  size_t const size = grid_cell_size(grid);
+
+  cells = char_calloc(dl_max(nbrows*nbcols,1)*size);
+  mr = dl_min(nbrows,grid->nbrows);
+  mc = dl_min(nbcols,grid->nbcols);
+  for (r=0;r<mr;++r) {
+    memcpy(cells+(r*nbcols*size), \
+        ((char const *)grid->cells)+(r*grid->nbcols*size),mc*size);
+  }
+
+  if (grid->cells) {
+    dl_free(grid->cells);
+  }
+  grid->cells = cells;
+  grid->nbrows = nbrows;
+  grid->nbcols = nbcols;
+}
+
+
+static void __merge_rows(
+    grid_t * const grid)
+{
+  size_t r, c;
+  size_t const nbcols = grid->nbcols;
+  size_t const nbrows = (grid->nbrows+1)/2;
+
+  /* every merged bin holds the counts of two */
+  __match_cells(grid,grid);
+
+  for (r=0;r<nbrows;++r) {
+    for (c=0;c<nbcols;++c) {
+      __copy(grid->cell,grid->cells,(r*nbcols)+c,grid->cells, \
+          (2*r*nbcols)+c);
+    }
+    if (2*r+1 < grid->nbrows) {
+      for (c=0;c<nbcols;++c) {
+        __combine(grid->cell,grid->cells,(r*nbcols)+c,grid->cells, \
+            ((2*r+1)*nbcols)+c);
+      }
+    }
+  }
+
+  grid->nbrows = nbrows;
+  ++grid->rshift;
+}
+
+
+static void __merge_cols(
+    grid_t * const grid)
+{
+  size_t r, c;
+  size_t const onbcols = grid->nbcols;
+  size_t const nbcols = (onbcols+1)/2;
+
+  __match_cells(grid,grid);
+
+  /* the destination of each bin is never past its sources, so we can merge
+   * in place */
+  for (r=0;r<grid->nbrows;++r) {
+    for (c=0;c<nbcols;++c) {
+      __copy(grid->cell,grid->cells,(r*nbcols)+c,grid->cells, \
+          (r*onbcols)+(2*c));
+      if (2*c+1 < onbcols) {
+        __combine(grid->cell,grid->cells,(r*nbcols)+c,grid->cells, \
+            (r*onbcols)+(2*c)+1);
+      }
+    }
+  }
+
+  grid->nbcols = nbcols;
+  ++grid->cshift;
+}
+
+
+/**
+ * @brief Map the rows/columns of a grid straight to pixels, without
+ * allocating its bins.
+ *
+ * @param grid The grid (with its dimensions set).
+ * @param prows The number of rows of pixels.
+ * @param pcols The number of columns of pixels.
+ */
+static void __cut(
+    grid_t * const grid,
+    size_t const prows,
+    size_t const pcols)
+{
+  DL_ASSERT(grid->nrows > 0 && grid->ncols > 0,"Cutting a grid of unknown " \
+      "dimensions\n");
+  DL_ASSERT(prows <= grid->nrows && pcols <= grid->ncols,"Cutting a grid " \
+      "into more pixels than rows/columns\n");
+
+  grid->prows = prows;
+  grid->pcols = pcols;
+  grid->rscale = prows / (double)grid->nrows;
+  grid->cscale = pcols / (double)grid->ncols;
+  grid->rshift = 0;
+  grid->cshift = 0;
+}
+
+
+/**
+ * @brief Get the first matrix row/column in a row/column of bins.
+ *
+ * @param b The row/column of bins.
+ * @param n The number of matrix rows/columns.
+ * @param shift The log2 of the rows/columns (or pixels) per bin.
+ * @param exact The number of pixels the rows/columns are mapped straight to
+ * (0 if bins hold rows/columns).
+ *
+ * @return The first row/column (n if the bin is past the end).
+ */
+static size_t __bin_start(
+    size_t const b,
+    size_t const n,
+    size_t const shift,
+    size_t const exact)
+{
+  size_t const first = b << shift;
+
+  if (exact > 0) {
+    /* the first row/column i with i*exact/n >= first */
+    return first >= exact ? n : ((first*n)+exact-1)/exact;
+  } else {
+    return dl_min(first,n);
+  }
+}
+
+
+/**
+ * @brief Build the table of which pixels each bin lands in.
+ *
+ * @param n The number of matrix rows/columns.
+ * @param shift The log2 of the rows/columns (or pixels) per bin.
+ * @param exact The number of pixels the rows/columns are mapped straight to
+ * (0 if bins hold rows/columns).
+ * @param nbins The number of bins.
+ * @param npix The number of pixels.
+ *
+ * @return The table of spans.
+ */
+static span_t * __build_spans(
+    size_t const n,
+    size_t const shift,
+    size_t const exact,
+    size_t const nbins,
+    size_t const npix)
+{
+  size_t b, start, end, bound;
+  span_t * spans;
+
+  spans = span_alloc(dl_max(nbins,1));
+
+  for (b=0;b<nbins;++b) {
+    start = __bin_start(b,n,shift,exact);
+    end = __bin_start(b+1,n,shift,exact);
+    spans[b].pix = (start*npix)/n;
+    spans[b].frac = 1.0;
+    /* split the bin by how many of its rows/columns fall into each pixel */
+    bound = (((spans[b].pix+1)*n)+npix-1)/npix;
+    if (bound < end) {
+      spans[b].frac = (bound-start) / (real_t)(end-start);
+    }
+  }
+
+  return spans;
+}
+
+
+
+/**
+ * @brief Add the rows of bins [rstart,rend) of a grid to the pixels they land
+ * in.
+ *
+ * @param grid The grid holding the bins (which may be a band of them).
+ * @param func The function being drawn.
+ * @param scale The factor to scale counts by.
+ * @param rspans The pixel rows each row of bins lands in.
+ * @param cspans The pixel columns each column of bins lands in.
+ * @param rstart The first row of bins.
+ * @param rend One past the last row of bins.
+ * @param nbc The number of columns of bins in use.
+ * @param x The width of the canvas.
+ * @param pstart The pixel row that out and counts start at.
+ * @param out The pixels.
+ * @param counts The number of non-zeros in each pixel (NULL unless drawing
+ * averages).
+ */
+static void __add_bins(
+    grid_t const * const grid,
+    functiontype_t const func,
+    real_t const scale,
+    span_t const * const rspans,
+    span_t const * const cspans,
+    size_t const rstart,
+    size_t const rend,
+    size_t const nbc,
+    size_t const x,
+    size_t const pstart,
+    real_t * const out,
+    real_t * const counts)
+{
+  size_t r, c, pr, pc, idx;
+  real_t v, n, wr;
+
+  for (r=rstart;r<rend;++r) {
+    for (c=0;c<nbc;++c) {
+      n = 0;
+      v = __cell_value(grid,func,scale, \
+          ((r-grid->broffset)*grid->nbcols)+c,&n);
+      if (v == 0 && n == 0) {
+        continue;
+      }
+      if (func == FUNCTION_MAX) {
+        /* a max cannot be split, so it only goes to the pixel that most of
+         * the bin lands in, rather than spreading to its neighbors */
+        pr = rspans[r].frac >= 0.5 ? 0 : 1;
+        pc = cspans[c].frac >= 0.5 ? 0 : 1;
+        idx = ((rspans[r].pix+pr-pstart)*x) + cspans[c].pix + pc;
+        out[idx] = dl_max(out[idx],v);
+        continue;
+      }
+      for (pr=0;pr<2;++pr) {
+        wr = pr == 0 ? rspans[r].frac : 1.0 - rspans[r].frac;
+        if (wr <= 0) {
+          continue;
+        }
+        for (pc=0;pc<2;++pc) {
+          real_t const w = wr * \
+              (pc == 0 ? cspans[c].frac : 1.0 - cspans[c].frac);
+          idx = ((rspans[r].pix+pr-pstart)*x) + cspans[c].pix + pc;
+          if (w <= 0) {
+            continue;
+          }
+          out[idx] += v*w;
+          if (counts) {
+            counts[idx] += n*w;
+          }
+        }
+      }
+    }
+  }
+}
+
+
+/**
+ * @brief Turn the sums of pixels into averages.
+ *
+ * @param out The pixels.
+ * @param counts The number of non-zeros in each pixel.
+ * @param n The number of pixels.
+ */
+static void __divide(
+    real_t * const out,
+    real_t const * const counts,
+    size_t const n)
+{
+  size_t i;
+
+  for (i=0;i<n;++i) {
+    if (counts[i] > 0) {
+      out[i] /= counts[i];
+    }
+  }
+}
+
+
+/**
+ * @brief Make sure a sweep holds at least the given number of pixel rows
+ * (from its first row not yet handed out), clearing any new ones.
+ *
+ * @param sweep The sweep.
+ * @param nrows The number of pixel rows.
+ */
+static void __hold_rows(
+    grid_sweep_t * const sweep,
+    size_t const nrows)
+{
+  size_t const x = sweep->x;
+
+  if (nrows <= sweep->held) {
+    return;
+  }
+
+  if (nrows > sweep->maxheld) {
+    sweep->maxheld = dl_max(nrows,2*sweep->maxheld);
+    sweep->out = real_realloc(sweep->out,sweep->maxheld*x);
+    if (sweep->counts) {
+      sweep->counts = real_realloc(sweep->counts,sweep->maxheld*x);
+    }
+  }
+
+  memset(sweep->out+(sweep->held*x),0,(nrows-sweep->held)*x*sizeof(real_t));
+  if (sweep->counts) {
+    memset(sweep->counts+(sweep->held*x),0, \
+        (nrows-sweep->held)*x*sizeof(real_t));
+  }
+
+  sweep->held = nrows;
+}
+
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+grid_t * grid_create(
+    size_t const nx,
+    size_t const ny,
+    size_t const nrows,
+    size_t const ncols,
+    unsigned int const funcs)
+{
+  grid_t * const grid = grid_calloc(1);
+
+  DL_ASSERT(funcs != 0,"Creating a grid without any functions\n");
+
+  grid->funcs = funcs;
+  grid->cell = __cell_for(funcs);
+  grid->cells = NULL;
+  grid->scale = 1.0;
+  grid->nx = nx;
+  grid->ny = ny;
+  grid->nrows = nrows;
+  grid->ncols = ncols;
+  grid->maxbrows = GRID_FINE_FACTOR*ny;
+  grid->maxbcols = GRID_FINE_FACTOR*nx;
+  grid->rshift = __shift_for(nrows,grid->maxbrows);
+  grid->cshift = __shift_for(ncols,grid->maxbcols);
+  grid->prows = 0;
+  grid->pcols = 0;
+  grid->broffset = 0;
+
+  if (nrows > 0 && ncols > 0) {
+    /* we know how big we are */
+    __resize(grid,((nrows-1) >> grid->rshift)+1,((ncols-1) >> grid->cshift)+1);
+  }
+
+  return grid;
+}
+
+
+grid_t * grid_create_exact(
+    size_t const nx,
+    size_t const ny,
+    size_t const nrows,
+    size_t const ncols,
+    unsigned int const funcs)
+{
+  grid_t * grid;
+
+  DL_ASSERT(nrows > 0 && ncols > 0,"Exact grids need the dimensions of the " \
+      "matrix\n");
+
+  grid = grid_create(nx,ny,0,0,funcs);
+
+  grid->nrows = nrows;
+  grid->ncols = ncols;
+  __cut(grid,dl_max(dl_min(ny,nrows),1),dl_max(dl_min(nx,ncols),1));
+  __resize(grid,grid->prows,grid->pcols);
+
+  return grid;
+}
+
+
+grid_t * grid_create_like(
+    grid_t const * const grid)
+{
+  DL_ASSERT(grid->broffset == 0,"Cannot copy a band of rows\n");
+
+  if (grid->prows > 0) {
+    return grid_create_exact(grid->nx,grid->ny,grid->nrows,grid->ncols, \
+        grid->funcs);
+  } else {
+    return grid_create(grid->nx,grid->ny,grid->nrows,grid->ncols,grid->funcs);
+  }
+}
+
+
+grid_t * grid_create_band(
+    size_t const nx,
+    size_t const ny,
+    size_t const nrows,
+    size_t const ncols,
+    unsigned int const funcs,
+    int const exact,
+    size_t const rstart,
+    size_t const rend)
+{
+  grid_t * grid;
+
+  DL_ASSERT(rstart < rend && rend <= nrows,"Bad band [%zu,%zu) of %zu rows\n", \
+      rstart,rend,nrows);
+
+  if (exact) {
+    grid = grid_create(nx,ny,0,0,funcs);
+    grid->nrows = nrows;
+    grid->ncols = ncols;
+    __cut(grid,dl_max(dl_min(ny,nrows),1),dl_max(dl_min(nx,ncols),1));
+  } else {
+    grid = grid_create(nx,ny,0,ncols,funcs);
+    grid->nrows = nrows;
+    grid->rshift = __shift_for(nrows,grid->maxbrows);
+  }
+
+  grid->broffset = grid_brow(grid,rstart);
+
+  __resize(grid,grid_brow(grid,rend-1)-grid->broffset+1, \
+      ncols > 0 ? grid_bcol(grid,ncols-1)+1 : 0);
+
+  return grid;
+}
+
+
+void grid_grow(
+    grid_t * const grid,
+    size_t const i,
+    size_t const j)
+{
+  size_t need;
+
+  if (grid->prows > 0 && (i >= grid->nrows || j >= grid->ncols)) {
+    dl_error("Non-zero (%zu,%zu) is outside of the %zux%zu matrix\n",i,j, \
+        grid->nrows,grid->ncols);
+  }
+
+  /* rows */
+  if (grid_brow(grid,i) >= grid->nbrows + grid->broffset) {
+    DL_ASSERT(grid->broffset == 0,"Cannot grow a band of rows\n");
+    while (grid_brow(grid,i) >= grid->maxbrows) {
+      __merge_rows(grid);
+    }
+    need = grid_brow(grid,i)+1;
+    need = dl_max(need,dl_min(2*grid->nbrows,grid->maxbrows));
+    __resize(grid,need,grid->nbcols);
+  }
+
+  /* columns */
+  if (grid_bcol(grid,j) >= grid->nbcols) {
+    while (grid_bcol(grid,j) >= grid->maxbcols) {
+      __merge_cols(grid);
+    }
+    need = grid_bcol(grid,j)+1;
+    need = dl_max(need,dl_min(2*grid->nbcols,grid->maxbcols));
+    __resize(grid,grid->nbrows,need);
+  }
+}
+
+
+void grid_coarsen(
+    grid_t * const grid,
+    size_t const nx,
+    size_t const ny)
+{
+  DL_ASSERT(grid->broffset == 0,"Cannot coarsen a band of rows\n");
+
+  grid->nx = nx;
+  grid->ny = ny;
+  grid->maxbrows = GRID_FINE_FACTOR*ny;
+  grid->maxbcols = GRID_FINE_FACTOR*nx;
+
+  /* only the bins in use count, as more may have been allocated ahead of
+   * the matrix growing into them */
+  while (grid->nrows > 0 && grid_brow(grid,grid->nrows-1) >= \
+      grid->maxbrows) {
+    __merge_rows(grid);
+  }
+  while (grid->ncols > 0 && grid_bcol(grid,grid->ncols-1) >= \
+      grid->maxbcols) {
+    __merge_cols(grid);
+  }
+  if (grid->nbrows > grid->maxbrows || grid->nbcols > grid->maxbcols) {
+    __resize(grid,dl_min(grid->nbrows,grid->maxbrows), \
+        dl_min(grid->nbcols,grid->maxbcols));
+  }
+}
+
+
+void grid_widen(
+    grid_t * const grid)
+{
+  size_t i;
+  void * cells;
+  size_t const n = grid->nbrows*grid->nbcols;
+
+  switch (grid->cell) {
+    case GRID_CELL_COUNT32: {
+      uint32_t const * const old = (uint32_t const *)grid->cells;
+      uint64_t * const wide = (uint64_t*)char_alloc(dl_max(n,1)* \
+          sizeof(uint64_t));
+      for (i=0;i<n;++i) {
+        wide[i] = old[i];
+      }
+      cells = wide;
+      grid->cell = GRID_CELL_COUNT64;
+      break;
+    }
+    case GRID_CELL_PIXEL32: {
+      grid_pixel32_t const * const old = (grid_pixel32_t const *)grid->cells;
+      grid_pixel64_t * const wide = (grid_pixel64_t*)char_alloc( \
+          dl_max(n,1)*sizeof(grid_pixel64_t));
+      for (i=0;i<n;++i) {
+        wide[i].count = old[i].count;
+        wide[i].sum = old[i].sum;
+        wide[i].max = old[i].max;
+      }
+      cells = wide;
+      grid->cell = GRID_CELL_PIXEL64;
+      break;
+    }
+    default:
+      return;
+  }
+
+  if (grid->cells) {
+    dl_free(grid->cells);
+  }
+  grid->cells = cells;
+}
+
+
+void grid_add_run(
+    grid_t * const grid,
+    size_t const i,
+    size_t const j,
+    real_t const * const vals,
+    size_t const n)
+{
+  size_t k, c, len, row;
+
+  if (n == 0) {
+    return;
+  }
+
+  /* cover the whole run up front, so the bins stay put while we fill them */
+  if (grid_brow(grid,i) - grid->broffset >= grid->nbrows || \
+      grid_bcol(grid,j+n-1) >= grid->nbcols) {
+    grid_grow(grid,i,j+n-1);
+  }
+  grid->nrows = dl_max(grid->nrows,i+1);
+  grid->ncols = dl_max(grid->ncols,j+n);
+
+  row = (grid_brow(grid,i) - grid->broffset)*grid->nbcols;
+  for (k=0;k<n;k+=len) {
+    c = grid_bcol(grid,j+k);
+    len = dl_min(__bin_start(c+1,grid->ncols,grid->cshift,grid->pcols) - \
+        (j+k),n-k);
+    if (grid->cell == GRID_CELL_COUNT32 || grid->cell == GRID_CELL_COUNT64) {
+      __add_bulk(grid,row+c,__run_count(vals+k,len),0,0);
+    } else {
+      /* every function is reduced from the same pass over the run */
+      __add_bulk(grid,row+c,__run_count(vals+k,len),__run_sum(vals+k,len), \
+          __run_max(vals+k,len));
+    }
+  }
+}
+
+
+void grid_add_points(
+    grid_t * const grid,
+    size_t const * const rows,
+    size_t const * const cols,
+    real_t const * const vals,
+    size_t const n)
+{
+  size_t k, maxi, maxj;
+
+  if (n == 0) {
+    return;
+  }
+
+  /* cover every point up front, so the bins stay put while we fill them */
+  maxi = maxj = 0;
+  for (k=0;k<n;++k) {
+    maxi = dl_max(maxi,rows[k]);
+    maxj = dl_max(maxj,cols[k]);
+  }
+  if (grid_brow(grid,maxi) - grid->broffset >= grid->nbrows || \
+      grid_bcol(grid,maxj) >= grid->nbcols) {
+    grid_grow(grid,maxi,maxj);
+  }
+  grid->nrows = dl_max(grid->nrows,maxi+1);
+  grid->ncols = dl_max(grid->ncols,maxj+1);
+
+  if (vals == NULL) {
+    for (k=0;k<n;++k) {
+      grid_accumulate(grid,grid_bin(grid,rows[k],cols[k]),1.0);
+    }
+  } else {
+    for (k=0;k<n;++k) {
+      grid_accumulate(grid,grid_bin(grid,rows[k],cols[k]),vals[k]);
+    }
+  }
+}
+
+
+void grid_merge(
+    grid_t * const dst,
+    grid_t * const src)
+{
+  size_t r, c, dr;
+
+  DL_ASSERT(dst->rshift == src->rshift && dst->prows == src->prows && \
+      dst->pcols == src->pcols,"Merging grids with different bins\n");
+  DL_ASSERT(src->broffset >= dst->broffset && src->broffset+src->nbrows <= \
+      dst->broffset+dst->nbrows,"Destination grid does not cover the source " \
+      "rows\n");
+
+  /* bring both grids to the same column bins */
+  while (src->cshift < dst->cshift) {
+    __merge_cols(src);
+  }
+  while (dst->cshift < src->cshift) {
+    __merge_cols(dst);
+  }
+  if (src->nbcols > dst->nbcols) {
+    __resize(dst,dst->nbrows,src->nbcols);
+  }
+  __match_cells(dst,src);
+
+  DL_ASSERT(dst->funcs == src->funcs,"Merging grids of different " \
+      "functions\n");
+
+  for (r=0;r<src->nbrows;++r) {
+    dr = r + src->broffset - dst->broffset;
+    for (c=0;c<src->nbcols;++c) {
+      __combine(dst->cell,dst->cells,(dr*dst->nbcols)+c,src->cells, \
+          (r*src->nbcols)+c);
+    }
+  }
+
+  dst->nrows = dl_max(dst->nrows,src->nrows);
+  dst->ncols = dl_max(dst->ncols,src->ncols);
+}
+
+
+void grid_reduce(
+    grid_t * const dst,
+    grid_t * const * const srcs,
+    size_t const nsrcs)
+{
+  size_t s, r, rshift, cshift, nbrows, nbcols;
+  int wide;
+  uint64_t total;
+
+  DL_ASSERT(dst->broffset == 0,"Cannot reduce into a band of rows\n");
+
+  /* find the coarsest bins */
+  rshift = dst->rshift;
+  cshift = dst->cshift;
+  for (s=0;s<nsrcs;++s) {
+    DL_ASSERT(srcs[s]->broffset == 0,"Cannot reduce a band of rows\n");
+    DL_ASSERT(srcs[s]->prows == dst->prows && srcs[s]->pcols == dst->pcols, \
+        "Reducing grids with different pixels\n");
+    rshift = dl_max(rshift,srcs[s]->rshift);
+    cshift = dl_max(cshift,srcs[s]->cshift);
+  }
+
+  /* bring every grid to them */
+  nbrows = nbcols = 0;
+  for (s=0;s<=nsrcs;++s) {
+    grid_t * const grid = s < nsrcs ? srcs[s] : dst;
+    while (grid->rshift < rshift) {
+      __merge_rows(grid);
+    }
+    while (grid->cshift < cshift) {
+      __merge_cols(grid);
+    }
+    nbrows = dl_max(nbrows,grid->nbrows);
+    nbcols = dl_max(nbcols,grid->nbcols);
+  }
+  if (nbrows > dst->nbrows || nbcols > dst->nbcols) {
+    __resize(dst,nbrows,nbcols);
+  }
+
+  /* and to the same bins, wide enough for the sum of their counts */
+  wide = 0;
+  total = __max_count(dst);
+  for (s=0;s<nsrcs;++s) {
+    DL_ASSERT(srcs[s]->funcs == dst->funcs,"Reducing grids of different " \
+        "functions\n");
+    wide = wide || srcs[s]->cell != dst->cell;
+    total += __max_count(srcs[s]);
+  }
+  if (wide || total > (uint64_t)UINT32_MAX) {
+    grid_widen(dst);
+    for (s=0;s<nsrcs;++s) {
+      grid_widen(srcs[s]);
+    }
+  }
+
+  /* each row of bins is independent */
+  #pragma omp parallel for schedule(static)
+  for (r=0;r<dst->nbrows;++r) {
+    size_t i, c;
+    for (i=0;i<nsrcs;++i) {
+      grid_t const * const src = srcs[i];
+      if (r >= src->nbrows) {
+        continue;
+      }
+      for (c=0;c<src->nbcols;++c) {
+        __combine(dst->cell,dst->cells,(r*dst->nbcols)+c,src->cells, \
+            (r*src->nbcols)+c);
+      }
+    }
+  }
+
+  for (s=0;s<nsrcs;++s) {
+    dst->nrows = dl_max(dst->nrows,srcs[s]->nrows);
+    dst->ncols = dl_max(dst->ncols,srcs[s]->ncols);
+  }
+}
+
+
+void grid_align(
+    grid_t * const grid,
+    size_t const rshift,
+    size_t const cshift,
+    size_t const nbrows,
+    size_t const nbcols)
+{
+  DL_ASSERT(grid->broffset == 0,"Cannot align a band of rows\n");
+
+  while (grid->rshift < rshift) {
+    __merge_rows(grid);
+  }
+  while (grid->cshift < cshift) {
+    __merge_cols(grid);
+  }
+  if (nbrows > grid->nbrows || nbcols > grid->nbcols) {
+    __resize(grid,dl_max(nbrows,grid->nbrows),dl_max(nbcols,grid->nbcols));
+  }
+}
+
+
+uint64_t grid_max_count(
+    grid_t const * const grid)
+{
+  return __max_count(grid);
+}
+
+
+void grid_combine_bins(
+    gridcell_t const cell,
+    void * const dst,
+    void const * const src,
+    size_t const n)
+{
+  size_t i;
+
+  for (i=0;i<n;++i) {
+    __combine(cell,dst,i,src,i);
+  }
+}
+
+
+void grid_scale(
+    grid_t * const grid,
+    real_t const scale)
+{
+  /* the counts may not fit in their bins once scaled, so it is applied when
+   * they are read out */
+  grid->scale *= scale;
+}
+
+
+real_t * grid_finalize(
+    grid_t const * const grid,
+    functiontype_t const func,
+    size_t * const r_x,
+    size_t * const r_y)
+{
+  size_t x, y, nbr, nbc;
+  real_t scale;
+  real_t * out, * counts;
+  span_t * rspans, * cspans;
+
+  if (!(grid->funcs & grid_func(func))) {
+    dl_error("Grid does not accumulate function '%d'\n",(int)func);
+  }
+
+  /* only counts are scaled */
+  scale = func == FUNCTION_DENSITY ? grid->scale : 1.0;
+
+  x = dl_max(dl_min(grid->nx,grid->ncols),1);
+  y = dl_max(dl_min(grid->ny,grid->nrows),1);
+
+  out = real_calloc(x*y);
+  /* averages are the sum of each pixel over its count */
+  counts = func == FUNCTION_AVERAGE ? real_calloc(x*y) : NULL;
+
+  nbr = grid->nrows > 0 ? grid_brow(grid,grid->nrows-1)+1 : 0;
+  nbc = grid->ncols > 0 ? grid_bcol(grid,grid->ncols-1)+1 : 0;
+  nbr = dl_min(nbr,grid->nbrows);
+  nbc = dl_min(nbc,grid->nbcols);
+
+  rspans = __build_spans(grid->nrows,grid->rshift,grid->prows,nbr,y);
+  cspans = __build_spans(grid->ncols,grid->cshift,grid->pcols,nbc,x);
+
+  __add_bins(grid,func,scale,rspans,cspans,0,nbr,nbc,x,0,out,counts);
+
+  if (func == FUNCTION_AVERAGE) {
+    __divide(out,counts,x*y);
+  }
+  if (counts) {
+    dl_free(counts);
+  }
+
+  dl_free(rspans);
+  dl_free(cspans);
+
+  *r_x = x;
+  *r_y = y;
+
+  return out;
+}
+
+
+grid_sweep_t * grid_sweep_create(
+    size_t const nx,
+    size_t const ny,
+    size_t const nrows,
+    size_t const ncols,
+    functiontype_t const func,
+    int const exact)
+{
+  grid_sweep_t * const sweep = sweep_calloc(1);
+
+  sweep->func = func;
+  sweep->nrows = nrows;
+  sweep->ncols = ncols;
+  sweep->x = dl_max(dl_min(nx,ncols),1);
+  sweep->y = dl_max(dl_min(ny,nrows),1);
+
+  /* the same bins as a grid of the whole matrix */
+  if (exact) {
+    sweep->rshift = sweep->cshift = 0;
+    sweep->prows = sweep->nbrows = sweep->y;
+    sweep->pcols = sweep->nbcols = sweep->x;
+  } else {
+    sweep->rshift = __shift_for(nrows,GRID_FINE_FACTOR*ny);
+    sweep->cshift = __shift_for(ncols,GRID_FINE_FACTOR*nx);
+    sweep->prows = sweep->pcols = 0;
+    sweep->nbrows = nrows > 0 ? ((nrows-1) >> sweep->rshift)+1 : 0;
+    sweep->nbcols = ncols > 0 ? ((ncols-1) >> sweep->cshift)+1 : 0;
+  }
+
+  sweep->rspans = __build_spans(nrows,sweep->rshift,sweep->prows, \
+      sweep->nbrows,sweep->y);
+  sweep->cspans = __build_spans(ncols,sweep->cshift,sweep->pcols, \
+      sweep->nbcols,sweep->x);
+
+  sweep->maxheld = 1;
+  sweep->out = real_alloc(sweep->x);
+  sweep->counts = func == FUNCTION_AVERAGE ? real_alloc(sweep->x) : NULL;
+
+  return sweep;
+}
+
+
+size_t grid_sweep_row(
+    grid_sweep_t const * const sweep,
+    size_t const b)
+{
+  return __bin_start(b,sweep->nrows,sweep->rshift,sweep->prows);
+}
+
+
+size_t grid_sweep(
+    grid_sweep_t * const sweep,
+    grid_t const * const band,
+    real_t ** const r_out)
+{
+  size_t rend, last, finish;
+  real_t scale;
+  size_t const x = sweep->x;
+
+  /* drop the rows handed out by the last call */
+  if (sweep->nout > 0) {
+    sweep->held -= sweep->nout;
+    memmove(sweep->out,sweep->out+(sweep->nout*x), \
+        sweep->held*x*sizeof(real_t));
+    if (sweep->counts) {
+      memmove(sweep->counts,sweep->counts+(sweep->nout*x), \
+          sweep->held*x*sizeof(real_t));
+    }
+    sweep->done += sweep->nout;
+    sweep->nout = 0;
+  }
+
+  if (band) {
+    if (!(band->funcs & grid_func(sweep->func))) {
+      dl_error("Grid does not accumulate function '%d'\n",(int)sweep->func);
+    }
+    DL_ASSERT(band->broffset == sweep->next && \
+        band->rshift == sweep->rshift && band->cshift == sweep->cshift && \
+        band->prows == sweep->prows && band->pcols == sweep->pcols, \
+        "Band of bins at row %zu does not follow row %zu\n", \
+        band->broffset,sweep->next);
+
+    rend = dl_min(sweep->next+band->nbrows,sweep->nbrows);
+    if (rend > sweep->next) {
+      /* a row of bins lands in the row of pixels it starts in, and maybe the
+       * one after it */
+      last = dl_min(sweep->rspans[rend-1].pix+2,sweep->y);
+      __hold_rows(sweep,last-sweep->done);
+
+      scale = sweep->func == FUNCTION_DENSITY ? band->scale : 1.0;
+      __add_bins(band,sweep->func,scale,sweep->rspans,sweep->cspans, \
+          sweep->next,rend,dl_min(sweep->nbcols,band->nbcols),x,sweep->done, \
+          sweep->out,sweep->counts);
+      sweep->next = rend;
+    }
+  }
+
+  /* the rows of pixels before the first one the next band can land in */
+  if (band == NULL || sweep->next >= sweep->nbrows) {
+    finish = sweep->y;
+  } else {
+    finish = sweep->rspans[sweep->next].pix;
+  }
+  __hold_rows(sweep,finish-sweep->done);
+
+  sweep->nout = finish-sweep->done;
+  if (sweep->func == FUNCTION_AVERAGE) {
+    __divide(sweep->out,sweep->counts,sweep->nout*x);
+  }
+
+  *r_out = sweep->out;
+
+  return sweep->nout;
+}
+
+
+void grid_sweep_free(
+    grid_sweep_t * const sweep)
+{
+  dl_free(sweep->rspans);
+  dl_free(sweep->cspans);
+  dl_free(sweep->out);
+  if (sweep->counts) {
+    dl_free(sweep->counts);
+  }
+  dl_free(sweep);
+}
+
+
+void grid_free(
+    grid_t * grid)
+{
+  if (grid->cells) {
+    dl_free(grid->cells);
+  }
+  dl_free(grid);
+}
+
+
+
+
+#endif
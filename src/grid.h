@@ -0,0 +1,808 @@
+/**
+ * @file grid.h
+ * @brief Pixel accumulation grid types and function prototypes
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-04
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_GRID_H
+#define CLAIRVOYANCE_GRID_H
+
+
+
+
+#include "base.h"
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* the number of bins per output pixel (in each direction) that the grid
+ * resolves before it starts merging matrix rows/columns into blocks */
+static const size_t GRID_FINE_FACTOR = 2;
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+/**
+ * @brief How the bins of a grid are stored, which depends on the functions
+ * accumulated. A grid for a single function gets the smallest bins it can:
+ * counts for density (4 bytes), floats for max (4 bytes), and {count,sum}
+ * pairs for average (16 bytes). A grid for several functions gets a single
+ * {count,max,sum} record per bin (16 bytes), so that each non-zero only
+ * touches one bin. The counts of density and of the records start out at 32
+ * bits, and the grid is widened to 64 bit counts (8 and 24 byte bins) the
+ * first time one would overflow. The count of an average bin is always 64
+ * bits, as a 32 bit count next to a double is padded to the same 16 bytes.
+ * Sums are always doubles, so that an average does not drift with the number
+ * of non-zeros in a bin or the order they are added in.
+ */
+typedef enum gridcell_t {
+  GRID_CELL_COUNT32,
+  GRID_CELL_COUNT64,
+  GRID_CELL_MAX,
+  GRID_CELL_AVERAGE,
+  GRID_CELL_PIXEL32,
+  GRID_CELL_PIXEL64
+} gridcell_t;
+
+
+typedef struct grid_avg_t {
+  uint64_t count;
+  double sum;
+} grid_avg_t;
+
+
+/* the count and max share the first 8 bytes, so four fit in a cache line --
+ * there is no min, as no function draws one, and a float for it would pad
+ * the record to 24 bytes */
+typedef struct grid_pixel32_t {
+  uint32_t count;
+  float max;
+  double sum;
+} grid_pixel32_t;
+
+
+/* 20 bytes padded to 24, so a record may straddle two cache lines */
+typedef struct grid_pixel64_t {
+  uint64_t count;
+  double sum;
+  float max;
+} grid_pixel64_t;
+
+
+/**
+ * @brief An accumulator of non-zeros for a matrix whose dimensions may not be
+ * known until every non-zero has been seen. Non-zeros are binned into blocks
+ * of 2^rshift rows by 2^cshift columns, and the blocks are only mapped to
+ * pixels once the final dimensions are known (grid_finalize()). When the
+ * extents outgrow the bins, neighboring blocks are merged and the block size
+ * doubled, which gives the same blocks as if the dimensions had been known
+ * up front. When the dimensions are known up front (grid_create_exact()),
+ * each row/column is instead mapped straight to the pixel it lands in, and
+ * the bins are blocks of 2^rshift by 2^cshift pixels, so that the image is
+ * exact rather than splitting bins that straddle pixels. A grid can
+ * accumulate several functions at once, so that they all come from a single
+ * pass over the matrix.
+ */
+typedef struct grid_t {
+  /* the functions accumulated, as a mask of grid_func()s */
+  unsigned int funcs;
+  gridcell_t cell;
+  void * cells;
+  /* requested canvas */
+  size_t nx;
+  size_t ny;
+  /* extents of the matrix (known or seen so far) */
+  size_t nrows;
+  size_t ncols;
+  /* log2 of the number of matrix rows/columns (or pixels) per bin */
+  size_t rshift;
+  size_t cshift;
+  /* the pixels the rows/columns are mapped to, when the dimensions were
+   * known up front (0 when bins hold matrix rows/columns), and the pixels per
+   * row/column */
+  size_t prows;
+  size_t pcols;
+  double rscale;
+  double cscale;
+  /* the first row of bins held (non-zero when only a band of rows is held) */
+  size_t broffset;
+  /* allocated bins, and the most we will allocate before merging */
+  size_t nbrows;
+  size_t nbcols;
+  size_t maxbrows;
+  size_t maxbcols;
+  /* the factor to scale the counts by when finalized (see grid_scale()) */
+  real_t scale;
+} grid_t;
+
+
+/**
+ * @brief A grid being mapped to pixels a band of rows of bins at a time
+ * (grid_sweep()), for a canvas whose bins do not all fit in memory at once.
+ * Rows of pixels are handed out as soon as no later band can land in them.
+ */
+typedef struct grid_sweep_t {
+  functiontype_t func;
+  /* the size of the canvas, and of the matrix */
+  size_t x;
+  size_t y;
+  size_t nrows;
+  size_t ncols;
+  /* the bins, and the pixels each row/column of them lands in */
+  size_t rshift;
+  size_t cshift;
+  size_t prows;
+  size_t pcols;
+  size_t nbrows;
+  size_t nbcols;
+  struct span_t * rspans;
+  struct span_t * cspans;
+  /* the next row of bins expected, and the first row of pixels that has not
+   * been handed out */
+  size_t next;
+  size_t done;
+  /* the rows of pixels held from done, and how many of them were handed out
+   * by the last call */
+  size_t held;
+  size_t maxheld;
+  size_t nout;
+  real_t * out;
+  real_t * counts;
+} grid_sweep_t;
+
+
+
+
+/******************************************************************************
+* FUNCTION PROTOTYPES *********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Create a new grid for rendering a matrix to a canvas.
+ *
+ * @param nx The width of the canvas.
+ * @param ny The height of the canvas.
+ * @param nrows The number of rows in the matrix (0 if unknown).
+ * @param ncols The number of columns in the matrix (0 if unknown).
+ * @param funcs The functions to accumulate non-zeros with (a mask of
+ * grid_func()s).
+ *
+ * @return The new grid.
+ */
+grid_t * grid_create(
+    size_t nx,
+    size_t ny,
+    size_t nrows,
+    size_t ncols,
+    unsigned int funcs);
+
+
+/**
+ * @brief Create a new grid for rendering a matrix whose dimensions are known
+ * up front to a canvas. Each row/column is mapped straight to the pixel it
+ * lands in, so that the image is exact.
+ *
+ * @param nx The width of the canvas.
+ * @param ny The height of the canvas.
+ * @param nrows The number of rows in the matrix.
+ * @param ncols The number of columns in the matrix.
+ * @param funcs The functions to accumulate non-zeros with.
+ *
+ * @return The new grid.
+ */
+grid_t * grid_create_exact(
+    size_t nx,
+    size_t ny,
+    size_t nrows,
+    size_t ncols,
+    unsigned int funcs);
+
+
+/**
+ * @brief Create a new empty grid of the same matrix and canvas as another,
+ * with the bins it started with.
+ *
+ * @param grid The grid to copy the shape of (which must hold all rows).
+ *
+ * @return The new grid.
+ */
+grid_t * grid_create_like(
+    grid_t const * grid);
+
+
+/**
+ * @brief Create a new grid that only holds the band of rows [rstart,rend) of
+ * a matrix with a known number of rows, so that several threads can each
+ * accumulate their own rows without a copy of the whole grid. Bands are
+ * combined with grid_merge().
+ *
+ * @param nx The width of the canvas.
+ * @param ny The height of the canvas.
+ * @param nrows The number of rows in the matrix.
+ * @param ncols The number of columns in the matrix (0 if unknown).
+ * @param funcs The functions to accumulate non-zeros with.
+ * @param exact Map the rows/columns straight to pixels (see
+ * grid_create_exact(), which requires ncols).
+ * @param rstart The first row of the band.
+ * @param rend One past the last row of the band.
+ *
+ * @return The new grid.
+ */
+grid_t * grid_create_band(
+    size_t nx,
+    size_t ny,
+    size_t nrows,
+    size_t ncols,
+    unsigned int funcs,
+    int exact,
+    size_t rstart,
+    size_t rend);
+
+
+/**
+ * @brief Make room in the grid for the non-zero (i,j), by allocating more
+ * bins or merging existing ones.
+ *
+ * @param grid The grid.
+ * @param i The row of the non-zero.
+ * @param j The column of the non-zero.
+ */
+void grid_grow(
+    grid_t * grid,
+    size_t i,
+    size_t j);
+
+
+/**
+ * @brief Move a grid to a smaller canvas, merging its bins until there are no
+ * more than it would have had if it had been created for that canvas. As
+ * merging bins is exact for every function, this gives the same grid as
+ * reading the matrix again for the smaller canvas, unless the rows/columns
+ * were mapped straight to pixels (grid_create_exact()), whose merged bins
+ * are then split between the new pixels.
+ *
+ * @param grid The grid (must hold all rows).
+ * @param nx The width of the new canvas.
+ * @param ny The height of the new canvas.
+ */
+void grid_coarsen(
+    grid_t * grid,
+    size_t nx,
+    size_t ny);
+
+
+/**
+ * @brief Widen the bins of a grid to 64 bit counts, such as when a 32 bit
+ * count is about to overflow, or before several threads update the grid at
+ * once and could not widen it safely. Bins for the max and average functions
+ * alone are left as they are.
+ *
+ * @param grid The grid.
+ */
+void grid_widen(
+    grid_t * grid);
+
+
+/**
+ * @brief Add a contiguous run of values from one row of a dense matrix to the
+ * grid. Each bin the run covers is reduced in a single pass over its values,
+ * rather than scattering them one at a time, and zeros are not counted as
+ * non-zeros.
+ *
+ * @param grid The grid.
+ * @param i The row of the run.
+ * @param j The column of the first value.
+ * @param vals The values.
+ * @param n The number of values.
+ */
+void grid_add_run(
+    grid_t * grid,
+    size_t i,
+    size_t j,
+    real_t const * vals,
+    size_t n);
+
+
+/**
+ * @brief Add a block of non-zeros to the grid. The grid is grown once to
+ * cover all of them, and each is then binned without checking it again.
+ *
+ * @param grid The grid.
+ * @param rows The rows of the non-zeros.
+ * @param cols The columns of the non-zeros.
+ * @param vals The values of the non-zeros (NULL if the grid only
+ * accumulates density).
+ * @param n The number of non-zeros.
+ */
+void grid_add_points(
+    grid_t * grid,
+    size_t const * rows,
+    size_t const * cols,
+    real_t const * vals,
+    size_t n);
+
+
+/**
+ * @brief Combine the non-zeros accumulated in one grid into another. Both
+ * grids must be for the same canvas and number of rows, and the destination
+ * must cover every row of the source.
+ *
+ * @param dst The grid to merge into.
+ * @param src The grid to merge from (its bins may be merged in the process).
+ */
+void grid_merge(
+    grid_t * dst,
+    grid_t * src);
+
+
+/**
+ * @brief Combine several grids (each holding all rows) into one, bringing them
+ * all to the coarsest bins among them and then reducing the bins in parallel.
+ *
+ * @param dst The grid to reduce into.
+ * @param srcs The grids to reduce from (their bins may be merged in the
+ * process).
+ * @param nsrcs The number of grids to reduce from.
+ */
+void grid_reduce(
+    grid_t * dst,
+    grid_t * const * srcs,
+    size_t nsrcs);
+
+
+/**
+ * @brief Bring a grid to bins of at least the given sizes, and allocate at
+ * least the given number of them, so that its bins line up with those of
+ * other grids of the same matrix (such as those read by other processes),
+ * which can then be combined bin for bin.
+ *
+ * @param grid The grid (must hold all rows).
+ * @param rshift The log2 of the rows per bin.
+ * @param cshift The log2 of the columns per bin.
+ * @param nbrows The least number of rows of bins.
+ * @param nbcols The least number of columns of bins.
+ */
+void grid_align(
+    grid_t * grid,
+    size_t rshift,
+    size_t cshift,
+    size_t nbrows,
+    size_t nbcols);
+
+
+/**
+ * @brief Find the largest 32 bit count in a grid, to tell whether combining
+ * it with others could overflow its bins.
+ *
+ * @param grid The grid.
+ *
+ * @return The largest count (0 if the counts are not 32 bits).
+ */
+uint64_t grid_max_count(
+    grid_t const * grid);
+
+
+/**
+ * @brief Combine a run of bins into another of the same type. The caller
+ * makes sure that counts can not overflow.
+ *
+ * @param cell The type of the bins.
+ * @param dst The bins to combine into.
+ * @param src The bins to combine from.
+ * @param n The number of bins.
+ */
+void grid_combine_bins(
+    gridcell_t cell,
+    void * dst,
+    void const * src,
+    size_t n);
+
+
+/**
+ * @brief Scale the accumulated non-zeros, such as to estimate the whole of a
+ * matrix from a sample of it. Only counts are scaled (when the grid is
+ * finalized), as averages and maximums are the same either way.
+ *
+ * @param grid The grid.
+ * @param scale The factor to scale by.
+ */
+void grid_scale(
+    grid_t * grid,
+    real_t scale);
+
+
+/**
+ * @brief Map the accumulated bins of one function to the output pixels. The
+ * output has min(nx,ncols) columns and min(ny,nrows) rows. A bin that
+ * straddles a pixel boundary is split in proportion to its overlap with each
+ * pixel (this only happens once the bins span more than one matrix
+ * row/column).
+ *
+ * @param grid The grid.
+ * @param func The function (one of those the grid accumulates).
+ * @param r_x The width of the output.
+ * @param r_y The height of the output.
+ *
+ * @return The output pixel values (to be freed by the caller).
+ */
+real_t * grid_finalize(
+    grid_t const * grid,
+    functiontype_t func,
+    size_t * r_x,
+    size_t * r_y);
+
+
+/**
+ * @brief Start mapping a grid to pixels a band of rows of bins at a time. The
+ * bins are those of a grid of a matrix of known size (see
+ * grid_create_band()), and the pixels are the same as grid_finalize() would
+ * give.
+ *
+ * @param nx The width of the canvas.
+ * @param ny The height of the canvas.
+ * @param nrows The number of rows in the matrix.
+ * @param ncols The number of columns in the matrix.
+ * @param func The function to draw.
+ * @param exact The bands are of grids whose rows/columns are mapped straight
+ * to pixels.
+ *
+ * @return The sweep (x, y, nbrows, and nbcols give the size of the output and
+ * the bins it takes).
+ */
+grid_sweep_t * grid_sweep_create(
+    size_t nx,
+    size_t ny,
+    size_t nrows,
+    size_t ncols,
+    functiontype_t func,
+    int exact);
+
+
+/**
+ * @brief Get the first row of the matrix in a row of bins of a sweep.
+ *
+ * @param sweep The sweep.
+ * @param b The row of bins.
+ *
+ * @return The first row (nrows if b is past the last row of bins).
+ */
+size_t grid_sweep_row(
+    grid_sweep_t const * sweep,
+    size_t b);
+
+
+/**
+ * @brief Map the next band of rows of bins to pixels, and hand out the rows
+ * of pixels that are done.
+ *
+ * @param sweep The sweep.
+ * @param band The band, whose first row of bins follows the last of the
+ * previous band (NULL once every band has been mapped, to hand out the rest).
+ * @param r_out The rows of pixels that are done, x to a row (valid until the
+ * next call, and free to be modified).
+ *
+ * @return The number of rows of pixels handed out.
+ */
+size_t grid_sweep(
+    grid_sweep_t * sweep,
+    grid_t const * band,
+    real_t ** r_out);
+
+
+/**
+ * @brief Free a sweep and its associated memory.
+ *
+ * @param sweep The sweep to free.
+ */
+void grid_sweep_free(
+    grid_sweep_t * sweep);
+
+
+/**
+ * @brief Free a grid and its associated memory.
+ *
+ * @param grid The grid to free.
+ */
+void grid_free(
+    grid_t * grid);
+
+
+
+
+/******************************************************************************
+* INLINE FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Get the pixel a row/column lands in, of npix pixels across n
+ * rows/columns: floor(i*npix/n). The multiply by scale can be off by one, so
+ * it is corrected against the exact quotient.
+ *
+ * @param i The row/column.
+ * @param npix The number of pixels.
+ * @param n The number of rows/columns.
+ * @param scale npix/n.
+ *
+ * @return The pixel.
+ */
+static inline size_t grid_pixel(
+    size_t const i,
+    size_t const npix,
+    size_t const n,
+    double const scale)
+{
+  size_t p = (size_t)(i*scale);
+
+  if (p*n > i*npix) {
+    --p;
+  } else if ((p+1)*n <= i*npix) {
+    ++p;
+  }
+
+  return p;
+}
+
+
+/**
+ * @brief Get the row of bins a row of the matrix falls into (counting from
+ * the first row of the matrix, not of the band held).
+ *
+ * @param grid The grid.
+ * @param i The row.
+ *
+ * @return The row of bins.
+ */
+static inline size_t grid_brow(
+    grid_t const * const grid,
+    size_t const i)
+{
+  if (grid->prows > 0) {
+    return grid_pixel(i,grid->prows,grid->nrows,grid->rscale) >> \
+        grid->rshift;
+  } else {
+    return i >> grid->rshift;
+  }
+}
+
+
+/**
+ * @brief Get the column of bins a column of the matrix falls into.
+ *
+ * @param grid The grid.
+ * @param j The column.
+ *
+ * @return The column of bins.
+ */
+static inline size_t grid_bcol(
+    grid_t const * const grid,
+    size_t const j)
+{
+  if (grid->pcols > 0) {
+    return grid_pixel(j,grid->pcols,grid->ncols,grid->cscale) >> \
+        grid->cshift;
+  } else {
+    return j >> grid->cshift;
+  }
+}
+
+
+/**
+ * @brief Get the bin a non-zero falls into, in a grid that already covers it.
+ *
+ * @param grid The grid.
+ * @param i The row of the non-zero.
+ * @param j The column of the non-zero.
+ *
+ * @return The index of the bin in the cells.
+ */
+static inline size_t grid_bin(
+    grid_t const * const grid,
+    size_t const i,
+    size_t const j)
+{
+  DL_ASSERT(i < grid->nrows && j < grid->ncols,"Non-zero (%zu,%zu) is " \
+      "outside of the grid\n",i,j);
+
+  return ((grid_brow(grid,i) - grid->broffset)*grid->nbcols) + \
+      grid_bcol(grid,j);
+}
+
+
+/**
+ * @brief Get the mask of a function, for building the set of functions a
+ * grid accumulates.
+ *
+ * @param func The function.
+ *
+ * @return The mask.
+ */
+static inline unsigned int grid_func(
+    functiontype_t const func)
+{
+  return 1u << func;
+}
+
+
+/**
+ * @brief Check if a grid needs the values of the non-zeros (rather than just
+ * where they are).
+ *
+ * @param grid The grid.
+ *
+ * @return 1 if it does.
+ */
+static inline int grid_needs_values(
+    grid_t const * const grid)
+{
+  return (grid->funcs & ~grid_func(FUNCTION_DENSITY)) != 0;
+}
+
+
+/**
+ * @brief Get the size of each bin of a grid in bytes.
+ *
+ * @param grid The grid.
+ *
+ * @return The size of a bin.
+ */
+static inline size_t grid_cell_size(
+    grid_t const * const grid)
+{
+  switch (grid->cell) {
+    case GRID_CELL_COUNT32:
+      return sizeof(uint32_t);
+    case GRID_CELL_COUNT64:
+      return sizeof(uint64_t);
+    case GRID_CELL_MAX:
+      return sizeof(float);
+    case GRID_CELL_AVERAGE:
+      return sizeof(grid_avg_t);
+    case GRID_CELL_PIXEL32:
+      return sizeof(grid_pixel32_t);
+    default:
+      return sizeof(grid_pixel64_t);
+  }
+}
+
+
+/**
+ * @brief Add a non-zero to a bin of the grid.
+ *
+ * @param grid The grid.
+ * @param idx The index of the bin.
+ * @param val The value of the non-zero.
+ */
+static inline void grid_accumulate(
+    grid_t * const grid,
+    size_t const idx,
+    real_t const val)
+{
+  switch (grid->cell) {
+    case GRID_CELL_COUNT32:
+      if (++((uint32_t*)grid->cells)[idx] == 0) {
+        /* the count wrapped around */
+        grid_widen(grid);
+        ((uint64_t*)grid->cells)[idx] += ((uint64_t)1) << 32;
+      }
+      break;
+    case GRID_CELL_COUNT64:
+      ++((uint64_t*)grid->cells)[idx];
+      break;
+    case GRID_CELL_MAX: {
+      float const fval = (float)val;
+      if (((float*)grid->cells)[idx] < fval) {
+        ((float*)grid->cells)[idx] = fval;
+      }
+      break;
+    }
+    case GRID_CELL_AVERAGE: {
+      grid_avg_t * const cell = ((grid_avg_t*)grid->cells)+idx;
+      ++cell->count;
+      cell->sum += val;
+      break;
+    }
+    case GRID_CELL_PIXEL32: {
+      grid_pixel32_t * const cell = ((grid_pixel32_t*)grid->cells)+idx;
+      float const fval = (float)val;
+      /* the max starts at zero, as it does for the max function alone */
+      cell->max = cell->max < fval ? fval : cell->max;
+      cell->sum += val;
+      if (++cell->count == 0) {
+        grid_widen(grid);
+        ((grid_pixel64_t*)grid->cells)[idx].count += ((uint64_t)1) << 32;
+      }
+      break;
+    }
+    case GRID_CELL_PIXEL64: {
+      grid_pixel64_t * const cell = ((grid_pixel64_t*)grid->cells)+idx;
+      float const fval = (float)val;
+      cell->max = cell->max < fval ? fval : cell->max;
+      cell->sum += val;
+      ++cell->count;
+      break;
+    }
+  }
+}
+
+
+/**
+ * @brief Add a non-zero to the grid.
+ *
+ * @param grid The grid.
+ * @param i The row of the non-zero.
+ * @param j The column of the non-zero.
+ * @param val The value of the non-zero.
+ */
+static inline void grid_add(
+    grid_t * const grid,
+    size_t const i,
+    size_t const j,
+    real_t const val)
+{
+  size_t r, c, idx;
+
+  DL_ASSERT(grid_brow(grid,i) >= grid->broffset,"Row %zu is before the " \
+      "band held by the grid\n",i);
+
+  r = grid_brow(grid,i) - grid->broffset;
+  c = grid_bcol(grid,j);
+  if (r >= grid->nbrows || c >= grid->nbcols) {
+    grid_grow(grid,i,j);
+    r = grid_brow(grid,i) - grid->broffset;
+    c = grid_bcol(grid,j);
+  }
+  if (i >= grid->nrows) {
+    grid->nrows = i+1;
+  }
+  if (j >= grid->ncols) {
+    grid->ncols = j+1;
+  }
+
+  idx = (r*grid->nbcols) + c;
+
+  grid_accumulate(grid,idx,val);
+}
+
+
+/**
+ * @brief Make sure the grid covers at least nrows by ncols, even if no
+ * non-zeros are found in the trailing rows/columns.
+ *
+ * @param grid The grid.
+ * @param nrows The minimum number of rows.
+ * @param ncols The minimum number of columns.
+ */
+static inline void grid_extend(
+    grid_t * const grid,
+    size_t const nrows,
+    size_t const ncols)
+{
+  if (nrows > grid->nrows || ncols > grid->ncols) {
+    grid_grow(grid,dl_max(nrows,1)-1,dl_max(ncols,1)-1);
+    grid->nrows = dl_max(grid->nrows,nrows);
+    grid->ncols = dl_max(grid->ncols,ncols);
+  }
+}
+
+
+
+
+#endif
@@ -21,11 +21,41 @@
 
 
 
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+/* a run of len pixels of a resampled line that all lie within source pixel
+ * src (frac is 1), or a single pixel that straddles src and src+1, with frac
+ * of its area in src */
+typedef struct span_t {
+  size_t start;
+  size_t len;
+  size_t src;
+  real_t frac;
+} span_t;
+
+
+
+
 /******************************************************************************
 * DOMLIB IMPORTS **************************************************************
 ******************************************************************************/
 
 
+#define DLMEM_PREFIX span
+#define DLMEM_TYPE_T span_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+
 #define DLMEM_PREFIX image
 #define DLMEM_TYPE_T image_t
 #define DLMEM_DLTYPE DLTYPE_STRUCT
@@ -41,6 +71,155 @@
 
 
 
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Build the table of which source pixels the pixels of a line being
+ * scaled up from n to npix pixels cover. Pixel k covers [k*n,(k+1)*n) and
+ * source pixel s covers [s*npix,(s+1)*npix), so the split of each pixel is
+ * found exactly in integers.
+ *
+ * @param n The number of source pixels.
+ * @param npix The number of pixels (at least n).
+ * @param r_nspans The number of spans.
+ *
+ * @return The table of spans.
+ */
+static span_t * __build_spans(
+    size_t const n,
+    size_t const npix,
+    size_t * const r_nspans)
+{
+  size_t k, src, bound, nspans;
+  span_t * spans;
+
+  /* at most a run and a straddling pixel per source pixel */
+  spans = span_alloc((2*n)+1);
+
+  nspans = 0;
+  for (k=0;k<npix;++k) {
+    src = (k*n)/npix;
+    bound = (src+1)*npix;
+    if ((k+1)*n <= bound) {
+      if (nspans > 0 && spans[nspans-1].src == src && \
+          spans[nspans-1].frac == 1.0) {
+        ++spans[nspans-1].len;
+        continue;
+      }
+      spans[nspans].frac = 1.0;
+    } else {
+      spans[nspans].frac = (bound-(k*n)) / (real_t)n;
+    }
+    spans[nspans].start = k;
+    spans[nspans].len = 1;
+    spans[nspans].src = src;
+    ++nspans;
+  }
+
+  *r_nspans = nspans;
+
+  return spans;
+}
+
+
+/**
+ * @brief Scale up a matrix of pixel values to the size of the image, with
+ * each pixel taking the area-weighted average of the source pixels it
+ * covers. Runs of pixels within the same source pixel are filled without
+ * dividing per pixel, and the rows are filled in parallel.
+ *
+ * @param mat The source pixel values.
+ * @param x The width of the source.
+ * @param y The height of the source.
+ * @param nx The width of the image (at least x).
+ * @param ny The height of the image (at least y).
+ *
+ * @return The pixel values of the image.
+ */
+static real_t * __resample(
+    real_t const * const mat,
+    size_t const x,
+    size_t const y,
+    size_t const nx,
+    size_t const ny)
+{
+  size_t i, k, nrspans, ncspans;
+  size_t * rsrc;
+  real_t * out, * rfrac;
+  span_t * rspans, * cspans;
+
+  DL_ASSERT(x <= nx && y <= ny,"Resampling %zux%zu pixels down to %zux%zu\n", \
+      x,y,nx,ny);
+
+  out = real_alloc(nx*ny);
+
+  /* the source row(s) of each row of the image */
+  rspans = __build_spans(y,ny,&nrspans);
+  rsrc = size_alloc(ny);
+  rfrac = real_alloc(ny);
+  for (k=0;k<nrspans;++k) {
+    for (i=rspans[k].start;i<rspans[k].start+rspans[k].len;++i) {
+      rsrc[i] = rspans[k].src;
+      rfrac[i] = rspans[k].frac;
+    }
+  }
+  dl_free(rspans);
+
+  cspans = __build_spans(x,nx,&ncspans);
+
+  #pragma omp parallel
+  {
+    size_t j, c, sp, end;
+    real_t v;
+    real_t const * row;
+    real_t * const blend = real_alloc(x);
+
+    #pragma omp for schedule(static)
+    for (i=0;i<ny;++i) {
+      real_t * const orow = out + (i*nx);
+      row = mat + (rsrc[i]*x);
+      if (rfrac[i] < 1.0) {
+        /* a row straddling two source rows */
+        for (c=0;c<x;++c) {
+          blend[c] = (rfrac[i]*row[c]) + ((1.0-rfrac[i])*row[c+x]);
+        }
+        row = blend;
+      }
+      if (x == nx) {
+        memcpy(orow,row,sizeof(real_t)*nx);
+        continue;
+      }
+      for (sp=0;sp<ncspans;++sp) {
+        span_t const * const span = cspans + sp;
+        if (span->frac < 1.0) {
+          orow[span->start] = (span->frac*row[span->src]) + \
+              ((1.0-span->frac)*row[span->src+1]);
+        } else {
+          v = row[span->src];
+          end = span->start + span->len;
+          for (j=span->start;j<end;++j) {
+            orow[j] = v;
+          }
+        }
+      }
+    }
+
+    dl_free(blend);
+  }
+
+  dl_free(cspans);
+  dl_free(rfrac);
+  dl_free(rsrc);
+
+  return out;
+}
+
+
+
+
 /******************************************************************************
 * PUBLIC FUNCTIONS ************************************************************
 ******************************************************************************/
@@ -115,22 +294,14 @@ image_t * image_create_grayscale(
     size_t const nx, 
     size_t const ny)
 {
-  size_t i,j, idx;
-
   real_t * red, * green, * blue;
 
-  red = real_alloc(nx*ny);
+  red = __resample(mat,x,y,nx,ny);
   green = real_alloc(nx*ny);
   blue = real_alloc(nx*ny);
 
-  for (i=0;i<ny;++i) {
-    for (j=0;j<nx;++j) {
-      idx = ((i*y)/ny)*x + ((j*x)/nx);
-      red[i*nx+j] = mat[idx];
-      green[i*nx+j] = mat[idx];
-      blue[i*nx+j] = mat[idx];
-    }
-  }
+  memcpy(green,red,sizeof(real_t)*nx*ny);
+  memcpy(blue,red,sizeof(real_t)*nx*ny);
 
   return image_create(nx,ny,red,green,blue);
 }
@@ -143,34 +314,34 @@ image_t * image_create_heatmap(
     size_t const nx, 
     size_t const ny)
 {
-  size_t i,j, idx;
-
+  size_t i;
+  real_t v;
   real_t * red, * green, * blue;
 
+  /* the values are colored in place of the blue channel */
+  blue = __resample(mat,x,y,nx,ny);
   red = real_alloc(nx*ny);
   green = real_alloc(nx*ny);
-  blue = real_alloc(nx*ny);
 
-  for (i=0;i<ny;++i) {
-    for (j=0;j<nx;++j) {
-      idx = ((i*y)/ny)*x + ((j*x)/nx);
-      if (mat[idx] < 255.0) {
-        red[i*nx+j] = 0;
-        green[i*nx+j] = 0;
-        blue[i*nx+j] = mat[idx];
-      } else if (mat[idx] < 510.0) {
-        red[i*nx+j] = 0;
-        green[i*nx+j] = mat[idx] - 255.0;
-        blue[i*nx+j] = 510.0 - mat[idx];
-      } else if (mat[idx] < 765.0) {
-        red[i*nx+j] = mat[idx] - 510.0;
-        green[i*nx+j] = 765.0 - mat[idx];
-        blue[i*nx+j] = 0;
-      } else {
-        red[i*nx+j] = 255.0;
-        green[i*nx+j] = mat[idx] - 765.0; 
-        blue[i*nx+j] = mat[idx] - 765.0; 
-      }
+  #pragma omp parallel for schedule(static) private(v)
+  for (i=0;i<nx*ny;++i) {
+    v = blue[i];
+    if (v < 255.0) {
+      red[i] = 0;
+      green[i] = 0;
+      blue[i] = v;
+    } else if (v < 510.0) {
+      red[i] = 0;
+      green[i] = v - 255.0;
+      blue[i] = 510.0 - v;
+    } else if (v < 765.0) {
+      red[i] = v - 510.0;
+      green[i] = 765.0 - v;
+      blue[i] = 0;
+    } else {
+      red[i] = 255.0;
+      green[i] = v - 765.0;
+      blue[i] = v - 765.0;
     }
   }
 
@@ -16,7 +16,22 @@
 
 
 
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+/* for MADV_DONTNEED, as glibc ignores POSIX_MADV_DONTNEED */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "io.h"
+#include "parse.h"
 
 
 
@@ -31,15 +46,71 @@ static const int FILETYPE_HEADER[] = {
   [FILETYPE_CLUTO] = 1,
   [FILETYPE_CSR] = 0,
   [FILETYPE_CSR_HEADER] = 1,
+  [FILETYPE_BCSR] = 0,
   [FILETYPE_RAW] = 0,
   [FILETYPE_DENSE] = 0,
-  [FILETYPE_DIMACS] = 1,
+  [FILETYPE_DIMACS] = 0,
   [FILETYPE_POINT] = 0,
   [FILETYPE_COO] = 0,
+  [FILETYPE_MTX] = 0,
+  [FILETYPE_NPY] = 0,
+  [FILETYPE_GAP] = 0,
+  [FILETYPE_LIGRA] = 0,
   [FILETYPE_UNKNOWN] = 0
 };
 
 
+/* the least amount of mapped text worth splitting between threads */
+static const size_t MIN_PARALLEL_BYTES = 1 << 20;
+
+
+/* the least amount of mapped text read past worth handing back to the
+ * kernel (see release_matrix()) */
+static const size_t MIN_RELEASE_BYTES = 1 << 20;
+
+
+/* the number of chunks to split the text into per thread, so that threads
+ * which get lines with fewer non-zeros can pick up more chunks */
+static const size_t CHUNKS_PER_THREAD = 4;
+
+
+/* the number of rows between the offsets recorded in a new index */
+static const size_t INDEX_STRIDE = 1024;
+
+
+/* the number of values of a dense row gathered before adding them to the grid
+ * as a run */
+#define DENSE_BLOCK_SIZE 256
+
+
+/* the number of entries of numpy input converted at a time */
+#define NPY_BLOCK_SIZE 1024
+
+
+/* the number of bytes of input in each block sampled by a preview */
+static const size_t PREVIEW_BLOCK_BYTES = 1 << 16;
+
+
+/* the number of blocks whose lines are counted to estimate the number of rows
+ * of a preview, when neither the file nor an index gives it */
+static const size_t PREVIEW_COUNT_BLOCKS = 64;
+
+
+#ifndef NO_OMP
+/* the most memory to spend on private grids when reading points in parallel,
+ * past which threads add to a single shared grid (see
+ * set_private_grid_limit()) */
+static size_t __private_grid_limit = ((size_t)1) << 30;
+
+
+/* the fewest bytes a point can take up ("i j\n") */
+static const size_t MIN_POINT_BYTES = 4;
+
+
+/* the number of locks guarding the bins of a shared grid */
+static const size_t NUM_BIN_LOCKS = 1024;
+#endif
+
 
 
 /******************************************************************************
@@ -58,6 +129,52 @@ static const int FILETYPE_HEADER[] = {
 #undef DLMEM_PREFIX
 
 
+#define DLMEM_PREFIX rowindex
+#define DLMEM_TYPE_T rowindex_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX index_off
+#define DLMEM_TYPE_T uint64_t
+#define DLMEM_DLTYPE DLTYPE_INTEGRAL
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX grid_ptr
+#define DLMEM_TYPE_T grid_t *
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#ifndef NO_OMP
+#define DLMEM_PREFIX omp_lock
+#define DLMEM_TYPE_T omp_lock_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+#endif
+
+
 
 
 /******************************************************************************
@@ -82,352 +199,3452 @@ static inline int __is_comment(
 }
 
 
-static int __read_chunk(
-    char * buffer, 
-    size_t bufsize, 
-    FILE * fin)
+/**
+ * @brief Check whether a line of a point based format holds a point (rather
+ * than being empty, a comment, or in dimacs files, some other kind of line).
+ *
+ * @param handle The handle the line came from.
+ * @param sptr The start of the line.
+ * @param eptr The end of the line.
+ *
+ * @return 1 if the line holds a point.
+ */
+static inline int __is_point_line(
+    spmat_handle_t const * const handle,
+    char const * const sptr,
+    char const * const eptr)
 {
-  char * tmpstr;
+  if (sptr == eptr) {
+    return 0;
+  } else if (handle->dimacs) {
+    return *sptr == 'a' || *sptr == 'e';
+  } else {
+    return !__is_comment(*sptr);
+  }
+}
 
-  tmpstr = fgets(buffer,bufsize,fin);
 
-  /* see if something went wrong */
-  if (tmpstr == NULL) {
-    if (feof(fin)) {
-      return 0; 
-    } else if (ferror(fin)) {
-      dl_error("Error while reading from file stream\n");
-    }
+/**
+ * @brief Parse the next signed integer from [sptr,eptr).
+ *
+ * @param sptr The start of the remaining line.
+ * @param eptr The end of the line.
+ * @param r_val The parsed value.
+ *
+ * @return A pointer to the first character after the number, or NULL if no
+ * number could be parsed.
+ */
+static inline char const * __read_long(
+    char const * sptr,
+    char const * const eptr,
+    long * const r_val)
+{
+  char buffer[MAX_TOKEN_SIZE];
+  char * end;
+
+  if (parse_copy_token(sptr,eptr,buffer,&sptr) == 0) {
+    return NULL;
+  }
+  *r_val = strtol(buffer,&end,10);
+  if (end == buffer) {
+    return NULL;
   }
 
-  return 1;
+  return sptr + (end - buffer);
 }
 
 
+/**
+ * @brief Attempt to memory-map the input file. This only works for regular,
+ * non-empty files -- anything else is left to the buffered reader.
+ *
+ * @param handle The handle to map the file for.
+ * @param name The name of the file.
+ *
+ * @return 1 if the file was mapped, 0 otherwise.
+ */
+static int __map_file(
+    spmat_handle_t * const handle,
+    char const * const name)
+{
+  int fd;
+  void * map;
+  struct stat st;
+
+  if ((fd = open(name,O_RDONLY)) < 0) {
+    return 0;
+  }
+  if (fstat(fd,&st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    close(fd);
+    return 0;
+  }
 
+  map = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
 
-/******************************************************************************
-* PUBLIC FUNCTIONS ************************************************************
-******************************************************************************/
+  /* we only ever stream through the file front to back */
+  posix_madvise(map,(size_t)st.st_size,POSIX_MADV_SEQUENTIAL);
 
+  handle->fd = fd;
+  handle->map = map;
+  handle->mapsize = (size_t)st.st_size;
+  handle->maplen = (size_t)st.st_size;
+  handle->mappos = 0;
 
-spmat_handle_t * open_matrix(
-    char const * const name, 
-    filetype_t const type)
-{
-  int flags, aux;
-  size_t idx, nnz, linesize;
-  ssize_t linelen;
-  char * line, * sptr, * eptr;
-  double v;
-  spmat_handle_t * handle;
+  return 1;
+}
 
-  line = NULL;
-  handle = NULL;
 
-  linesize = DEFAULT_BUFFER_SIZE;
-  line = char_alloc(linesize);
-  handle = spmat_handle_alloc(1);
+/**
+ * @brief Hand the pages of part of a mapping back to the kernel, from the
+ * page holding its start up to the page holding its end. The mapping must be
+ * a private mapping of a file that is never written to, so that the pages are
+ * read back in from the file should they be touched again.
+ *
+ * @param start The start of the part.
+ * @param end The end of the part.
+ */
+static void __release(
+    char const * const start,
+    char const * const end)
+{
+  size_t const page = (size_t)sysconf(_SC_PAGESIZE);
+  uintptr_t const s = (uintptr_t)start - ((uintptr_t)start % page);
+  uintptr_t const e = (uintptr_t)end - ((uintptr_t)end % page);
 
-  if (dl_open_file(name,"r",&(handle->fp)) != DL_FILE_SUCCESS) {
-    dl_error("Failed to open '%s' for reading\n",name);
-    perror("Cause:");
-    goto FAIL;
+  if (e <= s) {
+    return;
   }
 
-  if (FILETYPE_HEADER[type]) {
-    while ((linelen = dl_get_next_line(handle->fp,&line,&linesize)) == 0 ||
-        __is_comment(line[0]));
+  #ifdef MADV_DONTNEED
+  madvise((void*)s,e-s,MADV_DONTNEED);
+  #else
+  posix_madvise((void*)s,e-s,POSIX_MADV_DONTNEED);
+  #endif
+}
+
+
+/**
+ * @brief Find the end of the line starting at sptr in mapped text.
+ *
+ * @param sptr The start of the line.
+ * @param end The end of the text.
+ * @param r_eptr The end of the line (excluding the newline and any '\r').
+ *
+ * @return The start of the next line (or end).
+ */
+static inline char const * __find_line(
+    char const * const sptr,
+    char const * const end,
+    char const ** const r_eptr)
+{
+  char const * eptr, * nptr;
+
+  if ((eptr = memchr(sptr,'\n',end - sptr)) != NULL) {
+    nptr = eptr + 1;
+  } else {
+    eptr = nptr = end;
   }
-  sptr = line;
+  if (eptr > sptr && *(eptr-1) == '\r') {
+    --eptr;
+  }
+  *r_eptr = eptr;
 
-  switch (type) {
-    case FILETYPE_METIS:
-      handle->use_rows = 1;
-      handle->ncols = handle->nrows = strtoull(sptr,&eptr,10);
-      if (sptr == eptr) {
-        dl_error("Failed to read number of vertices from metis file '%s'\n",
-            name);
-        goto FAIL;
-      }
-      sptr = eptr;
-      nnz = (size_t)strtoull(sptr,&eptr,10); /* don't care about nnz */
-      if (nnz == 0) {
-        wprintf("Sparse matrix is all zeros.\n");
-      }
-      if (sptr == eptr) {
-        eprintf("Failed to read number of edges from metis file '%s'\n",name);
-        goto FAIL;
-      }
-      sptr = eptr;
-      flags = strtol(sptr,&eptr,10);
-      if (sptr == eptr || flags == 0) {
-        /* no weights */
-        handle->val = 0;
-        handle->nfields = 1;
-        handle->idxoffset = 0;
-        handle->lineoffset = 0;
-      } else if (flags == 1) {
-        /* only edge weights */
-        handle->val = 1;
-        handle->nfields = 2;
-        handle->idxoffset = 0;
-        handle->valoffset = 1;
-        handle->lineoffset = 0;
-      } else if (flags == 10) {
-        /* only vertex weights */
-        handle->val = 0;
-        handle->nfields = 1;
-        handle->idxoffset = 0;
-        aux = strtol(sptr,&eptr,10);
-        if (sptr == eptr) {
-          handle->lineoffset = 1;
-        } else {
-          handle->lineoffset = aux;
-        }
-      } else if (flags == 11) {
-        /* both weights */
-        handle->val = 1;
-        handle->nfields = 2;
-        handle->idxoffset = 0;
-        handle->valoffset = 1;
-        aux = strtol(sptr,&eptr,10);
-        if (sptr == eptr) {
-          handle->lineoffset = 1;
-        } else {
-          handle->lineoffset = aux;
-        }
-      }
-      break;
-    case FILETYPE_CLUTO:
-      handle->use_rows = 1;
-      handle->val = 1;
-      handle->nrows = strtoull(sptr,&eptr,10);
-      if (sptr == eptr) {
-        eprintf("Failed to read number of rows from cluto file '%s'\n",name);
-        goto FAIL;
-      }
-      sptr = eptr;
-      handle->ncols = strtoull(sptr,&eptr,10);
-      if (sptr == eptr) {
-        eprintf("Failed to read number of rows from cluto file '%s'\n",name);
-        goto FAIL;
+  return nptr;
+}
+
+
+/**
+ * @brief Get the next line from a compressed input.
+ *
+ * @param handle The handle to read from.
+ * @param r_line A pointer to the start of the line.
+ *
+ * @return The length of the line (excluding the newline), or -1 at the end of
+ * the file.
+ */
+static ssize_t __next_decompressed_line(
+    spmat_handle_t * const handle,
+    char const ** const r_line)
+{
+  ssize_t len;
+  size_t linelen, n;
+  char const * sptr, * eptr, * end;
+
+  linelen = 0;
+  for (;;) {
+    if (handle->dpos >= handle->dlen) {
+      if ((len = decompress_next(handle->decomp,&(handle->dbuf))) < 0) {
+        dl_error("Failed to decompress input\n");
       }
-      sptr = eptr;
-      nnz = strtoull(sptr,&eptr,10); /* throw away nnz */
-      sptr = eptr;
-      handle->lineoffset = 0;
-      handle->nfields = 2;
-      handle->idxoffset = 0;
-      handle->valoffset = 1;
-      break;
-    case FILETYPE_CSR_HEADER: /* the header is useless */
-    case FILETYPE_CSR:
-      handle->use_rows = 1;
-      handle->val = 1;
-      handle->nrows = 0;
-      handle->ncols = 0;
-      handle->lineoffset = 0;
-      handle->idxoffset = 0;
-      handle->valoffset = 1;
-      handle->nfields = 2;
-      while ((linelen = dl_get_next_line(handle->fp,&line,&linesize)) > -1) {
-        if (__is_comment(line[0])) {
-          continue;
-        }
-        /* find the maximum column */
-        sptr = line;
-        idx = strtoull(sptr,&eptr,10)+1;
-        sptr = eptr;
-        v = strtod(sptr,&eptr); /* ignore value for now */
-        while (sptr != eptr) {
-          if (v == 0) {
-            wprintf("Found sparse 0 at idx: %zu\n",idx);
-          }
-          handle->ncols = dl_storemax(idx,handle->ncols);
-          sptr = eptr;
-          idx = strtoull(sptr,&eptr,10);
-          sptr = eptr;
-          v = strtod(sptr,&eptr); /* ignore value for now */
+      handle->dlen = (size_t)len;
+      handle->dpos = 0;
+      if (len == 0) {
+        if (linelen == 0) {
+          return -1;
         }
-        ++handle->nrows;
+        break;
       }
-      /* reset the fd */
-      dl_reset_file(handle->fp);
-      if (FILETYPE_HEADER[type]) {
-        while ((linelen = dl_get_next_line(handle->fp,&line,&linesize)) == 0 ||
-            __is_comment(line[0]));
+    }
+    sptr = handle->dbuf + handle->dpos;
+    end = handle->dbuf + handle->dlen;
+    eptr = memchr(sptr,'\n',end - sptr);
+    if (eptr && linelen == 0) {
+      /* the whole line is in this buffer */
+      handle->dpos = (eptr + 1) - handle->dbuf;
+      if (eptr > sptr && *(eptr-1) == '\r') {
+        --eptr;
       }
+      *r_line = sptr;
+      return eptr - sptr;
+    }
+    /* the line continues into the next buffer */
+    n = (eptr ? eptr : end) - sptr;
+    if (linelen + n + 1 > handle->linesize) {
+      handle->linesize = dl_max(2*handle->linesize,linelen + n + 1);
+      handle->line = char_realloc(handle->line,handle->linesize);
+    }
+    memcpy(handle->line+linelen,sptr,n);
+    linelen += n;
+    if (eptr) {
+      handle->dpos = (eptr + 1) - handle->dbuf;
       break;
-    case FILETYPE_COO:
-    case FILETYPE_POINT:
-      handle->use_rows = 0;
-      handle->val = 1;
-      handle->nrows = 0;
-      handle->ncols = 0;
-      handle->lineoffset = 0;
-      handle->idxoffset = 1;
-      handle->valoffset = 2;
-      handle->nfields = 3;
-      while ((linelen = dl_get_next_line(handle->fp,&line,&linesize)) > -1) {
-        if (__is_comment(line[0])) {
-          continue;
-        }
-        /* find the maximum row */
-        sptr = line;
-        idx = strtoull(sptr,&eptr,10)+1;
-        sptr = eptr;
-        handle->nrows = dl_storemax(idx,handle->nrows);
-        /* find the maximum column */
-        idx = strtoull(sptr,&eptr,10)+1;
-        sptr = eptr;
-        handle->ncols = dl_storemax(idx,handle->ncols);
-        /* ignore value for now */
-        v = strtod(sptr,&eptr);
-      }
-      dl_reset_file(handle->fp);
-      break;
-    default :
-      dl_error("Unknown filetype '%d'\n",type);
+    }
+    handle->dpos = handle->dlen;
   }
+  if (handle->line[linelen-1] == '\r') {
+    --linelen;
+  }
+  *r_line = handle->line;
 
-  handle->line = line;
-  handle->linesize = linesize;
+  return linelen;
+}
 
-  dprintf("Created handle for %zux%zu matrix\n",handle->nrows,handle->ncols);
 
-  return handle;
+/**
+ * @brief Get the next line from the input. For memory-mapped files, the
+ * returned line points directly into the mapping and is not null terminated.
+ *
+ * @param handle The handle to read from.
+ * @param r_line A pointer to the start of the line.
+ *
+ * @return The length of the line (excluding the newline), or -1 at the end of
+ * the file.
+ */
+static ssize_t __next_line(
+    spmat_handle_t * const handle,
+    char const ** const r_line)
+{
+  ssize_t linelen;
+  char const * sptr, * eptr, * nptr;
 
-  FAIL:
-  if (handle) {
-    if (handle->fp) {
-      dl_close_file(handle->fp);
+  if (handle->map) {
+    if (handle->mappos >= handle->mapsize) {
+      return -1;
     }
-    dl_free(handle);
-  }
-  if (line) {
-    dl_free(line);
+    sptr = handle->map + handle->mappos;
+    nptr = __find_line(sptr,handle->map + handle->mapsize,&eptr);
+    handle->mappos = nptr - handle->map;
+    *r_line = sptr;
+    return eptr - sptr;
+  } else if (handle->decomp) {
+    return __next_decompressed_line(handle,r_line);
+  } else {
+    linelen = dl_get_next_line(handle->fp,&(handle->line), \
+        &(handle->linesize));
+    *r_line = handle->line;
+    return linelen;
   }
-  return NULL;
 }
 
 
-int read_points(
-    spmat_handle_t * const handle, 
-    size_t const npx, 
-    size_t const npy, 
-    real_t * const pden, 
-    real_t * const pavg, 
-    real_t * const pmax)
+/**
+ * @brief Get the next non-empty, non-comment line (the header of a file).
+ *
+ * @param handle The handle to read from.
+ * @param r_line A pointer to the start of the line.
+ *
+ * @return The length of the line, or -1 at the end of the file.
+ */
+static ssize_t __next_header_line(
+    spmat_handle_t * const handle,
+    char const ** const r_line)
 {
-  size_t i,j,nfill,idx;
   ssize_t linelen;
-  double val;
 
-  double const xscale = npx/(double)handle->ncols;
-  double const yscale = npy/(double)handle->nrows;
+  while ((linelen = __next_line(handle,r_line)) == 0 || 
+      (linelen > 0 && __is_comment((*r_line)[0])));
 
-  while ((linelen = dl_get_next_line(handle->fp,&handle->line,
-              &handle->linesize)) > 0) {
-    /* skip comment lines */
-    if (__is_comment(handle->line[0])) {
-      continue;
-    }
-    
-    nfill = sscanf(handle->line,"%zu %zu %lf",&i,&j,&val);
-    if (nfill < 2) {
-      dl_error("Point had %zu elements\n",nfill);
-      return 0;
-    } else if (nfill < 3) {
-      val = 1.0;
-    }
-    idx = (i*yscale)*npx + j*xscale;
+  return linelen;
+}
 
-    DL_ASSERT(idx < npx*npy,"Bad index %zu (%zu,%zu) from (%zu/%zu, " \
-        "%zu/%zu) for %zux%zu",idx,idx/npx,idx%npx,i,handle->nrows,j, \
-        handle->ncols,npx,npy);
 
-    if (pden) {
-      ++pden[idx];
-    }
-    if (pavg) {
-      pavg[idx] += val;
-    }
-    if (pmax && pmax[idx] < val) {
-      pmax[idx] = val;
-    }
+
+/**
+ * @brief Split the remaining mapped text into chunks on line boundaries.
+ *
+ * @param handle The handle to split the text of.
+ * @param nchunks The number of chunks.
+ *
+ * @return The offset of each chunk in the mapping (nchunks+1 of them, the
+ * last being the end of the text).
+ */
+static size_t * __split_lines(
+    spmat_handle_t const * const handle,
+    size_t const nchunks)
+{
+  size_t c, pos;
+  size_t * offsets;
+  char const * eptr;
+  char const * const map = handle->map;
+  size_t const start = handle->mappos;
+  size_t const end = handle->mapsize;
+
+  offsets = size_alloc(nchunks+1);
+  offsets[0] = start;
+  for (c=1;c<nchunks;++c) {
+    pos = start + (((end-start)*c)/nchunks);
+    pos = __find_line(map+pos,map+end,&eptr) - map;
+    offsets[c] = dl_max(pos,offsets[c-1]);
   }
-  
-  return 1;
+  offsets[nchunks] = end;
+
+  return offsets;
 }
 
 
-int read_row(
-    spmat_handle_t * const handle, 
-    size_t const ypix, 
-    real_t * const pden, 
-    real_t * const pmax, 
-    real_t * const pavg, 
-    size_t const npix)
+/**
+ * @brief Copy the next word of a line, in lower case.
+ *
+ * @param sptr The start of the remaining line (moved past the word).
+ * @param eptr The end of the line.
+ * @param buffer The buffer to copy the word to (MAX_TOKEN_SIZE bytes).
+ *
+ * @return The length of the word (0 if there are no more words).
+ */
+static size_t __next_word(
+    char const ** const sptr,
+    char const * const eptr,
+    char * const buffer)
+{
+  size_t i, len;
+  char const * start;
+
+  len = parse_copy_token(*sptr,eptr,buffer,&start);
+  for (i=0;i<len;++i) {
+    buffer[i] = (char)tolower((unsigned char)buffer[i]);
+  }
+  *sptr = start + len;
+
+  return len;
+}
+
+
+/**
+ * @brief Read the banner and size line of a Matrix Market file.
+ *
+ * @param handle The handle to read from.
+ * @param name The name of the file.
+ *
+ * @return 1 on success, 0 if the file is not a supported Matrix Market file.
+ */
+static int __read_mtx_header(
+    spmat_handle_t * const handle,
+    char const * const name)
 {
-  size_t ne,idx;
+  int array;
   ssize_t linelen;
-  char * sptr, * eptr;
-  double val;
-  const double scale = npix/(double)handle->ncols;
-  const size_t offset = ypix*npix;
+  unsigned long long num;
+  char const * line, * sptr, * eptr;
+  char word[MAX_TOKEN_SIZE];
 
-  /* skip comment lines */
-  while ((linelen = dl_get_next_line(handle->fp,&handle->line,
-          &handle->linesize)) > 0 && __is_comment(handle->line[0]));
+  /* the banner is the first line */
+  if ((linelen = __next_line(handle,&line)) < 0) {
+    eprintf("Empty matrix market file '%s'\n",name);
+    return 0;
+  }
+  sptr = line;
+  eptr = line + linelen;
+  if (__next_word(&sptr,eptr,word) == 0 || \
+      strcmp(word,"%%matrixmarket") != 0 || \
+      __next_word(&sptr,eptr,word) == 0 || strcmp(word,"matrix") != 0) {
+    eprintf("Missing matrix market banner in '%s'\n",name);
+    return 0;
+  }
 
-  if (linelen == 0) {
-    /* empty line */
-    return 1;
+  __next_word(&sptr,eptr,word);
+  if (strcmp(word,"coordinate") == 0) {
+    array = 0;
+  } else if (strcmp(word,"array") == 0) {
+    array = 1;
+  } else {
+    eprintf("Unknown matrix market format '%s' in '%s'\n",word,name);
+    return 0;
   }
 
-  ne = 0;
-  sptr = handle->line;
-  val = strtod(sptr,&eptr);
-  /* skip offset */
-  while (ne < handle->lineoffset && sptr != eptr) {
-    ++ne;
-    val = strtod(sptr,&eptr);
+  __next_word(&sptr,eptr,word);
+  if (strcmp(word,"real") == 0 || strcmp(word,"integer") == 0) {
+    handle->val = 1;
+  } else if (strcmp(word,"pattern") == 0 && !array) {
+    handle->val = 0;
+  } else {
+    eprintf("Unsupported matrix market field '%s' in '%s'\n",word,name);
+    return 0;
   }
-  if (ne < handle->lineoffset) {
-    dl_error("Failed to read in header of row\n");
+
+  __next_word(&sptr,eptr,word);
+  if (strcmp(word,"general") == 0) {
+    handle->mirror = 0;
+  } else if (strcmp(word,"symmetric") == 0) {
+    handle->mirror = 1;
+  } else if (strcmp(word,"skew-symmetric") == 0) {
+    handle->mirror = -1;
+  } else {
+    eprintf("Unsupported matrix market symmetry '%s' in '%s'\n",word,name);
     return 0;
   }
 
-  /* read the actual data for the line */
-  ne = 0; /* reset element coutner */
-  idx = 0;
-  while (sptr != eptr) {
+  /* followed by the dimensions (and number of entries) */
+  if ((linelen = __next_header_line(handle,&line)) < 0) {
+    eprintf("Missing matrix market size line in '%s'\n",name);
+    return 0;
+  }
+  sptr = line;
+  eptr = line + linelen;
+  if ((sptr = parse_uint(sptr,eptr,&num)) == NULL) {
+    eprintf("Failed to read number of rows from '%s'\n",name);
+    return 0;
+  }
+  handle->nrows = (size_t)num;
+  if ((sptr = parse_uint(sptr,eptr,&num)) == NULL) {
+    eprintf("Failed to read number of columns from '%s'\n",name);
+    return 0;
+  }
+  handle->ncols = (size_t)num;
+  /* the number of entries is not needed */
+
+  handle->use_rows = 0;
+  handle->dense = array;
+  handle->ijbase = 1;
+  handle->drow = handle->mirror < 0 ? 1 : 0;
+  handle->dcol = 0;
+
+  return 1;
+}
+
+
+/**
+ * @brief Get the next non-zero of a Matrix Market array (stored column by
+ * column, and only the lower triangle when symmetric).
+ *
+ * @param handle The handle to read from.
+ * @param r_i The row of the non-zero.
+ * @param r_j The column of the non-zero.
+ * @param r_val The value of the non-zero.
+ *
+ * @return 1 if a non-zero was read, 0 at the end of the array.
+ */
+static int __next_dense(
+    spmat_handle_t * const handle,
+    size_t * const r_i,
+    size_t * const r_j,
+    double * const r_val)
+{
+  ssize_t linelen;
+  char const * line;
+  double val;
+
+  for (;;) {
+    /* move to the next stored position */
+    while (handle->drow >= handle->nrows && handle->dcol < handle->ncols) {
+      ++handle->dcol;
+      if (handle->mirror > 0) {
+        handle->drow = handle->dcol;
+      } else if (handle->mirror < 0) {
+        handle->drow = handle->dcol+1;
+      } else {
+        handle->drow = 0;
+      }
+    }
+    if (handle->dcol >= handle->ncols) {
+      return 0;
+    }
+
+    while ((linelen = __next_line(handle,&line)) == 0 || \
+        (linelen > 0 && __is_comment(line[0])));
+    if (linelen < 0) {
+      return 0;
+    }
+    if (parse_double(line,line+linelen,&val) == NULL) {
+      dl_error("Failed to read value (%zu,%zu) of the array\n", \
+          handle->drow,handle->dcol);
+      return 0;
+    }
+
+    *r_i = handle->drow++;
+    *r_j = handle->dcol;
+
+    /* explicit zeros are not non-zeros */
+    if (val != 0) {
+      *r_val = val;
+      return 1;
+    }
+  }
+}
+
+
+/**
+ * @brief Read the problem line of a DIMACS file, which follows the comments.
+ *
+ * @param handle The handle to read from.
+ * @param name The name of the file.
+ *
+ * @return 1 on success, 0 if the problem line is missing or malformed.
+ */
+static int __read_dimacs_header(
+    spmat_handle_t * const handle,
+    char const * const name)
+{
+  ssize_t linelen;
+  unsigned long long num;
+  char const * line, * sptr, * eptr;
+  char word[MAX_TOKEN_SIZE];
+
+  while ((linelen = __next_line(handle,&line)) == 0 || \
+      (linelen > 0 && line[0] == 'c'));
+  if (linelen < 0 || line[0] != 'p') {
+    eprintf("Missing problem line in dimacs file '%s'\n",name);
+    return 0;
+  }
+  sptr = line + 1;
+  eptr = line + linelen;
+
+  if (__next_word(&sptr,eptr,word) == 0) {
+    eprintf("Missing problem type in dimacs file '%s'\n",name);
+    return 0;
+  }
+  /* undirected problems give each edge once */
+  if (strcmp(word,"edge") == 0 || strcmp(word,"col") == 0) {
+    handle->mirror = 1;
+  } else {
+    handle->mirror = 0;
+  }
+
+  if ((sptr = parse_uint(sptr,eptr,&num)) == NULL) {
+    eprintf("Failed to read number of nodes from dimacs file '%s'\n",name);
+    return 0;
+  }
+  handle->nrows = handle->ncols = (size_t)num;
+  /* the number of arcs is not needed */
+
+  handle->use_rows = 0;
+  handle->val = 1;
+  handle->ijbase = 1;
+  handle->dimacs = 1;
+
+  return 1;
+}
+
+
+/**
+ * @brief Check if a point of the matrix is inside of a window.
+ *
+ * @param window The window.
+ * @param i The row of the point.
+ * @param j The column of the point.
+ *
+ * @return 1 if it is inside.
+ */
+static inline int __in_window(
+    window_t const * const window,
+    size_t const i,
+    size_t const j)
+{
+  return i >= window->rstart && i < window->rend && j >= window->cstart && \
+      j < window->cend;
+}
+
+
+/**
+ * @brief Find how many of the first n rows/columns of the matrix fall inside
+ * of a window.
+ *
+ * @param n The number of rows/columns.
+ * @param start The first row/column of the window.
+ * @param end One past the last row/column of the window.
+ *
+ * @return The number inside of the window.
+ */
+static inline size_t __window_extent(
+    size_t const n,
+    size_t const start,
+    size_t const end)
+{
+  return n > start ? dl_min(n,end) - start : 0;
+}
+
+
+/**
+ * @brief Make sure the grid covers the part of the first nrows by ncols of
+ * the matrix that is inside of the window being read (see grid_extend()).
+ *
+ * @param handle The handle being read.
+ * @param grid The grid.
+ * @param nrows The minimum number of rows of the matrix.
+ * @param ncols The minimum number of columns of the matrix.
+ */
+static inline void __extend_window(
+    spmat_handle_t const * const handle,
+    grid_t * const grid,
+    size_t const nrows,
+    size_t const ncols)
+{
+  window_t const * const window = &handle->window;
+
+  grid_extend(grid,__window_extent(nrows,window->rstart,window->rend), \
+      __window_extent(ncols,window->cstart,window->cend));
+}
+
+
+/**
+ * @brief Drop the points of a block that are outside of a window, and shift
+ * the rest to start at (0,0).
+ *
+ * @param window The window.
+ * @param rows The rows of the points.
+ * @param cols The columns of the points.
+ * @param vals The values of the points (NULL if not needed).
+ * @param n The number of points.
+ *
+ * @return The number of points left.
+ */
+static size_t __window_points(
+    window_t const * const window,
+    size_t * const rows,
+    size_t * const cols,
+    real_t * const vals,
+    size_t const n)
+{
+  size_t k, m;
+
+  if (window->rstart == 0 && window->rend == WINDOW_END && \
+      window->cstart == 0 && window->cend == WINDOW_END) {
+    return n;
+  }
+
+  m = 0;
+  for (k=0;k<n;++k) {
+    if (__in_window(window,rows[k],cols[k])) {
+      rows[m] = rows[k] - window->rstart;
+      cols[m] = cols[k] - window->cstart;
+      if (vals) {
+        vals[m] = vals[k];
+      }
+      ++m;
+    }
+  }
+
+  return m;
+}
+
+
+/**
+ * @brief Parse a point (i, j, and an optional value) from a line, and shift it
+ * to be zero based.
+ *
+ * @param handle The handle the line came from.
+ * @param sptr The start of the line.
+ * @param eptr The end of the line.
+ * @param r_i The row of the point.
+ * @param r_j The column of the point.
+ * @param r_val The value of the point (1 if it has none, or it is not
+ * needed -- as for points outside of the window being read).
+ * @param needval Whether the value is needed.
+ *
+ * @return 1 on success, 0 if the line is malformed.
+ */
+static inline int __parse_point(
+    spmat_handle_t const * const handle,
+    char const * sptr,
+    char const * const eptr,
+    size_t * const r_i,
+    size_t * const r_j,
+    double * const r_val,
+    int const needval)
+{
+  unsigned long long i, j;
+
+  if (handle->dimacs) {
+    /* skip the 'a' or 'e' */
+    ++sptr;
+  }
+
+  if ((sptr = parse_index(sptr,eptr,&i)) == NULL || 
+      (sptr = parse_index(sptr,eptr,&j)) == NULL) {
+    dl_error("Point had less than 2 elements\n");
+    return 0;
+  }
+
+  if (i < handle->ijbase || j < handle->ijbase) {
+    dl_error("Point (%llu,%llu) is below the index base of %zu\n",i,j,
+        handle->ijbase);
+    return 0;
+  }
+  *r_i = (size_t)i - handle->ijbase + handle->roffset;
+  *r_j = (size_t)j - handle->ijbase + handle->coffset;
+
+  /* when the dimensions come from a header, the grid is not grown */
+  if ((handle->nrows > 0 && *r_i >= handle->nrows) || \
+      (handle->ncols > 0 && *r_j >= handle->ncols)) {
+    dl_error("Point (%llu,%llu) is outside of the %zux%zu matrix\n",i,j,
+        handle->nrows,handle->ncols);
+    return 0;
+  }
+
+  if (!needval || !(__in_window(&handle->window,*r_i,*r_j) || \
+      (handle->mirror != 0 && __in_window(&handle->window,*r_j,*r_i))) || \
+      parse_double(sptr,eptr,r_val) == NULL) {
+    *r_val = 1.0;
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Add a point to the grid, along with its mirror image for symmetric
+ * and skew-symmetric matrices, if they are inside of the window being read.
+ *
+ * @param handle The handle the point came from.
+ * @param grid The grid to add the point to.
+ * @param i The row of the point.
+ * @param j The column of the point.
+ * @param val The value of the point.
+ */
+static inline void __add_point(
+    spmat_handle_t const * const handle,
+    grid_t * const grid,
+    size_t const i,
+    size_t const j,
+    real_t const val)
+{
+  window_t const * const window = &handle->window;
+
+  if (__in_window(window,i,j)) {
+    grid_add(grid,i-window->rstart,j-window->cstart,val);
+  }
+  if (handle->mirror != 0 && i != j && __in_window(window,j,i)) {
+    grid_add(grid,j-window->rstart,i-window->cstart,handle->mirror*val);
+  }
+}
+
+
+/**
+ * @brief Add a line of dense text (every value of the row) to the grid, a
+ * block of values at a time. The values before the window being read are
+ * skipped without being parsed, and those after it are not looked at.
+ *
+ * @param handle The handle the line came from.
+ * @param sptr The start of the line.
+ * @param eptr The end of the line.
+ * @param row The row the line represents.
+ * @param grid The grid to add the values to.
+ *
+ * @return The number of values read from the row, or -1 if it has too many
+ * or one can not be parsed.
+ */
+static ssize_t __parse_dense_row(
+    spmat_handle_t const * const handle,
+    char const * sptr,
+    char const * const eptr,
+    size_t const row,
+    grid_t * const grid)
+{
+  size_t n, col;
+  double val;
+  char const * next;
+  real_t vals[DENSE_BLOCK_SIZE];
+  size_t const cstart = handle->window.cstart;
+  size_t const cend = handle->window.cend;
+
+  col = 0;
+  while (col < cstart && (sptr = parse_skip_token(sptr,eptr)) != NULL) {
+    ++col;
+  }
+  if (sptr == NULL) {
+    return 0;
+  }
+
+  n = 0;
+  while (col+n < cend && (next = parse_double(sptr,eptr,&val)) != NULL) {
+    sptr = next;
+    vals[n++] = val;
+    if (n == DENSE_BLOCK_SIZE) {
+      grid_add_run(grid,row,col-cstart,vals,n);
+      col += n;
+      n = 0;
+    }
+  }
+  if (n > 0) {
+    grid_add_run(grid,row,col-cstart,vals,n);
+    col += n;
+  }
+
+  /* a value that could not be parsed, rather than the end of the line */
+  if (col < cend && parse_skip_blanks(sptr,eptr) < eptr) {
+    return -1;
+  }
+
+  if (handle->ncols > 0 && col > handle->ncols) {
+    dl_error("Row %zu has %zu values, but the matrix has %zu columns\n",row,
+        col,handle->ncols);
+    return -1;
+  }
+
+  return (ssize_t)(col-cstart);
+}
+
+
+/**
+ * @brief Get a block of values from a row of raw input, converted to real_t.
+ *
+ * @param handle The handle of the raw input.
+ * @param offset The offset of the first value (in values).
+ * @param n The number of values.
+ * @param vals The converted values.
+ */
+static inline void __convert_raw(
+    spmat_handle_t const * const handle,
+    size_t const offset,
+    size_t const n,
+    real_t * const vals)
+{
+  size_t k;
+  float const * fval;
+  double const * dval;
+
+  if (handle->rawwidth == sizeof(float)) {
+    fval = ((float const *)handle->map) + offset;
+    for (k=0;k<n;++k) {
+      vals[k] = fval[k];
+    }
+  } else {
+    dval = ((double const *)handle->map) + offset;
+    for (k=0;k<n;++k) {
+      vals[k] = dval[k];
+    }
+  }
+}
+
+
+/**
+ * @brief Add the columns of a row of raw input that are inside of the window
+ * being read to the grid. When the values are already real_t they are added
+ * straight out of the mapping.
+ *
+ * @param handle The handle of the raw input.
+ * @param src The row of the input.
+ * @param row The row of the grid.
+ * @param grid The grid to add the values to.
+ */
+static void __add_raw_row(
+    spmat_handle_t const * const handle,
+    size_t const src,
+    size_t const row,
+    grid_t * const grid)
+{
+  size_t k, n;
+  real_t vals[DENSE_BLOCK_SIZE];
+  size_t const ncols = handle->ncols;
+  size_t const cstart = handle->window.cstart;
+  size_t const cend = dl_min(handle->window.cend,ncols);
+
+  if (cstart >= cend) {
+    return;
+  }
+
+  if (handle->rawwidth == sizeof(real_t)) {
+    grid_add_run(grid,row,0,((real_t const *)handle->map)+(src*ncols)+cstart, \
+        cend-cstart);
+  } else {
+    for (k=cstart;k<cend;k+=n) {
+      n = dl_min(DENSE_BLOCK_SIZE,cend-k);
+      __convert_raw(handle,(src*ncols)+k,n,vals);
+      grid_add_run(grid,row,k-cstart,vals,n);
+    }
+  }
+}
+
+
+/**
+ * @brief Parse the column index of a non-zero of a row based format, and
+ * shift it to be zero based.
+ *
+ * @param handle The handle the line came from.
+ * @param sptr The start of the index.
+ * @param eptr The end of the line.
+ * @param r_col The column.
+ *
+ * @return A pointer to the first character after the index, or NULL at the
+ * end of the line (or if the index is out of range).
+ */
+static inline char const * __parse_col(
+    spmat_handle_t const * const handle,
+    char const * sptr,
+    char const * const eptr,
+    size_t * const r_col)
+{
+  unsigned long long j;
+
+  if ((sptr = parse_index(sptr,eptr,&j)) == NULL) {
+    return NULL;
+  }
+
+  if (j < handle->ijbase) {
+    dl_error("Column %llu is below the index base of %zu\n",j,
+        handle->ijbase);
+    return NULL;
+  }
+  *r_col = (size_t)j - handle->ijbase + handle->coffset;
+
+  /* when the dimensions come from a header, the grid is not grown */
+  if (handle->ncols > 0 && *r_col >= handle->ncols) {
+    dl_error("Column %llu is outside of the %zu columns of the matrix\n",j,
+        handle->ncols);
+    return NULL;
+  }
+
+  return sptr;
+}
+
+
+/**
+ * @brief Add the non-zeros from a line of a row based format to the grid.
+ * Column indices are parsed as integers, and values are only parsed when the
+ * function of the grid uses them and their column is inside of the window
+ * being read.
+ *
+ * @param handle The handle the line came from.
+ * @param sptr The start of the line.
+ * @param eptr The end of the line.
+ * @param row The row the line represents.
+ * @param grid The grid to add the non-zeros to.
+ *
+ * @return The number of non-zeros in the row, or -1 if the line is
+ * malformed.
+ */
+static ssize_t __parse_row(
+    spmat_handle_t const * const handle,
+    char const * sptr,
+    char const * const eptr,
+    size_t const row,
+    grid_t * const grid)
+{
+  int inside;
+  size_t ne, field, col;
+  double val;
+  char const * next;
+  int const needval = handle->val && grid_needs_values(grid);
+  size_t const cstart = handle->window.cstart;
+  size_t const cend = handle->window.cend;
+
+  if (handle->denserows) {
+    return __parse_dense_row(handle,sptr,eptr,row,grid);
+  }
+
+  /* skip offset */
+  for (ne=0;ne<handle->lineoffset;++ne) {
+    if ((sptr = parse_skip_token(sptr,eptr)) == NULL) {
+      return -1;
+    }
+  }
+
+  /* read the actual data for the line */
+  col = 0;
+  inside = 0;
+  for (ne=0;;++ne) {
+    field = ne % handle->nfields;
+    if (field == handle->idxoffset) {
+      if ((next = __parse_col(handle,sptr,eptr,&col)) == NULL) {
+        break;
+      }
+      inside = col >= cstart && col < cend;
+      if (!handle->val && inside) {
+        /* if we dont' have values */
+        grid_add(grid,row,col-cstart,1.0);
+      }
+    } else if (handle->val && field == handle->valoffset) {
+      if (needval && inside) {
+        if ((next = parse_double(sptr,eptr,&val)) == NULL) {
+          break;
+        }
+        grid_add(grid,row,col-cstart,val);
+      } else {
+        if ((next = parse_skip_token(sptr,eptr)) == NULL) {
+          break;
+        }
+        if (inside) {
+          grid_add(grid,row,col-cstart,1.0);
+        }
+      }
+    } else if ((next = parse_skip_token(sptr,eptr)) == NULL) {
+      break;
+    }
+    sptr = next;
+  }
+
+  /* a token that could not be parsed, rather than the end of the line */
+  if (parse_skip_blanks(sptr,eptr) < eptr) {
+    return -1;
+  }
+
+  return (ssize_t)(ne / handle->nfields);
+}
+
+
+/**
+ * @brief Count the rows in chunks of the mapped text, to find the row each
+ * chunk starts with.
+ *
+ * @param handle The handle to read from.
+ * @param offsets The offsets of the chunks.
+ * @param nchunks The number of chunks.
+ *
+ * @return The first row of each chunk (nchunks+1 of them, counting from the
+ * row at mappos, and the last being the number of rows).
+ */
+static size_t * __count_rows(
+    spmat_handle_t const * const handle,
+    size_t const * const offsets,
+    size_t const nchunks)
+{
+  size_t c;
+  size_t * rowstart;
+  char const * const map = handle->map;
+
+  /* every line that is not a comment (including empty ones) is a row */
+  rowstart = size_calloc(nchunks+1);
+  rowstart[0] = handle->drow;
+  #pragma omp parallel for schedule(dynamic,1)
+  for (c=0;c<nchunks;++c) {
+    char const * lend;
+    char const * sptr = map + offsets[c];
+    char const * const cend = map + offsets[c+1];
+    size_t nrows = 0;
+    while (sptr < cend) {
+      if (!__is_comment(*sptr)) {
+        ++nrows;
+      }
+      sptr = __find_line(sptr,cend,&lend);
+    }
+    rowstart[c+1] = nrows;
+  }
+  for (c=0;c<nchunks;++c) {
+    rowstart[c+1] += rowstart[c];
+  }
+
+  return rowstart;
+}
+
+
+/**
+ * @brief Find the extents of the non-zeros on a line of a format that does
+ * not give the dimensions of the matrix: one past the largest column of a
+ * row (or the number of values of a dense row), or one past the row and
+ * column of a point. Rows that are malformed are left to be reported when
+ * they are read.
+ *
+ * @param handle The handle the line came from.
+ * @param sptr The start of the line.
+ * @param eptr The end of the line.
+ * @param r_nrows One past the largest row seen so far (points only).
+ * @param r_ncols One past the largest column seen so far.
+ *
+ * @return 1 on success, 0 if a point is malformed.
+ */
+static int __scan_line(
+    spmat_handle_t const * const handle,
+    char const * sptr,
+    char const * const eptr,
+    size_t * const r_nrows,
+    size_t * const r_ncols)
+{
+  size_t ne, i, j, col;
+  double val;
+  char const * next;
+
+  if (!handle->use_rows) {
+    if (!__parse_point(handle,sptr,eptr,&i,&j,&val,0)) {
+      return 0;
+    }
+    *r_nrows = dl_max(*r_nrows,i+1);
+    *r_ncols = dl_max(*r_ncols,j+1);
+    return 1;
+  }
+
+  if (handle->denserows) {
+    for (ne=0;(sptr = parse_skip_token(sptr,eptr)) != NULL;++ne);
+    *r_ncols = dl_max(*r_ncols,ne);
+    return 1;
+  }
+
+  for (ne=0;ne<handle->lineoffset;++ne) {
+    if ((sptr = parse_skip_token(sptr,eptr)) == NULL) {
+      return 1;
+    }
+  }
+  for (ne=0;;++ne) {
     if (ne % handle->nfields == handle->idxoffset) {
-      idx = offset + val*scale;
-      if (pden) {
-        pden[idx] += 1; 
+      if ((next = __parse_col(handle,sptr,eptr,&col)) == NULL) {
+        break;
+      }
+      *r_ncols = dl_max(*r_ncols,col+1);
+    } else if ((next = parse_skip_token(sptr,eptr)) == NULL) {
+      break;
+    }
+    sptr = next;
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Find the extents of what remains of a stream of text that does not
+ * give the dimensions of its matrix, by reading through it.
+ *
+ * @param handle The handle to read from.
+ * @param r_nrows The number of rows.
+ * @param r_ncols The number of columns.
+ *
+ * @return 1 on success, 0 if a point is malformed.
+ */
+static int __scan_stream(
+    spmat_handle_t * const handle,
+    size_t * const r_nrows,
+    size_t * const r_ncols)
+{
+  ssize_t linelen;
+  size_t nrows, ncols;
+  char const * line;
+
+  nrows = ncols = 0;
+  while ((linelen = __next_line(handle,&line)) >= 0) {
+    if (handle->use_rows) {
+      /* every line that is not a comment (including empty ones) is a row */
+      if (linelen > 0 && __is_comment(line[0])) {
+        continue;
+      }
+      ++nrows;
+    } else if (!__is_point_line(handle,line,line+linelen)) {
+      continue;
+    }
+    if (!__scan_line(handle,line,line+linelen,&nrows,&ncols)) {
+      return 0;
+    }
+  }
+  if (handle->use_rows) {
+    nrows += handle->drow;
+  } else if (handle->mirror != 0) {
+    nrows = ncols = dl_max(nrows,ncols);
+  }
+
+  *r_nrows = nrows;
+  *r_ncols = ncols;
+
+  return 1;
+}
+
+
+/**
+ * @brief Copy what remains of input that can only be read once (standard
+ * input or a pipe) to a temporary file, and map that in its place, so that
+ * it can be read more than once.
+ *
+ * @param handle The handle of the input.
+ *
+ * @return 1 on success, 0 if the temporary file could not be written.
+ */
+static int __spool_stream(
+    spmat_handle_t * const handle)
+{
+  int ok;
+  ssize_t linelen;
+  size_t size;
+  char const * line;
+  void * map;
+  FILE * tmp;
+
+  if ((tmp = tmpfile()) == NULL) {
+    eprintf("Failed to create a temporary file for the input\n");
+    return 0;
+  }
+
+  ok = 1;
+  size = 0;
+  while (ok && (linelen = __next_line(handle,&line)) >= 0) {
+    ok = fwrite(line,1,(size_t)linelen,tmp) == (size_t)linelen && \
+        fputc('\n',tmp) != EOF;
+    size += (size_t)linelen+1;
+  }
+  ok = ok && fflush(tmp) == 0;
+  if (!ok) {
+    eprintf("Failed to write the input to a temporary file\n");
+    fclose(tmp);
+    return 0;
+  }
+
+  /* there is nothing to map, and the stream will only say so again */
+  if (size == 0) {
+    fclose(tmp);
+    return 1;
+  }
+
+  map = mmap(NULL,size,PROT_READ,MAP_PRIVATE,fileno(tmp),0);
+  fclose(tmp);
+  if (map == MAP_FAILED) {
+    eprintf("Failed to map the temporary copy of the input\n");
+    return 0;
+  }
+  posix_madvise(map,size,POSIX_MADV_SEQUENTIAL);
+
+  if (handle->decomp) {
+    decompress_close(handle->decomp);
+    handle->decomp = NULL;
+  }
+  if (handle->fp) {
+    dl_close_file(handle->fp);
+    handle->fp = NULL;
+  }
+  handle->map = map;
+  handle->mapsize = size;
+  handle->maplen = size;
+  handle->mappos = 0;
+
+  return 1;
+}
+
+
+/**
+ * @brief Split the remaining mapped text into chunks at rows recorded in the
+ * index, so that each chunk starts at a known row without counting them.
+ *
+ * @param handle The handle to read from (with a loaded index).
+ * @param nchunks The number of chunks.
+ * @param r_rowstart The first row of each chunk (nchunks+1 of them).
+ *
+ * @return The offset of each chunk in the mapping (nchunks+1 of them).
+ */
+static size_t * __split_indexed(
+    spmat_handle_t const * const handle,
+    size_t const nchunks,
+    size_t ** const r_rowstart)
+{
+  size_t c, lo, hi, mid, target;
+  size_t * offsets, * rowstart;
+  rowindex_t const * const index = handle->index;
+  uint64_t const * const off = index->offsets;
+  size_t const start = handle->mappos;
+  size_t const end = handle->mapsize;
+
+  offsets = size_alloc(nchunks+1);
+  rowstart = size_alloc(nchunks+1);
+  offsets[0] = start;
+  rowstart[0] = handle->drow;
+  lo = 0;
+  for (c=1;c<nchunks;++c) {
+    /* the last indexed row at or before an even split of the bytes */
+    target = start + (((end-start)*c)/nchunks);
+    hi = (size_t)index->header.noffsets;
+    while (hi - lo > 1) {
+      mid = lo + ((hi-lo)/2);
+      if (off[mid] <= target) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    if (index->header.noffsets > 0 && off[lo] >= offsets[c-1]) {
+      offsets[c] = (size_t)off[lo];
+      rowstart[c] = lo*(size_t)index->header.stride;
+    } else {
+      offsets[c] = offsets[c-1];
+      rowstart[c] = rowstart[c-1];
+    }
+  }
+  offsets[nchunks] = end;
+  rowstart[nchunks] = handle->nrows;
+
+  *r_rowstart = rowstart;
+
+  return offsets;
+}
+
+
+/**
+ * @brief Remember where a row starts in the index being built.
+ *
+ * @param index The index.
+ * @param row The row (a multiple of the stride).
+ * @param offset The offset of the row in the file.
+ */
+static void __index_row(
+    rowindex_t * const index,
+    size_t const row,
+    size_t const offset)
+{
+  size_t const k = row / (size_t)index->header.stride;
+
+  if (k >= index->maxoffsets) {
+    index->maxoffsets = dl_max(2*index->maxoffsets,k+1);
+    index->offsets = index_off_realloc(index->offsets,index->maxoffsets);
+  }
+  index->offsets[k] = offset;
+  index->header.noffsets = dl_max(index->header.noffsets,k+1);
+}
+
+
+/**
+ * @brief Skip the rows of row based text before the window being read,
+ * without parsing them. With a loaded index, the read first jumps to the last
+ * indexed row at or before the window.
+ *
+ * @param handle The handle to read from.
+ *
+ * @return 1 if the window was reached, 0 if the file ended before it.
+ */
+static int __seek_window(
+    spmat_handle_t * const handle)
+{
+  size_t k, stride;
+  ssize_t linelen;
+  char const * line;
+  rowindex_t const * const index = handle->index;
+  size_t const rstart = handle->window.rstart;
+
+  if (handle->map && index && index->loaded && index->header.noffsets > 0) {
+    stride = (size_t)index->header.stride;
+    k = dl_min(rstart/stride,(size_t)index->header.noffsets-1);
+    if (k*stride > handle->drow && index->offsets[k] >= handle->mappos) {
+      handle->mappos = (size_t)index->offsets[k];
+      handle->drow = k*stride;
+    }
+  }
+
+  /* every line that is not a comment (including empty ones) is a row */
+  while (handle->drow < rstart) {
+    if ((linelen = __next_line(handle,&line)) < 0) {
+      return 0;
+    }
+    if (linelen == 0 || !__is_comment(line[0])) {
+      ++handle->drow;
+    }
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Read the rows of a memory-mapped file in parallel. The text is split
+ * into chunks on line boundaries, the rows in each chunk are counted to find
+ * which row each chunk starts with (unless an index says where they are),
+ * and then each chunk is parsed into its own band of the grid, which are
+ * merged once every chunk is parsed. Rows past the window being read are
+ * not parsed.
+ *
+ * @param handle The handle to read from.
+ * @param grid The grid to add the non-zeros to.
+ *
+ * @return 1 on success, 0 if a row is malformed.
+ */
+static int __read_rows_parallel(
+    spmat_handle_t * const handle,
+    grid_t * const grid)
+{
+  size_t c, nchunks, total, nnz, stride, bad;
+  size_t * offsets, * rowstart;
+  grid_t ** bands;
+  rowindex_t * index;
+  char const * const map = handle->map;
+  size_t const base = handle->window.rstart;
+
+  nchunks = CHUNKS_PER_THREAD*(size_t)max_threads();
+  if (handle->index && handle->index->loaded) {
+    offsets = __split_indexed(handle,nchunks,&rowstart);
+    index = NULL;
+  } else {
+    offsets = __split_lines(handle,nchunks);
+    rowstart = __count_rows(handle,offsets,nchunks);
+    index = handle->index;
+  }
+
+  /* rows past the number in the header are ignored */
+  total = rowstart[nchunks];
+  if (handle->nrows > 0) {
+    total = dl_min(total,handle->nrows);
+  }
+  total = dl_min(total,handle->window.rend);
+
+  /* empty rows at the end still count towards the height */
+  __extend_window(handle,grid,total,0);
+
+  /* every row is recorded by the thread that reads it */
+  stride = 1;
+  if (index && total > 0) {
+    stride = (size_t)index->header.stride;
+    __index_row(index,((total-1)/stride)*stride,0);
+  }
+
+  bands = grid_ptr_calloc(nchunks);
+
+  /* the first malformed row, if any */
+  bad = SIZE_MAX;
+  nnz = 0;
+  #pragma omp parallel for schedule(dynamic,1) reduction(min:bad) \
+      reduction(+:nnz)
+  for (c=0;c<nchunks;++c) {
+    ssize_t n;
+    char const * lend;
+    char const * sptr = map + offsets[c];
+    char const * const cend = map + offsets[c+1];
+    size_t row = rowstart[c];
+    size_t const rend = dl_min(rowstart[c+1],total);
+    if (row < rend) {
+      bands[c] = grid_create_band(grid->nx,grid->ny,grid->nrows,grid->ncols, \
+          grid->funcs,grid->prows > 0,row-base,rend-base);
+      while (sptr < cend && row < rend) {
+        char const * const nptr = __find_line(sptr,cend,&lend);
+        if (!__is_comment(*sptr)) {
+          if (index && row % stride == 0) {
+            index->offsets[row/stride] = sptr - map;
+          }
+          if (bad == SIZE_MAX) {
+            if ((n = __parse_row(handle,sptr,lend,row-base,bands[c])) < 0) {
+              bad = row;
+            } else {
+              nnz += (size_t)n;
+            }
+          }
+          ++row;
+        }
+        sptr = nptr;
+      }
+    }
+  }
+  handle->nnz += nnz;
+
+  for (c=0;c<nchunks;++c) {
+    if (bands[c]) {
+      grid_merge(grid,bands[c]);
+      grid_free(bands[c]);
+    }
+  }
+
+  handle->mappos = handle->mapsize;
+
+  dl_free(bands);
+  dl_free(rowstart);
+  dl_free(offsets);
+
+  if (bad != SIZE_MAX) {
+    eprintf("Row %zu is malformed\n",bad);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Read the points of a memory-mapped file in parallel, with each
+ * thread parsing its chunk of the text into its own grid, and the grids
+ * reduced into one at the end.
+ *
+ * @param handle The handle to read from.
+ * @param grid The grid to add the non-zeros to.
+ *
+ * @return 1 on success, 0 if a point is malformed.
+ */
+static int __read_points_private(
+    spmat_handle_t * const handle,
+    grid_t * const grid)
+{
+  int ok;
+  size_t c, nchunks, nnz;
+  size_t * offsets;
+  grid_t ** grids;
+  char const * const map = handle->map;
+  int const needval = grid_needs_values(grid);
+
+  nchunks = (size_t)max_threads();
+  offsets = __split_lines(handle,nchunks);
+
+  grids = grid_ptr_alloc(nchunks);
+
+  ok = 1;
+  nnz = 0;
+  #pragma omp parallel for schedule(static,1) reduction(&&:ok) \
+      reduction(+:nnz)
+  for (c=0;c<nchunks;++c) {
+    size_t i, j;
+    double val;
+    char const * lend;
+    char const * sptr = map + offsets[c];
+    char const * const cend = map + offsets[c+1];
+    grid_t * const mine = grid_create_like(grid);
+    while (ok && sptr < cend) {
+      char const * const nptr = __find_line(sptr,cend,&lend);
+      /* skip empty and comment lines */
+      if (__is_point_line(handle,sptr,lend)) {
+        if (__parse_point(handle,sptr,lend,&i,&j,&val,needval)) {
+          __add_point(handle,mine,i,j,val);
+          ++nnz;
+        } else {
+          ok = 0;
+        }
+      }
+      sptr = nptr;
+    }
+    grids[c] = mine;
+  }
+  handle->nnz += nnz;
+
+  grid_reduce(grid,grids,nchunks);
+
+  for (c=0;c<nchunks;++c) {
+    grid_free(grids[c]);
+  }
+  handle->mappos = handle->mapsize;
+
+  dl_free(grids);
+  dl_free(offsets);
+
+  return ok;
+}
+
+
+#ifndef NO_OMP
+/**
+ * @brief Add a point to a grid shared between threads, that already covers
+ * the point, and whose counts are wide enough that none can overflow. Points
+ * outside of the window being read are skipped.
+ *
+ * @param grid The grid.
+ * @param locks The locks guarding the bins that can not be updated atomically.
+ * @param window The window being read.
+ * @param i The row of the point.
+ * @param j The column of the point.
+ * @param val The value of the point.
+ */
+static inline void __add_point_shared(
+    grid_t * const grid,
+    omp_lock_t * const locks,
+    window_t const * const window,
+    size_t const i,
+    size_t const j,
+    real_t const val)
+{
+  size_t bin;
+
+  if (!__in_window(window,i,j)) {
+    return;
+  }
+  bin = grid_bin(grid,i-window->rstart,j-window->cstart);
+
+  switch (grid->cell) {
+    case GRID_CELL_COUNT32: {
+      uint32_t * const cells = (uint32_t*)grid->cells;
+      #pragma omp atomic
+      cells[bin] += 1;
+      break;
+    }
+    case GRID_CELL_COUNT64: {
+      uint64_t * const cells = (uint64_t*)grid->cells;
+      #pragma omp atomic
+      cells[bin] += 1;
+      break;
+    }
+    case GRID_CELL_AVERAGE: {
+      grid_avg_t * const cells = (grid_avg_t*)grid->cells;
+      #pragma omp atomic
+      cells[bin].count += 1;
+      #pragma omp atomic
+      cells[bin].sum += val;
+      break;
+    }
+    default:
+      /* the max and the whole records are updated under a lock */
+      omp_set_lock(locks+(bin%NUM_BIN_LOCKS));
+      grid_accumulate(grid,bin,val);
+      omp_unset_lock(locks+(bin%NUM_BIN_LOCKS));
+      break;
+  }
+}
+
+
+/**
+ * @brief Read the points of a memory-mapped file in parallel into a single
+ * shared grid, for when a private grid per thread would take too much memory.
+ * Unless they are given by a header, the extents of the points are found in
+ * a first pass so that the grid never has to grow, and then the bins are
+ * updated atomically (or under one of a set of striped locks for the max
+ * and for whole records of several functions).
+ *
+ * @param handle The handle to read from.
+ * @param grid The grid to add the non-zeros to.
+ *
+ * @return 1 on success, 0 if a point is malformed.
+ */
+static int __read_points_shared(
+    spmat_handle_t * const handle,
+    grid_t * const grid)
+{
+  int ok;
+  size_t c, l, nchunks, nrows, ncols, nnz;
+  size_t * offsets;
+  omp_lock_t * locks;
+  char const * const map = handle->map;
+  int const needval = grid_needs_values(grid);
+
+  nchunks = CHUNKS_PER_THREAD*(size_t)max_threads();
+  offsets = __split_lines(handle,nchunks);
+
+  ok = 1;
+  nrows = handle->nrows;
+  ncols = handle->ncols;
+  if (nrows == 0 || ncols == 0) {
+    ok = scan_dims(handle,&nrows,&ncols);
+  }
+
+  if (ok && nrows > 0) {
+    __extend_window(handle,grid,nrows,ncols);
+    /* the counts can not be widened once threads share them, so do it now
+     * unless the text is too short to hold enough points to overflow them */
+    if ((handle->mapsize-handle->mappos)/MIN_POINT_BYTES >= \
+        (size_t)(UINT32_MAX/(handle->mirror != 0 ? 2 : 1))) {
+      grid_widen(grid);
+    }
+
+    locks = omp_lock_alloc(NUM_BIN_LOCKS);
+    for (l=0;l<NUM_BIN_LOCKS;++l) {
+      omp_init_lock(locks+l);
+    }
+
+    nnz = 0;
+    #pragma omp parallel for schedule(dynamic,1) reduction(&&:ok) \
+        reduction(+:nnz)
+    for (c=0;c<nchunks;++c) {
+      size_t i, j;
+      double val;
+      char const * lend;
+      char const * sptr = map + offsets[c];
+      char const * const cend = map + offsets[c+1];
+      while (ok && sptr < cend) {
+        char const * const nptr = __find_line(sptr,cend,&lend);
+        if (__is_point_line(handle,sptr,lend)) {
+          if (__parse_point(handle,sptr,lend,&i,&j,&val,needval)) {
+            ++nnz;
+            __add_point_shared(grid,locks,&handle->window,i,j,val);
+            if (handle->mirror != 0 && i != j) {
+              __add_point_shared(grid,locks,&handle->window,j,i, \
+                  handle->mirror*val);
+            }
+          } else {
+            ok = 0;
+          }
+        }
+        sptr = nptr;
+      }
+    }
+
+    handle->nnz += nnz;
+
+    for (l=0;l<NUM_BIN_LOCKS;++l) {
+      omp_destroy_lock(locks+l);
+    }
+    dl_free(locks);
+  }
+
+  handle->mappos = handle->mapsize;
+
+  dl_free(offsets);
+
+  return ok;
+}
+#endif
+
+
+/**
+ * @brief Convert a block of the entries of numpy input.
+ *
+ * @param handle The handle of the numpy input.
+ * @param start The first entry.
+ * @param n The number of entries.
+ * @param rows The rows of the entries.
+ * @param cols The columns of the entries.
+ * @param vals The values of the entries (NULL if they are not needed).
+ *
+ * @return 1 on success, 0 if an index is negative.
+ */
+static int __convert_npy(
+    spmat_handle_t const * const handle,
+    size_t const start,
+    size_t const n,
+    size_t * const rows,
+    size_t * const cols,
+    real_t * const vals)
+{
+  size_t k;
+  npy_coo_t const * const coo = handle->npy;
+
+  if (npy_get_indices(&(coo->row),start,n,rows) != NPY_SUCCESS || \
+      npy_get_indices(&(coo->col),start,n,cols) != NPY_SUCCESS) {
+    dl_error("Negative index in entries %zu to %zu of npy input\n",start,
+        start+n);
+    return 0;
+  }
+  if (vals) {
+    if (coo->hasval) {
+      npy_get_values(&(coo->val),start,n,vals);
+    } else {
+      for (k=0;k<n;++k) {
+        vals[k] = 1.0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Find the extents of numpy input, with a parallel pass over the
+ * mapped row and column arrays a block at a time.
+ *
+ * @param handle The handle of the input.
+ * @param r_nrows One past the largest row.
+ * @param r_ncols One past the largest column.
+ *
+ * @return 1 on success, 0 if an entry is negative.
+ */
+static int __scan_npy(
+    spmat_handle_t const * const handle,
+    size_t * const r_nrows,
+    size_t * const r_ncols)
+{
+  int ok;
+  size_t b, nblocks, nrows, ncols;
+  size_t const nnz = handle->npy->nnz;
+
+  nblocks = (nnz + NPY_BLOCK_SIZE - 1) / NPY_BLOCK_SIZE;
+
+  ok = 1;
+  nrows = ncols = 0;
+  #pragma omp parallel for schedule(static) reduction(&&:ok) \
+      reduction(max:nrows,ncols)
+  for (b=0;b<nblocks;++b) {
+    size_t k;
+    size_t rows[NPY_BLOCK_SIZE], cols[NPY_BLOCK_SIZE];
+    size_t const start = b*NPY_BLOCK_SIZE;
+    size_t const n = dl_min(NPY_BLOCK_SIZE,nnz-start);
+    if (ok && __convert_npy(handle,start,n,rows,cols,NULL)) {
+      for (k=0;k<n;++k) {
+        nrows = dl_max(nrows,rows[k]+1);
+        ncols = dl_max(ncols,cols[k]+1);
+      }
+    } else {
+      ok = 0;
+    }
+  }
+
+  *r_nrows = nrows;
+  *r_ncols = ncols;
+
+  return ok;
+}
+
+
+/**
+ * @brief Read the entries of numpy input, a block at a time. Each block is
+ * converted in a pass per array and added to the private grid of a thread,
+ * after a first pass to find the extents of the matrix if they are not
+ * given (see find_dims()).
+ *
+ * @param handle The handle to read from.
+ * @param grid The grid to add the non-zeros to.
+ *
+ * @return 1 on success, 0 if an entry is negative or outside of the given
+ * dimensions.
+ */
+static int __read_points_npy(
+    spmat_handle_t * const handle,
+    grid_t * const grid)
+{
+  int ok;
+  size_t b, t, nblocks, nthreads, nrows, ncols;
+  grid_t ** grids;
+  size_t const nnz = handle->npy->nnz;
+  int const needval = handle->val && grid_needs_values(grid);
+
+  nblocks = (nnz + NPY_BLOCK_SIZE - 1) / NPY_BLOCK_SIZE;
+
+  ok = 1;
+  nrows = handle->nrows;
+  ncols = handle->ncols;
+  if (nrows == 0 || ncols == 0) {
+    if (!__scan_npy(handle,&nrows,&ncols)) {
+      return 0;
+    }
+    nrows = dl_max(nrows,handle->nrows);
+    ncols = dl_max(ncols,handle->ncols);
+  }
+  __extend_window(handle,grid,nrows,ncols);
+
+  nthreads = (size_t)max_threads();
+  #ifndef NO_OMP
+  nthreads = dl_max(dl_min(nthreads,__private_grid_limit / \
+      (grid->maxbrows*grid->maxbcols*grid_cell_size(grid))),1);
+  #endif
+  grids = grid_ptr_alloc(nthreads);
+  for (t=0;t<nthreads;++t) {
+    grids[t] = grid_create_like(grid);
+  }
+
+  #pragma omp parallel for num_threads(nthreads) schedule(static) \
+      reduction(&&:ok)
+  for (b=0;b<nblocks;++b) {
+    size_t k, m;
+    size_t rows[NPY_BLOCK_SIZE], cols[NPY_BLOCK_SIZE];
+    real_t vals[NPY_BLOCK_SIZE];
+    size_t const start = b*NPY_BLOCK_SIZE;
+    size_t const n = dl_min(NPY_BLOCK_SIZE,nnz-start);
+    if (!ok || !__convert_npy(handle,start,n,rows,cols, \
+        needval ? vals : NULL)) {
+      ok = 0;
+      continue;
+    }
+    for (k=0;k<n;++k) {
+      if (rows[k] >= nrows || cols[k] >= ncols) {
+        dl_error("Entry (%zu,%zu) is outside of the %zux%zu matrix\n", \
+            rows[k],cols[k],nrows,ncols);
+        ok = 0;
+      }
+    }
+    if (ok) {
+      m = __window_points(&handle->window,rows,cols,needval ? vals : NULL,n);
+      grid_add_points(grids[thread_id()],rows,cols,vals,m);
+    }
+  }
+  handle->nnz += nnz;
+  handle->npos = nnz;
+
+  grid_reduce(grid,grids,nthreads);
+  for (t=0;t<nthreads;++t) {
+    grid_free(grids[t]);
+  }
+  dl_free(grids);
+
+  return ok;
+}
+
+
+/**
+ * @brief Get the next entry of numpy input.
+ *
+ * @param handle The handle to read from.
+ * @param r_i The row of the entry.
+ * @param r_j The column of the entry.
+ * @param r_val The value of the entry.
+ *
+ * @return 1 if an entry was read, 0 at the end of the input.
+ */
+static int __next_npy(
+    spmat_handle_t * const handle,
+    size_t * const r_i,
+    size_t * const r_j,
+    double * const r_val)
+{
+  real_t val;
+
+  if (handle->npos >= handle->npy->nnz || \
+      !__convert_npy(handle,handle->npos,1,r_i,r_j,&val)) {
+    return 0;
+  }
+  ++handle->npos;
+  *r_val = val;
+
+  return 1;
+}
+
+
+/**
+ * @brief Point a csr matrix at the arrays of a mapped binary csr file.
+ *
+ * @param header The header at the start of the file.
+ *
+ * @return The matrix (which does not own the mapping).
+ */
+static csrmap_t * __bcsr_csrmap(
+    bcsr_header_t const * const header)
+{
+  csrmap_t * csr;
+  char const * const base = (char const *)header;
+
+  csr = csrmap_create();
+  csr->nrows = (size_t)header->nrows;
+  csr->ncols = (size_t)header->ncols;
+  csr->nnz = (size_t)header->nnz;
+  csr->rowptr = base + header->rowptroff;
+  csr->ptrwidth = sizeof(uint64_t);
+  csr->nptrs = csr->nrows+1;
+  csr->colind = base + header->colindoff;
+  csr->idxwidth = header->idxwidth;
+  csr->idxstride = header->idxwidth;
+  csr->vals = base + header->valsoff;
+  switch (header->valtype) {
+    case BCSR_VALUE_FLOAT:
+      csr->valtype = CSRMAP_VALUE_FLOAT;
+      csr->valstride = sizeof(float);
+      break;
+    case BCSR_VALUE_DOUBLE:
+      csr->valtype = CSRMAP_VALUE_DOUBLE;
+      csr->valstride = sizeof(double);
+      break;
+    default:
+      csr->valtype = CSRMAP_VALUE_NONE;
+  }
+
+  return csr;
+}
+
+
+/**
+ * @brief Add the non-zeros of a range of rows of a matrix in csr form, that
+ * are inside of the window being read, to the grid.
+ *
+ * @param handle The handle of the matrix.
+ * @param rstart The first row (inside of the window).
+ * @param rend One past the last row (inside of the window).
+ * @param grid The grid to add the non-zeros to.
+ */
+static void __add_csr_rows(
+    spmat_handle_t const * const handle,
+    size_t const rstart,
+    size_t const rend,
+    grid_t * const grid)
+{
+  size_t i, j;
+  uint64_t k, start, end;
+  csrmap_t const * const csr = handle->csr;
+  window_t const * const window = &handle->window;
+
+  end = csrmap_rowptr(csr,rstart);
+  for (i=rstart;i<rend;++i) {
+    start = end;
+    end = csrmap_rowptr(csr,i+1);
+    if (end < start || end > csr->nnz) {
+      dl_error("Invalid offsets for row %zu\n",i);
+    }
+    for (k=start;k<end;++k) {
+      j = csrmap_col(csr,k);
+      if (j >= csr->ncols) {
+        dl_error("Column %zu of row %zu is out of range\n",j,i);
+      }
+      if (j >= window->cstart && j < window->cend) {
+        grid_add(grid,i-window->rstart,j-window->cstart,csrmap_val(csr,k));
+      }
+    }
+  }
+}
+
+
+/**
+ * @brief Read the rows of a matrix in csr form (those inside of the window
+ * being read), splitting them into bands with an even number of non-zeros
+ * between threads when it is worth it.
+ *
+ * @param handle The handle to read from.
+ * @param grid The grid to add the non-zeros to.
+ *
+ * @return 1 on success.
+ */
+static int __read_rows_csr(
+    spmat_handle_t * const handle,
+    grid_t * const grid)
+{
+  size_t c, nchunks, lo, hi, mid;
+  uint64_t target, first, nnz;
+  size_t * rowstart;
+  grid_t ** bands;
+  csrmap_t const * const csr = handle->csr;
+  size_t const nrows = csr->nrows;
+  size_t const rstart = dl_min(handle->window.rstart,nrows);
+  size_t const rend = dl_min(handle->window.rend,nrows);
+
+  __extend_window(handle,grid,nrows,csr->ncols);
+  first = csrmap_rowptr(csr,rstart);
+  nnz = csrmap_rowptr(csr,rend) - first;
+  handle->nnz += nnz;
+  handle->drow = nrows;
+
+  nchunks = CHUNKS_PER_THREAD*(size_t)max_threads();
+  if (max_threads() == 1 || rend - rstart < nchunks || \
+      nnz*csr->idxstride < MIN_PARALLEL_BYTES) {
+    __add_csr_rows(handle,rstart,rend,grid);
+    return 1;
+  }
+
+  /* find the row each chunk starts at */
+  rowstart = size_alloc(nchunks+1);
+  rowstart[0] = rstart;
+  for (c=1;c<nchunks;++c) {
+    target = first + ((nnz*c)/nchunks);
+    lo = rowstart[c-1];
+    hi = rend;
+    while (lo < hi) {
+      mid = lo + ((hi-lo)/2);
+      if (csrmap_rowptr(csr,mid) < target) {
+        lo = mid+1;
+      } else {
+        hi = mid;
+      }
+    }
+    rowstart[c] = lo;
+  }
+  rowstart[nchunks] = rend;
+
+  bands = grid_ptr_calloc(nchunks);
+
+  #pragma omp parallel for schedule(dynamic,1)
+  for (c=0;c<nchunks;++c) {
+    if (rowstart[c] < rowstart[c+1]) {
+      bands[c] = grid_create_band(grid->nx,grid->ny,grid->nrows,grid->ncols, \
+          grid->funcs,grid->prows > 0,rowstart[c]-rstart, \
+          rowstart[c+1]-rstart);
+      __add_csr_rows(handle,rowstart[c],rowstart[c+1],bands[c]);
+    }
+  }
+
+  for (c=0;c<nchunks;++c) {
+    if (bands[c]) {
+      grid_merge(grid,bands[c]);
+      grid_free(bands[c]);
+    }
+  }
+
+  dl_free(bands);
+  dl_free(rowstart);
+
+  return 1;
+}
+
+
+/**
+ * @brief Store a non-zero of a row read by read_row_entries(), growing the
+ * arrays as needed.
+ *
+ * @param r_ind The column indices.
+ * @param r_val The values.
+ * @param r_cap The size of the two arrays.
+ * @param idx The position to store the non-zero at.
+ * @param col The column of the non-zero.
+ * @param val The value of the non-zero.
+ */
+static inline void __push_entry(
+    size_t ** const r_ind,
+    real_t ** const r_val,
+    size_t * const r_cap,
+    size_t const idx,
+    size_t const col,
+    real_t const val)
+{
+  if (idx == *r_cap) {
+    *r_cap *= 2;
+    *r_ind = size_realloc(*r_ind,*r_cap);
+    *r_val = real_realloc(*r_val,*r_cap);
+  }
+  (*r_ind)[idx] = col;
+  (*r_val)[idx] = val;
+}
+
+
+/**
+ * @brief Read the rows of a raw dense matrix (those inside of the window
+ * being read), splitting them into bands between threads when it is worth it.
+ *
+ * @param handle The handle to read from.
+ * @param grid The grid to add the values to.
+ *
+ * @return 1 on success.
+ */
+static int __read_rows_raw(
+    spmat_handle_t * const handle,
+    grid_t * const grid)
+{
+  size_t c, i, nchunks, first, last;
+  grid_t ** bands;
+  size_t const nrows = handle->nrows;
+  size_t const base = handle->window.rstart;
+
+  __extend_window(handle,grid,nrows,handle->ncols);
+
+  first = dl_max(handle->drow,base);
+  last = dl_min(nrows,handle->window.rend);
+
+  nchunks = CHUNKS_PER_THREAD*(size_t)max_threads();
+  if (max_threads() == 1 || first + nchunks > last || \
+      handle->mapsize < MIN_PARALLEL_BYTES) {
+    for (i=first;i<last;++i) {
+      __add_raw_row(handle,i,i-base,grid);
+    }
+    handle->drow = nrows;
+    return 1;
+  }
+
+  bands = grid_ptr_calloc(nchunks);
+
+  /* every row is the same amount of work */
+  #pragma omp parallel for schedule(dynamic,1)
+  for (c=0;c<nchunks;++c) {
+    size_t r;
+    size_t const rstart = first + (((last-first)*c)/nchunks);
+    size_t const rend = first + (((last-first)*(c+1))/nchunks);
+    if (rstart < rend) {
+      bands[c] = grid_create_band(grid->nx,grid->ny,grid->nrows,grid->ncols, \
+          grid->funcs,grid->prows > 0,rstart-base,rend-base);
+      for (r=rstart;r<rend;++r) {
+        __add_raw_row(handle,r,r-base,bands[c]);
+      }
+    }
+  }
+
+  for (c=0;c<nchunks;++c) {
+    if (bands[c]) {
+      grid_merge(grid,bands[c]);
+      grid_free(bands[c]);
+    }
+  }
+  handle->drow = nrows;
+
+  dl_free(bands);
+
+  return 1;
+}
+
+
+
+/**
+ * @brief Choose the order to sample the blocks of a preview in. Block k is
+ * visited k*step (mod nblocks)'th, with a step near nblocks divided by the
+ * golden ratio, so that however many blocks a preview gets through they are
+ * spread evenly over the file.
+ *
+ * @param nblocks The number of blocks.
+ *
+ * @return The step (coprime with nblocks, so every block is visited).
+ */
+static size_t __preview_step(
+    size_t const nblocks)
+{
+  size_t step, a, b, t;
+
+  step = dl_max((size_t)(nblocks*0.6180339887),1);
+  for (;step<nblocks;++step) {
+    a = nblocks;
+    b = step;
+    while (b > 0) {
+      t = a % b;
+      a = b;
+      b = t;
+    }
+    if (a == 1) {
+      break;
+    }
+  }
+
+  return step < nblocks ? step : 1;
+}
+
+
+/**
+ * @brief Find where a block of the mapped text sampled by a preview starts.
+ * Blocks are an even split of the bytes, moved forward to the next line
+ * start, so together they cover every line exactly once.
+ *
+ * @param handle The handle to sample.
+ * @param block The block (nblocks for the end of the text).
+ * @param nblocks The number of blocks.
+ *
+ * @return The offset of the block in the mapping.
+ */
+static size_t __preview_offset(
+    spmat_handle_t const * const handle,
+    size_t const block,
+    size_t const nblocks)
+{
+  size_t pos;
+  char const * eptr;
+  rowindex_t const * const index = handle->index;
+  size_t const start = handle->mappos;
+  size_t const end = handle->mapsize;
+
+  if (block == 0) {
+    return start;
+  } else if (block == nblocks) {
+    return end;
+  } else if (handle->use_rows && index && index->loaded) {
+    /* each block is a stride of rows */
+    return (size_t)index->offsets[block];
+  }
+  pos = start + (size_t)(((double)(end-start)*block)/nblocks);
+
+  return __find_line(handle->map+pos,handle->map+end,&eptr) - handle->map;
+}
+
+
+/**
+ * @brief Add the rows/points in a block of mapped text to the grid.
+ *
+ * @param handle The handle to sample.
+ * @param sptr The start of the block.
+ * @param eptr The end of the block.
+ * @param row The row of the first line of the block (for row based formats).
+ * @param nrows The number of rows, past which lines are ignored.
+ * @param grid The grid to add the non-zeros to.
+ *
+ * @return The number of non-zeros, or -1 if a line is malformed.
+ */
+static ssize_t __preview_text(
+    spmat_handle_t const * const handle,
+    char const * sptr,
+    char const * const eptr,
+    size_t row,
+    size_t const nrows,
+    grid_t * const grid)
+{
+  ssize_t n;
+  size_t i, j, nnz;
+  double val;
+  char const * lend;
+  window_t const * const window = &handle->window;
+
+  nnz = 0;
+  while (sptr < eptr) {
+    char const * const nptr = __find_line(sptr,eptr,&lend);
+    if (handle->use_rows) {
+      if (!__is_comment(*sptr)) {
+        if (row >= nrows || row >= window->rend) {
+          break;
+        }
+        if (row >= window->rstart) {
+          n = __parse_row(handle,sptr,lend,row-window->rstart,grid);
+          if (n < 0) {
+            return -1;
+          }
+          nnz += (size_t)n;
+        }
+        ++row;
+      }
+    } else if (__is_point_line(handle,sptr,lend)) {
+      if (!__parse_point(handle,sptr,lend,&i,&j,&val, \
+          grid_needs_values(grid))) {
+        return -1;
+      }
+      __add_point(handle,grid,i,j,val);
+      ++nnz;
+    }
+    sptr = nptr;
+  }
+
+  return (ssize_t)nnz;
+}
+
+
+/**
+ * @brief Estimate the number of rows in mapped text from the number of lines
+ * in a sample of its blocks.
+ *
+ * @param handle The handle to sample.
+ * @param nblocks The number of blocks.
+ * @param step The order the blocks are sampled in.
+ *
+ * @return The estimated number of rows.
+ */
+static size_t __preview_count_rows(
+    spmat_handle_t const * const handle,
+    size_t const nblocks,
+    size_t const step)
+{
+  size_t k, b, lines, bytes, nsample;
+  char const * sptr, * eptr, * lend;
+  char const * const map = handle->map;
+
+  nsample = dl_min(nblocks,PREVIEW_COUNT_BLOCKS);
+  lines = 0;
+  bytes = 0;
+  for (k=0;k<nsample;++k) {
+    b = (k*step) % nblocks;
+    sptr = map + __preview_offset(handle,b,nblocks);
+    eptr = map + __preview_offset(handle,b+1,nblocks);
+    bytes += eptr - sptr;
+    while (sptr < eptr) {
+      if (!__is_comment(*sptr)) {
+        ++lines;
+      }
+      sptr = __find_line(sptr,eptr,&lend);
+    }
+  }
+  if (bytes == 0) {
+    return 0;
+  }
+
+  return (size_t)((((double)lines)*(handle->mapsize-handle->mappos))/bytes + \
+      0.5);
+}
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+spmat_handle_t * open_matrix(
+    char const * const name, 
+    filetype_t const type,
+    size_t const nrows,
+    size_t const ncols)
+{
+  long flags, aux;
+  unsigned long long num;
+  ssize_t linelen;
+  char const * line, * sptr, * eptr, * nptr;
+  compression_t ctype;
+  spmat_handle_t * handle;
+
+  handle = spmat_handle_calloc(1);
+  handle->fd = -1;
+  handle->window.rend = WINDOW_END;
+  handle->window.cend = WINDOW_END;
+  handle->linesize = DEFAULT_BUFFER_SIZE;
+  handle->line = char_alloc(handle->linesize);
+
+  /* compressed files and standard input are streamed through the ring of
+   * buffers filled by a separate thread */
+  ctype = decompress_type(name);
+  if (type == FILETYPE_NPY) {
+    /* the arrays are mapped and used in place */
+    if ((handle->npy = npy_open(name)) == NULL) {
+      goto FAIL;
+    }
+  } else if (type == FILETYPE_LIGRA) {
+    /* as are the offsets and edges of a ligra graph */
+    if ((handle->csr = graph_open_ligra(name)) == NULL) {
+      goto FAIL;
+    }
+  } else if (ctype != COMPRESSION_NONE || \
+      strcmp(name,DECOMPRESS_STDIN) == 0) {
+    if ((handle->decomp = decompress_open(name,ctype)) == NULL) {
+      eprintf("Failed to open '%s' for reading\n",name);
+      goto FAIL;
+    }
+  } else if (!__map_file(handle,name)) {
+    if (dl_open_file(name,"r",&(handle->fp)) != DL_FILE_SUCCESS) {
+      dl_error("Failed to open '%s' for reading\n",name);
+      perror("Cause:");
+      goto FAIL;
+    }
+  }
+
+  sptr = eptr = NULL;
+  if (FILETYPE_HEADER[type]) {
+    if ((linelen = __next_header_line(handle,&line)) < 0) {
+      eprintf("Failed to find header in '%s'\n",name);
+      goto FAIL;
+    }
+    sptr = line;
+    eptr = line + linelen;
+  }
+
+  switch (type) {
+    case FILETYPE_METIS:
+      handle->use_rows = 1;
+      if ((nptr = parse_uint(sptr,eptr,&num)) == NULL) {
+        dl_error("Failed to read number of vertices from metis file '%s'\n",
+            name);
+        goto FAIL;
+      }
+      handle->ncols = handle->nrows = (size_t)num;
+      /* vertices are numbered from 1 */
+      handle->ijbase = 1;
+      sptr = nptr;
+      if ((nptr = parse_uint(sptr,eptr,&num)) == NULL) {
+        eprintf("Failed to read number of edges from metis file '%s'\n",name);
+        goto FAIL;
+      }
+      if (num == 0) { /* don't care about nnz */
+        wprintf("Sparse matrix is all zeros.\n");
+      }
+      sptr = nptr;
+      if ((nptr = __read_long(sptr,eptr,&flags)) == NULL) {
+        flags = 0;
+      } else {
+        sptr = nptr;
+      }
+      if (flags == 0) {
+        /* no weights */
+        handle->val = 0;
+        handle->nfields = 1;
+        handle->idxoffset = 0;
+        handle->lineoffset = 0;
+      } else if (flags == 1) {
+        /* only edge weights */
+        handle->val = 1;
+        handle->nfields = 2;
+        handle->idxoffset = 0;
+        handle->valoffset = 1;
+        handle->lineoffset = 0;
+      } else if (flags == 10 || flags == 11) {
+        /* vertex weights, and maybe edge weights */
+        if (flags == 11) {
+          handle->val = 1;
+          handle->nfields = 2;
+          handle->valoffset = 1;
+        } else {
+          handle->val = 0;
+          handle->nfields = 1;
+        }
+        handle->idxoffset = 0;
+        if (__read_long(sptr,eptr,&aux) == NULL) {
+          handle->lineoffset = 1;
+        } else {
+          handle->lineoffset = aux;
+        }
+      } else {
+        eprintf("Unsupported metis format flags '%ld' in '%s'\n",flags,name);
+        goto FAIL;
+      }
+      break;
+    case FILETYPE_CLUTO:
+      handle->use_rows = 1;
+      handle->val = 1;
+      if ((nptr = parse_uint(sptr,eptr,&num)) == NULL) {
+        eprintf("Failed to read number of rows from cluto file '%s'\n",name);
+        goto FAIL;
+      }
+      handle->nrows = (size_t)num;
+      sptr = nptr;
+      if ((nptr = parse_uint(sptr,eptr,&num)) == NULL) {
+        eprintf("Failed to read number of rows from cluto file '%s'\n",name);
+        goto FAIL;
+      }
+      handle->ncols = (size_t)num;
+      /* columns are numbered from 1 */
+      handle->ijbase = 1;
+      /* throw away nnz */
+      handle->lineoffset = 0;
+      handle->nfields = 2;
+      handle->idxoffset = 0;
+      handle->valoffset = 1;
+      break;
+    case FILETYPE_CSR_HEADER: /* the header is useless */
+    case FILETYPE_CSR:
+      /* dimensions are discovered as the rows are read */
+      handle->use_rows = 1;
+      handle->val = 1;
+      handle->nrows = 0;
+      handle->ncols = 0;
+      handle->lineoffset = 0;
+      handle->idxoffset = 0;
+      handle->valoffset = 1;
+      handle->nfields = 2;
+      break;
+    case FILETYPE_BCSR:
+      if (!handle->map) {
+        eprintf("Binary csr file '%s' must be a regular file\n",name);
+        goto FAIL;
+      }
+      if (bcsr_check((bcsr_header_t const *)handle->map,handle->mapsize) != \
+          BCSR_SUCCESS) {
+        eprintf("Invalid binary csr file '%s'\n",name);
+        goto FAIL;
+      }
+      handle->csr = __bcsr_csrmap((bcsr_header_t const *)handle->map);
+      handle->use_rows = 1;
+      handle->val = handle->csr->valtype != CSRMAP_VALUE_NONE;
+      handle->nrows = handle->csr->nrows;
+      handle->ncols = handle->csr->ncols;
+      /* there is no text to tokenize */
+      handle->mappos = handle->mapsize;
+      break;
+    case FILETYPE_GAP:
+      if (!handle->map) {
+        eprintf("GAP graph '%s' must be a regular file\n",name);
+        goto FAIL;
+      }
+      if ((handle->csr = graph_open_gap(handle->map,handle->mapsize, \
+          name)) == NULL) {
+        goto FAIL;
+      }
+      /* fall through */
+    case FILETYPE_LIGRA:
+      handle->use_rows = 1;
+      handle->val = handle->csr->valtype != CSRMAP_VALUE_NONE;
+      handle->nrows = handle->csr->nrows;
+      handle->ncols = handle->csr->ncols;
+      handle->drow = 0;
+      handle->mappos = handle->mapsize;
+      break;
+    case FILETYPE_MTX:
+      if (!__read_mtx_header(handle,name)) {
+        goto FAIL;
+      }
+      break;
+    case FILETYPE_DIMACS:
+      if (!__read_dimacs_header(handle,name)) {
+        goto FAIL;
+      }
+      break;
+    case FILETYPE_DENSE:
+      /* each line is a row, holding the value of every column */
+      handle->use_rows = 1;
+      handle->val = 1;
+      handle->denserows = 1;
+      handle->nrows = 0;
+      handle->ncols = 0;
+      break;
+    case FILETYPE_RAW:
+      /* row-major floats or doubles, with nothing to say how many */
+      if (!handle->map) {
+        eprintf("Raw file '%s' must be a regular file\n",name);
+        goto FAIL;
+      }
+      if (nrows == 0 || ncols == 0) {
+        eprintf("The dimensions of raw file '%s' must be given\n",name);
+        goto FAIL;
+      }
+      if (handle->mapsize == nrows*ncols*sizeof(float)) {
+        handle->rawwidth = sizeof(float);
+      } else if (handle->mapsize == nrows*ncols*sizeof(double)) {
+        handle->rawwidth = sizeof(double);
+      } else {
+        eprintf("Raw file '%s' of %zu bytes is not a %zux%zu matrix of floats "
+            "or doubles\n",name,handle->mapsize,nrows,ncols);
+        goto FAIL;
+      }
+      handle->use_rows = 1;
+      handle->val = 1;
+      handle->denserows = 1;
+      handle->nrows = nrows;
+      handle->ncols = ncols;
+      handle->drow = 0;
+      /* there is no text to tokenize */
+      handle->mappos = handle->mapsize;
+      break;
+    case FILETYPE_NPY:
+      /* dimensions are discovered from the arrays */
+      handle->use_rows = 0;
+      handle->val = handle->npy->hasval;
+      handle->nrows = 0;
+      handle->ncols = 0;
+      break;
+    case FILETYPE_COO:
+    case FILETYPE_POINT:
+      /* dimensions are discovered as the points are read */
+      handle->use_rows = 0;
+      handle->val = 1;
+      handle->nrows = 0;
+      handle->ncols = 0;
+      handle->lineoffset = 0;
+      handle->idxoffset = 1;
+      handle->valoffset = 2;
+      handle->nfields = 3;
+      break;
+    default :
+      dl_error("Unknown filetype '%d'\n",type);
+  }
+
+  /* dimensions given ahead of time fill in what the file does not say */
+  if (handle->nrows == 0) {
+    handle->nrows = nrows;
+  }
+  if (handle->ncols == 0) {
+    handle->ncols = ncols;
+  }
+
+  dprintf("Created handle for %zux%zu matrix\n",handle->nrows,handle->ncols);
+
+  return handle;
+
+  FAIL:
+  close_matrix(handle);
+  return NULL;
+}
+
+
+int set_window(
+    spmat_handle_t * const handle,
+    window_t const * const window)
+{
+  if (window->rstart >= window->rend || window->cstart >= window->cend) {
+    eprintf("A window must hold at least one row and column\n");
+    return 0;
+  }
+  if ((handle->nrows > 0 && window->rstart >= handle->nrows) || \
+      (handle->ncols > 0 && window->cstart >= handle->ncols)) {
+    eprintf("The window starting at row %zu and column %zu is outside of the "
+        "%zux%zu matrix\n",window->rstart,window->cstart,handle->nrows, \
+        handle->ncols);
+    return 0;
+  }
+
+  handle->window = *window;
+
+  /* only a read of the whole file says enough about it to index it */
+  if (handle->index && !handle->index->loaded) {
+    if (handle->index->offsets) {
+      dl_free(handle->index->offsets);
+    }
+    dl_free(handle->index);
+    handle->index = NULL;
+  }
+
+  return 1;
+}
+
+
+int offset_matrix(
+    spmat_handle_t * const handle,
+    size_t const roffset,
+    size_t const coffset)
+{
+  if (handle->csr || handle->npy || handle->rawwidth || handle->dense || \
+      handle->denserows || handle->index) {
+    eprintf("Only the rows and columns of sparse text input can be offset\n");
+    return 0;
+  }
+
+  handle->roffset = roffset;
+  handle->coffset = coffset;
+  if (handle->use_rows) {
+    handle->drow = roffset;
+  }
+  handle->nrows = 0;
+  handle->ncols = 0;
+
+  return 1;
+}
+
+
+void window_dims(
+    spmat_handle_t const * const handle,
+    size_t * const r_nrows,
+    size_t * const r_ncols)
+{
+  window_t const * const window = &handle->window;
+
+  /* without the dimensions of the matrix, a bounded window gives them */
+  if (handle->nrows > 0) {
+    *r_nrows = __window_extent(handle->nrows,window->rstart,window->rend);
+  } else if (window->rend != WINDOW_END) {
+    *r_nrows = window->rend - window->rstart;
+  } else {
+    *r_nrows = 0;
+  }
+  if (handle->ncols > 0) {
+    *r_ncols = __window_extent(handle->ncols,window->cstart,window->cend);
+  } else if (window->cend != WINDOW_END) {
+    *r_ncols = window->cend - window->cstart;
+  } else {
+    *r_ncols = 0;
+  }
+}
+
+
+int resume_matrix(
+    spmat_handle_t * const handle,
+    size_t const offset,
+    char const * const tail,
+    size_t const ntail)
+{
+  size_t end;
+
+  if (handle->map == NULL || handle->use_rows || handle->dense || \
+      handle->npy) {
+    return 0;
+  }
+
+  if (offset > 0) {
+    /* the file must still hold what was read, followed by more */
+    if (offset < handle->mappos || offset > handle->mapsize || \
+        ntail > offset || \
+        memcmp(handle->map+offset-ntail,tail,ntail) != 0) {
+      return 0;
+    }
+    handle->mappos = offset;
+  }
+
+  /* the last line may be only partly written */
+  end = handle->mapsize;
+  while (end > handle->mappos && handle->map[end-1] != '\n') {
+    --end;
+  }
+  handle->mapsize = end;
+
+  return 1;
+}
+
+
+size_t matrix_tail(
+    spmat_handle_t const * const handle,
+    char * const tail,
+    size_t const maxtail)
+{
+  size_t const ntail = dl_min(handle->mappos,maxtail);
+
+  memcpy(tail,handle->map+handle->mappos-ntail,ntail);
+
+  return ntail;
+}
+
+
+void set_private_grid_limit(
+    size_t const bytes)
+{
+  #ifndef NO_OMP
+  __private_grid_limit = bytes;
+  #else
+  (void)bytes;
+  #endif
+}
+
+
+void release_matrix(
+    spmat_handle_t * const handle)
+{
+  size_t start, end;
+  csrmap_t const * const csr = handle->csr;
+
+  if (csr) {
+    start = (size_t)csrmap_rowptr(csr,handle->mapfree);
+    end = (size_t)csrmap_rowptr(csr,handle->drow);
+    if (end < start || (end-start)*csr->idxstride < MIN_RELEASE_BYTES) {
+      return;
+    }
+    __release(csr->rowptr+(handle->mapfree*csr->ptrwidth), \
+        csr->rowptr+(dl_min(handle->drow,csr->nptrs)*csr->ptrwidth));
+    __release(csr->colind+(start*csr->idxstride), \
+        csr->colind+(end*csr->idxstride));
+    if (csr->valtype != CSRMAP_VALUE_NONE) {
+      __release(csr->vals+(start*csr->valstride), \
+          csr->vals+(end*csr->valstride));
+    }
+    handle->mapfree = handle->drow;
+  } else if (handle->map) {
+    if (handle->mappos < handle->mapfree + MIN_RELEASE_BYTES) {
+      return;
+    }
+    __release(handle->map+handle->mapfree,handle->map+handle->mappos);
+    handle->mapfree = handle->mappos;
+  }
+}
+
+
+int split_matrix(
+    spmat_handle_t * const handle,
+    size_t const part,
+    size_t const nparts)
+{
+  size_t pos, start, end;
+  char const * eptr;
+  char const * const map = handle->map;
+  size_t const first = handle->mappos;
+  size_t const last = handle->mapsize;
+
+  if (map == NULL || handle->csr || handle->rawwidth || handle->dense || \
+      handle->npy || (handle->index && handle->index->loaded) || \
+      part >= nparts) {
+    return 0;
+  }
+
+  /* every part ends where the next one starts, on the first line to start
+   * after an even split of the bytes */
+  start = first;
+  end = last;
+  if (part > 0) {
+    pos = first + (((last-first)*part)/nparts);
+    start = __find_line(map+pos,map+last,&eptr) - map;
+  }
+  if (part+1 < nparts) {
+    pos = first + (((last-first)*(part+1))/nparts);
+    end = __find_line(map+pos,map+last,&eptr) - map;
+  }
+
+  handle->mappos = start;
+  handle->mapsize = end;
+
+  return 1;
+}
+
+
+size_t count_rows(
+    spmat_handle_t const * const handle)
+{
+  size_t nrows;
+  char const * lend;
+  char const * sptr = handle->map + handle->mappos;
+  char const * const end = handle->map + handle->mapsize;
+
+  /* every line that is not a comment (including empty ones) is a row */
+  nrows = 0;
+  while (sptr < end) {
+    if (!__is_comment(*sptr)) {
+      ++nrows;
+    }
+    sptr = __find_line(sptr,end,&lend);
+  }
+
+  return nrows;
+}
+
+
+int scan_dims(
+    spmat_handle_t const * const handle,
+    size_t * const r_nrows,
+    size_t * const r_ncols)
+{
+  int ok;
+  size_t c, nchunks, nrows, ncols, lines;
+  size_t * offsets;
+  char const * const map = handle->map;
+
+  if (map == NULL || handle->csr || handle->rawwidth || handle->dense || \
+      handle->npy) {
+    return 0;
+  }
+
+  nchunks = CHUNKS_PER_THREAD*(size_t)max_threads();
+  offsets = __split_lines(handle,nchunks);
+
+  ok = 1;
+  nrows = ncols = lines = 0;
+  #pragma omp parallel for schedule(dynamic,1) reduction(&&:ok) \
+      reduction(max:nrows,ncols) reduction(+:lines)
+  for (c=0;c<nchunks;++c) {
+    char const * lend;
+    char const * sptr = map + offsets[c];
+    char const * const cend = map + offsets[c+1];
+    while (ok && sptr < cend) {
+      char const * const nptr = __find_line(sptr,cend,&lend);
+      /* every line that is not a comment (including empty ones) is a row */
+      if (handle->use_rows ? !__is_comment(*sptr) : \
+          __is_point_line(handle,sptr,lend)) {
+        lines += handle->use_rows;
+        ok = __scan_line(handle,sptr,lend,&nrows,&ncols);
       }
-      if (!handle->val) {
-        /* if we dont' have values */
-        if (pavg) {
-          pavg[idx] += 1.0; 
+      sptr = nptr;
+    }
+  }
+  dl_free(offsets);
+
+  if (handle->use_rows) {
+    nrows = handle->drow + lines;
+  } else if (handle->mirror != 0) {
+    nrows = ncols = dl_max(nrows,ncols);
+  }
+
+  *r_nrows = nrows;
+  *r_ncols = ncols;
+
+  return ok;
+}
+
+
+int find_dims(
+    spmat_handle_t * const handle,
+    filetype_t const type,
+    char const * const name)
+{
+  int ok;
+  size_t nrows, ncols;
+  spmat_handle_t * other;
+
+  if ((handle->nrows > 0 && handle->ncols > 0) || handle->csr || \
+      handle->rawwidth || handle->dense) {
+    return 1;
+  }
+
+  nrows = ncols = 0;
+  if (handle->npy) {
+    ok = __scan_npy(handle,&nrows,&ncols);
+  } else if (handle->map) {
+    ok = scan_dims(handle,&nrows,&ncols);
+  } else if (handle->decomp && strcmp(name,DECOMPRESS_STDIN) != 0) {
+    /* a compressed file is decompressed an extra time, rather than kept */
+    if ((other = open_matrix(name,type,handle->nrows,handle->ncols)) == \
+        NULL) {
+      return 0;
+    }
+    ok = __scan_stream(other,&nrows,&ncols);
+    close_matrix(other);
+  } else {
+    /* anything else can only be read once, so it is kept in a temporary file
+     * which is read instead */
+    ok = __spool_stream(handle) && \
+        (handle->map == NULL || scan_dims(handle,&nrows,&ncols));
+  }
+  if (!ok) {
+    return 0;
+  }
+
+  if (handle->nrows == 0) {
+    handle->nrows = nrows;
+  }
+  if (handle->ncols == 0) {
+    handle->ncols = ncols;
+  }
+
+  return 1;
+}
+
+
+int read_points(
+    spmat_handle_t * const handle, 
+    grid_t * const grid)
+{
+  size_t i, j, nthreads;
+  ssize_t linelen;
+  char const * line;
+  double val;
+
+  if (handle->dense) {
+    /* the position of each value depends on every value before it */
+    while (__next_dense(handle,&i,&j,&val)) {
+      __add_point(handle,grid,i,j,val);
+      ++handle->nnz;
+    }
+    return 1;
+  } else if (handle->npy) {
+    return __read_points_npy(handle,grid);
+  }
+
+  nthreads = (size_t)max_threads();
+  if (handle->map && nthreads > 1 && \
+      handle->mapsize - handle->mappos >= MIN_PARALLEL_BYTES) {
+    #ifndef NO_OMP
+    if (grid->maxbrows*grid->maxbcols*grid_cell_size(grid)*nthreads > \
+        __private_grid_limit) {
+      return __read_points_shared(handle,grid);
+    }
+    #endif
+    return __read_points_private(handle,grid);
+  }
+
+  while ((linelen = __next_line(handle,&line)) >= 0) {
+    /* skip empty and comment lines */
+    if (!__is_point_line(handle,line,line+linelen)) {
+      continue;
+    }
+
+    if (!__parse_point(handle,line,line+linelen,&i,&j,&val, \
+        grid_needs_values(grid))) {
+      return 0;
+    }
+
+    __add_point(handle,grid,i,j,val);
+    ++handle->nnz;
+  }
+  
+  return 1;
+}
+
+
+int read_row(
+    spmat_handle_t * const handle, 
+    size_t const row, 
+    grid_t * const grid)
+{
+  ssize_t linelen, n;
+  char const * line;
+
+  if (handle->rawwidth) {
+    if (handle->drow >= handle->nrows) {
+      return 0;
+    }
+    __add_raw_row(handle,handle->drow++,row,grid);
+    return 1;
+  }
+
+  /* skip comment lines */
+  while ((linelen = __next_line(handle,&line)) > 0 && __is_comment(line[0]));
+
+  if (linelen < 0) {
+    /* end of the file */
+    return 0;
+  } else if (linelen == 0) {
+    /* empty line */
+    return 1;
+  }
+
+  if ((n = __parse_row(handle,line,line+linelen,row,grid)) < 0) {
+    return -1;
+  }
+  handle->nnz += (size_t)n;
+
+  return 1;
+}
+
+
+int read_rows(
+    spmat_handle_t * const handle,
+    grid_t * const grid)
+{
+  int rv;
+  size_t i, stride;
+  rowindex_t * index;
+  window_t const * const window = &handle->window;
+
+  if (handle->csr) {
+    return __read_rows_csr(handle,grid);
+  } else if (handle->rawwidth) {
+    return __read_rows_raw(handle,grid);
+  }
+
+  if (!__seek_window(handle)) {
+    return 1;
+  }
+
+  if (handle->map && max_threads() > 1 && \
+      handle->mapsize - handle->mappos >= MIN_PARALLEL_BYTES) {
+    return __read_rows_parallel(handle,grid);
+  }
+
+  stride = 1;
+  index = NULL;
+  if (handle->index && !handle->index->loaded) {
+    index = handle->index;
+    stride = (size_t)index->header.stride;
+  }
+
+  for (i=handle->drow;(handle->nrows == 0 || i<handle->nrows) && \
+      i<window->rend;++i) {
+    if (index && i % stride == 0) {
+      __index_row(index,i,handle->mappos);
+    }
+    if ((rv = read_row(handle,i-window->rstart,grid)) < 0) {
+      eprintf("Row %zu is malformed\n",i);
+      return 0;
+    } else if (rv == 0) {
+      break;
+    }
+  }
+  /* empty rows at the end still count towards the height */
+  __extend_window(handle,grid,i,0);
+
+  return 1;
+}
+
+
+int read_preview(
+    spmat_handle_t * const handle,
+    grid_t * const grid,
+    double const budget,
+    double * const r_fraction)
+{
+  int ok, binary;
+  size_t k, t, nblocks, nthreads, step, nrows, ncols, nnz, total, used, \
+      bytes, first;
+  double deadline;
+  grid_t ** grids;
+  rowindex_t const * const index = handle->index;
+  window_t const * const window = &handle->window;
+
+  *r_fraction = 1.0;
+
+  if ((!handle->map && !handle->csr) || handle->dense) {
+    wprintf("This input can not be sampled, so all of it will be read\n");
+    if (handle->use_rows) {
+      return read_rows(handle,grid);
+    } else {
+      return read_points(handle,grid);
+    }
+  }
+
+  deadline = dl_wctime() + budget;
+
+  /* raw and csr input is sampled by bands of rows, and text by blocks of
+   * bytes (or the strides of rows in an index) */
+  binary = handle->csr != NULL || handle->rawwidth > 0;
+  nrows = handle->nrows;
+  ncols = handle->ncols;
+  first = 0;
+  if (binary) {
+    /* only the rows inside of the window are sampled */
+    first = dl_min(window->rstart,nrows);
+    total = dl_min(window->rend,nrows) - first;
+    /* the bulk of csr input is its column indices (which for ligra graphs
+     * are not in handle->map) */
+    bytes = handle->csr ? handle->csr->nnz*handle->csr->idxstride : \
+        handle->mapsize;
+    nblocks = dl_min(dl_max(bytes/PREVIEW_BLOCK_BYTES,1),dl_max(total,1));
+  } else {
+    total = handle->mapsize - handle->mappos;
+    if (handle->use_rows && index && index->loaded) {
+      nblocks = dl_max((size_t)index->header.noffsets,1);
+    } else {
+      nblocks = dl_max(total/PREVIEW_BLOCK_BYTES,1);
+    }
+  }
+  step = __preview_step(nblocks);
+
+  /* without an index, the row each block starts at is estimated from its
+   * offset in the file */
+  if (!binary && handle->use_rows && nrows == 0) {
+    nrows = __preview_count_rows(handle,nblocks,step);
+  }
+  if (handle->use_rows) {
+    __extend_window(handle,grid,nrows,ncols);
+  }
+
+  if (handle->map) {
+    posix_madvise(handle->map,handle->mapsize,POSIX_MADV_RANDOM);
+  }
+
+  nthreads = (size_t)max_threads();
+  #ifndef NO_OMP
+  nthreads = dl_max(dl_min(nthreads,__private_grid_limit / \
+      (grid->maxbrows*grid->maxbcols*grid_cell_size(grid))),1);
+  #endif
+  grids = grid_ptr_alloc(nthreads);
+  for (t=0;t<nthreads;++t) {
+    grids[t] = grid_create_like(grid);
+  }
+
+  ok = 1;
+  nnz = 0;
+  used = 0;
+  #pragma omp parallel for num_threads(nthreads) schedule(dynamic,1) \
+      reduction(&&:ok) reduction(+:nnz,used)
+  for (k=0;k<nblocks;++k) {
+    ssize_t n;
+    size_t r, rstart, rend, bstart, bend;
+    grid_t * const mine = grids[thread_id()];
+    size_t const b = (k*step) % nblocks;
+    /* the first block is always read, so there is something to show */
+    if (!ok || (k > 0 && dl_wctime() >= deadline)) {
+      continue;
+    }
+    if (binary) {
+      rstart = first + ((total*b)/nblocks);
+      rend = first + ((total*(b+1))/nblocks);
+      if (handle->csr) {
+        __add_csr_rows(handle,rstart,rend,mine);
+      } else {
+        for (r=rstart;r<rend;++r) {
+          __add_raw_row(handle,r,r-first,mine);
         }
-        if (pmax && pmax[idx] < 1.0) {
-          pmax[idx] = 1.0; 
+      }
+      used += rend - rstart;
+    } else {
+      bstart = __preview_offset(handle,b,nblocks);
+      bend = __preview_offset(handle,b+1,nblocks);
+      if (handle->use_rows && index && index->loaded) {
+        r = b*(size_t)index->header.stride;
+      } else if (handle->use_rows) {
+        r = (size_t)(((double)nrows*(bstart-handle->mappos))/total);
+      } else {
+        r = 0;
+      }
+      n = __preview_text(handle,handle->map+bstart,handle->map+bend,r,nrows, \
+          mine);
+      if (n < 0) {
+        ok = 0;
+      } else {
+        nnz += (size_t)n;
+      }
+      used += bend - bstart;
+    }
+  }
+  handle->nnz += nnz;
+  if (!ok) {
+    /* the row a block starts at is only an estimate without an index */
+    eprintf("A %s in the sample is malformed\n", \
+        handle->use_rows ? "row" : "point");
+  }
+
+  grid_reduce(grid,grids,nthreads);
+  for (t=0;t<nthreads;++t) {
+    grid_free(grids[t]);
+  }
+  dl_free(grids);
+
+  /* scale the sample up to the whole of the matrix */
+  if (total > 0) {
+    *r_fraction = ((double)used)/total;
+  }
+  if (*r_fraction > 0 && *r_fraction < 1.0) {
+    grid_scale(grid,1.0/(*r_fraction));
+  }
+
+  handle->mappos = handle->mapsize;
+  handle->drow = handle->nrows;
+
+  return ok;
+}
+
+
+ssize_t read_row_entries(
+    spmat_handle_t * const handle,
+    size_t ** const r_ind,
+    real_t ** const r_val,
+    size_t * const r_cap)
+{
+  size_t ne, nnz, col, field, k, n;
+  uint64_t start, end;
+  ssize_t linelen;
+  char const * line, * sptr, * eptr, * next;
+  double val;
+  real_t vals[DENSE_BLOCK_SIZE];
+
+  if (handle->rawwidth) {
+    if (handle->drow >= handle->nrows) {
+      return -1;
+    }
+    nnz = 0;
+    for (k=0;k<handle->ncols;k+=n) {
+      n = dl_min(DENSE_BLOCK_SIZE,handle->ncols-k);
+      __convert_raw(handle,(handle->drow*handle->ncols)+k,n,vals);
+      for (ne=0;ne<n;++ne) {
+        if (vals[ne] != 0) {
+          __push_entry(r_ind,r_val,r_cap,nnz++,k+ne,vals[ne]);
         }
       }
-    } else if (handle->val && ne %handle->nfields == handle->valoffset) {
-      if (pavg) {
-        pavg[idx] += val; 
+    }
+    ++handle->drow;
+    return (ssize_t)nnz;
+  } else if (handle->csr) {
+    if (handle->drow >= handle->csr->nrows) {
+      return -1;
+    }
+    nnz = 0;
+    start = csrmap_rowptr(handle->csr,handle->drow);
+    end = csrmap_rowptr(handle->csr,handle->drow+1);
+    if (end < start || end > handle->csr->nnz) {
+      dl_error("Invalid offsets for row %zu\n",handle->drow);
+    }
+    for (k=(size_t)start;k<end;++k) {
+      __push_entry(r_ind,r_val,r_cap,nnz++,csrmap_col(handle->csr,k), \
+          csrmap_val(handle->csr,k));
+    }
+    ++handle->drow;
+    return (ssize_t)nnz;
+  }
+
+  /* skip comment lines */
+  while ((linelen = __next_line(handle,&line)) > 0 && __is_comment(line[0]));
+
+  if (linelen < 0) {
+    /* end of the file */
+    return -1;
+  } else if (linelen == 0) {
+    /* empty line */
+    return 0;
+  }
+
+  sptr = line;
+  eptr = line + linelen;
+  nnz = 0;
+
+  if (handle->denserows) {
+    for (col=0;(next = parse_double(sptr,eptr,&val)) != NULL;++col) {
+      sptr = next;
+      if (val != 0) {
+        __push_entry(r_ind,r_val,r_cap,nnz++,col,val);
+      }
+    }
+  } else {
+    /* skip offset */
+    for (ne=0;ne<handle->lineoffset;++ne) {
+      if ((sptr = parse_skip_token(sptr,eptr)) == NULL) {
+        return -2;
+      }
+    }
+
+    col = 0;
+    for (ne=0;;++ne) {
+      field = ne % handle->nfields;
+      if (field == handle->idxoffset) {
+        if ((next = __parse_col(handle,sptr,eptr,&col)) == NULL) {
+          break;
+        }
+        if (!handle->val) {
+          __push_entry(r_ind,r_val,r_cap,nnz++,col,1.0);
+        }
+      } else if (handle->val && field == handle->valoffset) {
+        if ((next = parse_double(sptr,eptr,&val)) == NULL) {
+          break;
+        }
+        __push_entry(r_ind,r_val,r_cap,nnz++,col,val);
+      } else if ((next = parse_skip_token(sptr,eptr)) == NULL) {
+        break;
       }
-      if (pmax && pmax[idx] < val) {
-        pmax[idx] = val; 
+      sptr = next;
+    }
+  }
+
+  /* a token that could not be parsed, rather than the end of the line */
+  if (parse_skip_blanks(sptr,eptr) < eptr) {
+    return -2;
+  }
+
+  return (ssize_t)nnz;
+}
+
+
+int read_point(
+    spmat_handle_t * const handle,
+    size_t * const r_i,
+    size_t * const r_j,
+    real_t * const r_val)
+{
+  int rv;
+  ssize_t linelen;
+  char const * line;
+  double val;
+
+  if (handle->pending) {
+    /* the mirror image of the last point */
+    handle->pending = 0;
+    *r_i = handle->pi;
+    *r_j = handle->pj;
+    *r_val = handle->pv;
+    return 1;
+  }
+
+  rv = 0;
+  if (handle->dense) {
+    rv = __next_dense(handle,r_i,r_j,&val);
+  } else if (handle->npy) {
+    rv = __next_npy(handle,r_i,r_j,&val);
+  } else {
+    while ((linelen = __next_line(handle,&line)) >= 0) {
+      /* skip empty and comment lines */
+      if (!__is_point_line(handle,line,line+linelen)) {
+        continue;
       }
+      rv = __parse_point(handle,line,line+linelen,r_i,r_j,&val,1);
+      break;
+    }
+  }
+
+  if (rv) {
+    *r_val = val;
+    if (handle->mirror != 0 && *r_i != *r_j) {
+      handle->pending = 1;
+      handle->pi = *r_j;
+      handle->pj = *r_i;
+      handle->pv = handle->mirror*val;
+    }
+  }
+
+  return rv;
+}
+
+
+int open_index(
+    spmat_handle_t * const handle,
+    filetype_t const type,
+    char const * const name)
+{
+  int err;
+  rowindex_t * index;
+  index_header_t stamp;
+
+  /* only text that can be seeked in is worth indexing */
+  if (!handle->map || handle->csr || handle->rawwidth) {
+    return 0;
+  }
+  if (index_stamp(handle->fd,&stamp) != INDEX_SUCCESS) {
+    return 0;
+  }
+
+  index = rowindex_calloc(1);
+  handle->index = index;
+
+  err = index_read(name,&stamp,&index->header,&index->offsets);
+  if (err == INDEX_SUCCESS) {
+    /* it must also describe the file as this handle reads it */
+    if (index->header.filetype != (uint32_t)type || \
+        index->header.datastart != handle->mappos || \
+        index->header.val != (uint32_t)handle->val || \
+        index->header.nfields != handle->nfields || \
+        index->header.idxoffset != handle->idxoffset || \
+        index->header.valoffset != handle->valoffset || \
+        index->header.lineoffset != handle->lineoffset || \
+        (handle->nrows > 0 && index->header.nrows != handle->nrows) || \
+        (handle->ncols > 0 && index->header.ncols != handle->ncols)) {
+      dl_free(index->offsets);
+      index->offsets = NULL;
+      err = INDEX_ERROR_STALE;
     }
-    ++ne;
-    sptr = eptr;
-    val = strtod(sptr,&eptr);
+  }
+
+  if (err == INDEX_SUCCESS) {
+    index->loaded = 1;
+    index->maxoffsets = (size_t)index->header.noffsets;
+    handle->nrows = (size_t)index->header.nrows;
+    handle->ncols = (size_t)index->header.ncols;
+    dprintf("Using index of %zux%zu matrix with %zu non-zeros\n", \
+        handle->nrows,handle->ncols,(size_t)index->header.nnz);
+    return 1;
+  }
+
+  /* build a new one as the file is read */
+  memset(&index->header,0,sizeof(index_header_t));
+  index->header.filesize = stamp.filesize;
+  index->header.mtime = stamp.mtime;
+  index->header.mtimensec = stamp.mtimensec;
+  index->header.datastart = handle->mappos;
+  index->header.stride = INDEX_STRIDE;
+  index->loaded = 0;
+
+  return 0;
+}
+
+
+int save_index(
+    spmat_handle_t * const handle,
+    grid_t const * const grid,
+    filetype_t const type,
+    char const * const name)
+{
+  rowindex_t * const index = handle->index;
+
+  if (index == NULL || index->loaded) {
+    return 1;
+  }
+
+  index->header.filetype = (uint32_t)type;
+  index->header.val = (uint32_t)handle->val;
+  index->header.nrows = grid->nrows;
+  index->header.ncols = grid->ncols;
+  index->header.nnz = handle->nnz;
+  index->header.nfields = handle->nfields;
+  index->header.idxoffset = handle->idxoffset;
+  index->header.valoffset = handle->valoffset;
+  index->header.lineoffset = handle->lineoffset;
+  if (!handle->use_rows) {
+    /* points can be in any order */
+    index->header.noffsets = 0;
+  }
+
+  if (index_write(name,&index->header,index->offsets) != INDEX_SUCCESS) {
+    wprintf("Failed to write index for '%s'\n",name);
+    return 0;
   }
 
   return 1;
@@ -437,9 +3654,30 @@ int read_row(
 int close_matrix(
     spmat_handle_t * handle)
 {
+  if (handle->map) {
+    munmap(handle->map,handle->maplen);
+  }
+  if (handle->fd >= 0) {
+    close(handle->fd);
+  }
   if (handle->fp) {
     dl_close_file(handle->fp);
   }
+  if (handle->decomp) {
+    decompress_close(handle->decomp);
+  }
+  if (handle->npy) {
+    npy_close(handle->npy);
+  }
+  if (handle->csr) {
+    graph_close(handle->csr);
+  }
+  if (handle->index) {
+    if (handle->index->offsets) {
+      dl_free(handle->index->offsets);
+    }
+    dl_free(handle->index);
+  }
   if (handle->line) {
     dl_free(handle->line);
   }
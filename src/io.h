@@ -3,6 +3,12 @@
 
 
 #include "base.h"
+#include "grid.h"
+#include "iobcsr.h"
+#include "decompress.h"
+#include "ioindex.h"
+#include "ionpy.h"
+#include "iograph.h"
 #include "dlfile.h"
 
 
@@ -13,9 +19,42 @@
 ******************************************************************************/
 
 
+/**
+ * @brief A region of a matrix: the rows [rstart,rend) and columns
+ * [cstart,cend). An end of WINDOW_END runs to the last row/column.
+ */
+typedef struct window_t {
+  size_t rstart;
+  size_t rend;
+  size_t cstart;
+  size_t cend;
+} window_t;
+
+
 typedef struct spmat_handle_t {
   file_t * fp;
   storagetype_t type;
+  /* memory-mapped input -- when map is non-NULL lines are tokenized directly
+   * out of the mapping and fp/line are unused */
+  int fd;
+  char * map;
+  size_t mapsize;
+  size_t mappos;
+  /* the length of the mapping (mapsize is cut short of it when a file that
+   * is still being written is read up to its last complete line) */
+  size_t maplen;
+  /* where the pages handed back by release_matrix() end (the next row of csr
+   * input, otherwise an offset into the mapping) */
+  size_t mapfree;
+  /* input already in csr form (binary csr, GAP, and Ligra graphs), whose
+   * arrays are used in place (drow is also its next row) */
+  csrmap_t * csr;
+  /* compressed input -- lines are cut out of the buffers handed over by the
+   * decompressor, and only copied to line when they span two buffers */
+  decompress_t * decomp;
+  char const * dbuf;
+  size_t dlen;
+  size_t dpos;
   char * line;
   int val, use_rows;
   size_t nrows;
@@ -25,37 +64,399 @@ typedef struct spmat_handle_t {
   size_t idxoffset;
   size_t valoffset;
   size_t lineoffset;
+  /* the index of the first row/column (1 for matrix market) */
+  size_t ijbase;
+  /* the row/column of the whole matrix that the first row/column of the file
+   * is, when it is a shard of a larger matrix (see offset_matrix()) */
+  size_t roffset;
+  size_t coffset;
+  /* 1 if each non-zero (i,j) implies (j,i), -1 if it implies -(j,i) */
+  int mirror;
+  /* dense (matrix market array) input, and the next position in it (drow is
+   * also the next row of raw input, and of row based text at mappos) */
+  int dense;
+  size_t drow;
+  size_t dcol;
+  /* dense text and raw input, where each row is given as all of its values */
+  int denserows;
+  /* the size of each value of raw input (sizeof(float) or sizeof(double)) */
+  size_t rawwidth;
+  /* dimacs input, where points are on the 'a' and 'e' lines */
+  int dimacs;
+  /* numpy coordinate input, and the next entry of it for read_point() */
+  npy_coo_t * npy;
+  size_t npos;
+  /* the sidecar index, if one is in use or being built */
+  rowindex_t * index;
+  /* the region read into grids, whose non-zeros are shifted to start at
+   * (0,0) and outside of which they are skipped */
+  window_t window;
+  /* the number of non-zeros read so far */
+  size_t nnz;
+  /* the mirror image of the last point returned by read_point() */
+  int pending;
+  size_t pi;
+  size_t pj;
+  real_t pv;
 }  spmat_handle_t;
 
 
 
 
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* the end of a window that runs to the last row/column of the matrix */
+static const size_t WINDOW_END = (size_t)-1;
+
+
+
+
 /******************************************************************************
 * FUNCTION PROTOTYPES *********************************************************
 ******************************************************************************/
 
 
+/**
+ * @brief Open a matrix for reading, and read its header.
+ *
+ * @param name The name of the file.
+ * @param type The format of the file.
+ * @param nrows The number of rows if known ahead of time (0 otherwise). This
+ * is only used when the file does not give it, and is required for raw input.
+ * @param ncols The number of columns if known ahead of time (0 otherwise).
+ *
+ * @return The handle, or NULL if the file could not be opened.
+ */
 spmat_handle_t * open_matrix(
     char const * name, 
-    filetype_t type);
+    filetype_t type,
+    size_t nrows,
+    size_t ncols);
+
+
+/**
+ * @brief Limit the reads of a matrix into grids to a region of it, which is
+ * then read as if it were the whole matrix. Rows before the region are
+ * skipped without being parsed (jumping straight to them if an index is
+ * loaded), and reading stops after its last row. This has no effect on
+ * read_point() and read_row_entries().
+ *
+ * @param handle The handle of the matrix.
+ * @param window The region to read.
+ *
+ * @return 1 on success, 0 if the region is empty or outside of the matrix.
+ */
+int set_window(
+    spmat_handle_t * handle,
+    window_t const * window);
+
+
+/**
+ * @brief Number the rows and columns of a text file from offsets, as for a
+ * shard of a larger matrix whose rows/columns are numbered from zero in its
+ * own file. Row based formats start at row roffset, and every index read is
+ * shifted by the offsets. The dimensions a header gives are those of the
+ * shard, not of the matrix, so they are dropped (the caller can set those of
+ * the whole matrix).
+ *
+ * @param handle The handle of the file (before anything is read from it).
+ * @param roffset The row of the matrix that the first row of the file is.
+ * @param coffset The column of the matrix that the first column of the file
+ * is.
+ *
+ * @return 1 on success, 0 if the file is binary, numpy, or dense input, whose
+ * rows/columns are not read as text indices.
+ */
+int offset_matrix(
+    spmat_handle_t * handle,
+    size_t roffset,
+    size_t coffset);
+
+
+/**
+ * @brief Get the dimensions of the region of a matrix being read (those of
+ * the matrix if no window is set).
+ *
+ * @param handle The handle of the matrix.
+ * @param r_nrows The number of rows (0 if not known ahead of time).
+ * @param r_ncols The number of columns (0 if not known ahead of time).
+ */
+void window_dims(
+    spmat_handle_t const * handle,
+    size_t * r_nrows,
+    size_t * r_ncols);
+
+
+/**
+ * @brief Read only the part of an append-only point text file (such as a log
+ * of edges) that was not read before. Reading starts where the previous read
+ * stopped, and stops at the end of the last complete line, as the rest may
+ * still be being written. The bytes just before where the previous read
+ * stopped (see matrix_tail()) must still be there, or the file has been
+ * rewritten rather than appended to.
+ *
+ * @param handle The handle of the file.
+ * @param offset Where the previous read stopped (0 to read from the first
+ * point).
+ * @param tail The bytes just before the offset.
+ * @param ntail The number of bytes in tail.
+ *
+ * @return 1 on success, 0 if the file is not memory-mapped point text or does
+ * not continue from the offset.
+ */
+int resume_matrix(
+    spmat_handle_t * handle,
+    size_t offset,
+    char const * tail,
+    size_t ntail);
+
+
+/**
+ * @brief Copy the last bytes read from a file set up with resume_matrix(), to
+ * check that it has only been appended to when it is next resumed (from
+ * handle->mappos).
+ *
+ * @param handle The handle of the file.
+ * @param tail The buffer to copy the bytes to.
+ * @param maxtail The size of the buffer.
+ *
+ * @return The number of bytes copied.
+ */
+size_t matrix_tail(
+    spmat_handle_t const * handle,
+    char * tail,
+    size_t maxtail);
+
+
+/**
+ * @brief Hand the pages of a memory-mapped file (text or csr arrays) that
+ * have been read past back to the kernel, so that a single pass over a file
+ * larger than memory does not keep all of it resident. This does nothing
+ * until at least a megabyte has been read since the last call, so it can be
+ * called after every row/point.
+ *
+ * @param handle The handle of the file.
+ */
+void release_matrix(
+    spmat_handle_t * handle);
+
+
+/**
+ * @brief Set the most memory to spend on the private grids of the threads
+ * reading points in parallel (a gigabyte unless set), past which they add to
+ * a single grid guarded by striped locks instead. This does nothing when
+ * built without OpenMP.
+ *
+ * @param bytes The number of bytes.
+ */
+void set_private_grid_limit(
+    size_t bytes);
+
+
+/**
+ * @brief Limit reading of a memory-mapped text file to one of several parts
+ * of what remains of it, split on line boundaries, such as to read the parts
+ * in separate processes. Row based formats are read as if their first row
+ * were handle->drow, which the caller must advance by the rows in the parts
+ * before this one (see count_rows()).
+ *
+ * @param handle The handle of the file (before anything is read from it).
+ * @param part The part to read.
+ * @param nparts The number of parts.
+ *
+ * @return 1 on success, 0 if the file is not memory-mapped text (or its rows
+ * are found through an index).
+ */
+int split_matrix(
+    spmat_handle_t * handle,
+    size_t part,
+    size_t nparts);
+
+
+/**
+ * @brief Count the rows left to read in a memory-mapped text file.
+ *
+ * @param handle The handle of the file.
+ *
+ * @return The number of rows.
+ */
+size_t count_rows(
+    spmat_handle_t const * handle);
+
+
+/**
+ * @brief Find the extents of what remains of a memory-mapped text file, in a
+ * parallel pass over the mapping that only parses the indices: the row after
+ * the last one (counting from handle->drow) for row based formats, or one
+ * past the largest row of a point, and one past the largest column.
+ *
+ * @param handle The handle of the file.
+ * @param r_nrows The number of rows.
+ * @param r_ncols The number of columns.
+ *
+ * @return 1 on success, 0 if the file is not memory-mapped text or a point is
+ * malformed.
+ */
+int scan_dims(
+    spmat_handle_t const * handle,
+    size_t * r_nrows,
+    size_t * r_ncols);
+
+
+/**
+ * @brief Fill in the dimensions of a matrix that neither its file nor the
+ * call to open_matrix() gave, with a pass over the file before it is read,
+ * so that its rows and columns can be mapped straight to pixels. Mapped text
+ * is scanned in parallel (see scan_dims()), compressed files are
+ * decompressed an extra time, and input that can only be read once (standard
+ * input and pipes) is copied to a temporary file, which is then read in its
+ * place.
+ *
+ * @param handle The handle of the file (before anything is read from it).
+ * @param type The format of the file.
+ * @param name The name of the file.
+ *
+ * @return 1 on success, 0 if the file could not be scanned.
+ */
+int find_dims(
+    spmat_handle_t * handle,
+    filetype_t type,
+    char const * name);
 
 
 int read_points(
     spmat_handle_t * handle, 
-    size_t npx, 
-    size_t npy, 
-    real_t * pden, 
-    real_t * pavg, 
-    real_t * pmax);
+    grid_t * grid);
 
 
+/**
+ * @brief Read the next row of a row based format into the grid.
+ *
+ * @param handle The handle to read from.
+ * @param row The row of the grid to add the non-zeros to.
+ * @param grid The grid.
+ *
+ * @return 1 if a row was read, 0 at the end of the file, or -1 if the row is
+ * malformed.
+ */
 int read_row(
     spmat_handle_t * handle, 
-    size_t xpix, 
-    real_t * pden, 
-    real_t * pmax, 
-    real_t * pavg, 
-    size_t npix);
+    size_t row, 
+    grid_t * grid);
+
+
+/**
+ * @brief Read the next row of a row based format into arrays of column
+ * indices and values, rather than a grid.
+ *
+ * @param handle The handle to read from.
+ * @param r_ind The column indices (grown as needed).
+ * @param r_val The values (grown as needed, 1 for formats without values).
+ * @param r_cap The size of the two arrays.
+ *
+ * @return The number of non-zeros in the row, -1 at the end of the file, or
+ * -2 if the row is malformed.
+ */
+ssize_t read_row_entries(
+    spmat_handle_t * handle,
+    size_t ** r_ind,
+    real_t ** r_val,
+    size_t * r_cap);
+
+
+/**
+ * @brief Read the next non-zero of a point based format.
+ *
+ * @param handle The handle to read from.
+ * @param r_i The row of the non-zero.
+ * @param r_j The column of the non-zero.
+ * @param r_val The value of the non-zero.
+ *
+ * @return 1 if a non-zero was read, 0 at the end of the file.
+ */
+int read_point(
+    spmat_handle_t * handle,
+    size_t * r_i,
+    size_t * r_j,
+    real_t * r_val);
+
+
+/**
+ * @brief Read every remaining row of a row based format into the grid (in
+ * parallel when the file is memory-mapped and large enough to be worth it).
+ *
+ * @param handle The handle to read from.
+ * @param grid The grid to add the non-zeros to.
+ *
+ * @return 1 on success, 0 if a row is malformed.
+ */
+int read_rows(
+    spmat_handle_t * handle,
+    grid_t * grid);
+
+
+/**
+ * @brief Read a sample of the matrix into the grid, rather than all of it,
+ * stopping once the time budget runs out. Blocks of the file are read in an
+ * order that spreads them evenly over it, and the sums in the grid are
+ * scaled up by the fraction of the file read. The row each block of a row
+ * based text format starts at is estimated from its offset, unless an index
+ * is loaded. Input that can not be sampled (compressed, standard input, and
+ * dense matrix market) is read in full.
+ *
+ * @param handle The handle to read from.
+ * @param grid The grid to add the non-zeros to.
+ * @param budget The number of seconds to spend reading.
+ * @param r_fraction The fraction of the file that was read.
+ *
+ * @return 1 on success, 0 if a row/point is malformed.
+ */
+int read_preview(
+    spmat_handle_t * handle,
+    grid_t * grid,
+    double budget,
+    double * r_fraction);
+
+
+/**
+ * @brief Load the sidecar index of a file opened with open_matrix(), if it
+ * matches the file, in which case the dimensions of the matrix are taken from
+ * it and the rows can be split between threads without counting them.
+ * Otherwise an index is built as the file is read, to be written with
+ * save_index(). Only regular text files are indexed.
+ *
+ * @param handle The handle of the file.
+ * @param type The format of the file.
+ * @param name The name of the file.
+ *
+ * @return 1 if an index was loaded, 0 otherwise.
+ */
+int open_index(
+    spmat_handle_t * handle,
+    filetype_t type,
+    char const * name);
+
+
+/**
+ * @brief Write the index built while reading a file, once every row/point
+ * has been read into the grid.
+ *
+ * @param handle The handle of the file.
+ * @param grid The grid the file was read into.
+ * @param type The format of the file.
+ * @param name The name of the file.
+ *
+ * @return 1 on success (or if there was nothing to write), 0 if the index
+ * could not be written.
+ */
+int save_index(
+    spmat_handle_t * handle,
+    grid_t const * grid,
+    filetype_t type,
+    char const * name);
 
 
 int close_matrix(
@@ -0,0 +1,563 @@
+/**
+ * @file iobcsr.c
+ * @brief Functions for checking and writing binary CSR files
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-10
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_IOBCSR_C
+#define CLAIRVOYANCE_IOBCSR_C
+
+
+
+
+#include "iobcsr.h"
+#include "io.h"
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* the number of entries to move between the temporary files and the output at
+ * a time */
+static const size_t BCSR_BLOCK_SIZE = 65536;
+
+
+
+
+/******************************************************************************
+* DOMLIB IMPORTS **************************************************************
+******************************************************************************/
+
+
+#define DLMEM_PREFIX bcsr_idx
+#define DLMEM_TYPE_T uint64_t
+#define DLMEM_DLTYPE DLTYPE_INTEGRAL
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX bcsr_ind32
+#define DLMEM_TYPE_T uint32_t
+#define DLMEM_DLTYPE DLTYPE_INTEGRAL
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+static inline uint64_t __align(
+    uint64_t const offset)
+{
+  return ((offset + BCSR_ALIGNMENT - 1) / BCSR_ALIGNMENT) * BCSR_ALIGNMENT;
+}
+
+
+/**
+ * @brief Pad the output with zeros up to an offset.
+ *
+ * @param fout The output file.
+ * @param pos The current offset in the output (updated).
+ * @param offset The offset to pad to.
+ *
+ * @return BCSR_SUCCESS on success.
+ */
+static int __pad(
+    FILE * const fout,
+    uint64_t * const pos,
+    uint64_t const offset)
+{
+  for (;*pos<offset;++(*pos)) {
+    if (fputc(0,fout) == EOF) {
+      return BCSR_ERROR_WRITE;
+    }
+  }
+
+  return BCSR_SUCCESS;
+}
+
+
+/**
+ * @brief Append the non-zeros of a row to the temporary files.
+ *
+ * @param colf The temporary file of column indices.
+ * @param valf The temporary file of values (NULL if there are none).
+ * @param ind The column indices.
+ * @param val The values.
+ * @param n The number of non-zeros.
+ * @param buf A buffer of at least n entries.
+ * @param r_maxcol The largest column seen (updated).
+ *
+ * @return BCSR_SUCCESS on success.
+ */
+static int __append(
+    FILE * const colf,
+    FILE * const valf,
+    size_t const * const ind,
+    real_t const * const val,
+    size_t const n,
+    uint64_t * const buf,
+    uint64_t * const r_maxcol)
+{
+  size_t k;
+
+  for (k=0;k<n;++k) {
+    buf[k] = (uint64_t)ind[k];
+    if (buf[k] + 1 > *r_maxcol) {
+      *r_maxcol = buf[k] + 1;
+    }
+  }
+  if (fwrite(buf,sizeof(uint64_t),n,colf) != n) {
+    return BCSR_ERROR_WRITE;
+  }
+  if (valf && fwrite(val,sizeof(real_t),n,valf) != n) {
+    return BCSR_ERROR_WRITE;
+  }
+
+  return BCSR_SUCCESS;
+}
+
+
+/**
+ * @brief Read the rows of a row based format into the temporary files.
+ *
+ * @param handle The handle to read from.
+ * @param colf The temporary file of column indices.
+ * @param valf The temporary file of values (NULL if there are none).
+ * @param r_rowptr The row pointer (allocated here).
+ * @param r_nrows The number of rows.
+ * @param r_ncols The number of columns.
+ *
+ * @return BCSR_SUCCESS on success, BCSR_ERROR_READ if a row is malformed.
+ */
+static int __stream_rows(
+    spmat_handle_t * const handle,
+    FILE * const colf,
+    FILE * const valf,
+    uint64_t ** const r_rowptr,
+    size_t * const r_nrows,
+    uint64_t * const r_ncols)
+{
+  int err;
+  size_t i, cap, bufcap, rowcap;
+  ssize_t n;
+  size_t * ind;
+  real_t * val;
+  uint64_t * rowptr, * buf;
+
+  cap = DEFAULT_BUFFER_SIZE;
+  ind = size_alloc(cap);
+  val = real_alloc(cap);
+  bufcap = cap;
+  buf = bcsr_idx_alloc(bufcap);
+
+  rowcap = dl_max(handle->nrows,DEFAULT_BUFFER_SIZE)+1;
+  rowptr = bcsr_idx_alloc(rowcap);
+  rowptr[0] = 0;
+
+  err = BCSR_SUCCESS;
+  for (i=0;handle->nrows == 0 || i<handle->nrows;++i) {
+    if ((n = read_row_entries(handle,&ind,&val,&cap)) == -2) {
+      eprintf("Row %zu is malformed\n",i);
+      err = BCSR_ERROR_READ;
+      break;
+    } else if (n < 0) {
+      break;
+    }
+    if (i+2 > rowcap) {
+      rowcap *= 2;
+      rowptr = bcsr_idx_realloc(rowptr,rowcap);
+    }
+    if (cap > bufcap) {
+      bufcap = cap;
+      buf = bcsr_idx_realloc(buf,bufcap);
+    }
+    if ((err = __append(colf,valf,ind,val,(size_t)n,buf,r_ncols)) != \
+        BCSR_SUCCESS) {
+      break;
+    }
+    rowptr[i+1] = rowptr[i] + (uint64_t)n;
+  }
+
+  /* empty rows at the end still count */
+  for (;i<handle->nrows;++i) {
+    rowptr[i+1] = rowptr[i];
+  }
+
+  dl_free(ind);
+  dl_free(val);
+  dl_free(buf);
+
+  *r_rowptr = rowptr;
+  *r_nrows = i;
+
+  return err;
+}
+
+
+/**
+ * @brief Read all of the points of a point based format, and write them
+ * sorted by row into the temporary files.
+ *
+ * @param handle The handle to read from.
+ * @param colf The temporary file of column indices.
+ * @param valf The temporary file of values.
+ * @param r_rowptr The row pointer (allocated here).
+ * @param r_nrows The number of rows.
+ * @param r_ncols The number of columns.
+ *
+ * @return BCSR_SUCCESS on success.
+ */
+static int __sort_points(
+    spmat_handle_t * const handle,
+    FILE * const colf,
+    FILE * const valf,
+    uint64_t ** const r_rowptr,
+    size_t * const r_nrows,
+    uint64_t * const r_ncols)
+{
+  int err;
+  size_t k, nnz, cap, nrows;
+  size_t pi, pj;
+  real_t pv;
+  size_t * ri, * ci, * sci;
+  real_t * v, * sv;
+  uint64_t * rowptr, * buf;
+
+  cap = DEFAULT_BUFFER_SIZE;
+  ri = size_alloc(cap);
+  ci = size_alloc(cap);
+  v = real_alloc(cap);
+
+  nnz = 0;
+  nrows = handle->nrows;
+  while (read_point(handle,&pi,&pj,&pv)) {
+    if (nnz == cap) {
+      cap *= 2;
+      ri = size_realloc(ri,cap);
+      ci = size_realloc(ci,cap);
+      v = real_realloc(v,cap);
+    }
+    ri[nnz] = pi;
+    ci[nnz] = pj;
+    v[nnz] = pv;
+    ++nnz;
+    nrows = dl_max(nrows,pi+1);
+  }
+
+  /* counting sort by row, keeping the order within each row */
+  rowptr = bcsr_idx_calloc(nrows+1);
+  for (k=0;k<nnz;++k) {
+    ++rowptr[ri[k]+1];
+  }
+  for (k=0;k<nrows;++k) {
+    rowptr[k+1] += rowptr[k];
+  }
+  sci = size_alloc(nnz);
+  sv = real_alloc(nnz);
+  for (k=0;k<nnz;++k) {
+    sci[rowptr[ri[k]]] = ci[k];
+    sv[rowptr[ri[k]]] = v[k];
+    ++rowptr[ri[k]];
+  }
+  for (k=nrows;k>0;--k) {
+    rowptr[k] = rowptr[k-1];
+  }
+  rowptr[0] = 0;
+
+  dl_free(ri);
+  dl_free(ci);
+  dl_free(v);
+
+  buf = bcsr_idx_alloc(nnz);
+  err = __append(colf,valf,sci,sv,nnz,buf,r_ncols);
+
+  dl_free(buf);
+  dl_free(sci);
+  dl_free(sv);
+
+  *r_rowptr = rowptr;
+  *r_nrows = nrows;
+
+  return err;
+}
+
+
+/**
+ * @brief Write the binary file from the row pointer and temporary files.
+ *
+ * @param outfile The name of the output file.
+ * @param header The header to write (with the dimensions set, and the offsets
+ * set here).
+ * @param rowptr The row pointer.
+ * @param colf The temporary file of column indices.
+ * @param valf The temporary file of values (NULL if there are none).
+ *
+ * @return BCSR_SUCCESS on success.
+ */
+static int __write(
+    char const * const outfile,
+    bcsr_header_t * const header,
+    uint64_t const * const rowptr,
+    FILE * const colf,
+    FILE * const valf)
+{
+  int err;
+  size_t k, n;
+  uint64_t pos, done;
+  uint64_t * buf;
+  uint32_t * buf32;
+  real_t * vbuf;
+  FILE * fout;
+
+  header->rowptroff = __align(sizeof(bcsr_header_t));
+  header->colindoff = __align(header->rowptroff + \
+      ((header->nrows+1)*sizeof(uint64_t)));
+  header->valsoff = __align(header->colindoff + \
+      (header->nnz*header->idxwidth));
+
+  if ((fout = fopen(outfile,"wb")) == NULL) {
+    eprintf("Failed to open '%s' for writing\n",outfile);
+    return BCSR_ERROR_OPEN;
+  }
+
+  buf = bcsr_idx_alloc(BCSR_BLOCK_SIZE);
+  buf32 = bcsr_ind32_alloc(BCSR_BLOCK_SIZE);
+  vbuf = real_alloc(BCSR_BLOCK_SIZE);
+
+  err = BCSR_ERROR_WRITE;
+
+  /* header and row pointer */
+  if (fwrite(header,sizeof(bcsr_header_t),1,fout) != 1) {
+    goto END;
+  }
+  pos = sizeof(bcsr_header_t);
+  if (__pad(fout,&pos,header->rowptroff) != BCSR_SUCCESS) {
+    goto END;
+  }
+  if (fwrite(rowptr,sizeof(uint64_t),header->nrows+1,fout) != \
+      header->nrows+1) {
+    goto END;
+  }
+  pos += (header->nrows+1)*sizeof(uint64_t);
+
+  /* column indices, narrowed if they fit */
+  if (__pad(fout,&pos,header->colindoff) != BCSR_SUCCESS) {
+    goto END;
+  }
+  rewind(colf);
+  for (done=0;done<header->nnz;done+=n) {
+    n = (size_t)dl_min((uint64_t)BCSR_BLOCK_SIZE,header->nnz-done);
+    if (fread(buf,sizeof(uint64_t),n,colf) != n) {
+      err = BCSR_ERROR_READ;
+      goto END;
+    }
+    if (header->idxwidth == sizeof(uint32_t)) {
+      for (k=0;k<n;++k) {
+        buf32[k] = (uint32_t)buf[k];
+      }
+      if (fwrite(buf32,sizeof(uint32_t),n,fout) != n) {
+        goto END;
+      }
+    } else {
+      if (fwrite(buf,sizeof(uint64_t),n,fout) != n) {
+        goto END;
+      }
+    }
+  }
+  pos += header->nnz*header->idxwidth;
+
+  /* values */
+  if (valf) {
+    if (__pad(fout,&pos,header->valsoff) != BCSR_SUCCESS) {
+      goto END;
+    }
+    rewind(valf);
+    for (done=0;done<header->nnz;done+=n) {
+      n = (size_t)dl_min((uint64_t)BCSR_BLOCK_SIZE,header->nnz-done);
+      if (fread(vbuf,sizeof(real_t),n,valf) != n) {
+        err = BCSR_ERROR_READ;
+        goto END;
+      }
+      if (fwrite(vbuf,sizeof(real_t),n,fout) != n) {
+        goto END;
+      }
+    }
+  }
+
+  err = BCSR_SUCCESS;
+
+  END:
+
+  if (fclose(fout) != 0 && err == BCSR_SUCCESS) {
+    err = BCSR_ERROR_WRITE;
+  }
+  if (err != BCSR_SUCCESS) {
+    eprintf("Failed to write binary csr file '%s'\n",outfile);
+  }
+
+  dl_free(buf);
+  dl_free(buf32);
+  dl_free(vbuf);
+
+  return err;
+}
+
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+int bcsr_check(
+    bcsr_header_t const * const header,
+    size_t const size)
+{
+  uint64_t const * rowptr;
+
+  if (size < sizeof(bcsr_header_t) || \
+      memcmp(header->magic,BCSR_MAGIC,sizeof(BCSR_MAGIC)) != 0) {
+    eprintf("Missing binary csr header\n");
+    return BCSR_ERROR_FORMAT;
+  }
+  if (header->byteorder != BCSR_BYTEORDER) {
+    eprintf("Binary csr file was written with a different byte order\n");
+    return BCSR_ERROR_FORMAT;
+  }
+  if (header->version != BCSR_VERSION) {
+    eprintf("Unsupported binary csr version '%u'\n",
+        (unsigned int)header->version);
+    return BCSR_ERROR_FORMAT;
+  }
+  if ((header->idxwidth != sizeof(uint32_t) && \
+      header->idxwidth != sizeof(uint64_t)) || \
+      header->valtype > BCSR_VALUE_DOUBLE) {
+    eprintf("Unsupported binary csr index width/value type\n");
+    return BCSR_ERROR_FORMAT;
+  }
+
+  /* make sure the arrays are all there */
+  if (header->rowptroff % sizeof(uint64_t) != 0 || \
+      header->colindoff % header->idxwidth != 0 || \
+      header->valsoff % sizeof(double) != 0 || \
+      header->rowptroff + ((header->nrows+1)*sizeof(uint64_t)) > size || \
+      header->colindoff + (header->nnz*header->idxwidth) > size || \
+      (header->valtype != BCSR_VALUE_NONE && header->valsoff + \
+      (header->nnz*(header->valtype == BCSR_VALUE_FLOAT ? sizeof(float) : \
+      sizeof(double))) > size)) {
+    eprintf("Binary csr file is truncated\n");
+    return BCSR_ERROR_FORMAT;
+  }
+  rowptr = (uint64_t const *)(((char const *)header) + header->rowptroff);
+  if (rowptr[0] != 0 || rowptr[header->nrows] != header->nnz) {
+    eprintf("Binary csr row pointer is inconsistent\n");
+    return BCSR_ERROR_FORMAT;
+  }
+
+  return BCSR_SUCCESS;
+}
+
+
+int bcsr_convert(
+    char const * const infile,
+    filetype_t const itype,
+    size_t const knownrows,
+    size_t const knowncols,
+    char const * const outfile)
+{
+  int err;
+  size_t nrows;
+  uint64_t ncols;
+  uint64_t * rowptr;
+  FILE * colf, * valf;
+  spmat_handle_t * handle;
+  bcsr_header_t header;
+
+  if (itype == FILETYPE_BCSR) {
+    eprintf("'%s' is already in binary csr format\n",infile);
+    return BCSR_ERROR_READ;
+  }
+
+  if ((handle = open_matrix(infile,itype,knownrows,knowncols)) == NULL) {
+    return BCSR_ERROR_READ;
+  }
+
+  rowptr = NULL;
+  colf = tmpfile();
+  valf = handle->val ? tmpfile() : NULL;
+  if (colf == NULL || (handle->val && valf == NULL)) {
+    eprintf("Failed to create temporary files\n");
+    err = BCSR_ERROR_OPEN;
+    goto END;
+  }
+
+  ncols = handle->ncols;
+  if (handle->use_rows) {
+    err = __stream_rows(handle,colf,valf,&rowptr,&nrows,&ncols);
+  } else {
+    err = __sort_points(handle,colf,valf,&rowptr,&nrows,&ncols);
+  }
+  if (err == BCSR_ERROR_WRITE) {
+    eprintf("Failed to write temporary files\n");
+    goto END;
+  } else if (err != BCSR_SUCCESS) {
+    goto END;
+  }
+
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,BCSR_MAGIC,sizeof(BCSR_MAGIC));
+  header.version = BCSR_VERSION;
+  header.byteorder = BCSR_BYTEORDER;
+  header.nrows = nrows;
+  header.ncols = ncols;
+  header.nnz = rowptr[nrows];
+  header.idxwidth = ncols <= ((uint64_t)UINT32_MAX)+1 ? sizeof(uint32_t) : \
+      sizeof(uint64_t);
+  header.valtype = valf ? BCSR_VALUE_DOUBLE : BCSR_VALUE_NONE;
+
+  err = __write(outfile,&header,rowptr,colf,valf);
+
+  END:
+
+  if (rowptr) {
+    dl_free(rowptr);
+  }
+  if (colf) {
+    fclose(colf);
+  }
+  if (valf) {
+    fclose(valf);
+  }
+  close_matrix(handle);
+
+  return err;
+}
+
+
+
+
+#endif
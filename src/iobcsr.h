@@ -0,0 +1,133 @@
+/**
+ * @file iobcsr.h
+ * @brief Types and function prototypes for the binary CSR format
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-10
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_IOBCSR_H
+#define CLAIRVOYANCE_IOBCSR_H
+
+
+
+
+#include "base.h"
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+typedef enum bcsr_error_t {
+  BCSR_SUCCESS = 1,
+  BCSR_ERROR_READ = -1,
+  BCSR_ERROR_WRITE = -2,
+  BCSR_ERROR_OPEN = -3,
+  BCSR_ERROR_FORMAT = -4
+} bcsr_error_t;
+
+
+typedef enum bcsr_valtype_t {
+  BCSR_VALUE_NONE = 0,
+  BCSR_VALUE_FLOAT = 1,
+  BCSR_VALUE_DOUBLE = 2
+} bcsr_valtype_t;
+
+
+/**
+ * @brief The header at the start of a binary CSR file. It is followed by the
+ * (nrows+1) 64 bit row pointers, the nnz column indices of idxwidth bytes
+ * each, and the nnz values (unless valtype is BCSR_VALUE_NONE), each array
+ * starting at the page aligned offset given here, so that the whole file can
+ * be mapped and used in place. Everything is stored in the byte order of the
+ * machine that wrote it, which is checked via the byteorder field.
+ */
+typedef struct bcsr_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteorder;
+  uint32_t idxwidth;
+  uint32_t valtype;
+  uint64_t nrows;
+  uint64_t ncols;
+  uint64_t nnz;
+  uint64_t rowptroff;
+  uint64_t colindoff;
+  uint64_t valsoff;
+} bcsr_header_t;
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+static const char BCSR_MAGIC[8] = {'C','V','B','C','S','R','\0','\0'};
+
+
+static const uint32_t BCSR_VERSION = 1;
+
+
+static const uint32_t BCSR_BYTEORDER = 0x01020304;
+
+
+/* the alignment of the header and each array in the file */
+static const size_t BCSR_ALIGNMENT = 4096;
+
+
+
+
+/******************************************************************************
+* FUNCTION PROTOTYPES *********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Check that a mapped binary CSR file is complete and was written on a
+ * machine with the same byte order.
+ *
+ * @param header The header at the start of the file.
+ * @param size The size of the file in bytes.
+ *
+ * @return BCSR_SUCCESS if the file can be used, BCSR_ERROR_FORMAT otherwise.
+ */
+int bcsr_check(
+    bcsr_header_t const * header,
+    size_t size);
+
+
+/**
+ * @brief Convert a matrix in one of the text formats to binary CSR. Rows are
+ * streamed to the output as they are read, while point formats (which may be
+ * in any order) are read in their entirety and sorted by row first.
+ *
+ * @param infile The matrix to convert.
+ * @param itype The format of the matrix.
+ * @param knownrows The number of rows if known ahead of time (0 otherwise).
+ * @param knowncols The number of columns if known ahead of time (0
+ * otherwise).
+ * @param outfile The binary CSR file to write.
+ *
+ * @return BCSR_SUCCESS on success.
+ */
+int bcsr_convert(
+    char const * infile,
+    filetype_t itype,
+    size_t knownrows,
+    size_t knowncols,
+    char const * outfile);
+
+
+
+
+#endif
@@ -0,0 +1,323 @@
+/**
+ * @file iograph.c
+ * @brief Functions for reading binary graphs (GAP serialized graphs and Ligra
+ * binary adjacency files) in place
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-18
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_IOGRAPH_C
+#define CLAIRVOYANCE_IOGRAPH_C
+
+
+
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "iograph.h"
+
+
+
+
+/******************************************************************************
+* DOMLIB IMPORTS **************************************************************
+******************************************************************************/
+
+
+#define DLMEM_PREFIX csrmap
+#define DLMEM_TYPE_T csrmap_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Map one of the files of a graph into one of the slots owned by the
+ * matrix.
+ *
+ * @param csr The matrix.
+ * @param slot The slot to map the file into.
+ * @param name The name of the file.
+ *
+ * @return 1 on success.
+ */
+static int __map_part(
+    csrmap_t * const csr,
+    size_t const slot,
+    char const * const name)
+{
+  int fd;
+  void * map;
+  struct stat st;
+
+  if ((fd = open(name,O_RDONLY)) < 0) {
+    eprintf("Failed to open '%s' for reading\n",name);
+    return 0;
+  }
+  if (fstat(fd,&st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    eprintf("Graph file '%s' must be a regular, non-empty file\n",name);
+    close(fd);
+    return 0;
+  }
+  map = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  if (map == MAP_FAILED) {
+    eprintf("Failed to map '%s'\n",name);
+    close(fd);
+    return 0;
+  }
+
+  /* rows are streamed through front to back (a band per thread) */
+  posix_madvise(map,(size_t)st.st_size,POSIX_MADV_SEQUENTIAL);
+
+  csr->fds[slot] = fd;
+  csr->maps[slot] = map;
+  csr->mapsizes[slot] = (size_t)st.st_size;
+
+  return 1;
+}
+
+
+/**
+ * @brief Build the name of one of the files of a Ligra graph.
+ *
+ * @param name The name given for the graph.
+ * @param ext The extension of the file.
+ *
+ * @return The name of the file (to be freed by the caller).
+ */
+static char * __ligra_name(
+    char const * const name,
+    char const * const ext)
+{
+  size_t i, len, elen;
+  char * fname;
+  char const * const exts[] = {
+    LIGRA_CONFIG_EXTENSION,
+    LIGRA_ADJ_EXTENSION,
+    LIGRA_IDX_EXTENSION
+  };
+
+  /* strip the extension off of any of the three files */
+  len = strlen(name);
+  for (i=0;i<sizeof(exts)/sizeof(char const *);++i) {
+    elen = strlen(exts[i]);
+    if (len > elen && strcmp(name+len-elen,exts[i]) == 0) {
+      len -= elen;
+      break;
+    }
+  }
+
+  fname = char_alloc(len+strlen(ext)+1);
+  memcpy(fname,name,len);
+  strcpy(fname+len,ext);
+
+  return fname;
+}
+
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+csrmap_t * csrmap_create(void)
+{
+  csrmap_t * csr;
+
+  csr = csrmap_calloc(1);
+  csr->fds[0] = csr->fds[1] = -1;
+
+  return csr;
+}
+
+
+csrmap_t * graph_open_gap(
+    char const * const map,
+    size_t const size,
+    char const * const name)
+{
+  int directed;
+  size_t ndirs, width, idxbytes;
+  int64_t nedges, nvtxs;
+  csrmap_t * csr;
+
+  if (size < GAP_HEADER_SIZE || (map[0] != 0 && map[0] != 1)) {
+    eprintf("'%s' is not a GAP serialized graph\n",name);
+    return NULL;
+  }
+  directed = map[0];
+  memcpy(&nedges,map+1,sizeof(int64_t));
+  memcpy(&nvtxs,map+1+sizeof(int64_t),sizeof(int64_t));
+  if (nedges < 0 || nvtxs < 0 || (uint64_t)nvtxs >= size/sizeof(int64_t) || \
+      (uint64_t)nedges > size/sizeof(int32_t)) {
+    eprintf("GAP graph '%s' has an invalid header\n",name);
+    return NULL;
+  }
+
+  /* the file only adds up for one of the neighbor widths */
+  ndirs = directed ? 2 : 1;
+  idxbytes = ((size_t)nvtxs+1)*sizeof(int64_t);
+  if (size == GAP_HEADER_SIZE + \
+      ndirs*(idxbytes+((size_t)nedges*sizeof(int32_t)))) {
+    width = sizeof(int32_t);
+  } else if (size == GAP_HEADER_SIZE + \
+      ndirs*(idxbytes+((size_t)nedges*2*sizeof(int32_t)))) {
+    width = 2*sizeof(int32_t);
+  } else {
+    eprintf("GAP graph '%s' of %zu bytes does not hold %lld vertices and "
+        "%lld edges\n",name,size,(long long)nvtxs,(long long)nedges);
+    return NULL;
+  }
+
+  csr = csrmap_create();
+  csr->nrows = csr->ncols = (size_t)nvtxs;
+  csr->nnz = (size_t)nedges;
+  csr->rowptr = map + GAP_HEADER_SIZE;
+  csr->ptrwidth = sizeof(int64_t);
+  csr->nptrs = (size_t)nvtxs+1;
+  csr->colind = csr->rowptr + idxbytes;
+  csr->idxwidth = sizeof(int32_t);
+  csr->idxstride = width;
+  if (width > sizeof(int32_t)) {
+    csr->vals = csr->colind + sizeof(int32_t);
+    csr->valtype = CSRMAP_VALUE_INT32;
+    csr->valstride = width;
+  } else {
+    csr->valtype = CSRMAP_VALUE_NONE;
+  }
+
+  if (csrmap_rowptr(csr,0) != 0 || \
+      csrmap_rowptr(csr,csr->nrows) != (uint64_t)nedges) {
+    eprintf("GAP graph '%s' has invalid offsets\n",name);
+    graph_close(csr);
+    return NULL;
+  }
+
+  return csr;
+}
+
+
+csrmap_t * graph_open_ligra(
+    char const * const name)
+{
+  int ok;
+  unsigned long long nvtxs;
+  char * cname, * aname, * iname;
+  FILE * fin;
+  csrmap_t * csr;
+
+  cname = __ligra_name(name,LIGRA_CONFIG_EXTENSION);
+  aname = __ligra_name(name,LIGRA_ADJ_EXTENSION);
+  iname = __ligra_name(name,LIGRA_IDX_EXTENSION);
+
+  csr = csrmap_create();
+
+  ok = 0;
+  if ((fin = fopen(cname,"r")) == NULL) {
+    eprintf("Failed to open '%s' for reading\n",cname);
+    goto END;
+  }
+  if (fscanf(fin,"%llu",&nvtxs) != 1 || nvtxs == 0) {
+    eprintf("Failed to read the number of vertices from '%s'\n",cname);
+    fclose(fin);
+    goto END;
+  }
+  fclose(fin);
+
+  if (!__map_part(csr,0,iname) || !__map_part(csr,1,aname)) {
+    goto END;
+  }
+
+  /* the offsets are either ints or longs, depending on how Ligra was built */
+  csr->nrows = csr->ncols = (size_t)nvtxs;
+  if (csr->mapsizes[0] == csr->nrows*sizeof(uint32_t)) {
+    csr->ptrwidth = sizeof(uint32_t);
+  } else if (csr->mapsizes[0] == csr->nrows*sizeof(uint64_t)) {
+    csr->ptrwidth = sizeof(uint64_t);
+  } else {
+    eprintf("Ligra offsets '%s' of %zu bytes do not hold %zu vertices\n", \
+        iname,csr->mapsizes[0],csr->nrows);
+    goto END;
+  }
+  if (csr->mapsizes[1] % sizeof(uint32_t) != 0) {
+    eprintf("Ligra edges '%s' of %zu bytes do not hold 32 bit vertices\n", \
+        aname,csr->mapsizes[1]);
+    goto END;
+  }
+
+  /* the end of the last row is implied by the number of edges */
+  csr->nnz = csr->mapsizes[1]/sizeof(uint32_t);
+  csr->rowptr = (char const *)csr->maps[0];
+  csr->nptrs = csr->nrows;
+  csr->colind = (char const *)csr->maps[1];
+  csr->idxwidth = sizeof(uint32_t);
+  csr->idxstride = sizeof(uint32_t);
+  csr->valtype = CSRMAP_VALUE_NONE;
+
+  if (csrmap_rowptr(csr,0) != 0 || \
+      csrmap_rowptr(csr,csr->nrows-1) > (uint64_t)csr->nnz) {
+    eprintf("Ligra offsets '%s' are invalid\n",iname);
+    goto END;
+  }
+
+  ok = 1;
+
+  END:
+
+  dl_free(cname);
+  dl_free(aname);
+  dl_free(iname);
+
+  if (!ok) {
+    graph_close(csr);
+    return NULL;
+  }
+
+  return csr;
+}
+
+
+void graph_close(
+    csrmap_t * const csr)
+{
+  size_t i;
+
+  for (i=0;i<2;++i) {
+    if (csr->maps[i]) {
+      munmap(csr->maps[i],csr->mapsizes[i]);
+    }
+    if (csr->fds[i] >= 0) {
+      close(csr->fds[i]);
+    }
+  }
+  dl_free(csr);
+}
+
+
+
+
+#endif
@@ -0,0 +1,243 @@
+/**
+ * @file iograph.h
+ * @brief Types and function prototypes for reading binary graphs (GAP
+ * serialized graphs and Ligra binary adjacency files) in place
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-18
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_IOGRAPH_H
+#define CLAIRVOYANCE_IOGRAPH_H
+
+
+
+
+#include "base.h"
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+typedef enum csrmap_valtype_t {
+  CSRMAP_VALUE_NONE,
+  CSRMAP_VALUE_FLOAT,
+  CSRMAP_VALUE_DOUBLE,
+  CSRMAP_VALUE_INT32
+} csrmap_valtype_t;
+
+
+/**
+ * @brief The arrays of a matrix that is stored in compressed sparse row form
+ * in one or more memory-mapped files, and is used in place. The row pointers
+ * are ptrwidth bytes each, and there are nrows+1 of them, or only nrows when
+ * the last is left implied by nnz (as Ligra does). The column indices are
+ * idxwidth bytes every idxstride bytes, and the values (if any) every
+ * valstride bytes, so that arrays of interleaved (column,value) pairs can be
+ * used as is. None of the arrays need be aligned.
+ */
+typedef struct csrmap_t {
+  size_t nrows;
+  size_t ncols;
+  size_t nnz;
+  char const * rowptr;
+  size_t ptrwidth;
+  size_t nptrs;
+  char const * colind;
+  size_t idxwidth;
+  size_t idxstride;
+  char const * vals;
+  csrmap_valtype_t valtype;
+  size_t valstride;
+  /* the mappings owned by this (for inputs spread over several files) */
+  int fds[2];
+  void * maps[2];
+  size_t mapsizes[2];
+} csrmap_t;
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* the size of a GAP serialized graph's header: a one byte flag for whether it
+ * is directed, followed by the 64 bit number of edges and vertices */
+static const size_t GAP_HEADER_SIZE = 1 + (2*sizeof(int64_t));
+
+
+/* the extensions of the three files making up a Ligra binary graph */
+static const char LIGRA_CONFIG_EXTENSION[] = ".config";
+static const char LIGRA_ADJ_EXTENSION[] = ".adj";
+static const char LIGRA_IDX_EXTENSION[] = ".idx";
+
+
+
+
+/******************************************************************************
+* INLINE FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Get the offset of the start of a row (or one past the end of the
+ * last row).
+ *
+ * @param csr The matrix.
+ * @param i The row.
+ *
+ * @return The offset of the first non-zero of the row.
+ */
+static inline uint64_t csrmap_rowptr(
+    csrmap_t const * const csr,
+    size_t const i)
+{
+  uint32_t p32;
+  uint64_t p64;
+
+  if (i >= csr->nptrs) {
+    return (uint64_t)csr->nnz;
+  }
+  if (csr->ptrwidth == sizeof(uint32_t)) {
+    memcpy(&p32,csr->rowptr+(i*sizeof(uint32_t)),sizeof(uint32_t));
+    return (uint64_t)p32;
+  } else {
+    memcpy(&p64,csr->rowptr+(i*sizeof(uint64_t)),sizeof(uint64_t));
+    return p64;
+  }
+}
+
+
+/**
+ * @brief Get the column index of a non-zero.
+ *
+ * @param csr The matrix.
+ * @param k The non-zero.
+ *
+ * @return The column index.
+ */
+static inline size_t csrmap_col(
+    csrmap_t const * const csr,
+    uint64_t const k)
+{
+  uint32_t j32;
+  uint64_t j64;
+
+  if (csr->idxwidth == sizeof(uint32_t)) {
+    memcpy(&j32,csr->colind+(k*csr->idxstride),sizeof(uint32_t));
+    return (size_t)j32;
+  } else {
+    memcpy(&j64,csr->colind+(k*csr->idxstride),sizeof(uint64_t));
+    return (size_t)j64;
+  }
+}
+
+
+/**
+ * @brief Get the value of a non-zero (1 for matrices without values).
+ *
+ * @param csr The matrix.
+ * @param k The non-zero.
+ *
+ * @return The value.
+ */
+static inline real_t csrmap_val(
+    csrmap_t const * const csr,
+    uint64_t const k)
+{
+  float f;
+  double d;
+  int32_t i32;
+  char const * const ptr = csr->vals + (k*csr->valstride);
+
+  switch (csr->valtype) {
+    case CSRMAP_VALUE_FLOAT:
+      memcpy(&f,ptr,sizeof(float));
+      return (real_t)f;
+    case CSRMAP_VALUE_DOUBLE:
+      memcpy(&d,ptr,sizeof(double));
+      return (real_t)d;
+    case CSRMAP_VALUE_INT32:
+      memcpy(&i32,ptr,sizeof(int32_t));
+      return (real_t)i32;
+    default:
+      return 1.0;
+  }
+}
+
+
+
+
+/******************************************************************************
+* FUNCTION PROTOTYPES *********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Create an empty matrix, owning no mappings, for a caller to point at
+ * arrays it has mapped itself.
+ *
+ * @return The matrix.
+ */
+csrmap_t * csrmap_create(void);
+
+
+/**
+ * @brief Use a memory-mapped GAP serialized graph (.sg, or .wsg with 32 bit
+ * weights). The file is: a one byte flag for whether the graph is directed,
+ * the 64 bit number of edges and vertices, the (nvtxs+1) 64 bit offsets and
+ * 32 bit neighbors (or {neighbor,weight} pairs) of each vertex's out edges,
+ * and for directed graphs the same again for the in edges, which are not
+ * needed here. Whether it is weighted is determined from its size.
+ *
+ * @param map The mapped file.
+ * @param size The size of the file in bytes.
+ * @param name The name of the file (for error messages).
+ *
+ * @return The graph's adjacency matrix (which does not own the mapping), or
+ * NULL if the file is not a GAP graph.
+ */
+csrmap_t * graph_open_gap(
+    char const * map,
+    size_t size,
+    char const * name);
+
+
+/**
+ * @brief Map a Ligra binary graph, made up of '<base>.config' holding the
+ * number of vertices as text, '<base>.idx' holding the 32 or 64 bit offset of
+ * each vertex's edges, and '<base>.adj' holding the 32 bit neighbors. Ligra's
+ * weighted binary graphs, which append the weights to the .adj file, can not
+ * be told apart from unweighted ones and are not supported.
+ *
+ * @param name The base name of the graph, or the name of any of its three
+ * files.
+ *
+ * @return The graph's adjacency matrix, or NULL if it could not be opened.
+ */
+csrmap_t * graph_open_ligra(
+    char const * name);
+
+
+/**
+ * @brief Unmap any files owned by a matrix and free the associated memory.
+ *
+ * @param csr The matrix.
+ */
+void graph_close(
+    csrmap_t * csr);
+
+
+
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ * @file ioindex.c
+ * @brief Functions for reading and writing the sidecar row index
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-14
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_IOINDEX_C
+#define CLAIRVOYANCE_IOINDEX_C
+
+
+
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <sys/stat.h>
+#include "ioindex.h"
+
+
+
+
+/******************************************************************************
+* DOMLIB IMPORTS **************************************************************
+******************************************************************************/
+
+
+#define DLMEM_PREFIX index_off
+#define DLMEM_TYPE_T uint64_t
+#define DLMEM_DLTYPE DLTYPE_INTEGRAL
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Build the name of the sidecar index of a file.
+ *
+ * @param name The name of the indexed file.
+ * @param suffix What to append after the index extension ("" for none).
+ *
+ * @return The name of the index (to be freed by the caller).
+ */
+static char * __index_name(
+    char const * const name,
+    char const * const suffix)
+{
+  size_t len;
+  char * iname;
+
+  len = strlen(name) + strlen(INDEX_EXTENSION) + strlen(suffix) + 1;
+  iname = char_alloc(len);
+  sprintf(iname,"%s%s%s",name,INDEX_EXTENSION,suffix);
+
+  return iname;
+}
+
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+int index_stamp(
+    int const fd,
+    index_header_t * const header)
+{
+  struct stat st;
+
+  if (fstat(fd,&st) != 0) {
+    return INDEX_ERROR_READ;
+  }
+
+  header->filesize = (uint64_t)st.st_size;
+  header->mtime = (int64_t)st.st_mtim.tv_sec;
+  header->mtimensec = (int64_t)st.st_mtim.tv_nsec;
+
+  return INDEX_SUCCESS;
+}
+
+
+int index_read(
+    char const * const name,
+    index_header_t const * const stamp,
+    index_header_t * const r_header,
+    uint64_t ** const r_offsets)
+{
+  int err;
+  char * iname;
+  uint64_t * offsets;
+  FILE * fin;
+
+  iname = __index_name(name,"");
+  fin = fopen(iname,"rb");
+  dl_free(iname);
+  if (fin == NULL) {
+    return INDEX_ERROR_OPEN;
+  }
+
+  offsets = NULL;
+  err = INDEX_ERROR_READ;
+  if (fread(r_header,sizeof(index_header_t),1,fin) != 1) {
+    goto END;
+  }
+
+  err = INDEX_ERROR_FORMAT;
+  if (memcmp(r_header->magic,INDEX_MAGIC,sizeof(INDEX_MAGIC)) != 0 || \
+      r_header->version != INDEX_VERSION || \
+      r_header->byteorder != INDEX_BYTEORDER) {
+    goto END;
+  }
+
+  err = INDEX_ERROR_STALE;
+  if (r_header->filesize != stamp->filesize || \
+      r_header->mtime != stamp->mtime || \
+      r_header->mtimensec != stamp->mtimensec) {
+    goto END;
+  }
+
+  err = INDEX_ERROR_READ;
+  offsets = index_off_alloc(dl_max(r_header->noffsets,1));
+  if (fread(offsets,sizeof(uint64_t),r_header->noffsets,fin) != \
+      r_header->noffsets) {
+    goto END;
+  }
+
+  err = INDEX_SUCCESS;
+
+  END:
+
+  fclose(fin);
+
+  if (err == INDEX_SUCCESS) {
+    *r_offsets = offsets;
+  } else if (offsets) {
+    dl_free(offsets);
+  }
+
+  return err;
+}
+
+
+int index_write(
+    char const * const name,
+    index_header_t * const header,
+    uint64_t const * const offsets)
+{
+  int err;
+  char * iname, * tname;
+  FILE * fout;
+
+  memcpy(header->magic,INDEX_MAGIC,sizeof(INDEX_MAGIC));
+  header->version = INDEX_VERSION;
+  header->byteorder = INDEX_BYTEORDER;
+
+  iname = __index_name(name,"");
+  tname = __index_name(name,".tmp");
+
+  err = INDEX_ERROR_OPEN;
+  if ((fout = fopen(tname,"wb")) == NULL) {
+    goto END;
+  }
+
+  err = INDEX_ERROR_WRITE;
+  if (fwrite(header,sizeof(index_header_t),1,fout) != 1 || \
+      fwrite(offsets,sizeof(uint64_t),header->noffsets,fout) != \
+          header->noffsets) {
+    fclose(fout);
+    remove(tname);
+    goto END;
+  }
+  if (fclose(fout) != 0 || rename(tname,iname) != 0) {
+    remove(tname);
+    goto END;
+  }
+
+  err = INDEX_SUCCESS;
+
+  END:
+
+  dl_free(iname);
+  dl_free(tname);
+
+  return err;
+}
+
+
+
+
+#endif
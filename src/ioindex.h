@@ -0,0 +1,161 @@
+/**
+ * @file ioindex.h
+ * @brief Types and function prototypes for the sidecar row index
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-14
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_IOINDEX_H
+#define CLAIRVOYANCE_IOINDEX_H
+
+
+
+
+#include "base.h"
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+typedef enum index_error_t {
+  INDEX_SUCCESS = 1,
+  INDEX_ERROR_READ = -1,
+  INDEX_ERROR_WRITE = -2,
+  INDEX_ERROR_OPEN = -3,
+  INDEX_ERROR_FORMAT = -4,
+  INDEX_ERROR_STALE = -5
+} index_error_t;
+
+
+/**
+ * @brief The header of a sidecar index ('<file>.cvidx'). It records what was
+ * learned from reading a text matrix -- its dimensions, number of non-zeros,
+ * and the layout of its lines -- along with the size and modification time of
+ * the file it describes, and is followed by the noffsets 64 bit byte offsets
+ * of every stride'th row (for row based formats).
+ */
+typedef struct index_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteorder;
+  uint32_t filetype;
+  uint32_t val;
+  /* the file the index describes */
+  uint64_t filesize;
+  int64_t mtime;
+  int64_t mtimensec;
+  /* the offset of the first row/point (after any header) */
+  uint64_t datastart;
+  uint64_t nrows;
+  uint64_t ncols;
+  uint64_t nnz;
+  uint64_t nfields;
+  uint64_t idxoffset;
+  uint64_t valoffset;
+  uint64_t lineoffset;
+  uint64_t stride;
+  uint64_t noffsets;
+} index_header_t;
+
+
+/**
+ * @brief An index loaded from a sidecar file, or being built as the file is
+ * read.
+ */
+typedef struct rowindex_t {
+  index_header_t header;
+  uint64_t * offsets;
+  size_t maxoffsets;
+  /* 1 if read from a sidecar that matches the file */
+  int loaded;
+} rowindex_t;
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+static const char INDEX_MAGIC[8] = {'C','V','I','D','X','\0','\0','\0'};
+
+
+static const uint32_t INDEX_VERSION = 1;
+
+
+static const uint32_t INDEX_BYTEORDER = 0x01020304;
+
+
+static const char INDEX_EXTENSION[] = ".cvidx";
+
+
+
+
+/******************************************************************************
+* FUNCTION PROTOTYPES *********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Fill in the size and modification time of an open file, which an
+ * index must match to be used.
+ *
+ * @param fd The file descriptor of the indexed file.
+ * @param header The header to fill in.
+ *
+ * @return INDEX_SUCCESS on success, INDEX_ERROR_READ if the file could not be
+ * stat'd.
+ */
+int index_stamp(
+    int fd,
+    index_header_t * header);
+
+
+/**
+ * @brief Read the sidecar index of a file.
+ *
+ * @param name The name of the indexed file (not the index).
+ * @param stamp The size and modification time the index must match.
+ * @param r_header The header of the index.
+ * @param r_offsets The row offsets (to be freed by the caller).
+ *
+ * @return INDEX_SUCCESS on success, INDEX_ERROR_STALE if the index does not
+ * match the file, or another error if it could not be read.
+ */
+int index_read(
+    char const * name,
+    index_header_t const * stamp,
+    index_header_t * r_header,
+    uint64_t ** r_offsets);
+
+
+/**
+ * @brief Write the sidecar index of a file. The index is written next to it
+ * and then moved into place, so a reader never sees half of one.
+ *
+ * @param name The name of the indexed file (not the index).
+ * @param header The header to write (the magic, version, and byte order are
+ * set here).
+ * @param offsets The header->noffsets row offsets.
+ *
+ * @return INDEX_SUCCESS on success.
+ */
+int index_write(
+    char const * name,
+    index_header_t * header,
+    uint64_t const * offsets);
+
+
+
+
+#endif
@@ -0,0 +1,643 @@
+/**
+ * @file ionpy.c
+ * @brief Functions for reading NumPy (.npy) coordinate arrays
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-17
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_IONPY_C
+#define CLAIRVOYANCE_IONPY_C
+
+
+
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ionpy.h"
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+typedef struct npy_dtype_name_t {
+  char const * name;
+  npy_dtype_t dtype;
+} npy_dtype_name_t;
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* the type codes of the supported dtypes, without their byte order */
+static const npy_dtype_name_t NPY_DTYPES[] = {
+  {"i1",NPY_INT8},
+  {"u1",NPY_UINT8},
+  {"i2",NPY_INT16},
+  {"u2",NPY_UINT16},
+  {"i4",NPY_INT32},
+  {"u4",NPY_UINT32},
+  {"i8",NPY_INT64},
+  {"u8",NPY_UINT64},
+  {"f4",NPY_FLOAT32},
+  {"f8",NPY_FLOAT64}
+};
+
+
+static const size_t NPY_NDTYPES = sizeof(NPY_DTYPES)/sizeof(npy_dtype_name_t);
+
+
+static const size_t NPY_WIDTHS[] = {
+  [NPY_INT8] = 1,
+  [NPY_UINT8] = 1,
+  [NPY_INT16] = 2,
+  [NPY_UINT16] = 2,
+  [NPY_INT32] = 4,
+  [NPY_UINT32] = 4,
+  [NPY_INT64] = 8,
+  [NPY_UINT64] = 8,
+  [NPY_FLOAT32] = 4,
+  [NPY_FLOAT64] = 8
+};
+
+
+
+
+/******************************************************************************
+* DOMLIB IMPORTS **************************************************************
+******************************************************************************/
+
+
+#define DLMEM_PREFIX npy_coo
+#define DLMEM_TYPE_T npy_coo_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Get the byte order character numpy uses for this machine.
+ *
+ * @return '<' for little endian, '>' for big endian.
+ */
+static char __native_order(void)
+{
+  uint16_t const one = 1;
+
+  return *((unsigned char const *)&one) == 1 ? '<' : '>';
+}
+
+
+/**
+ * @brief Find the value of a key in the dictionary of a .npy header.
+ *
+ * @param header The header.
+ * @param end The end of the header.
+ * @param key The key (without quotes).
+ *
+ * @return The start of the value, or NULL if the key is missing.
+ */
+static char const * __find_key(
+    char const * const header,
+    char const * const end,
+    char const * const key)
+{
+  size_t const len = strlen(key);
+  char const * ptr;
+
+  for (ptr=header;ptr+len+2<=end;++ptr) {
+    if ((*ptr == '\'' || *ptr == '"') && ptr[len+1] == *ptr && \
+        strncmp(ptr+1,key,len) == 0) {
+      ptr += len+2;
+      while (ptr < end && (*ptr == ' ' || *ptr == ':')) {
+        ++ptr;
+      }
+      return ptr;
+    }
+  }
+
+  return NULL;
+}
+
+
+/**
+ * @brief Parse the header of a .npy file, which must describe a one
+ * dimensional array (or one whose other dimensions are all 1).
+ *
+ * @param array The array (the mapping must be set, the rest is filled in).
+ * @param name The name of the file (for errors).
+ *
+ * @return NPY_SUCCESS on success, NPY_ERROR_FORMAT otherwise.
+ */
+static int __parse_header(
+    npy_array_t * const array,
+    char const * const name)
+{
+  size_t i, hlen, hstart, len, dim, ndims, length;
+  char const * header, * end, * ptr;
+  unsigned char const * const bytes = (unsigned char const *)array->map;
+
+  if (array->mapsize < 10 || memcmp(bytes,NPY_MAGIC,sizeof(NPY_MAGIC)) != 0) {
+    eprintf("Missing npy header in '%s'\n",name);
+    return NPY_ERROR_FORMAT;
+  }
+  if (bytes[6] == 1) {
+    hlen = (size_t)bytes[8] | ((size_t)bytes[9] << 8);
+    hstart = 10;
+  } else if ((bytes[6] == 2 || bytes[6] == 3) && array->mapsize >= 12) {
+    hlen = (size_t)bytes[8] | ((size_t)bytes[9] << 8) | \
+        ((size_t)bytes[10] << 16) | ((size_t)bytes[11] << 24);
+    hstart = 12;
+  } else {
+    eprintf("Unsupported npy version '%u' in '%s'\n",(unsigned int)bytes[6],
+        name);
+    return NPY_ERROR_FORMAT;
+  }
+  if (hstart + hlen > array->mapsize) {
+    eprintf("Npy header of '%s' is truncated\n",name);
+    return NPY_ERROR_FORMAT;
+  }
+  header = ((char const *)array->map) + hstart;
+  end = header + hlen;
+
+  /* the type, including its byte order */
+  if ((ptr = __find_key(header,end,"descr")) == NULL || end - ptr < 5 || \
+      (*ptr != '\'' && *ptr != '"')) {
+    eprintf("Missing dtype in npy header of '%s'\n",name);
+    return NPY_ERROR_FORMAT;
+  }
+  ++ptr;
+  if (ptr[3] != ptr[-1] || (ptr[0] != '|' && ptr[0] != __native_order())) {
+    eprintf("Unsupported dtype '%.3s' in '%s'\n",ptr,name);
+    return NPY_ERROR_FORMAT;
+  }
+  for (i=0;i<NPY_NDTYPES;++i) {
+    if (strncmp(ptr+1,NPY_DTYPES[i].name,2) == 0) {
+      break;
+    }
+  }
+  if (i == NPY_NDTYPES || \
+      (ptr[0] == '|' && NPY_WIDTHS[NPY_DTYPES[i].dtype] > 1)) {
+    eprintf("Unsupported dtype '%.3s' in '%s'\n",ptr,name);
+    return NPY_ERROR_FORMAT;
+  }
+  array->dtype = NPY_DTYPES[i].dtype;
+
+  /* the shape -- with only one dimension above 1, the order does not
+   * matter */
+  if ((ptr = __find_key(header,end,"shape")) == NULL || *ptr != '(') {
+    eprintf("Missing shape in npy header of '%s'\n",name);
+    return NPY_ERROR_FORMAT;
+  }
+  ++ptr;
+  length = 1;
+  ndims = 0;
+  while (ptr < end && *ptr != ')') {
+    if (*ptr >= '0' && *ptr <= '9') {
+      dim = 0;
+      while (ptr < end && *ptr >= '0' && *ptr <= '9') {
+        dim = (dim*10) + (size_t)(*ptr - '0');
+        ++ptr;
+      }
+      if (dim > 1) {
+        ++ndims;
+      }
+      length *= dim;
+    } else {
+      ++ptr;
+    }
+  }
+  if (ndims > 1) {
+    eprintf("Npy array in '%s' is not one dimensional\n",name);
+    return NPY_ERROR_FORMAT;
+  }
+
+  /* the arrays are used in place */
+  if ((hstart + hlen) % NPY_WIDTHS[array->dtype] != 0) {
+    eprintf("Npy array in '%s' is not aligned\n",name);
+    return NPY_ERROR_FORMAT;
+  }
+  len = length * NPY_WIDTHS[array->dtype];
+  if (hstart + hlen + len > array->mapsize) {
+    eprintf("Npy array in '%s' is truncated\n",name);
+    return NPY_ERROR_FORMAT;
+  }
+  array->length = length;
+  array->data = end;
+
+  return NPY_SUCCESS;
+}
+
+
+/**
+ * @brief Map a .npy file and parse its header.
+ *
+ * @param array The array to fill in.
+ * @param name The name of the file.
+ *
+ * @return NPY_SUCCESS on success.
+ */
+static int __map_array(
+    npy_array_t * const array,
+    char const * const name)
+{
+  int fd;
+  void * map;
+  struct stat st;
+
+  if ((fd = open(name,O_RDONLY)) < 0) {
+    eprintf("Failed to open '%s' for reading\n",name);
+    return NPY_ERROR_OPEN;
+  }
+  if (fstat(fd,&st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    eprintf("Npy file '%s' must be a regular, non-empty file\n",name);
+    close(fd);
+    return NPY_ERROR_OPEN;
+  }
+  map = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  if (map == MAP_FAILED) {
+    eprintf("Failed to map '%s'\n",name);
+    close(fd);
+    return NPY_ERROR_OPEN;
+  }
+
+  array->fd = fd;
+  array->map = map;
+  array->mapsize = (size_t)st.st_size;
+
+  return __parse_header(array,name);
+}
+
+
+/**
+ * @brief Unmap a .npy file.
+ *
+ * @param array The array.
+ */
+static void __unmap_array(
+    npy_array_t * const array)
+{
+  if (array->map) {
+    munmap(array->map,array->mapsize);
+    array->map = NULL;
+  }
+  if (array->fd >= 0) {
+    close(array->fd);
+    array->fd = -1;
+  }
+}
+
+
+/**
+ * @brief Split the name of the input into the names of its arrays.
+ *
+ * @param name The name of the input.
+ * @param names The names of the row, column, and value arrays (the last is
+ * set to NULL if there is none, and each is to be freed by the caller).
+ *
+ * @return The number of arrays (2 or 3), or 0 if the input names neither a
+ * directory nor a list of arrays.
+ */
+static size_t __split_names(
+    char const * const name,
+    char * names[3])
+{
+  size_t n, len;
+  char const * sptr, * eptr;
+  struct stat st;
+  char const * const files[] = {NPY_ROW_NAME,NPY_COL_NAME,NPY_VAL_NAME};
+
+  names[0] = names[1] = names[2] = NULL;
+
+  if (stat(name,&st) == 0 && S_ISDIR(st.st_mode)) {
+    for (n=0;n<3;++n) {
+      len = strlen(name) + strlen(files[n]) + 2;
+      names[n] = char_alloc(len);
+      sprintf(names[n],"%s/%s",name,files[n]);
+    }
+    /* the values are optional */
+    if (stat(names[2],&st) != 0) {
+      dl_free(names[2]);
+      names[2] = NULL;
+      return 2;
+    }
+    return 3;
+  }
+
+  n = 0;
+  eptr = sptr = name;
+  while (n < 3) {
+    if ((eptr = strchr(sptr,NPY_SEPARATOR)) == NULL) {
+      eptr = sptr + strlen(sptr);
+    }
+    len = eptr - sptr;
+    names[n] = char_alloc(len+1);
+    memcpy(names[n],sptr,len);
+    names[n][len] = '\0';
+    ++n;
+    if (*eptr == '\0') {
+      break;
+    }
+    sptr = eptr+1;
+  }
+  if (n < 2 || *eptr != '\0') {
+    for (len=0;len<n;++len) {
+      dl_free(names[len]);
+      names[len] = NULL;
+    }
+    return 0;
+  }
+
+  return n;
+}
+
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+int npy_detect(
+    char const * const name)
+{
+  size_t len;
+  char * row;
+  struct stat st;
+  int found;
+
+  len = strlen(name);
+  if (len >= 4 && strcmp(name+len-4,".npy") == 0) {
+    return 1;
+  }
+
+  if (stat(name,&st) != 0 || !S_ISDIR(st.st_mode)) {
+    return 0;
+  }
+  row = char_alloc(len + strlen(NPY_ROW_NAME) + 2);
+  sprintf(row,"%s/%s",name,NPY_ROW_NAME);
+  found = stat(row,&st) == 0;
+  dl_free(row);
+
+  return found;
+}
+
+
+npy_coo_t * npy_open(
+    char const * const name)
+{
+  int err;
+  size_t i, narrays;
+  char * names[3];
+  npy_array_t * arrays[3];
+  npy_coo_t * coo;
+
+  if ((narrays = __split_names(name,names)) == 0) {
+    eprintf("'%s' is neither a directory holding %s and %s, nor a list of "
+        "two or three .npy files\n",name,NPY_ROW_NAME,NPY_COL_NAME);
+    return NULL;
+  }
+
+  coo = npy_coo_calloc(1);
+  coo->row.fd = coo->col.fd = coo->val.fd = -1;
+  arrays[0] = &(coo->row);
+  arrays[1] = &(coo->col);
+  arrays[2] = &(coo->val);
+
+  err = NPY_SUCCESS;
+  for (i=0;i<narrays && err == NPY_SUCCESS;++i) {
+    err = __map_array(arrays[i],names[i]);
+  }
+  if (err == NPY_SUCCESS) {
+    coo->hasval = narrays == 3;
+    coo->nnz = coo->row.length;
+    if (coo->row.dtype >= NPY_FLOAT32 || coo->col.dtype >= NPY_FLOAT32) {
+      eprintf("The row and column arrays of '%s' must be integers\n",name);
+      err = NPY_ERROR_FORMAT;
+    } else if (coo->col.length != coo->nnz || \
+        (coo->hasval && coo->val.length != coo->nnz)) {
+      eprintf("The arrays of '%s' are not all the same length\n",name);
+      err = NPY_ERROR_FORMAT;
+    }
+  }
+
+  for (i=0;i<narrays;++i) {
+    dl_free(names[i]);
+  }
+
+  if (err != NPY_SUCCESS) {
+    npy_close(coo);
+    return NULL;
+  }
+
+  return coo;
+}
+
+
+int npy_get_indices(
+    npy_array_t const * const array,
+    size_t const start,
+    size_t const n,
+    size_t * const out)
+{
+  size_t k;
+  int64_t neg;
+
+  /* each loop is over a single type so that it can be vectorized */
+  neg = 0;
+  switch (array->dtype) {
+    case NPY_INT8: {
+      int8_t const * const data = ((int8_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (size_t)data[k];
+        neg |= data[k];
+      }
+      break;
+    }
+    case NPY_UINT8: {
+      uint8_t const * const data = ((uint8_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (size_t)data[k];
+      }
+      break;
+    }
+    case NPY_INT16: {
+      int16_t const * const data = ((int16_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (size_t)data[k];
+        neg |= data[k];
+      }
+      break;
+    }
+    case NPY_UINT16: {
+      uint16_t const * const data = ((uint16_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (size_t)data[k];
+      }
+      break;
+    }
+    case NPY_INT32: {
+      int32_t const * const data = ((int32_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (size_t)data[k];
+        neg |= data[k];
+      }
+      break;
+    }
+    case NPY_UINT32: {
+      uint32_t const * const data = ((uint32_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (size_t)data[k];
+      }
+      break;
+    }
+    case NPY_INT64: {
+      int64_t const * const data = ((int64_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (size_t)data[k];
+        neg |= data[k];
+      }
+      break;
+    }
+    case NPY_UINT64: {
+      uint64_t const * const data = ((uint64_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (size_t)data[k];
+      }
+      break;
+    }
+    default:
+      dl_error("Npy array of type %d is not an index array\n",
+          (int)array->dtype);
+  }
+
+  return neg < 0 ? NPY_ERROR_NEGATIVE : NPY_SUCCESS;
+}
+
+
+void npy_get_values(
+    npy_array_t const * const array,
+    size_t const start,
+    size_t const n,
+    real_t * const out)
+{
+  size_t k;
+
+  switch (array->dtype) {
+    case NPY_FLOAT32: {
+      float const * const data = ((float const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (real_t)data[k];
+      }
+      break;
+    }
+    case NPY_FLOAT64: {
+      double const * const data = ((double const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (real_t)data[k];
+      }
+      break;
+    }
+    case NPY_INT8: {
+      int8_t const * const data = ((int8_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (real_t)data[k];
+      }
+      break;
+    }
+    case NPY_UINT8: {
+      uint8_t const * const data = ((uint8_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (real_t)data[k];
+      }
+      break;
+    }
+    case NPY_INT16: {
+      int16_t const * const data = ((int16_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (real_t)data[k];
+      }
+      break;
+    }
+    case NPY_UINT16: {
+      uint16_t const * const data = ((uint16_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (real_t)data[k];
+      }
+      break;
+    }
+    case NPY_INT32: {
+      int32_t const * const data = ((int32_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (real_t)data[k];
+      }
+      break;
+    }
+    case NPY_UINT32: {
+      uint32_t const * const data = ((uint32_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (real_t)data[k];
+      }
+      break;
+    }
+    case NPY_INT64: {
+      int64_t const * const data = ((int64_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (real_t)data[k];
+      }
+      break;
+    }
+    case NPY_UINT64: {
+      uint64_t const * const data = ((uint64_t const *)array->data) + start;
+      for (k=0;k<n;++k) {
+        out[k] = (real_t)data[k];
+      }
+      break;
+    }
+  }
+}
+
+
+void npy_close(
+    npy_coo_t * const coo)
+{
+  __unmap_array(&(coo->row));
+  __unmap_array(&(coo->col));
+  __unmap_array(&(coo->val));
+  dl_free(coo);
+}
+
+
+
+
+#endif
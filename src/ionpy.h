@@ -0,0 +1,176 @@
+/**
+ * @file ionpy.h
+ * @brief Types and function prototypes for reading NumPy (.npy) coordinate
+ * arrays
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-17
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_IONPY_H
+#define CLAIRVOYANCE_IONPY_H
+
+
+
+
+#include "base.h"
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+typedef enum npy_error_t {
+  NPY_SUCCESS = 1,
+  NPY_ERROR_OPEN = -1,
+  NPY_ERROR_FORMAT = -2,
+  NPY_ERROR_NEGATIVE = -3
+} npy_error_t;
+
+
+typedef enum npy_dtype_t {
+  NPY_INT8,
+  NPY_UINT8,
+  NPY_INT16,
+  NPY_UINT16,
+  NPY_INT32,
+  NPY_UINT32,
+  NPY_INT64,
+  NPY_UINT64,
+  NPY_FLOAT32,
+  NPY_FLOAT64
+} npy_dtype_t;
+
+
+/**
+ * @brief A one dimensional array in a memory-mapped .npy file, used in place.
+ */
+typedef struct npy_array_t {
+  int fd;
+  void * map;
+  size_t mapsize;
+  npy_dtype_t dtype;
+  size_t length;
+  char const * data;
+} npy_array_t;
+
+
+/**
+ * @brief A matrix in coordinate form, as three arrays of the same length (the
+ * row, col, and data arrays of a scipy.sparse.coo_matrix). The values are
+ * optional.
+ */
+typedef struct npy_coo_t {
+  npy_array_t row;
+  npy_array_t col;
+  npy_array_t val;
+  int hasval;
+  size_t nnz;
+} npy_coo_t;
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+static const char NPY_MAGIC[6] = {'\x93','N','U','M','P','Y'};
+
+
+/* the names of the arrays in a directory holding a matrix */
+static const char NPY_ROW_NAME[] = "row.npy";
+static const char NPY_COL_NAME[] = "col.npy";
+static const char NPY_VAL_NAME[] = "data.npy";
+
+
+/* the separator between the names of the arrays given as one input */
+static const char NPY_SEPARATOR = ',';
+
+
+
+
+/******************************************************************************
+* FUNCTION PROTOTYPES *********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Check if an input names a matrix stored as .npy arrays -- either a
+ * directory holding a row.npy, or a list of .npy files.
+ *
+ * @param name The name of the input.
+ *
+ * @return 1 if it does.
+ */
+int npy_detect(
+    char const * name);
+
+
+/**
+ * @brief Map the arrays of a matrix in coordinate form, and check that their
+ * types and shapes make sense.
+ *
+ * @param name Either a directory holding row.npy, col.npy, and optionally
+ * data.npy, or the names of the row, column, and optionally value arrays
+ * separated by commas.
+ *
+ * @return The arrays, or NULL if they could not be opened.
+ */
+npy_coo_t * npy_open(
+    char const * name);
+
+
+/**
+ * @brief Convert a block of an index array to size_t.
+ *
+ * @param array The array.
+ * @param start The first entry of the block.
+ * @param n The number of entries in the block.
+ * @param out The converted entries.
+ *
+ * @return NPY_SUCCESS on success, NPY_ERROR_NEGATIVE if an entry is
+ * negative.
+ */
+int npy_get_indices(
+    npy_array_t const * array,
+    size_t start,
+    size_t n,
+    size_t * out);
+
+
+/**
+ * @brief Convert a block of a value array to real_t.
+ *
+ * @param array The array.
+ * @param start The first entry of the block.
+ * @param n The number of entries in the block.
+ * @param out The converted entries.
+ */
+void npy_get_values(
+    npy_array_t const * array,
+    size_t start,
+    size_t n,
+    real_t * out);
+
+
+/**
+ * @brief Unmap the arrays of a matrix and free the associated memory.
+ *
+ * @param coo The arrays.
+ */
+void npy_close(
+    npy_coo_t * coo);
+
+
+
+
+#endif
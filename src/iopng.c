@@ -25,6 +25,26 @@
 
 
 
+/******************************************************************************
+* DOMLIB IMPORTS **************************************************************
+******************************************************************************/
+
+
+#ifndef NO_PNG_SUPPORT
+#define DLMEM_PREFIX png_stream
+#define DLMEM_TYPE_T png_stream_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+#endif
+
+
+
+
 /******************************************************************************
 * PUBLIC FUNCTIONS ************************************************************
 ******************************************************************************/
@@ -33,26 +53,43 @@
 int png_write(
     char const * const filename, 
     image_t const * const image) 
+{
+  png_stream_t * stream;
+
+  stream = png_open(filename,image->width,image->height);
+  if (stream == NULL) {
+    return 0;
+  }
+
+  png_write_band(stream,image);
+
+  return png_close(stream);
+}
+
+
+png_stream_t * png_open(
+    char const * const filename,
+    size_t const width,
+    size_t const height)
 {
   #ifndef NO_PNG_SUPPORT
-  size_t i,j,idx;
   FILE * fout = NULL;
   png_structp png_ptr = NULL;
   png_infop info_ptr = NULL;
-  png_byte ** rows;
+  png_stream_t * stream;
 
   fout = fopen(filename,"w");
   if (fout == NULL) {
     dl_error("Faild to open '%s' for writing\n",filename);
     perror("Failed due to:");
-    return 0;
+    return NULL;
   }
 
   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,NULL,NULL,NULL);
   if (png_ptr == NULL) {
     dl_error("Failed to initialize PNG library writer.\n");
     fclose(fout);
-    return 0;
+    return NULL;
   }
 
   info_ptr = png_create_info_struct(png_ptr);
@@ -60,37 +97,88 @@ int png_write(
     dl_error("Failed to initialize PNG library info.\n");
     png_destroy_write_struct(&png_ptr,NULL);
     fclose(fout);
-    return 0;
+    return NULL;
   }
 
-  png_set_IHDR(png_ptr,info_ptr,image->width,image->height,8,
+  png_set_IHDR(png_ptr,info_ptr,width,height,8,
       PNG_COLOR_TYPE_RGB,PNG_INTERLACE_NONE,
       PNG_COMPRESSION_TYPE_DEFAULT,PNG_FILTER_TYPE_DEFAULT);
 
-  rows = png_malloc(png_ptr,image->height*sizeof(png_byte*));
+  png_init_io(png_ptr,fout);
+  png_write_info(png_ptr,info_ptr);
+
+  stream = png_stream_alloc(1);
+  stream->fout = fout;
+  stream->png = png_ptr;
+  stream->info = info_ptr;
+  stream->width = width;
+  stream->height = height;
+  stream->nrows = 0;
+  stream->row = png_malloc(png_ptr,width*sizeof(png_byte)*3);
+
+  return stream;
+  #else
+  fprintf(stderr,"Built without PNG support.\n");
+  return NULL;
+  #endif
+}
+
+
+int png_write_band(
+    png_stream_t * const stream,
+    image_t const * const band)
+{
+  #ifndef NO_PNG_SUPPORT
+  size_t i,j,idx;
+  png_byte * const row = stream->row;
+
+  if (band->width != stream->width || \
+      stream->nrows+band->height > stream->height) {
+    eprintf("A band of %zux%zu pixels does not fit at row %zu of a %zux%zu "
+        "image\n",band->width,band->height,stream->nrows,stream->width, \
+        stream->height);
+    return 0;
+  }
 
-  for (i=0;i<(size_t)image->height;++i) {
-    rows[i] = png_malloc(png_ptr,image->width*sizeof(png_byte)*3);
-    for (j=0;j<(size_t)image->width;++j) {
-      idx = i*image->width+j;
-      rows[i][j*3] = image->red[idx];
-      rows[i][j*3+1] = image->green[idx];
-      rows[i][j*3+2] = image->blue[idx];
+  for (i=0;i<(size_t)band->height;++i) {
+    for (j=0;j<(size_t)band->width;++j) {
+      idx = i*band->width+j;
+      row[j*3] = band->red[idx];
+      row[j*3+1] = band->green[idx];
+      row[j*3+2] = band->blue[idx];
     }
+    png_write_row((png_structp)stream->png,row);
   }
+  stream->nrows += band->height;
 
-  png_init_io(png_ptr,fout);
-  png_set_rows(png_ptr,info_ptr,rows);
-  png_write_png(png_ptr,info_ptr,PNG_TRANSFORM_IDENTITY,NULL);
+  return 1;
+  #else
+  fprintf(stderr,"Built without PNG support.\n");
+  return 0;
+  #endif
+}
 
-  for (i=0;i<(size_t)image->height;++i) {
-    png_free(png_ptr,rows[i]);
+
+int png_close(
+    png_stream_t * const stream)
+{
+  #ifndef NO_PNG_SUPPORT
+  int ok;
+  png_structp png_ptr = (png_structp)stream->png;
+  png_infop info_ptr = (png_infop)stream->info;
+
+  /* libpng can not end an image short of its height */
+  ok = stream->nrows == stream->height;
+  if (ok) {
+    png_write_end(png_ptr,info_ptr);
   }
-  png_free(png_ptr,rows);
+
+  png_free(png_ptr,stream->row);
   png_destroy_write_struct(&png_ptr,&info_ptr);
-  fclose(fout);
+  fclose(stream->fout);
+  dl_free(stream);
 
-  return 1;
+  return ok;
   #else
   fprintf(stderr,"Built without PNG support.\n");
   return 0;
@@ -99,5 +187,4 @@ int png_write(
 
 
 
-
 #endif
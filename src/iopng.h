@@ -22,6 +22,31 @@
 
 
 
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+/**
+ * @brief A PNG being written a band of rows at a time, for images too large
+ * to hold in memory all at once.
+ */
+typedef struct png_stream_t {
+  FILE * fout;
+  /* the png_structp and png_infop of the writer */
+  void * png;
+  void * info;
+  size_t width;
+  size_t height;
+  /* the number of rows written so far */
+  size_t nrows;
+  /* a row of RGB bytes */
+  unsigned char * row;
+} png_stream_t;
+
+
+
+
 /******************************************************************************
 * FUNCTION PROTOTYPES *********************************************************
 ******************************************************************************/
@@ -32,6 +57,46 @@ int png_write(
     image_t const * image);
 
 
+/**
+ * @brief Start writing a PNG a band of rows at a time.
+ *
+ * @param filename The file to write to.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ *
+ * @return The stream, or NULL if the file could not be opened.
+ */
+png_stream_t * png_open(
+    char const * filename,
+    size_t width,
+    size_t height);
+
+
+/**
+ * @brief Write the next band of rows of a PNG.
+ *
+ * @param stream The stream.
+ * @param band The rows (as wide as the image).
+ *
+ * @return 1 on success, 0 if the band is the wrong width or runs past the
+ * bottom of the image.
+ */
+int png_write_band(
+    png_stream_t * stream,
+    image_t const * band);
+
+
+/**
+ * @brief Finish writing a PNG and free the stream.
+ *
+ * @param stream The stream.
+ *
+ * @return 1 on success, 0 if not every row of the image was written.
+ */
+int png_close(
+    png_stream_t * stream);
+
+
 
 
 #endif
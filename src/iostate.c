@@ -0,0 +1,194 @@
+/**
+ * @file iostate.c
+ * @brief Functions for saving and loading the state of an incremental render
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-22
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_IOSTATE_C
+#define CLAIRVOYANCE_IOSTATE_C
+
+
+
+
+#include "iostate.h"
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Build the name of the temporary file a state is written to.
+ *
+ * @param name The name of the state file.
+ *
+ * @return The name of the temporary file (to be freed by the caller).
+ */
+static char * __temp_name(
+    char const * const name)
+{
+  char * tname;
+
+  tname = char_alloc(strlen(name)+strlen(".tmp")+1);
+  sprintf(tname,"%s.tmp",name);
+
+  return tname;
+}
+
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+int state_read(
+    char const * const name,
+    state_header_t * const r_header,
+    grid_t ** const r_grid)
+{
+  int err;
+  size_t ncells;
+  grid_t * grid;
+  FILE * fin;
+
+  if ((fin = fopen(name,"rb")) == NULL) {
+    return STATE_ERROR_OPEN;
+  }
+
+  grid = NULL;
+  err = STATE_ERROR_READ;
+  if (fread(r_header,sizeof(state_header_t),1,fin) != 1) {
+    goto END;
+  }
+
+  err = STATE_ERROR_FORMAT;
+  if (memcmp(r_header->magic,STATE_MAGIC,sizeof(STATE_MAGIC)) != 0 || \
+      r_header->version != STATE_VERSION || \
+      r_header->byteorder != STATE_BYTEORDER || \
+      r_header->funcs == 0 || r_header->cell > GRID_CELL_PIXEL64 || \
+      r_header->ntail > STATE_TAIL_SIZE || \
+      r_header->nx == 0 || r_header->ny == 0) {
+    goto END;
+  }
+
+  grid = grid_create((size_t)r_header->nx,(size_t)r_header->ny,0,0, \
+      (unsigned int)r_header->funcs);
+  grid->cell = (gridcell_t)r_header->cell;
+  grid->nrows = (size_t)r_header->nrows;
+  grid->ncols = (size_t)r_header->ncols;
+  grid->rshift = (size_t)r_header->rshift;
+  grid->cshift = (size_t)r_header->cshift;
+  grid->nbrows = (size_t)r_header->nbrows;
+  grid->nbcols = (size_t)r_header->nbcols;
+  grid->scale = (real_t)r_header->scale;
+  if (grid->nbrows > grid->maxbrows || grid->nbcols > grid->maxbcols || \
+      r_header->prows > r_header->nrows || r_header->pcols > \
+      r_header->ncols || (r_header->prows == 0) != (r_header->pcols == 0)) {
+    goto END;
+  }
+  if (r_header->prows > 0) {
+    grid->prows = (size_t)r_header->prows;
+    grid->pcols = (size_t)r_header->pcols;
+    grid->rscale = grid->prows / (double)grid->nrows;
+    grid->cscale = grid->pcols / (double)grid->ncols;
+  }
+
+  err = STATE_ERROR_READ;
+  ncells = grid->nbrows*grid->nbcols;
+  if (ncells > 0) {
+    grid->cells = char_alloc(ncells*grid_cell_size(grid));
+    if (fread(grid->cells,grid_cell_size(grid),ncells,fin) != ncells) {
+      goto END;
+    }
+  }
+
+  err = STATE_SUCCESS;
+
+  END:
+
+  fclose(fin);
+
+  if (err == STATE_SUCCESS) {
+    *r_grid = grid;
+  } else if (grid) {
+    grid_free(grid);
+  }
+
+  return err;
+}
+
+
+int state_write(
+    char const * const name,
+    state_header_t * const header,
+    grid_t const * const grid)
+{
+  int err;
+  size_t ncells;
+  char * tname;
+  FILE * fout;
+
+  memcpy(header->magic,STATE_MAGIC,sizeof(STATE_MAGIC));
+  header->version = STATE_VERSION;
+  header->byteorder = STATE_BYTEORDER;
+  header->funcs = (uint32_t)grid->funcs;
+  header->cell = (uint32_t)grid->cell;
+  header->nx = (uint64_t)grid->nx;
+  header->ny = (uint64_t)grid->ny;
+  header->nrows = (uint64_t)grid->nrows;
+  header->ncols = (uint64_t)grid->ncols;
+  header->rshift = (uint64_t)grid->rshift;
+  header->cshift = (uint64_t)grid->cshift;
+  header->nbrows = (uint64_t)grid->nbrows;
+  header->nbcols = (uint64_t)grid->nbcols;
+  header->prows = (uint64_t)grid->prows;
+  header->pcols = (uint64_t)grid->pcols;
+  header->scale = (double)grid->scale;
+
+  DL_ASSERT(grid->broffset == 0,"Cannot save a band of rows\n");
+
+  tname = __temp_name(name);
+
+  err = STATE_ERROR_OPEN;
+  if ((fout = fopen(tname,"wb")) == NULL) {
+    goto END;
+  }
+
+  err = STATE_ERROR_WRITE;
+  ncells = grid->nbrows*grid->nbcols;
+  if (fwrite(header,sizeof(state_header_t),1,fout) != 1 || \
+      (ncells > 0 && fwrite(grid->cells,grid_cell_size(grid),ncells,fout) != \
+          ncells)) {
+    fclose(fout);
+    remove(tname);
+    goto END;
+  }
+  if (fclose(fout) != 0 || rename(tname,name) != 0) {
+    remove(tname);
+    goto END;
+  }
+
+  err = STATE_SUCCESS;
+
+  END:
+
+  dl_free(tname);
+
+  return err;
+}
+
+
+
+
+#endif
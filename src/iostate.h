@@ -0,0 +1,159 @@
+/**
+ * @file iostate.h
+ * @brief Types and function prototypes for saving the state of an incremental
+ * render, or the accumulators of a shard of a matrix
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-22
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_IOSTATE_H
+#define CLAIRVOYANCE_IOSTATE_H
+
+
+
+
+#include "grid.h"
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* the number of bytes before the end of what was read that are kept, to tell
+ * a file that was appended to from one that was rewritten (used as an array
+ * size, so this can not be a static const) */
+#define STATE_TAIL_SIZE 64
+
+
+static const char STATE_MAGIC[8] = {'C','V','S','T','A','T','E','\0'};
+
+
+/* 2 keeps the sums of bins with 32 bit counts in doubles, 3 adds the pixels
+ * of grids whose dimensions were known up front, 4 drops the average bins
+ * with 32 bit counts (renumbering the types of bins), 5 adds the offsets of
+ * shards */
+static const uint32_t STATE_VERSION = 5;
+
+
+static const uint32_t STATE_BYTEORDER = 0x01020304;
+
+
+/* the offset of accumulators that can not be picked up where they left off
+ * (those of a shard, or of a file that is not append-only point text) */
+static const uint64_t STATE_NO_OFFSET = (uint64_t)-1;
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+typedef enum state_error_t {
+  STATE_SUCCESS = 1,
+  STATE_ERROR_READ = -1,
+  STATE_ERROR_WRITE = -2,
+  STATE_ERROR_OPEN = -3,
+  STATE_ERROR_FORMAT = -4
+} state_error_t;
+
+
+/**
+ * @brief The header of a saved render ('--state <file>'), or of the
+ * accumulators of a shard of a matrix (see 'shard' and 'merge'). It records
+ * how far into an append-only file has been read, the region of the matrix
+ * drawn, and the bins of the grid it was read into, which follow the header
+ * (nbrows*nbcols of them, of the size given by cell). The bins are in the
+ * coordinates of the region, which shards of it share, so that their grids
+ * can be combined exactly.
+ */
+typedef struct state_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteorder;
+  uint32_t filetype;
+  uint32_t funcs;
+  uint32_t cell;
+  uint32_t ntail;
+  /* the offset reading stopped at (or STATE_NO_OFFSET), and the bytes just
+   * before it */
+  uint64_t offset;
+  char tail[STATE_TAIL_SIZE];
+  /* the region of the matrix drawn, from its global row/column offsets */
+  uint64_t rstart;
+  uint64_t rend;
+  uint64_t cstart;
+  uint64_t cend;
+  /* the row/column of the matrix that the first row/column of the file of a
+   * shard is (see offset_matrix()) */
+  uint64_t roffset;
+  uint64_t coffset;
+  /* the grid */
+  uint64_t nx;
+  uint64_t ny;
+  uint64_t nrows;
+  uint64_t ncols;
+  uint64_t rshift;
+  uint64_t cshift;
+  uint64_t nbrows;
+  uint64_t nbcols;
+  uint64_t prows;
+  uint64_t pcols;
+  double scale;
+} state_header_t;
+
+
+
+
+/******************************************************************************
+* FUNCTION PROTOTYPES *********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Read a saved render.
+ *
+ * @param name The name of the state file.
+ * @param r_header The header of the state.
+ * @param r_grid The grid the file had been read into (to be freed by the
+ * caller).
+ *
+ * @return STATE_SUCCESS on success, STATE_ERROR_OPEN if there is no state
+ * yet, or another error if it could not be read.
+ */
+int state_read(
+    char const * name,
+    state_header_t * r_header,
+    grid_t ** r_grid);
+
+
+/**
+ * @brief Save a render, so that it can be picked up where it left off. The
+ * state is written next to the file and then moved into place, so a reader
+ * never sees half of one.
+ *
+ * @param name The name of the state file.
+ * @param header The header to write (the magic, version, byte order, and
+ * grid fields are set here).
+ * @param grid The grid the file was read into.
+ *
+ * @return STATE_SUCCESS on success.
+ */
+int state_write(
+    char const * name,
+    state_header_t * header,
+    grid_t const * grid);
+
+
+
+
+#endif
@@ -0,0 +1,792 @@
+/**
+ * @file ooc.c
+ * @brief Functions for drawing a matrix out of core, a band of rows of bins at
+ * a time from a scratch file
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-24
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_OOC_C
+#define CLAIRVOYANCE_OOC_C
+
+
+
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "ooc.h"
+#include "draw.h"
+#include "iopng.h"
+
+
+
+
+/******************************************************************************
+* TYPES ***********************************************************************
+******************************************************************************/
+
+
+/* a non-zero spilled to the scratch file, in the coordinates of the window */
+typedef struct ooc_point_t {
+  uint64_t i;
+  uint64_t j;
+  real_t v;
+} ooc_point_t;
+
+
+/* a run of non-zeros of a bucket in the scratch file */
+typedef struct ooc_chunk_t {
+  size_t offset;
+  size_t n;
+} ooc_chunk_t;
+
+
+/* the non-zeros of a block of rows, those written out and those buffered */
+typedef struct ooc_bucket_t {
+  ooc_chunk_t * chunks;
+  size_t nchunks;
+  size_t maxchunks;
+  ooc_point_t * buffer;
+  size_t nbuffered;
+} ooc_bucket_t;
+
+
+/* the bins of a band of rows of bins in the scratch file, and the grid they
+ * were accumulated in (without its cells) */
+typedef struct ooc_band_t {
+  size_t offset;
+  size_t nbytes;
+  grid_t shape;
+} ooc_band_t;
+
+
+typedef struct ooc_scratch_t {
+  int fd;
+  /* the bytes used so far (everything is written at page boundaries, so it
+   * can be mapped back in) */
+  size_t size;
+  size_t page;
+  /* the non-zeros buffered per bucket before they are written out */
+  size_t chunkpts;
+  /* the log2 of the rows per bucket */
+  size_t bshift;
+  ooc_bucket_t * buckets;
+  /* the number of chunks written */
+  size_t nchunks;
+  /* 0 once a write has failed */
+  int ok;
+} ooc_scratch_t;
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* the most buckets the non-zeros are spread over, so that each band of rows
+ * only reads back those of the buckets it overlaps */
+static const size_t OOC_MAX_BUCKETS = 1024;
+
+
+/* the share of the memory cap (one in this many bytes) that buffers the
+ * non-zeros of the buckets */
+static const size_t OOC_BUFFER_SHARE = 4;
+
+
+/* the bytes of each pixel of a band as it is drawn: its value and count, the
+ * three planes of the image, and the copy made of each plane */
+static const size_t OOC_PIXEL_BYTES = 6*sizeof(real_t);
+
+
+/* the bytes of each bin of a band, which may be widened in place (the old and
+ * new bins are both held while it is) */
+static const size_t OOC_BIN_FACTOR = 3;
+
+
+/* the bytes per row/column of bins of the table of the pixels they land in
+ * (a pixel and a fraction) */
+static const size_t OOC_SPAN_BYTES = 2*sizeof(size_t);
+
+
+
+
+/******************************************************************************
+* DOMLIB IMPORTS **************************************************************
+******************************************************************************/
+
+
+#define DLMEM_PREFIX ooc_point
+#define DLMEM_TYPE_T ooc_point_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX ooc_chunk
+#define DLMEM_TYPE_T ooc_chunk_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX ooc_bucket
+#define DLMEM_TYPE_T ooc_bucket_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+#define DLMEM_PREFIX ooc_band
+#define DLMEM_TYPE_T ooc_band_t
+#define DLMEM_DLTYPE DLTYPE_STRUCT
+#define DLMEM_STATIC
+#include "dlmem_headers.h"
+#undef DLMEM_STATIC
+#undef DLMEM_DLTYPE
+#undef DLMEM_TYPE_T
+#undef DLMEM_PREFIX
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Open the scratch file next to the output. It is removed right away,
+ * so it goes away with the process however it exits.
+ *
+ * @param scratch The scratch file to open.
+ * @param fileout The name of the output.
+ * @param maxmem The number of bytes to hold at most.
+ *
+ * @return 1 on success, 0 if the file could not be created.
+ */
+static int __scratch_open(
+    ooc_scratch_t * const scratch,
+    char const * const fileout,
+    size_t const maxmem)
+{
+  size_t bytes;
+  char * name;
+
+  name = char_alloc(strlen(fileout)+strlen(".scratch")+1);
+  sprintf(name,"%s.scratch",fileout);
+
+  scratch->fd = open(name,O_RDWR|O_CREAT|O_TRUNC,0600);
+  if (scratch->fd < 0) {
+    eprintf("Failed to create scratch file '%s'\n",name);
+    dl_free(name);
+    return 0;
+  }
+  unlink(name);
+  dl_free(name);
+
+  scratch->size = 0;
+  scratch->page = (size_t)sysconf(_SC_PAGESIZE);
+  scratch->bshift = 0;
+  scratch->nchunks = 0;
+  scratch->ok = 1;
+
+  /* whole pages, so each chunk starts on one */
+  bytes = maxmem / OOC_BUFFER_SHARE / OOC_MAX_BUCKETS;
+  bytes = dl_max(bytes - (bytes % scratch->page),scratch->page);
+  scratch->chunkpts = bytes / sizeof(ooc_point_t);
+
+  scratch->buckets = ooc_bucket_calloc(OOC_MAX_BUCKETS);
+
+  return 1;
+}
+
+
+/**
+ * @brief Close the scratch file and free its buckets.
+ *
+ * @param scratch The scratch file.
+ */
+static void __scratch_close(
+    ooc_scratch_t * const scratch)
+{
+  size_t k;
+
+  for (k=0;k<OOC_MAX_BUCKETS;++k) {
+    if (scratch->buckets[k].chunks) {
+      dl_free(scratch->buckets[k].chunks);
+    }
+    if (scratch->buckets[k].buffer) {
+      dl_free(scratch->buckets[k].buffer);
+    }
+  }
+  dl_free(scratch->buckets);
+
+  close(scratch->fd);
+}
+
+
+/**
+ * @brief Append to the scratch file, starting at the next page boundary.
+ *
+ * @param scratch The scratch file.
+ * @param data The bytes to write.
+ * @param nbytes The number of bytes.
+ *
+ * @return The offset the bytes were written at.
+ */
+static size_t __scratch_write(
+    ooc_scratch_t * const scratch,
+    void const * const data,
+    size_t const nbytes)
+{
+  size_t done;
+  ssize_t rv;
+  size_t const offset = scratch->size;
+
+  for (done=0;done<nbytes;done+=(size_t)rv) {
+    rv = pwrite(scratch->fd,((char const *)data)+done,nbytes-done, \
+        (off_t)(offset+done));
+    if (rv <= 0) {
+      scratch->ok = 0;
+      break;
+    }
+  }
+
+  scratch->size += ((nbytes+scratch->page-1)/scratch->page)*scratch->page;
+
+  return offset;
+}
+
+
+/**
+ * @brief Map part of the scratch file back in.
+ *
+ * @param scratch The scratch file.
+ * @param offset Where the part starts (on a page boundary).
+ * @param nbytes The number of bytes.
+ *
+ * @return The mapping, or NULL if it could not be mapped.
+ */
+static void * __scratch_map(
+    ooc_scratch_t const * const scratch,
+    size_t const offset,
+    size_t const nbytes)
+{
+  void * map;
+
+  map = mmap(NULL,nbytes,PROT_READ,MAP_SHARED,scratch->fd,(off_t)offset);
+  if (map == MAP_FAILED) {
+    eprintf("Failed to map %zu bytes of the scratch file\n",nbytes);
+    return NULL;
+  }
+
+  return map;
+}
+
+
+/**
+ * @brief Write out the buffered non-zeros of a bucket as a chunk.
+ *
+ * @param scratch The scratch file.
+ * @param bucket The bucket.
+ */
+static void __flush_bucket(
+    ooc_scratch_t * const scratch,
+    ooc_bucket_t * const bucket)
+{
+  if (bucket->nbuffered == 0) {
+    return;
+  }
+
+  if (bucket->nchunks == bucket->maxchunks) {
+    bucket->maxchunks = dl_max(2*bucket->maxchunks,16);
+    if (bucket->chunks) {
+      bucket->chunks = ooc_chunk_realloc(bucket->chunks,bucket->maxchunks);
+    } else {
+      bucket->chunks = ooc_chunk_alloc(bucket->maxchunks);
+    }
+  }
+
+  bucket->chunks[bucket->nchunks].offset = __scratch_write(scratch, \
+      bucket->buffer,bucket->nbuffered*sizeof(ooc_point_t));
+  bucket->chunks[bucket->nchunks].n = bucket->nbuffered;
+  ++bucket->nchunks;
+  ++scratch->nchunks;
+
+  bucket->nbuffered = 0;
+}
+
+
+/**
+ * @brief Write out every buffered non-zero, and free the buffers.
+ *
+ * @param scratch The scratch file.
+ */
+static void __flush_buckets(
+    ooc_scratch_t * const scratch)
+{
+  size_t k;
+  ooc_bucket_t * bucket;
+
+  for (k=0;k<OOC_MAX_BUCKETS;++k) {
+    bucket = scratch->buckets+k;
+    __flush_bucket(scratch,bucket);
+    if (bucket->buffer) {
+      dl_free(bucket->buffer);
+      bucket->buffer = NULL;
+    }
+  }
+}
+
+
+/**
+ * @brief Double the rows per bucket, once the matrix has outgrown them. The
+ * chunks of each pair of buckets are joined in order, so the non-zeros of
+ * each row are still read back in the order they were spilled.
+ *
+ * @param scratch The scratch file.
+ */
+static void __merge_buckets(
+    ooc_scratch_t * const scratch)
+{
+  size_t k;
+  ooc_bucket_t a, b;
+  ooc_bucket_t * const buckets = scratch->buckets;
+
+  __flush_buckets(scratch);
+
+  for (k=0;k<OOC_MAX_BUCKETS/2;++k) {
+    a = buckets[2*k];
+    b = buckets[(2*k)+1];
+    if (b.nchunks > 0) {
+      if (a.chunks) {
+        a.chunks = ooc_chunk_realloc(a.chunks,a.nchunks+b.nchunks);
+      } else {
+        a.chunks = ooc_chunk_alloc(b.nchunks);
+      }
+      memcpy(a.chunks+a.nchunks,b.chunks,b.nchunks*sizeof(ooc_chunk_t));
+      a.nchunks += b.nchunks;
+      a.maxchunks = a.nchunks;
+      dl_free(b.chunks);
+    }
+    buckets[k] = a;
+  }
+  memset(buckets+(OOC_MAX_BUCKETS/2),0, \
+      (OOC_MAX_BUCKETS/2)*sizeof(ooc_bucket_t));
+
+  ++scratch->bshift;
+}
+
+
+/**
+ * @brief Spill a non-zero to the bucket of its row.
+ *
+ * @param scratch The scratch file.
+ * @param i The row of the non-zero.
+ * @param j The column of the non-zero.
+ * @param v The value of the non-zero.
+ */
+static void __spill_point(
+    ooc_scratch_t * const scratch,
+    size_t const i,
+    size_t const j,
+    real_t const v)
+{
+  ooc_bucket_t * bucket;
+  ooc_point_t * point;
+
+  while ((i >> scratch->bshift) >= OOC_MAX_BUCKETS) {
+    __merge_buckets(scratch);
+  }
+
+  bucket = scratch->buckets+(i >> scratch->bshift);
+  if (bucket->buffer == NULL) {
+    bucket->buffer = ooc_point_alloc(scratch->chunkpts);
+  }
+
+  point = bucket->buffer+bucket->nbuffered;
+  point->i = (uint64_t)i;
+  point->j = (uint64_t)j;
+  point->v = v;
+
+  if (++bucket->nbuffered == scratch->chunkpts) {
+    __flush_bucket(scratch,bucket);
+  }
+}
+
+
+/**
+ * @brief Spill every non-zero inside of the window of a matrix to the
+ * scratch file, shifted to start at (0,0), and find the extents of the
+ * window. When the file does not give the dimensions of the matrix, the
+ * rows after the window are still read for them, so that they are the
+ * dimensions an in memory draw would find.
+ *
+ * @param handle The handle to read from.
+ * @param scratch The scratch file.
+ * @param r_nrows The number of rows in the window.
+ * @param r_ncols The number of columns in the window.
+ *
+ * @return 1 on success, 0 if a row is malformed.
+ */
+static int __spill(
+    spmat_handle_t * const handle,
+    ooc_scratch_t * const scratch,
+    size_t * const r_nrows,
+    size_t * const r_ncols)
+{
+  size_t i, j, k, cap, nrows, ncols, maxrow, maxcol;
+  ssize_t n;
+  real_t v;
+  size_t * ind;
+  real_t * val;
+  window_t const * const window = &handle->window;
+  size_t const rend = handle->nrows > 0 ? window->rend : WINDOW_END;
+
+  window_dims(handle,&nrows,&ncols);
+  maxrow = maxcol = 0;
+
+  /* start with buckets just large enough for the rows known of */
+  while (nrows > 0 && ((nrows-1) >> scratch->bshift) >= OOC_MAX_BUCKETS) {
+    ++scratch->bshift;
+  }
+
+  if (handle->use_rows) {
+    cap = DEFAULT_BUFFER_SIZE;
+    ind = size_alloc(cap);
+    val = real_alloc(cap);
+    for (i=0;(handle->nrows == 0 || i<handle->nrows) && i<rend;++i) {
+      if ((n = read_row_entries(handle,&ind,&val,&cap)) == -2) {
+        eprintf("Row %zu is malformed\n",i);
+        dl_free(ind);
+        dl_free(val);
+        return 0;
+      } else if (n < 0) {
+        break;
+      }
+      for (k=0;k<(size_t)n;++k) {
+        j = ind[k];
+        maxcol = dl_max(maxcol,j+1);
+        if (i >= window->rstart && i < window->rend && \
+            j >= window->cstart && j < window->cend) {
+          __spill_point(scratch,i-window->rstart,j-window->cstart,val[k]);
+        }
+      }
+      release_matrix(handle);
+    }
+    dl_free(ind);
+    dl_free(val);
+
+    /* empty rows at the end still count towards the height */
+    maxrow = i;
+  } else {
+    while (read_point(handle,&i,&j,&v)) {
+      maxrow = dl_max(maxrow,i+1);
+      maxcol = dl_max(maxcol,j+1);
+      if (i >= window->rstart && i < window->rend && \
+          j >= window->cstart && j < window->cend) {
+        __spill_point(scratch,i-window->rstart,j-window->cstart,v);
+      }
+      release_matrix(handle);
+    }
+  }
+
+  if (maxrow > window->rstart) {
+    nrows = dl_max(nrows,dl_min(maxrow,window->rend)-window->rstart);
+  }
+  if (maxcol > window->cstart) {
+    ncols = dl_max(ncols,dl_min(maxcol,window->cend)-window->cstart);
+  }
+
+  __flush_buckets(scratch);
+
+  *r_nrows = nrows;
+  *r_ncols = ncols;
+
+  return 1;
+}
+
+
+/**
+ * @brief Decide how many rows of bins to draw at a time, so that the bins
+ * and the pixels they land in fit under the memory cap (but at least one).
+ *
+ * @param scratch The scratch file.
+ * @param sweep The sweep the bins are mapped to pixels with.
+ * @param cellsize The size of each bin.
+ * @param maxmem The number of bytes to hold at most.
+ *
+ * @return The number of rows of bins.
+ */
+static size_t __band_rows(
+    ooc_scratch_t const * const scratch,
+    grid_sweep_t const * const sweep,
+    size_t const cellsize,
+    size_t const maxmem)
+{
+  size_t fixed, row, nbrows;
+
+  /* the tables of spans and chunks, a chunk being read back, and the two
+   * rows of pixels a band can hold past its own */
+  fixed = ((sweep->nbrows+sweep->nbcols)*OOC_SPAN_BYTES) + \
+      (scratch->nchunks*sizeof(ooc_chunk_t)) + \
+      (scratch->chunkpts*sizeof(ooc_point_t)) + \
+      (2*sweep->x*OOC_PIXEL_BYTES);
+
+  /* a row of bins lands in at most one new row of pixels */
+  row = (sweep->nbcols*cellsize*OOC_BIN_FACTOR) + \
+      (sweep->x*OOC_PIXEL_BYTES);
+
+  nbrows = maxmem > fixed ? (maxmem-fixed)/row : 0;
+  if (nbrows == 0) {
+    wprintf("A memory cap of %zu bytes is too small for a row of bins, "
+        "using %zu bytes\n",maxmem,fixed+row);
+    nbrows = 1;
+  }
+
+  return dl_min(nbrows,dl_max(sweep->nbrows,1));
+}
+
+
+/**
+ * @brief Accumulate the non-zeros of the rows [rstart,rend) of the matrix
+ * into a band, from the buckets it overlaps.
+ *
+ * @param scratch The scratch file.
+ * @param band The band.
+ * @param rstart The first row.
+ * @param rend One past the last row.
+ *
+ * @return 1 on success, 0 if a chunk could not be mapped.
+ */
+static int __fill_band(
+    ooc_scratch_t const * const scratch,
+    grid_t * const band,
+    size_t const rstart,
+    size_t const rend)
+{
+  size_t k, c, p;
+  ooc_point_t const * points;
+  ooc_bucket_t const * bucket;
+  size_t const kend = dl_min(((rend-1) >> scratch->bshift)+1, \
+      OOC_MAX_BUCKETS);
+
+  for (k=rstart >> scratch->bshift;k<kend;++k) {
+    bucket = scratch->buckets+k;
+    for (c=0;c<bucket->nchunks;++c) {
+      ooc_chunk_t const * const chunk = bucket->chunks+c;
+      points = (ooc_point_t const *)__scratch_map(scratch,chunk->offset, \
+          chunk->n*sizeof(ooc_point_t));
+      if (points == NULL) {
+        return 0;
+      }
+      for (p=0;p<chunk->n;++p) {
+        if (points[p].i >= rstart && points[p].i < rend) {
+          grid_add(band,(size_t)points[p].i,(size_t)points[p].j,points[p].v);
+        }
+      }
+      munmap((void*)points,chunk->n*sizeof(ooc_point_t));
+    }
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Color rows of pixels and write them to the image.
+ *
+ * @param stream The image.
+ * @param vals The pixel values (overwritten).
+ * @param n The number of rows.
+ * @param ctype The coloring.
+ * @param range The range of the whole canvas.
+ *
+ * @return 1 on success.
+ */
+static int __write_rows(
+    png_stream_t * const stream,
+    real_t * const vals,
+    size_t const n,
+    colortype_t const ctype,
+    color_range_t const * const range)
+{
+  int ok;
+  image_t * img;
+  size_t const x = stream->width;
+
+  if (n == 0) {
+    return 1;
+  }
+
+  draw_color_part(vals,n*x,ctype,range);
+  img = draw_color_image(vals,x,n,ctype,x,n);
+  ok = png_write_band(stream,img);
+  image_free(img);
+
+  return ok;
+}
+
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+int ooc_draw(
+    spmat_handle_t * const handle,
+    functiontype_t const func,
+    colortype_t const ctype,
+    size_t const nx,
+    size_t const ny,
+    size_t const maxmem,
+    char const * const fileout,
+    size_t * const r_x,
+    size_t * const r_y)
+{
+  int ok, exact;
+  size_t b, k, n, nrows, ncols, nbrows, nbands, rstart, rend, cellsize;
+  real_t * vals;
+  void * map;
+  grid_t * grid;
+  grid_sweep_t * sweep;
+  ooc_band_t * bands;
+  png_stream_t * stream;
+  ooc_scratch_t scratch;
+  grid_t view;
+  color_range_t range = {0,0,0};
+  unsigned int const funcs = grid_func(func);
+
+  if (!__scratch_open(&scratch,fileout,maxmem)) {
+    return 0;
+  }
+
+  if (!__spill(handle,&scratch,&nrows,&ncols)) {
+    __scratch_close(&scratch);
+    return 0;
+  }
+  if (!scratch.ok) {
+    eprintf("Failed to write to the scratch file\n");
+    __scratch_close(&scratch);
+    return 0;
+  }
+
+  /* every non-zero has been seen, so the rows/columns are mapped straight to
+   * pixels, as an in memory draw would */
+  exact = nrows > 0 && ncols > 0;
+
+  /* the bins as they would be in a grid of the whole matrix */
+  grid = grid_create(nx,ny,0,0,funcs);
+  cellsize = grid_cell_size(grid);
+  grid_free(grid);
+
+  sweep = grid_sweep_create(nx,ny,nrows,ncols,func,exact);
+  nbrows = __band_rows(&scratch,sweep,cellsize,maxmem);
+  nbands = (sweep->nbrows+nbrows-1)/nbrows;
+  bands = ooc_band_alloc(dl_max(nbands,1));
+
+  /* accumulate each band, saving its bins for the second pass, and find the
+   * range of the canvas */
+  ok = 1;
+  for (k=0;ok && k<nbands;++k) {
+    b = k*nbrows;
+    rstart = grid_sweep_row(sweep,b);
+    rend = grid_sweep_row(sweep,dl_min(b+nbrows,sweep->nbrows));
+
+    grid = grid_create_band(nx,ny,nrows,ncols,funcs,exact,rstart,rend);
+    ok = __fill_band(&scratch,grid,rstart,rend);
+
+    bands[k].nbytes = grid->nbrows*grid->nbcols*grid_cell_size(grid);
+    bands[k].offset = __scratch_write(&scratch,grid->cells,bands[k].nbytes);
+    bands[k].shape = *grid;
+    bands[k].shape.cells = NULL;
+    ok = ok && scratch.ok;
+
+    n = grid_sweep(sweep,grid,&vals);
+    draw_color_range(vals,n*sweep->x,&range);
+    grid_free(grid);
+  }
+  n = grid_sweep(sweep,NULL,&vals);
+  draw_color_range(vals,n*sweep->x,&range);
+  grid_sweep_free(sweep);
+
+  if (!ok) {
+    eprintf("Failed to write to the scratch file\n");
+    goto END;
+  }
+
+  /* map the saved bins back in a band at a time, and write their pixels */
+  sweep = grid_sweep_create(nx,ny,nrows,ncols,func,exact);
+  stream = png_open(fileout,sweep->x,sweep->y);
+  if (stream == NULL) {
+    grid_sweep_free(sweep);
+    ok = 0;
+    goto END;
+  }
+  for (k=0;ok && k<nbands;++k) {
+    map = NULL;
+    if (bands[k].nbytes > 0) {
+      map = __scratch_map(&scratch,bands[k].offset,bands[k].nbytes);
+      if (map == NULL) {
+        ok = 0;
+        break;
+      }
+    }
+    view = bands[k].shape;
+    view.cells = map;
+
+    n = grid_sweep(sweep,&view,&vals);
+    ok = __write_rows(stream,vals,n,ctype,&range);
+
+    if (map) {
+      munmap(map,bands[k].nbytes);
+    }
+  }
+  if (ok) {
+    n = grid_sweep(sweep,NULL,&vals);
+    ok = __write_rows(stream,vals,n,ctype,&range);
+  }
+  ok = png_close(stream) && ok;
+
+  *r_x = sweep->x;
+  *r_y = sweep->y;
+  grid_sweep_free(sweep);
+
+  END:
+
+  dl_free(bands);
+  __scratch_close(&scratch);
+
+  return ok;
+}
+
+
+
+
+#endif
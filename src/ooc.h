@@ -0,0 +1,71 @@
+/**
+ * @file ooc.h
+ * @brief Function prototypes for drawing a matrix out of core, for canvases
+ * whose bins and pixels do not fit in memory
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-24
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_OOC_H
+#define CLAIRVOYANCE_OOC_H
+
+
+
+
+#include "base.h"
+#include "grid.h"
+#include "io.h"
+
+
+
+
+/******************************************************************************
+* FUNCTION PROTOTYPES *********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Draw a matrix to a PNG while holding no more than about maxmem
+ * bytes. The non-zeros are first spilled to a scratch file next to the
+ * output ('<fileout>.scratch', removed as soon as it is opened), bucketed by
+ * row. The bins are then accumulated a band of rows at a time from the
+ * buckets the band overlaps, written to the scratch file, and mapped to
+ * pixels to find the range of the canvas. Last, each band of bins is mapped
+ * back in from the scratch file, colored with that range, and its rows are
+ * written to the PNG. The image is the same as an in memory draw of the
+ * matrix, but is not scaled up past the size of the matrix. The pages of a
+ * memory-mapped input file are handed back to the kernel as they are read
+ * past (see release_matrix()), so that they do not pile up past the cap.
+ *
+ * @param handle The handle to read from (with its window set, if any).
+ * @param func The function to draw.
+ * @param ctype The coloring.
+ * @param nx The width of the canvas.
+ * @param ny The height of the canvas.
+ * @param maxmem The number of bytes to hold at most.
+ * @param fileout The PNG to write.
+ * @param r_x The width of the image written.
+ * @param r_y The height of the image written.
+ *
+ * @return 1 on success, 0 if the scratch file or image could not be written.
+ */
+int ooc_draw(
+    spmat_handle_t * handle,
+    functiontype_t func,
+    colortype_t ctype,
+    size_t nx,
+    size_t ny,
+    size_t maxmem,
+    char const * fileout,
+    size_t * r_x,
+    size_t * r_y);
+
+
+
+
+#endif
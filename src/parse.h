@@ -0,0 +1,486 @@
+/**
+ * @file parse.h
+ * @brief Inline functions for parsing numbers out of (not necessarily null
+ * terminated) text
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-06
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_PARSE_H
+#define CLAIRVOYANCE_PARSE_H
+
+
+
+
+#include <float.h>
+#include "base.h"
+
+
+
+
+/******************************************************************************
+* DEFINES *********************************************************************
+******************************************************************************/
+
+
+/* the SWAR digit conversion below assumes little endian words */
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PARSE_SWAR 1
+#endif
+
+/* the exact fast path for doubles requires that double operations are not
+ * carried out in extended precision */
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define PARSE_FAST_DOUBLE 1
+#endif
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* longest number token we will hand to strtod()/strtoull() */
+static const size_t MAX_TOKEN_SIZE = 128;
+
+
+/* every power of ten that is exactly representable as a double */
+static const double PARSE_POW10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+  1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/* the largest integer all smaller integers of which are exact doubles */
+static const uint64_t PARSE_MAX_EXACT = ((uint64_t)1) << 53;
+
+
+
+
+/******************************************************************************
+* INLINE FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+static inline int parse_is_blank(
+    char const c)
+{
+  switch (c) {
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+    case '\v':
+    case '\f':
+      return 1;
+    default :
+      return 0;
+  }
+}
+
+
+static inline int parse_is_digit(
+    char const c)
+{
+  return (unsigned char)(c - '0') < 10;
+}
+
+
+/**
+ * @brief Skip to the start of the next token.
+ *
+ * @param sptr The start of the remaining text.
+ * @param eptr The end of the text.
+ *
+ * @return The start of the next token (or eptr).
+ */
+static inline char const * parse_skip_blanks(
+    char const * sptr,
+    char const * const eptr)
+{
+  while (sptr < eptr && parse_is_blank(*sptr)) {
+    ++sptr;
+  }
+  return sptr;
+}
+
+
+/**
+ * @brief Copy the next whitespace delimited token in [sptr,eptr) into a null
+ * terminated buffer, so that it can be handed to the libc conversion
+ * functions without them wandering past the end of the text.
+ *
+ * @param sptr The start of the remaining text.
+ * @param eptr The end of the text.
+ * @param buffer The buffer to copy the token into (MAX_TOKEN_SIZE bytes).
+ * @param r_start Where the token starts in the text.
+ *
+ * @return The length of the token (0 if there are no more tokens).
+ */
+static inline size_t parse_copy_token(
+    char const * sptr,
+    char const * const eptr,
+    char * const buffer,
+    char const ** const r_start)
+{
+  size_t len;
+
+  sptr = parse_skip_blanks(sptr,eptr);
+  len = 0;
+  while (sptr+len < eptr && !parse_is_blank(sptr[len]) &&
+      len < MAX_TOKEN_SIZE-1) {
+    ++len;
+  }
+  memcpy(buffer,sptr,len);
+  buffer[len] = '\0';
+
+  *r_start = sptr;
+
+  return len;
+}
+
+
+#ifdef PARSE_SWAR
+/**
+ * @brief Check if the 8 bytes in a word are all ascii digits.
+ *
+ * @param v The word.
+ *
+ * @return 1 if they are all digits.
+ */
+static inline int parse_is_8digits(
+    uint64_t const v)
+{
+  return ((v & 0xF0F0F0F0F0F0F0F0ULL) | \
+      (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == \
+      0x3333333333333333ULL;
+}
+
+
+/**
+ * @brief Convert 8 ascii digits packed in a word to their value with three
+ * multiplies instead of eight.
+ *
+ * @param v The word.
+ *
+ * @return The value of the digits.
+ */
+static inline uint64_t parse_8digits(
+    uint64_t v)
+{
+  uint64_t const mask = 0x000000FF000000FFULL;
+  uint64_t const mul1 = 100 + (1000000ULL << 32);
+  uint64_t const mul2 = 1 + (10000ULL << 32);
+
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+
+  return v & 0xFFFFFFFFULL;
+}
+#endif
+
+
+/**
+ * @brief Accumulate a run of digits into a mantissa.
+ *
+ * @param sptr The start of the digits.
+ * @param eptr The end of the text.
+ * @param r_m The mantissa to accumulate into.
+ * @param r_nd The number of digits to increase.
+ *
+ * @return The first character after the digits.
+ */
+static inline char const * parse_digits(
+    char const * sptr,
+    char const * const eptr,
+    uint64_t * const r_m,
+    size_t * const r_nd)
+{
+  uint64_t m = *r_m;
+  size_t nd = *r_nd;
+
+  #ifdef PARSE_SWAR
+  uint64_t v;
+  /* stop converting 8 at a time before the mantissa could overflow */
+  while (eptr - sptr >= 8 && nd <= 11) {
+    memcpy(&v,sptr,sizeof(v));
+    if (!parse_is_8digits(v)) {
+      break;
+    }
+    m = (m * 100000000ULL) + parse_8digits(v);
+    nd += 8;
+    sptr += 8;
+  }
+  #endif
+
+  while (sptr < eptr && parse_is_digit(*sptr)) {
+    m = (m * 10) + (uint64_t)(*sptr - '0');
+    ++nd;
+    ++sptr;
+  }
+
+  *r_m = m;
+  *r_nd = nd;
+
+  return sptr;
+}
+
+
+/**
+ * @brief Parse the next number from [sptr,eptr) with strtod().
+ *
+ * @param sptr The start of the remaining text.
+ * @param eptr The end of the text.
+ * @param r_val The parsed value.
+ *
+ * @return A pointer to the first character after the number, or NULL if no
+ * number could be parsed.
+ */
+static inline char const * parse_double_slow(
+    char const * sptr,
+    char const * const eptr,
+    double * const r_val)
+{
+  char buffer[MAX_TOKEN_SIZE];
+  char * end;
+
+  if (parse_copy_token(sptr,eptr,buffer,&sptr) == 0) {
+    return NULL;
+  }
+  *r_val = strtod(buffer,&end);
+  if (end == buffer) {
+    return NULL;
+  }
+
+  return sptr + (end - buffer);
+}
+
+
+/**
+ * @brief Parse the next number from [sptr,eptr) with strtoull().
+ *
+ * @param sptr The start of the remaining text.
+ * @param eptr The end of the text.
+ * @param r_val The parsed value.
+ *
+ * @return A pointer to the first character after the number, or NULL if no
+ * number could be parsed.
+ */
+static inline char const * parse_uint_slow(
+    char const * sptr,
+    char const * const eptr,
+    unsigned long long * const r_val)
+{
+  char buffer[MAX_TOKEN_SIZE];
+  char * end;
+
+  if (parse_copy_token(sptr,eptr,buffer,&sptr) == 0) {
+    return NULL;
+  }
+  *r_val = strtoull(buffer,&end,10);
+  if (end == buffer) {
+    return NULL;
+  }
+
+  return sptr + (end - buffer);
+}
+
+
+/**
+ * @brief Parse the next floating point number from [sptr,eptr). Plain
+ * decimals whose digits fit in a double and whose exponent is a power of ten
+ * that does, are converted with a single correctly rounded multiply or
+ * divide, which gives the same result as strtod(). Anything else is handed to
+ * strtod().
+ *
+ * @param sptr The start of the remaining text.
+ * @param eptr The end of the text.
+ * @param r_val The parsed value.
+ *
+ * @return A pointer to the first character after the number, or NULL if no
+ * number could be parsed.
+ */
+static inline char const * parse_double(
+    char const * sptr,
+    char const * const eptr,
+    double * const r_val)
+{
+  #ifdef PARSE_FAST_DOUBLE
+  int neg, eneg;
+  size_t nd, fd, ed;
+  long e, x;
+  uint64_t m, ev;
+  double v;
+  char const * ptr, * q;
+
+  ptr = sptr = parse_skip_blanks(sptr,eptr);
+
+  neg = 0;
+  if (ptr < eptr && (*ptr == '-' || *ptr == '+')) {
+    neg = *ptr == '-';
+    ++ptr;
+  }
+
+  m = 0;
+  nd = 0;
+  ptr = parse_digits(ptr,eptr,&m,&nd);
+  e = 0;
+  if (ptr < eptr && *ptr == '.') {
+    fd = nd;
+    ptr = parse_digits(ptr+1,eptr,&m,&nd);
+    e = -(long)(nd - fd);
+  }
+  if (nd == 0 || nd > 19) {
+    goto SLOW;
+  }
+
+  if (ptr < eptr && (*ptr == 'e' || *ptr == 'E')) {
+    q = ptr+1;
+    eneg = 0;
+    if (q < eptr && (*q == '-' || *q == '+')) {
+      eneg = *q == '-';
+      ++q;
+    }
+    ev = 0;
+    ed = 0;
+    q = parse_digits(q,eptr,&ev,&ed);
+    if (ed == 0 || ed > 4) {
+      goto SLOW;
+    }
+    x = (long)ev;
+    e += eneg ? -x : x;
+    ptr = q;
+  }
+
+  /* make sure we consumed the whole token like strtod() would have */
+  if ((ptr < eptr && !parse_is_blank(*ptr)) || m > PARSE_MAX_EXACT ||
+      e < -22 || e > 22) {
+    goto SLOW;
+  }
+
+  v = (double)m;
+  if (e < 0) {
+    v /= PARSE_POW10[-e];
+  } else {
+    v *= PARSE_POW10[e];
+  }
+  *r_val = neg ? -v : v;
+
+  return ptr;
+
+  SLOW:
+  #endif
+  return parse_double_slow(sptr,eptr,r_val);
+}
+
+
+/**
+ * @brief Parse the next unsigned integer from [sptr,eptr). This gives the
+ * same result as strtoull() (base 10).
+ *
+ * @param sptr The start of the remaining text.
+ * @param eptr The end of the text.
+ * @param r_val The parsed value.
+ *
+ * @return A pointer to the first character after the number, or NULL if no
+ * number could be parsed.
+ */
+static inline char const * parse_uint(
+    char const * sptr,
+    char const * const eptr,
+    unsigned long long * const r_val)
+{
+  size_t nd;
+  uint64_t m;
+  char const * ptr;
+
+  ptr = sptr = parse_skip_blanks(sptr,eptr);
+
+  m = 0;
+  nd = 0;
+  ptr = parse_digits(ptr,eptr,&m,&nd);
+  if (nd == 0 || nd > 19) {
+    /* signs and possible overflow */
+    return parse_uint_slow(sptr,eptr,r_val);
+  }
+  *r_val = m;
+
+  return ptr;
+}
+
+
+
+/**
+ * @brief Skip the next whitespace delimited token in [sptr,eptr), without
+ * looking at what it holds.
+ *
+ * @param sptr The start of the remaining text.
+ * @param eptr The end of the text.
+ *
+ * @return A pointer to the first character after the token, or NULL if there
+ * are no more tokens.
+ */
+static inline char const * parse_skip_token(
+    char const * sptr,
+    char const * const eptr)
+{
+  sptr = parse_skip_blanks(sptr,eptr);
+  if (sptr == eptr) {
+    return NULL;
+  }
+  while (sptr < eptr && !parse_is_blank(*sptr)) {
+    ++sptr;
+  }
+
+  return sptr;
+}
+
+
+/**
+ * @brief Parse the next row/column index from [sptr,eptr). Indices are
+ * parsed as integers, so they are exact all the way to 2^64, but an index
+ * written as a whole floating point number (ie. 3.0 or 1e3) is accepted as
+ * well.
+ *
+ * @param sptr The start of the remaining text.
+ * @param eptr The end of the text.
+ * @param r_val The parsed index.
+ *
+ * @return A pointer to the first character after the index, or NULL if no
+ * index could be parsed.
+ */
+static inline char const * parse_index(
+    char const * sptr,
+    char const * const eptr,
+    unsigned long long * const r_val)
+{
+  double val;
+  char const * ptr;
+
+  sptr = parse_skip_blanks(sptr,eptr);
+  ptr = parse_uint(sptr,eptr,r_val);
+  if (ptr != NULL && (ptr == eptr || parse_is_blank(*ptr))) {
+    return ptr;
+  }
+
+  if ((ptr = parse_double(sptr,eptr,&val)) == NULL || val < 0 || \
+      val != floor(val)) {
+    return NULL;
+  }
+  *r_val = (unsigned long long)val;
+
+  return ptr;
+}
+
+
+
+#endif
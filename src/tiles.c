@@ -0,0 +1,182 @@
+/**
+ * @file tiles.c
+ * @brief Functions for writing a zoomable pyramid of tiles
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-21
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_TILES_C
+#define CLAIRVOYANCE_TILES_C
+
+
+
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <errno.h>
+#include <sys/stat.h>
+#include "tiles.h"
+#include "draw.h"
+#include "iopng.h"
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Create a directory, unless it already exists.
+ *
+ * @param name The name of the directory.
+ *
+ * @return 1 on success.
+ */
+static int __make_dir(
+    char const * const name)
+{
+  if (mkdir(name,0755) != 0 && errno != EEXIST) {
+    eprintf("Failed to create directory '%s'\n",name);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Write the tiles of one zoom level.
+ *
+ * @param vals The colored intensities of the level, padded out to a whole
+ * number of tiles.
+ * @param ntx The number of tiles across the level.
+ * @param nty The number of tiles down the level.
+ * @param ctype The coloring.
+ * @param outdir The directory to write the tiles to.
+ * @param z The zoom level.
+ *
+ * @return 1 on success.
+ */
+static int __write_level(
+    real_t const * const vals,
+    size_t const ntx,
+    size_t const nty,
+    colortype_t const ctype,
+    char const * const outdir,
+    size_t const z)
+{
+  int ok;
+  size_t t;
+  char * name;
+  size_t const width = ntx*TILE_SIZE;
+  size_t const len = strlen(outdir) + 64;
+
+  /* the directories have to exist before the tiles are written in parallel */
+  name = char_alloc(len);
+  sprintf(name,"%s/%zu",outdir,z);
+  ok = __make_dir(name);
+  for (t=0;ok && t<ntx;++t) {
+    sprintf(name,"%s/%zu/%zu",outdir,z,t);
+    ok = __make_dir(name);
+  }
+  dl_free(name);
+  if (!ok) {
+    return 0;
+  }
+
+  #pragma omp parallel for schedule(dynamic,1) reduction(&&:ok)
+  for (t=0;t<ntx*nty;++t) {
+    size_t r;
+    image_t * img;
+    size_t const tx = t % ntx;
+    size_t const ty = t / ntx;
+    real_t * const tile = real_alloc(TILE_SIZE*TILE_SIZE);
+    char * const tname = char_alloc(len);
+
+    for (r=0;r<TILE_SIZE;++r) {
+      memcpy(tile+(r*TILE_SIZE),vals+(((ty*TILE_SIZE)+r)*width)+ \
+          (tx*TILE_SIZE),sizeof(real_t)*TILE_SIZE);
+    }
+    img = draw_color_image(tile,TILE_SIZE,TILE_SIZE,ctype,TILE_SIZE, \
+        TILE_SIZE);
+
+    sprintf(tname,"%s/%zu/%zu/%zu.png",outdir,z,tx,ty);
+    ok = png_write(tname,img) && ok;
+
+    image_free(img);
+    dl_free(tname);
+    dl_free(tile);
+  }
+
+  return ok;
+}
+
+
+
+
+/******************************************************************************
+* PUBLIC FUNCTIONS ************************************************************
+******************************************************************************/
+
+
+size_t tiles_write(
+    grid_t * const grid,
+    functiontype_t const func,
+    colortype_t const ctype,
+    char const * const outdir)
+{
+  size_t z, zmax, dx, dy, x, y, r, ntx, nty, ntiles;
+  real_t * out, * vals;
+
+  if (!__make_dir(outdir)) {
+    return 0;
+  }
+
+  /* the size of the finest level, and how far it is zoomed in */
+  dx = dl_max(dl_min(grid->nx,grid->ncols),1);
+  dy = dl_max(dl_min(grid->ny,grid->nrows),1);
+  zmax = 0;
+  while ((TILE_SIZE << zmax) < dl_max(dx,dy)) {
+    ++zmax;
+  }
+
+  ntiles = 0;
+  for (z=zmax+1;z>0;--z) {
+    /* each level is half the size of the one below it */
+    grid_coarsen(grid,((dx-1) >> (zmax+1-z))+1,((dy-1) >> (zmax+1-z))+1);
+    out = grid_finalize(grid,func,&x,&y);
+
+    ntx = ((x-1)/TILE_SIZE)+1;
+    nty = ((y-1)/TILE_SIZE)+1;
+    vals = real_calloc(ntx*TILE_SIZE*nty*TILE_SIZE);
+    for (r=0;r<y;++r) {
+      memcpy(vals+(r*ntx*TILE_SIZE),out+(r*x),sizeof(real_t)*x);
+    }
+    dl_free(out);
+
+    draw_color_values(vals,ntx*TILE_SIZE*nty*TILE_SIZE,ctype);
+    if (!__write_level(vals,ntx,nty,ctype,outdir,z-1)) {
+      dl_free(vals);
+      return 0;
+    }
+    dl_free(vals);
+
+    ntiles += ntx*nty;
+  }
+
+  return ntiles;
+}
+
+
+
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * @file tiles.h
+ * @brief Function prototypes for writing a zoomable pyramid of tiles
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-21
+ */
+
+
+
+
+#ifndef CLAIRVOYANCE_TILES_H
+#define CLAIRVOYANCE_TILES_H
+
+
+
+
+#include "base.h"
+#include "grid.h"
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* the width and height of each tile in pixels */
+static const size_t TILE_SIZE = 256;
+
+
+
+
+/******************************************************************************
+* FUNCTION PROTOTYPES *********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Write the accumulated non-zeros of a grid as a pyramid of PNG tiles,
+ * laid out as '<outdir>/<z>/<x>/<y>.png' for serving as XYZ map tiles. The
+ * finest level is the grid's canvas (or the matrix, if it is smaller), and
+ * has zoom level z such that it fits in 2^z by 2^z tiles. Each coarser level
+ * is half the size of the one below it, and its bins are merged from that
+ * level's bins, down to a single tile at zoom level 0. Tiles past the edge of
+ * a level are colored as if empty. Each level is scaled and colored as a
+ * whole, so tiles of the same level can be compared.
+ *
+ * @param grid The grid (its bins are merged in the process).
+ * @param func The function to draw.
+ * @param ctype The coloring.
+ * @param outdir The directory to write the tiles to (created if needed).
+ *
+ * @return The number of tiles written, or 0 if they could not be written.
+ */
+size_t tiles_write(
+    grid_t * grid,
+    functiontype_t func,
+    colortype_t ctype,
+    char const * outdir);
+
+
+
+
+#endif
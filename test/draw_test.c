@@ -0,0 +1,890 @@
+/**
+ * @file draw_test.c
+ * @brief Tests that the ways of drawing the same matrix give the same images
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-24
+ */
+
+
+
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "draw.h"
+#include "iobcsr.h"
+#include "iopng.h"
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* dimensions that do not divide evenly into the canvas, so that rows and
+ * columns binned before they are known straddle pixels */
+static const size_t NUM_ROWS = 3001;
+
+
+static const size_t NUM_COLS = 2777;
+
+
+/* enough that the text files are read in parallel */
+static const size_t NUM_NONZEROS = 150000;
+
+
+static const size_t CANVAS = 100;
+
+
+#ifndef NO_OMP
+/* the number of threads to read with in parallel */
+static const int NUM_THREADS = 4;
+#endif
+
+
+/* small enough that an out of core draw takes several bands */
+static const size_t OOC_MAX_MEMORY = 1 << 16;
+
+
+/* used as an array size, so this can not be a static const */
+#define NUM_SHARDS 3
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Get the next number of a fixed sequence, so that every run draws
+ * the same matrix.
+ *
+ * @param state The state of the sequence.
+ *
+ * @return The number.
+ */
+static size_t __next(
+    uint64_t * const state)
+{
+  *state = (*state * 6364136223846793005ULL) + 1442695040888963407ULL;
+
+  return (size_t)(*state >> 33);
+}
+
+
+/**
+ * @brief Write a matrix with non-zeros in its last row and column, as csr
+ * text (a line of column/value pairs per row) and as point text.
+ *
+ * @param csrfile The csr file to write.
+ * @param ijfile The point file to write.
+ *
+ * @return 1 on success, 0 if a file could not be written.
+ */
+static int __write_matrix(
+    char const * const csrfile,
+    char const * const ijfile)
+{
+  size_t i, k, n;
+  uint64_t state;
+  FILE * csr, * ij;
+
+  if ((csr = fopen(csrfile,"w")) == NULL) {
+    return 0;
+  }
+  if ((ij = fopen(ijfile,"w")) == NULL) {
+    fclose(csr);
+    return 0;
+  }
+
+  state = 1;
+  for (i=0;i<NUM_ROWS;++i) {
+    n = i+1 == NUM_ROWS ? 1 : __next(&state) % (2*NUM_NONZEROS/NUM_ROWS);
+    for (k=0;k<n;++k) {
+      size_t const j = i+1 == NUM_ROWS ? NUM_COLS-1 : \
+          __next(&state) % (NUM_COLS-1);
+      double const v = (__next(&state) % 1000) / 100.0;
+      fprintf(csr,"%s%zu %g",k > 0 ? " " : "",j,v);
+      fprintf(ij,"%zu %zu %g\n",i,j,v);
+    }
+    fprintf(csr,"\n");
+  }
+
+  fclose(ij);
+  return fclose(csr) == 0;
+}
+
+
+/**
+ * @brief Write a version 1.0 npy header, padded so that the array starts 128
+ * bytes into the file.
+ *
+ * @param file The file to write to.
+ * @param type The type of the array, without its byte order ("i8" or "f8").
+ * @param n The length of the array.
+ */
+static void __write_npy_header(
+    FILE * const file,
+    char const * const type,
+    size_t const n)
+{
+  char header[128];
+  uint16_t const one = 1;
+  char const order = *(unsigned char const *)&one == 1 ? '<' : '>';
+  uint16_t const hlen = (uint16_t)(sizeof(header) - 10);
+
+  memset(header,' ',sizeof(header));
+  memcpy(header,"\x93NUMPY\x01\x00",8);
+  memcpy(header+8,&hlen,sizeof(hlen));
+  header[9+hlen] = '\n';
+  sprintf(header+10,"{'descr': '%c%s', 'fortran_order': False, " \
+      "'shape': (%zu,), }",order,type,n);
+  header[strlen(header)] = ' ';
+
+  fwrite(header,1,sizeof(header),file);
+}
+
+
+/**
+ * @brief Write the non-zeros of a point text file as the row.npy, col.npy,
+ * and data.npy arrays of a directory.
+ *
+ * @param ijfile The point file to read.
+ * @param npydir The directory to write the arrays to.
+ *
+ * @return 1 on success, 0 if a file could not be read or written.
+ */
+static int __write_npy(
+    char const * const ijfile,
+    char const * const npydir)
+{
+  int rv;
+  size_t f, n;
+  char name[3][80];
+  int64_t ij[2];
+  double v;
+  FILE * in, * out[3];
+
+  if ((in = fopen(ijfile,"r")) == NULL) {
+    return 0;
+  }
+  n = 0;
+  while (fscanf(in,"%"SCNd64" %"SCNd64" %lf",ij,ij+1,&v) == 3) {
+    ++n;
+  }
+  rewind(in);
+
+  sprintf(name[0],"%s/row.npy",npydir);
+  sprintf(name[1],"%s/col.npy",npydir);
+  sprintf(name[2],"%s/data.npy",npydir);
+  for (f=0;f<3;++f) {
+    if ((out[f] = fopen(name[f],"wb")) == NULL) {
+      while (f > 0) {
+        fclose(out[--f]);
+      }
+      fclose(in);
+      return 0;
+    }
+    __write_npy_header(out[f],f < 2 ? "i8" : "f8",n);
+  }
+
+  while (fscanf(in,"%"SCNd64" %"SCNd64" %lf",ij,ij+1,&v) == 3) {
+    fwrite(ij,sizeof(*ij),1,out[0]);
+    fwrite(ij+1,sizeof(*ij),1,out[1]);
+    fwrite(&v,sizeof(v),1,out[2]);
+  }
+
+  rv = 1;
+  for (f=0;f<3;++f) {
+    rv &= fclose(out[f]) == 0;
+  }
+  fclose(in);
+
+  return rv;
+}
+
+
+/**
+ * @brief Check that two images are the same, pixel for pixel, as they are
+ * written to a file (the intensities of functions of real values, such as
+ * the average, may differ in their last bits with the order the non-zeros
+ * are added in).
+ *
+ * @param name The name of the check.
+ * @param a The first image.
+ * @param b The second image.
+ *
+ * @return 1 if they are, 0 otherwise.
+ */
+static int __same_image(
+    char const * const name,
+    image_t const * const a,
+    image_t const * const b)
+{
+  size_t i, n, ndiff;
+
+  if (a == NULL || b == NULL) {
+    eprintf("%s: failed to draw\n",name);
+    return 0;
+  }
+  if (a->width != b->width || a->height != b->height) {
+    eprintf("%s: %zux%zu image, expected %zux%zu\n",name,a->width, \
+        a->height,b->width,b->height);
+    return 0;
+  }
+
+  n = a->width*a->height;
+  ndiff = 0;
+  for (i=0;i<n;++i) {
+    if ((unsigned char)a->red[i] != (unsigned char)b->red[i] || \
+        (unsigned char)a->green[i] != (unsigned char)b->green[i] || \
+        (unsigned char)a->blue[i] != (unsigned char)b->blue[i]) {
+      ++ndiff;
+    }
+  }
+  if (ndiff > 0) {
+    eprintf("%s: %zu of %zu pixels differ\n",name,ndiff,n);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Draw a matrix, optionally giving its dimensions.
+ *
+ * @param file The file of the matrix.
+ * @param ftype The format of the file.
+ * @param func The function to draw.
+ * @param dims Whether to give the dimensions of the matrix.
+ *
+ * @return The image (NULL if it could not be drawn).
+ */
+static image_t * __draw(
+    char const * const file,
+    filetype_t const ftype,
+    functiontype_t const func,
+    int const dims)
+{
+  return draw_matrix_file(file,ftype,COLOR_GRAYSCALE,func,CANVAS,CANVAS, \
+      dims ? NUM_ROWS : 0,dims ? NUM_COLS : 0,NULL,0,NULL,0,NULL);
+}
+
+
+/**
+ * @brief Check that a matrix drawn from a file that does not give its
+ * dimensions is drawn the same as when they are given.
+ *
+ * @param name The name of the check.
+ * @param file The file of the matrix.
+ * @param ftype The format of the file.
+ *
+ * @return 1 if every function is drawn the same, 0 otherwise.
+ */
+static int __test_dims(
+    char const * const name,
+    char const * const file,
+    filetype_t const ftype)
+{
+  int rv;
+  size_t f;
+  image_t * found, * given;
+  functiontype_t const funcs[] = {FUNCTION_DENSITY,FUNCTION_MAX, \
+      FUNCTION_AVERAGE};
+
+  rv = 1;
+  for (f=0;f<sizeof(funcs)/sizeof(*funcs);++f) {
+    found = __draw(file,ftype,funcs[f],0);
+    given = __draw(file,ftype,funcs[f],1);
+    rv &= __same_image(name,found,given);
+    if (found) {
+      image_free(found);
+    }
+    if (given) {
+      image_free(given);
+    }
+  }
+
+  return rv;
+}
+
+
+/**
+ * @brief Check that a matrix drawn while building its sidecar index, and
+ * then again using it, is drawn the same as when its dimensions are given
+ * without an index.
+ *
+ * @param name The name of the check.
+ * @param file The file of the matrix.
+ * @param ftype The format of the file.
+ *
+ * @return 1 if both draws are the same, 0 otherwise.
+ */
+static int __test_index(
+    char const * const name,
+    char const * const file,
+    filetype_t const ftype)
+{
+  int rv, run;
+  char iname[128];
+  image_t * indexed, * given;
+
+  given = __draw(file,ftype,FUNCTION_DENSITY,1);
+
+  rv = 1;
+  for (run=0;run<2;++run) {
+    indexed = draw_matrix_file(file,ftype,COLOR_GRAYSCALE,FUNCTION_DENSITY, \
+        CANVAS,CANVAS,0,0,NULL,1,NULL,0,NULL);
+    rv &= __same_image(name,indexed,given);
+    if (indexed) {
+      image_free(indexed);
+    }
+  }
+
+  if (given) {
+    image_free(given);
+  }
+  sprintf(iname,"%s%s",file,INDEX_EXTENSION);
+  remove(iname);
+
+  return rv;
+}
+
+
+/**
+ * @brief Count the lines of a file.
+ *
+ * @param file The file.
+ *
+ * @return The number of lines (0 if the file could not be read).
+ */
+static size_t __count_lines(
+    char const * const file)
+{
+  int c;
+  size_t n;
+  FILE * fin;
+
+  if ((fin = fopen(file,"r")) == NULL) {
+    return 0;
+  }
+
+  n = 0;
+  while ((c = fgetc(fin)) != EOF) {
+    if (c == '\n') {
+      ++n;
+    }
+  }
+
+  fclose(fin);
+  return n;
+}
+
+
+/**
+ * @brief Copy some of the lines of a file to another.
+ *
+ * @param file The file to copy from.
+ * @param start The first line to copy.
+ * @param end One past the last line to copy.
+ * @param out The file to copy to.
+ * @param mode The mode to open it with ("w" to replace it, "a" to append to
+ * it).
+ *
+ * @return 1 on success, 0 if a file could not be read or written.
+ */
+static int __copy_lines(
+    char const * const file,
+    size_t const start,
+    size_t const end,
+    char const * const out,
+    char const * const mode)
+{
+  int c;
+  size_t line;
+  FILE * fin, * fout;
+
+  if ((fin = fopen(file,"r")) == NULL) {
+    return 0;
+  }
+  if ((fout = fopen(out,mode)) == NULL) {
+    fclose(fin);
+    return 0;
+  }
+
+  line = 0;
+  while (line < end && (c = fgetc(fin)) != EOF) {
+    if (line >= start) {
+      fputc(c,fout);
+    }
+    if (c == '\n') {
+      ++line;
+    }
+  }
+
+  fclose(fin);
+  return fclose(fout) == 0;
+}
+
+
+/**
+ * @brief Check that a matrix split by lines into shards merges to the same
+ * image as drawing the whole file. The shards of a csr file number their rows
+ * from zero, and are accumulated from the row they start at, while the
+ * points of a point file keep their place in the matrix.
+ *
+ * @param name The name of the check.
+ * @param dir The directory to write the shards to.
+ * @param file The file of the matrix.
+ * @param ftype The format of the file (FILETYPE_CSR or FILETYPE_POINT).
+ *
+ * @return 1 if the merge is drawn the same, 0 otherwise.
+ */
+static int __test_shards(
+    char const * const name,
+    char const * const dir,
+    char const * const file,
+    filetype_t const ftype)
+{
+  int rv;
+  size_t s, nlines;
+  char part[NUM_SHARDS][80], state[NUM_SHARDS][80];
+  char * states[NUM_SHARDS];
+  image_t * merged, * whole;
+  functiontype_t const func = FUNCTION_DENSITY;
+  colortype_t const ctype = COLOR_GRAYSCALE;
+
+  nlines = __count_lines(file);
+
+  rv = 1;
+  for (s=0;s<NUM_SHARDS;++s) {
+    size_t const start = (s*nlines)/NUM_SHARDS;
+    size_t const end = ((s+1)*nlines)/NUM_SHARDS;
+    size_t const roffset = ftype == FILETYPE_CSR ? start : 0;
+    sprintf(part[s],"%s/shard%zu",dir,s);
+    sprintf(state[s],"%s/shard%zu.cvstate",dir,s);
+    states[s] = state[s];
+    rv = rv && __copy_lines(file,start,end,part[s],"w") && \
+        draw_matrix_shard(part[s],ftype,&func,1,CANVAS,CANVAS,NUM_ROWS, \
+        NUM_COLS,NULL,roffset,0,0,state[s]);
+  }
+
+  merged = NULL;
+  if (rv) {
+    rv = draw_merge_images(states,NUM_SHARDS,&func,1,&ctype,1,0,0,0,0, \
+        &merged);
+  }
+  whole = __draw(file,ftype,func,1);
+
+  rv = rv && __same_image(name,merged,whole);
+  if (merged) {
+    image_free(merged);
+  }
+  if (whole) {
+    image_free(whole);
+  }
+  for (s=0;s<NUM_SHARDS;++s) {
+    remove(part[s]);
+    remove(state[s]);
+  }
+
+  return rv;
+}
+
+
+/**
+ * @brief Check that a matrix piped to standard input without its dimensions
+ * is drawn the same as from the file with them. Standard input is replaced
+ * by a pipe which a child process writes the file to.
+ *
+ * @param name The name of the check.
+ * @param file The file of the matrix.
+ * @param ftype The format of the file.
+ *
+ * @return 1 if it is drawn the same, 0 otherwise.
+ */
+static int __test_stdin(
+    char const * const name,
+    char const * const file,
+    filetype_t const ftype)
+{
+  int rv, status;
+  int fds[2];
+  pid_t pid;
+  image_t * piped, * given;
+
+  if (pipe(fds) != 0 || (pid = fork()) < 0) {
+    eprintf("%s: failed to create a pipe\n",name);
+    return 0;
+  }
+
+  if (pid == 0) {
+    char buffer[4096];
+    size_t n;
+    FILE * fin;
+
+    close(fds[0]);
+    if ((fin = fopen(file,"r")) == NULL) {
+      _exit(1);
+    }
+    while ((n = fread(buffer,1,sizeof(buffer),fin)) > 0) {
+      if (write(fds[1],buffer,n) != (ssize_t)n) {
+        _exit(1);
+      }
+    }
+    _exit(0);
+  }
+
+  close(fds[1]);
+  dup2(fds[0],STDIN_FILENO);
+  close(fds[0]);
+
+  piped = __draw("-",ftype,FUNCTION_DENSITY,0);
+  waitpid(pid,&status,0);
+  given = __draw(file,ftype,FUNCTION_DENSITY,1);
+
+  rv = __same_image(name,piped,given);
+  if (piped) {
+    image_free(piped);
+  }
+  if (given) {
+    image_free(given);
+  }
+
+  return rv;
+}
+
+
+#ifndef NO_OMP
+/**
+ * @brief Check that a matrix read in parallel is drawn the same as when it is
+ * read serially, both with a private grid per thread and with threads adding
+ * to a single grid (by limiting the memory private grids may take to a
+ * byte).
+ *
+ * @param name The name of the check.
+ * @param file The file of the matrix.
+ * @param ftype The format of the file.
+ *
+ * @return 1 if every function is drawn the same, 0 otherwise.
+ */
+static int __test_threads(
+    char const * const name,
+    char const * const file,
+    filetype_t const ftype)
+{
+  int rv;
+  size_t f, l;
+  image_t * serial, * parallel;
+  size_t const limits[] = {SIZE_MAX,1};
+  functiontype_t const funcs[] = {FUNCTION_DENSITY,FUNCTION_MAX, \
+      FUNCTION_AVERAGE};
+
+  rv = 1;
+  for (l=0;l<sizeof(limits)/sizeof(*limits);++l) {
+    set_private_grid_limit(limits[l]);
+    for (f=0;f<sizeof(funcs)/sizeof(*funcs);++f) {
+      omp_set_num_threads(1);
+      serial = __draw(file,ftype,funcs[f],1);
+      omp_set_num_threads(NUM_THREADS);
+      parallel = __draw(file,ftype,funcs[f],1);
+      rv &= __same_image(name,parallel,serial);
+      if (serial) {
+        image_free(serial);
+      }
+      if (parallel) {
+        image_free(parallel);
+      }
+    }
+  }
+  set_private_grid_limit(((size_t)1) << 30);
+
+  return rv;
+}
+#endif
+
+
+/**
+ * @brief Check that a csr text file converted to binary csr is drawn the
+ * same as the text.
+ *
+ * @param name The name of the check.
+ * @param dir The directory to write the binary file to.
+ * @param file The csr text file of the matrix.
+ *
+ * @return 1 if every function is drawn the same, 0 otherwise.
+ */
+static int __test_bcsr(
+    char const * const name,
+    char const * const dir,
+    char const * const file)
+{
+  int rv;
+  size_t f;
+  char bname[80];
+  image_t * binary, * text;
+  functiontype_t const funcs[] = {FUNCTION_DENSITY,FUNCTION_MAX, \
+      FUNCTION_AVERAGE};
+
+  sprintf(bname,"%s/m.bcsr",dir);
+  if (!bcsr_convert(file,FILETYPE_CSR,NUM_ROWS,NUM_COLS,bname)) {
+    eprintf("%s: failed to convert\n",name);
+    return 0;
+  }
+
+  rv = 1;
+  for (f=0;f<sizeof(funcs)/sizeof(*funcs);++f) {
+    binary = __draw(bname,FILETYPE_BCSR,funcs[f],0);
+    text = __draw(file,FILETYPE_CSR,funcs[f],1);
+    rv &= __same_image(name,binary,text);
+    if (binary) {
+      image_free(binary);
+    }
+    if (text) {
+      image_free(text);
+    }
+  }
+
+  remove(bname);
+
+  return rv;
+}
+
+
+/**
+ * @brief Check that a point file drawn with a state file, appended to, and
+ * drawn again from where the state left off, is drawn the same as the whole
+ * file read at once.
+ *
+ * @param name The name of the check.
+ * @param dir The directory to write the growing file and state to.
+ * @param file The point file of the matrix.
+ *
+ * @return 1 if it is drawn the same, 0 otherwise.
+ */
+static int __test_state(
+    char const * const name,
+    char const * const dir,
+    char const * const file)
+{
+  int rv;
+  size_t nlines;
+  char log[80], state[80];
+  image_t * resumed, * whole;
+
+  sprintf(log,"%s/log.ij",dir);
+  sprintf(state,"%s/log.cvstate",dir);
+  nlines = __count_lines(file);
+
+  resumed = NULL;
+  rv = __copy_lines(file,0,nlines/2,log,"w");
+  if (rv) {
+    resumed = draw_matrix_file(log,FILETYPE_POINT,COLOR_GRAYSCALE, \
+        FUNCTION_DENSITY,CANVAS,CANVAS,NUM_ROWS,NUM_COLS,NULL,0,state,0, \
+        NULL);
+    if (resumed) {
+      image_free(resumed);
+    }
+    rv = resumed != NULL && __copy_lines(file,nlines/2,nlines,log,"a");
+  }
+  resumed = NULL;
+  if (rv) {
+    resumed = draw_matrix_file(log,FILETYPE_POINT,COLOR_GRAYSCALE, \
+        FUNCTION_DENSITY,CANVAS,CANVAS,NUM_ROWS,NUM_COLS,NULL,0,state,0, \
+        NULL);
+  }
+  whole = __draw(file,FILETYPE_POINT,FUNCTION_DENSITY,1);
+
+  rv = rv && __same_image(name,resumed,whole);
+  if (resumed) {
+    image_free(resumed);
+  }
+  if (whole) {
+    image_free(whole);
+  }
+  remove(log);
+  remove(state);
+
+  return rv;
+}
+
+
+/**
+ * @brief Check that two files hold the same bytes.
+ *
+ * @param name The name of the check.
+ * @param a The first file.
+ * @param b The second file.
+ *
+ * @return 1 if they do, 0 otherwise.
+ */
+static int __same_file(
+    char const * const name,
+    char const * const a,
+    char const * const b)
+{
+  int ca, cb;
+  size_t n;
+  FILE * fa, * fb;
+
+  if ((fa = fopen(a,"rb")) == NULL) {
+    eprintf("%s: failed to open '%s'\n",name,a);
+    return 0;
+  }
+  if ((fb = fopen(b,"rb")) == NULL) {
+    eprintf("%s: failed to open '%s'\n",name,b);
+    fclose(fa);
+    return 0;
+  }
+
+  n = 0;
+  do {
+    ca = fgetc(fa);
+    cb = fgetc(fb);
+    ++n;
+  } while (ca == cb && ca != EOF);
+
+  fclose(fa);
+  fclose(fb);
+
+  if (ca != cb) {
+    eprintf("%s: files differ at byte %zu\n",name,n);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Check that a matrix drawn out of core, a band at a time, is written
+ * to the same PNG as when it is drawn in memory.
+ *
+ * @param name The name of the check.
+ * @param dir The directory to write the images to.
+ * @param file The file of the matrix.
+ * @param ftype The format of the file.
+ *
+ * @return 1 if every function is written the same, 0 otherwise.
+ */
+static int __test_ooc(
+    char const * const name,
+    char const * const dir,
+    char const * const file,
+    filetype_t const ftype)
+{
+  int rv;
+  size_t f, x, y;
+  char ooc[80], mem[80];
+  image_t * img;
+  functiontype_t const funcs[] = {FUNCTION_DENSITY,FUNCTION_MAX, \
+      FUNCTION_AVERAGE};
+
+  sprintf(ooc,"%s/ooc.png",dir);
+  sprintf(mem,"%s/mem.png",dir);
+
+  rv = 1;
+  for (f=0;f<sizeof(funcs)/sizeof(*funcs);++f) {
+    img = __draw(file,ftype,funcs[f],1);
+    if (img == NULL || !png_write(mem,img) || \
+        !draw_matrix_ooc(file,ftype,COLOR_GRAYSCALE,funcs[f],CANVAS,CANVAS, \
+        NUM_ROWS,NUM_COLS,NULL,OOC_MAX_MEMORY,ooc,&x,&y)) {
+      eprintf("%s: failed to draw\n",name);
+      rv = 0;
+    } else {
+      rv &= __same_file(name,ooc,mem);
+    }
+    if (img) {
+      image_free(img);
+    }
+  }
+
+  remove(ooc);
+  remove(mem);
+
+  return rv;
+}
+
+
+
+
+/******************************************************************************
+* MAIN ************************************************************************
+******************************************************************************/
+
+
+int main(void)
+{
+  int rv;
+  char dir[] = "draw_testXXXXXX";
+  char csrfile[64], ijfile[64], npydir[64], name[80];
+
+  if (mkdtemp(dir) == NULL) {
+    eprintf("Failed to create a directory for the test matrices\n");
+    return 1;
+  }
+  sprintf(csrfile,"%s/m.csr",dir);
+  sprintf(ijfile,"%s/m.ij",dir);
+  sprintf(npydir,"%s/npy",dir);
+
+  rv = __write_matrix(csrfile,ijfile) && mkdir(npydir,0700) == 0 && \
+      __write_npy(ijfile,npydir);
+
+  /* the dimensions found by scanning the file are those it would be given */
+  rv = rv && __test_dims("csr dims",csrfile,FILETYPE_CSR);
+  rv = rv && __test_dims("point dims",ijfile,FILETYPE_POINT);
+  rv = rv && __test_dims("npy dims",npydir,FILETYPE_NPY);
+
+  /* as are those found by copying standard input to a temporary file */
+  rv = rv && __test_stdin("stdin dims",csrfile,FILETYPE_CSR);
+
+  /* an index only makes the draws that build and use it faster */
+  rv = rv && __test_index("csr index",csrfile,FILETYPE_CSR);
+  rv = rv && __test_index("point index",ijfile,FILETYPE_POINT);
+
+  /* shards of rows numbered from zero merge to the whole matrix */
+  rv = rv && __test_shards("csr shards",dir,csrfile,FILETYPE_CSR);
+  rv = rv && __test_shards("point shards",dir,ijfile,FILETYPE_POINT);
+
+  /* as does a point file picked up where its state left off */
+  rv = rv && __test_state("point state",dir,ijfile);
+
+  #ifndef NO_OMP
+  /* the order threads add non-zeros in does not change the image */
+  rv = rv && __test_threads("csr threads",csrfile,FILETYPE_CSR);
+  rv = rv && __test_threads("point threads",ijfile,FILETYPE_POINT);
+  #endif
+
+  /* nor does the format of the file */
+  rv = rv && __test_bcsr("bcsr",dir,csrfile);
+
+  /* nor does drawing a band at a time */
+  rv = rv && __test_ooc("csr ooc",dir,csrfile,FILETYPE_CSR);
+  rv = rv && __test_ooc("point ooc",dir,ijfile,FILETYPE_POINT);
+
+  sprintf(name,"%s/row.npy",npydir);
+  remove(name);
+  sprintf(name,"%s/col.npy",npydir);
+  remove(name);
+  sprintf(name,"%s/data.npy",npydir);
+  remove(name);
+  rmdir(npydir);
+  remove(csrfile);
+  remove(ijfile);
+  rmdir(dir);
+
+  return rv ? 0 : 1;
+}
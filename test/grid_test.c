@@ -0,0 +1,129 @@
+/**
+ * @file grid_test.c
+ * @brief Tests for the accumulation of averages in a grid
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-24
+ */
+
+
+
+
+#include "grid.h"
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* enough non-zeros in one bin for a float sum to drift by a few levels */
+static const size_t NUM_VALUES = 5000000;
+
+
+static const size_t RUN_SIZE = 1000;
+
+
+static const real_t VALUE = 0.1;
+
+
+/* the relative error allowed of an average */
+static const real_t TOLERANCE = 1e-9;
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Check that an average is within the tolerance of its exact value.
+ *
+ * @param name The name of the check.
+ * @param got The average found.
+ * @param exact The exact average.
+ *
+ * @return 1 if it is, 0 otherwise.
+ */
+static int __check(
+    char const * const name,
+    real_t const got,
+    real_t const exact)
+{
+  if (fabs(got-exact) > TOLERANCE*exact) {
+    eprintf("%s: average is %.17g, expected %.17g\n",name,got,exact);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Put NUM_VALUES copies of VALUE into each of the two bins of a one
+ * row, two column grid, one at a time into the first and in runs into the
+ * second, and check the average of each pixel.
+ *
+ * @param name The name of the check.
+ * @param funcs The functions the grid accumulates.
+ *
+ * @return 1 if both averages are exact, 0 otherwise.
+ */
+static int __test_one_bin(
+    char const * const name,
+    unsigned int const funcs)
+{
+  int rv;
+  size_t i, x, y;
+  real_t * run, * out;
+  grid_t * grid;
+
+  grid = grid_create(2,1,1,2,funcs);
+
+  for (i=0;i<NUM_VALUES;++i) {
+    grid_add(grid,0,0,VALUE);
+  }
+
+  run = real_init_alloc(VALUE,RUN_SIZE);
+  for (i=0;i<NUM_VALUES;i+=RUN_SIZE) {
+    grid_add_run(grid,0,1,run,1);
+    grid_add_run(grid,0,1,run+1,RUN_SIZE-1);
+  }
+  dl_free(run);
+
+  out = grid_finalize(grid,FUNCTION_AVERAGE,&x,&y);
+
+  rv = x == 2 && y == 1 && __check(name,out[0],VALUE) && \
+      __check(name,out[1],VALUE);
+
+  dl_free(out);
+  grid_free(grid);
+
+  return rv;
+}
+
+
+
+
+/******************************************************************************
+* MAIN ************************************************************************
+******************************************************************************/
+
+
+int main(void)
+{
+  int rv = 1;
+
+  /* {count,sum} bins */
+  rv &= __test_one_bin("average",grid_func(FUNCTION_AVERAGE));
+  /* whole records */
+  rv &= __test_one_bin("average+max",grid_func(FUNCTION_AVERAGE) | \
+      grid_func(FUNCTION_MAX));
+
+  return rv ? 0 : 1;
+}
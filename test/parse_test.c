@@ -0,0 +1,256 @@
+/**
+ * @file parse_test.c
+ * @brief Tests that the number parsers give the same results as the libc
+ * conversion functions
+ * @author Dominique LaSalle <lasalle@cs.umn.edu>
+ * Copyright 2014
+ * @version 1
+ * @date 2014-11-24
+ */
+
+
+
+
+#include <stddef.h>
+#include <string.h>
+#include "parse.h"
+
+
+
+
+/******************************************************************************
+* CONSTANTS *******************************************************************
+******************************************************************************/
+
+
+/* tokens on either side of the fast paths and their limits */
+static char const * const EDGE_TOKENS[] = {
+  "0", "-0", "+0", "0.0", "-0.0", "00000", "1", "-1", "+1.5", ".5", "-.5",
+  "5.", "0.1", "0.2", "0.3", "3.14159", "2.718281828459045", "1e0", "1E5",
+  "1e+5", "1e-5", "-1.5e-5", "1e22", "1e23", "1e-22", "1e-23", "9.99e22",
+  "123e-22", "1e00005", "1e0005", "1e9999", "1e-9999",
+  "9007199254740991", "9007199254740992", "9007199254740993",
+  "9007199254740992e1", "9007199254740993e1",
+  "9007199254740993e-5", "4503599627370497.5",
+  "1234567890123456789", "12345678901234567890",
+  "123456789012345678901", "0.1234567890123456789",
+  "0.12345678901234567890", "0000000000000000000001",
+  "0.0000000000000000000001", "1.7976931348623157e308",
+  "1.7976931348623159e308", "2.2250738585072014e-308",
+  "2.2250738585071e-308", "4.9e-324", "2.4e-324", "1e-400", "1e400",
+  "inf", "-inf", "nan", "infinity", "0x10", "0x1p-3", "1e", "1e+", "1e-",
+  "1.5x", "1e5x", "-", "+", ".", "e5", "x"
+};
+
+
+/* unsigned tokens on either side of the fast path and of overflow */
+static char const * const UINT_TOKENS[] = {
+  "0", "00", "7", "007", "+5", "-1", "4294967296", "9999999999999999999",
+  "10000000000000000000", "18446744073709551615", "18446744073709551616",
+  "99999999999999999999999", "12x", "x"
+};
+
+
+static const size_t NUM_RANDOM = 200000;
+
+
+
+
+/******************************************************************************
+* PRIVATE FUNCTIONS ***********************************************************
+******************************************************************************/
+
+
+/**
+ * @brief Get the next number of a fixed sequence, so that every run parses
+ * the same tokens.
+ *
+ * @param state The state of the sequence.
+ *
+ * @return The number.
+ */
+static uint64_t __next(
+    uint64_t * const state)
+{
+  *state = (*state * 6364136223846793005ULL) + 1442695040888963407ULL;
+
+  return *state >> 11;
+}
+
+
+/**
+ * @brief Check that parse_double() gives the same bits and stops at the same
+ * place as strtod() on a token, both surrounded by blanks and running up to
+ * the end of the text.
+ *
+ * @param token The token.
+ *
+ * @return 1 if it does, 0 otherwise.
+ */
+static int __check_double(
+    char const * const token)
+{
+  int pass;
+  size_t len;
+  double got, exact;
+  char text[MAX_TOKEN_SIZE+4];
+  char * end;
+  char const * ptr, * eptr;
+
+  len = strlen(token);
+  exact = strtod(token,&end);
+
+  for (pass=0;pass<2;++pass) {
+    if (pass == 0) {
+      sprintf(text," %s\n",token);
+      eptr = text+len+2;
+    } else {
+      /* a digit past the end of the text must not be read */
+      sprintf(text," %s7",token);
+      eptr = text+len+1;
+    }
+
+    got = 0;
+    ptr = parse_double(text,eptr,&got);
+    if (end == token) {
+      if (ptr != NULL) {
+        eprintf("parse_double('%s'): parsed %.17g, expected nothing\n", \
+            token,got);
+        return 0;
+      }
+    } else if (ptr != text+1+(end-token) || \
+        memcmp(&got,&exact,sizeof(got)) != 0) {
+      eprintf("parse_double('%s'): %.17g after %td bytes, expected %.17g " \
+          "after %td\n",token,got,ptr ? ptr-text-1 : (ptrdiff_t)-1,exact, \
+          end-token);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Check that parse_uint() gives the same value and stops at the same
+ * place as strtoull() on a token.
+ *
+ * @param token The token.
+ *
+ * @return 1 if it does, 0 otherwise.
+ */
+static int __check_uint(
+    char const * const token)
+{
+  unsigned long long got, exact;
+  char text[MAX_TOKEN_SIZE+4];
+  char * end;
+  char const * ptr;
+
+  exact = strtoull(token,&end,10);
+
+  sprintf(text," %s\n",token);
+  got = 0;
+  ptr = parse_uint(text,text+strlen(text),&got);
+  if (end == token) {
+    if (ptr != NULL) {
+      eprintf("parse_uint('%s'): parsed %llu, expected nothing\n",token, \
+          got);
+      return 0;
+    }
+  } else if (ptr != text+1+(end-token) || got != exact) {
+    eprintf("parse_uint('%s'): %llu, expected %llu\n",token,got,exact);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/**
+ * @brief Write a random decimal token: up to 21 digits, maybe with a point,
+ * and maybe with an exponent around the edge of the fast path.
+ *
+ * @param state The state of the sequence.
+ * @param token The buffer to write the token to.
+ */
+static void __random_token(
+    uint64_t * const state,
+    char * const token)
+{
+  size_t i, nd, point;
+  char * ptr;
+
+  ptr = token;
+  if (__next(state) % 4 == 0) {
+    *ptr++ = '-';
+  }
+  nd = 1 + (__next(state) % 21);
+  point = __next(state) % (nd+2);
+  for (i=0;i<nd;++i) {
+    if (i == point) {
+      *ptr++ = '.';
+    }
+    *ptr++ = (char)('0' + (__next(state) % 10));
+  }
+  if (__next(state) % 2 == 0) {
+    ptr += sprintf(ptr,"e%d",(int)(__next(state) % 61) - 30);
+  }
+  *ptr = '\0';
+}
+
+
+/**
+ * @brief Check random tokens: decimals from __random_token(), and doubles of
+ * random bits printed in full.
+ *
+ * @return 1 if every token parses the same as with strtod(), 0 otherwise.
+ */
+static int __test_random(void)
+{
+  size_t i;
+  uint64_t state, bits;
+  double v;
+  char token[MAX_TOKEN_SIZE];
+
+  state = 1;
+  for (i=0;i<NUM_RANDOM;++i) {
+    __random_token(&state,token);
+    if (!__check_double(token)) {
+      return 0;
+    }
+
+    bits = (__next(&state) << 11) ^ __next(&state);
+    memcpy(&v,&bits,sizeof(v));
+    sprintf(token,"%.17g",v);
+    if (!__check_double(token)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+
+
+/******************************************************************************
+* MAIN ************************************************************************
+******************************************************************************/
+
+
+int main(void)
+{
+  int rv = 1;
+  size_t i;
+
+  for (i=0;i<sizeof(EDGE_TOKENS)/sizeof(*EDGE_TOKENS);++i) {
+    rv &= __check_double(EDGE_TOKENS[i]);
+  }
+  for (i=0;i<sizeof(UINT_TOKENS)/sizeof(*UINT_TOKENS);++i) {
+    rv &= __check_uint(UINT_TOKENS[i]);
+  }
+  rv &= __test_random();
+
+  return rv ? 0 : 1;
+}